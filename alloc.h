@@ -0,0 +1,228 @@
+#pragma once
+
+#include "trace.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Totals for matrix storage allocated through TrackedAllocator since the
+// last allocationReset(). liveBytes is never reset.
+struct AllocationStats {
+  uint64_t allocations = 0;
+  uint64_t deallocations = 0;
+  uint64_t bytesAllocated = 0;
+  uint64_t liveBytes = 0;
+  uint64_t peakBytes = 0;
+};
+
+namespace morpheus {
+
+struct OpAllocations {
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> bytes{0};
+};
+
+class AllocationRegistry {
+
+public:
+  static AllocationRegistry &instance() {
+    static AllocationRegistry registry;
+    return registry;
+  }
+
+  // Counters of the named operation; the reference stays valid forever.
+  OpAllocations &forOperation(const char *name) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::unique_ptr<OpAllocations> &slot = ops[name];
+    if (!slot) {
+      slot = std::make_unique<OpAllocations>();
+    }
+    return *slot;
+  }
+
+  // Operation the calling thread is inside, or null.
+  static OpAllocations *&current() {
+    thread_local OpAllocations *op = nullptr;
+    return op;
+  }
+
+  void allocated(uint64_t bytes) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+    uint64_t live = liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+    if (OpAllocations *op = current()) {
+      op->allocations.fetch_add(1, std::memory_order_relaxed);
+      op->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+  }
+
+  void deallocated(uint64_t bytes) {
+    deallocations.fetch_add(1, std::memory_order_relaxed);
+    liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  AllocationStats stats() const {
+    AllocationStats s;
+    s.allocations = allocations.load();
+    s.deallocations = deallocations.load();
+    s.bytesAllocated = bytesAllocated.load();
+    s.liveBytes = liveBytes.load();
+    s.peakBytes = peakBytes.load();
+    return s;
+  }
+
+  std::map<std::string, AllocationStats> report() {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, AllocationStats> Result;
+    for (const auto &[name, op] : ops) {
+      if (op->allocations > 0) {
+        AllocationStats &s = Result[name];
+        s.allocations = op->allocations;
+        s.bytesAllocated = op->bytes;
+      }
+    }
+    return Result;
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    allocations = 0;
+    deallocations = 0;
+    bytesAllocated = 0;
+    peakBytes = liveBytes.load();
+    for (auto &entry : ops) {
+      entry.second->allocations = 0;
+      entry.second->bytes = 0;
+    }
+  }
+
+private:
+  std::mutex lock;
+  std::map<std::string, std::unique_ptr<OpAllocations>> ops;
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> deallocations{0};
+  std::atomic<uint64_t> bytesAllocated{0};
+  std::atomic<uint64_t> liveBytes{0};
+  std::atomic<uint64_t> peakBytes{0};
+};
+
+// Attributes allocations made by the calling thread to `name` until it goes
+// out of scope. Nested scopes take over and restore the outer one.
+class AllocationScope {
+
+public:
+  template <typename... Ignored>
+  explicit AllocationScope(const char *name, Ignored &&...)
+      : outer(AllocationRegistry::current()) {
+    AllocationRegistry::current() =
+        &AllocationRegistry::instance().forOperation(name);
+  }
+
+  ~AllocationScope() { AllocationRegistry::current() = outer; }
+
+  AllocationScope(const AllocationScope &) = delete;
+  AllocationScope &operator=(const AllocationScope &) = delete;
+
+private:
+  OpAllocations *outer;
+};
+
+// Attributes allocations made by the calling thread to `op`, which may be
+// null, until it goes out of scope. parallelFor uses it to charge the work
+// its tasks do on other threads to the operation that started them.
+class AllocationHandoff {
+
+public:
+  explicit AllocationHandoff(OpAllocations *op)
+      : outer(AllocationRegistry::current()) {
+    AllocationRegistry::current() = op;
+  }
+
+  ~AllocationHandoff() { AllocationRegistry::current() = outer; }
+
+  AllocationHandoff(const AllocationHandoff &) = delete;
+  AllocationHandoff &operator=(const AllocationHandoff &) = delete;
+
+private:
+  OpAllocations *outer;
+};
+
+// Allocator that counts matrix storage when MORPHEUS_TRACK_ALLOCATIONS (or
+// MORPHEUS_TRACE, for the per-event byte counts) is defined.
+template <typename T> struct TrackedAllocator {
+  using value_type = T;
+
+  TrackedAllocator() noexcept = default;
+  template <typename U>
+  TrackedAllocator(const TrackedAllocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+    T *p = std::allocator<T>().allocate(n);
+#ifdef MORPHEUS_TRACK_ALLOCATIONS
+    AllocationRegistry::instance().allocated(n * sizeof(T));
+#endif
+#ifdef MORPHEUS_TRACE
+    noteAllocation(n * sizeof(T));
+#endif
+    return p;
+  }
+
+  void deallocate(T *p, size_t n) noexcept {
+#ifdef MORPHEUS_TRACK_ALLOCATIONS
+    AllocationRegistry::instance().deallocated(n * sizeof(T));
+#endif
+    std::allocator<T>().deallocate(p, n);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const TrackedAllocator<T> &, const TrackedAllocator<U> &) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const TrackedAllocator<T> &, const TrackedAllocator<U> &) {
+  return false;
+}
+
+// Allocator behind all matrix storage (the rows and row lists of Matrix,
+// and vec). Without the flags above it is std::allocator, so vec and Mat are
+// the plain std::vector types and convert to and from user code as before.
+//
+// The flags therefore change the ABI: with either defined, vec, Mat and the
+// layout of Matrix use TrackedAllocator, a plain std::vector<double> no
+// longer binds to a `const vec &` parameter, and translation units built
+// with and without the flags must not be linked together. Define them
+// project-wide (as the tests and bench targets do), never per file.
+#if defined(MORPHEUS_TRACK_ALLOCATIONS) || defined(MORPHEUS_TRACE)
+template <typename T> using StorageAllocator = TrackedAllocator<T>;
+#else
+template <typename T> using StorageAllocator = std::allocator<T>;
+#endif
+
+} // namespace morpheus
+
+inline AllocationStats allocationStats() {
+  return morpheus::AllocationRegistry::instance().stats();
+}
+
+// Allocation counts and bytes per operation name (the name given to
+// MORPHEUS_OP); liveBytes and peakBytes are not tracked per operation.
+inline std::map<std::string, AllocationStats> allocationReport() {
+  return morpheus::AllocationRegistry::instance().report();
+}
+
+// Zeroes the counters and restarts peak tracking from the current live
+// bytes.
+inline void allocationReset() {
+  morpheus::AllocationRegistry::instance().reset();
+}
@@ -0,0 +1,314 @@
+#pragma once
+
+#include "banded.h"
+#include "matrix.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Thrown by AsyncResult::get for an operation that was cancelled, or that
+// depended on one.
+class OperationCancelled : public std::runtime_error {
+
+public:
+  OperationCancelled() : std::runtime_error("OPERATION CANCELLED!") {}
+};
+
+namespace morpheus {
+
+// Shared state of one asynchronous operation. It finishes exactly once:
+// with a value, with an exception or cancelled.
+template <typename T> class AsyncState {
+
+public:
+  // Runs produce() and stores its value or exception, unless the operation
+  // was cancelled before it started.
+  template <typename F> void run(F &&produce) {
+    int expected = Pending;
+    if (!phase.compare_exchange_strong(expected, Running)) {
+      return;
+    }
+    try {
+      value.emplace(produce());
+    } catch (...) {
+      error = std::current_exception();
+    }
+    finish();
+  }
+
+  // Finishes with `e` unless already finished.
+  void fail(std::exception_ptr e) {
+    int expected = Pending;
+    if (phase.compare_exchange_strong(expected, Running)) {
+      error = std::move(e);
+      finish();
+    }
+  }
+
+  // A pending operation finishes right away; a running one completes but
+  // its result is dropped. No effect once finished.
+  void cancel() {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (done) {
+        return;
+      }
+      cancelled.store(true, std::memory_order_release);
+    }
+    fail(std::make_exception_ptr(OperationCancelled()));
+  }
+
+  // Calls fn once the operation has finished: right away if it has, else on
+  // the thread that finishes it. fn must not block.
+  void onFinish(std::function<void()> fn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!done) {
+      continuations.push_back(std::move(fn));
+      return;
+    }
+    lock.unlock();
+    fn();
+  }
+
+  bool finished() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return done;
+  }
+
+  void wait() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    finishedSignal.wait(lock, [this] { return done; });
+  }
+
+  // The error the operation finished with, if any. Call once finished.
+  std::exception_ptr failure() const {
+    if (cancelled.load(std::memory_order_acquire) && !error) {
+      return std::make_exception_ptr(OperationCancelled());
+    }
+    return error;
+  }
+
+  // Call once finished without failure.
+  const T &result() const { return *value; }
+
+private:
+  enum { Pending, Running };
+
+  void finish() {
+    std::vector<std::function<void()>> ready;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      done = true;
+      ready.swap(continuations);
+    }
+    finishedSignal.notify_all();
+    for (auto &fn : ready) {
+      fn();
+    }
+  }
+
+  std::atomic<int> phase{Pending};
+  std::atomic<bool> cancelled{false};
+  std::optional<T> value;
+  std::exception_ptr error;
+  mutable std::mutex mutex;
+  mutable std::condition_variable finishedSignal;
+  bool done = false;
+  std::vector<std::function<void()>> continuations;
+};
+
+// Posts produce() to the current executor as the body of `state`.
+template <typename T, typename F>
+void postTo(const std::shared_ptr<AsyncState<T>> &state, F produce) {
+  currentExecutor()->post(
+      [state, produce = std::move(produce)]() mutable { state->run(produce); });
+}
+
+} // namespace morpheus
+
+// Handle to the result of an operation running on the library's executor.
+// Copies share the result, like std::shared_future. get() blocks; then()
+// and co_await do not: the follow-up is posted to the executor when this
+// result is ready. Do not call get() from inside an operation or a
+// continuation, as that can hold the pool's only worker.
+template <typename T> class AsyncResult {
+
+public:
+  using value_type = T;
+
+  explicit AsyncResult(std::shared_ptr<morpheus::AsyncState<T>> state)
+      : state(std::move(state)) {}
+
+  // An already finished result, for mixing plain values into chains.
+  static AsyncResult ready(T value) {
+    auto state = std::make_shared<morpheus::AsyncState<T>>();
+    state->run([&] { return std::move(value); });
+    return AsyncResult(state);
+  }
+
+  bool isReady() const { return state->finished(); }
+
+  void wait() const { state->wait(); }
+
+  // The value, or rethrows the operation's exception (OperationCancelled
+  // if it was cancelled).
+  const T &get() const {
+    state->wait();
+    if (std::exception_ptr e = state->failure()) {
+      std::rethrow_exception(e);
+    }
+    return state->result();
+  }
+
+  // The exception the operation finished with, or null. Only meaningful
+  // once isReady().
+  std::exception_ptr error() const { return state->failure(); }
+
+  // Calls fn once the operation has finished, successfully or not: right
+  // away if it has, else on the thread that finishes it. fn must not block.
+  void onReady(std::function<void()> fn) const {
+    state->onFinish(std::move(fn));
+  }
+
+  // Stops the operation if it has not started; a running one finishes but
+  // its result is dropped. Operations chained on this one are cancelled
+  // too once it finishes.
+  void cancel() const { state->cancel(); }
+
+  // AsyncResult<U> for U = fn(value), run on the executor once this result
+  // is ready. If this operation fails the returned one fails the same way.
+  template <typename F>
+  auto then(F fn) const -> AsyncResult<std::invoke_result_t<F, const T &>> {
+    using U = std::invoke_result_t<F, const T &>;
+    auto next = std::make_shared<morpheus::AsyncState<U>>();
+    auto source = state;
+    source->onFinish([source, next, fn = std::move(fn)]() mutable {
+      if (std::exception_ptr e = source->failure()) {
+        next->fail(e);
+        return;
+      }
+      morpheus::postTo(next, [source, fn = std::move(fn)]() mutable {
+        return fn(source->result());
+      });
+    });
+    return AsyncResult<U>(next);
+  }
+
+  // Awaitable, so a C++20 coroutine can co_await the result. The coroutine
+  // resumes on an executor thread. await_suspend is a template so that the
+  // library itself stays C++17; co_await yields a copy, since the awaited
+  // handle is usually a temporary.
+  bool await_ready() const { return isReady(); }
+
+  template <typename Handle> void await_suspend(Handle handle) const {
+    state->onFinish([handle]() mutable {
+      morpheus::currentExecutor()->post([handle]() mutable { handle.resume(); });
+    });
+  }
+
+  T await_resume() const { return get(); }
+
+private:
+  std::shared_ptr<morpheus::AsyncState<T>> state;
+};
+
+namespace morpheus {
+
+// AsyncResult of fn(a, b), posted once both inputs are ready. Fails with
+// the first input's error if either fails.
+template <typename A, typename B, typename F>
+auto whenBoth(const AsyncResult<A> &a, const AsyncResult<B> &b, F fn)
+    -> AsyncResult<std::invoke_result_t<F, const A &, const B &>> {
+  using U = std::invoke_result_t<F, const A &, const B &>;
+  auto next = std::make_shared<AsyncState<U>>();
+  auto remaining = std::make_shared<std::atomic<int>>(2);
+  auto start = [a, b, next, remaining, fn = std::move(fn)] {
+    if (remaining->fetch_sub(1) != 1) {
+      return;
+    }
+    if (std::exception_ptr e = a.error() ? a.error() : b.error()) {
+      next->fail(e);
+      return;
+    }
+    postTo(next, [a, b, fn] { return fn(a.get(), b.get()); });
+  };
+  a.onReady(start);
+  b.onReady(start);
+  return AsyncResult<U>(next);
+}
+
+} // namespace morpheus
+
+// Runs fn() on the library's executor.
+template <typename F> auto runAsync(F fn) -> AsyncResult<std::invoke_result_t<F>> {
+  auto state = std::make_shared<morpheus::AsyncState<std::invoke_result_t<F>>>();
+  morpheus::postTo(state, std::move(fn));
+  return AsyncResult<std::invoke_result_t<F>>(state);
+}
+
+// Asynchronous versions of the core operations. Plain inputs are copied
+// (or moved in), so the caller may change or drop its matrices meanwhile.
+// The AsyncResult overloads start once their inputs are ready, so chained
+// operations never park a thread on an unfinished input.
+
+inline AsyncResult<Matrix> dotAsync(Matrix m1, Matrix m2) {
+  return runAsync([m1 = std::move(m1), m2 = std::move(m2)] {
+    return Matrix::dot(m1, m2);
+  });
+}
+
+inline AsyncResult<Matrix> dotAsync(const AsyncResult<Matrix> &m1,
+                                    const AsyncResult<Matrix> &m2) {
+  return morpheus::whenBoth(m1, m2, [](const Matrix &a, const Matrix &b) {
+    return Matrix::dot(a, b);
+  });
+}
+
+inline AsyncResult<Matrix> AddMatrixAsync(Matrix Mat1, Matrix Mat2) {
+  return runAsync([Mat1 = std::move(Mat1), Mat2 = std::move(Mat2)] {
+    return Matrix::AddMatrix(Mat1, Mat2);
+  });
+}
+
+inline AsyncResult<Matrix> AddMatrixAsync(const AsyncResult<Matrix> &Mat1,
+                                          const AsyncResult<Matrix> &Mat2) {
+  return morpheus::whenBoth(Mat1, Mat2, Matrix::AddMatrix);
+}
+
+inline AsyncResult<Matrix> SubtractMatixAsync(Matrix Mat1, Matrix Mat2) {
+  return runAsync([Mat1 = std::move(Mat1), Mat2 = std::move(Mat2)] {
+    return Matrix::SubtractMatix(Mat1, Mat2);
+  });
+}
+
+inline AsyncResult<Matrix> SubtractMatixAsync(const AsyncResult<Matrix> &Mat1,
+                                              const AsyncResult<Matrix> &Mat2) {
+  return morpheus::whenBoth(Mat1, Mat2, Matrix::SubtractMatix);
+}
+
+inline AsyncResult<BandMatrix::LU> luAsync(BandMatrix A) {
+  return runAsync([A = std::move(A)] { return BandMatrix::lu(A); });
+}
+
+inline AsyncResult<BandMatrix::LU> luAsync(const AsyncResult<BandMatrix> &A) {
+  return A.then(BandMatrix::lu);
+}
+
+inline AsyncResult<BandMatrix::Cholesky> choleskyAsync(BandMatrix A) {
+  return runAsync([A = std::move(A)] { return BandMatrix::cholesky(A); });
+}
+
+inline AsyncResult<BandMatrix::Cholesky>
+choleskyAsync(const AsyncResult<BandMatrix> &A) {
+  return A.then(BandMatrix::cholesky);
+}
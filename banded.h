@@ -0,0 +1,387 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// n x n matrix with `lower` sub-diagonals and `upper` super-diagonals. Rows
+// are stored one after another, each holding lower + upper + 1 slots, so
+// element (i, j) lives at i * width() + (j - i + lower).
+class BandMatrix {
+
+public:
+  int size = 0;
+  int lower = 0;
+  int upper = 0;
+  vec data;
+
+  BandMatrix(int n = 2, int lower = 0, int upper = 0) {
+    if (n < 0 || lower < 0 || upper < 0) {
+      throw std::invalid_argument(
+          "INVALID SIZE! BandMatrix size and bandwidths must be >= 0");
+    }
+    this->size = n;
+    this->lower = lower;
+    this->upper = upper;
+    this->data.assign((size_t)n * width(), 0.0);
+  }
+
+  int width() const { return lower + upper + 1; }
+  bool inBand(int i, int j) const { return j - i <= upper && i - j <= lower; }
+
+  double get(int i, int j) const {
+    return inBand(i, j) ? data[(size_t)i * width() + (j - i + lower)] : 0.0;
+  }
+
+  void set(int i, int j, double value) {
+    if (!inBand(i, j)) {
+      throw std::invalid_argument("INVALID OPERATION! Element (" +
+                                  std::to_string(i) + ", " + std::to_string(j) +
+                                  ") is outside the band");
+    }
+    data[(size_t)i * width() + (j - i + lower)] = value;
+  }
+
+  // Entries of the dense matrix outside the requested band are dropped.
+  static BandMatrix fromMatrix(const Matrix &m, int lower, int upper) {
+    if (m.rowsize != m.columnsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! BandMatrix needs a square Matrix, got " +
+          std::to_string((int)m.rowsize) + "x" +
+          std::to_string((int)m.columnsize));
+    }
+
+    int n = m.rowsize;
+    BandMatrix Result(n, lower, upper);
+    for (int i = 0; i < n; i++) {
+      int jEnd = std::min(n - 1, i + upper);
+      for (int j = std::max(0, i - lower); j <= jEnd; j++) {
+        Result.data[(size_t)i * Result.width() + (j - i + lower)] =
+            m.matrix[i][j];
+      }
+    }
+    return Result;
+  }
+
+  Matrix toMatrix() const {
+    Matrix Result({}, std::make_tuple(size, size));
+    for (int i = 0; i < size; i++) {
+      int jEnd = std::min(size - 1, i + upper);
+      for (int j = std::max(0, i - lower); j <= jEnd; j++) {
+        Result.matrix[i][j] = data[(size_t)i * width() + (j - i + lower)];
+      }
+    }
+    return Result;
+  }
+
+  // y = A x in O(n * width).
+  static vec gbmv(const BandMatrix &A, const vec &x) {
+    MORPHEUS_OP("BandMatrix::gbmv", 2.0 * A.data.size(),
+                8.0 * (A.data.size() + 2.0 * A.size), A.size, A.lower,
+                A.upper);
+    if ((int)x.size() != A.size) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! BandMatrix of size " +
+          std::to_string(A.size) + " and vector of size " +
+          std::to_string(x.size()));
+    }
+
+    vec y(A.size, 0.0);
+    int w = A.width();
+    for (int i = 0; i < A.size; i++) {
+      int jBegin = std::max(0, i - A.lower);
+      int jEnd = std::min(A.size - 1, i + A.upper);
+      const double *row = A.data.data() + (size_t)i * w + (jBegin - i + A.lower);
+      const double *xj = x.data() + jBegin;
+      double sum{};
+      for (int j = 0; j <= jEnd - jBegin; j++) {
+        sum += row[j] * xj[j];
+      }
+      y[i] = sum;
+    }
+    return y;
+  }
+
+  struct LU;
+  struct Cholesky;
+
+  static LU lu(const BandMatrix &A);
+  static Cholesky cholesky(const BandMatrix &A);
+
+  // Thomas algorithm for a single tridiagonal system. `sub` and `super` hold
+  // the n - 1 off-diagonals, `diag` the n diagonal entries. No pivoting is
+  // done, so the system should be diagonally dominant (or otherwise safe).
+  static vec solveTridiagonal(const vec &sub, const vec &diag, const vec &super,
+                              const vec &rhs) {
+    vec x = rhs;
+    solveTridiagonalBatched(diag.size(), 1, sub, diag, super, x);
+    return x;
+  }
+
+  // Solves `batch` independent tridiagonal systems of size n at once. The
+  // inputs are interleaved so that entry i of system s sits at
+  // i * batch + s; the innermost loop then runs over the systems with unit
+  // stride and vectorizes. `rhs` is overwritten with the solutions.
+  static void solveTridiagonalBatched(int n, int batch, const vec &sub,
+                                      const vec &diag, const vec &super,
+                                      vec &rhs) {
+    solveTridiagonalBatched(n, batch, sub.data(), diag.data(), super.data(),
+                            rhs.data(), sub.size(), diag.size(), super.size(),
+                            rhs.size());
+  }
+
+private:
+  static void solveTridiagonalBatched(int n, int batch, const double *sub,
+                                      const double *diag, const double *super,
+                                      double *rhs, size_t subSize,
+                                      size_t diagSize, size_t superSize,
+                                      size_t rhsSize) {
+    if (n < 0 || batch < 0) {
+      throw std::invalid_argument(
+          "INVALID SIZE! Tridiagonal size and batch must be >= 0");
+    }
+    size_t full = (size_t)n * batch;
+    size_t offDiag = n > 0 ? (size_t)(n - 1) * batch : 0;
+    if (diagSize != full || rhsSize != full || subSize != offDiag ||
+        superSize != offDiag) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Tridiagonal system of size " +
+          std::to_string(n) + " with batch " + std::to_string(batch) +
+          " has mismatched diagonals");
+    }
+    if (n == 0) {
+      return;
+    }
+
+    // Modified super-diagonal, reused across the forward sweep. Zero pivots
+    // are collected in a flag so the inner loops stay branch-free.
+    vec c(offDiag);
+    bool singular = false;
+    for (int s = 0; s < batch; s++) {
+      singular |= diag[s] == 0;
+      double inv = 1.0 / diag[s];
+      if (n > 1) {
+        c[s] = super[s] * inv;
+      }
+      rhs[s] *= inv;
+    }
+    for (int i = 1; i < n; i++) {
+      const double *a = sub + (size_t)(i - 1) * batch;
+      const double *b = diag + (size_t)i * batch;
+      const double *cPrev = c.data() + (size_t)(i - 1) * batch;
+      const double *dPrev = rhs + (size_t)(i - 1) * batch;
+      double *d = rhs + (size_t)i * batch;
+      if (i < n - 1) {
+        const double *up = super + (size_t)i * batch;
+        double *cCur = c.data() + (size_t)i * batch;
+        for (int s = 0; s < batch; s++) {
+          double m = b[s] - a[s] * cPrev[s];
+          singular |= m == 0;
+          double inv = 1.0 / m;
+          cCur[s] = up[s] * inv;
+          d[s] = (d[s] - a[s] * dPrev[s]) * inv;
+        }
+      } else {
+        for (int s = 0; s < batch; s++) {
+          double m = b[s] - a[s] * cPrev[s];
+          singular |= m == 0;
+          d[s] = (d[s] - a[s] * dPrev[s]) / m;
+        }
+      }
+    }
+    if (singular) {
+      throw std::invalid_argument(
+          "SINGULAR MATRIX! Zero pivot in tridiagonal system");
+    }
+    for (int i = n - 2; i >= 0; i--) {
+      const double *cCur = c.data() + (size_t)i * batch;
+      const double *next = rhs + (size_t)(i + 1) * batch;
+      double *d = rhs + (size_t)i * batch;
+      for (int s = 0; s < batch; s++) {
+        d[s] -= cCur[s] * next[s];
+      }
+    }
+  }
+};
+
+// Banded LU with partial pivoting. Row swaps can push U up to
+// lower + upper super-diagonals, so the factor is kept in a BandMatrix with
+// that wider upper band; the multipliers of L sit in its lower band.
+struct BandMatrix::LU {
+  BandMatrix factors;
+  std::vector<int> pivots;
+
+  vec solve(const vec &b) const {
+    int n = factors.size;
+    if ((int)b.size() != n) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! LU of size " +
+          std::to_string(n) + " and vector of size " +
+          std::to_string(b.size()));
+    }
+
+    vec x = b;
+    int kl = factors.lower;
+    int ku = factors.upper;
+    int w = factors.width();
+    const double *a = factors.data.data();
+    for (int k = 0; k < n; k++) {
+      std::swap(x[k], x[pivots[k]]);
+      int iEnd = std::min(n - 1, k + kl);
+      for (int i = k + 1; i <= iEnd; i++) {
+        x[i] -= a[(size_t)i * w + (k - i + kl)] * x[k];
+      }
+    }
+    for (int i = n - 1; i >= 0; i--) {
+      const double *row = a + (size_t)i * w + kl;
+      int jEnd = std::min(n - 1, i + ku);
+      double sum = x[i];
+      for (int j = i + 1; j <= jEnd; j++) {
+        sum -= row[j - i] * x[j];
+      }
+      x[i] = sum / row[0];
+    }
+    return x;
+  }
+};
+
+// Banded Cholesky A = L L^T for symmetric positive definite band matrices;
+// L keeps the lower band of A.
+struct BandMatrix::Cholesky {
+  BandMatrix factor;
+
+  vec solve(const vec &b) const {
+    int n = factor.size;
+    if ((int)b.size() != n) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Cholesky of size " +
+          std::to_string(n) + " and vector of size " +
+          std::to_string(b.size()));
+    }
+
+    vec x = b;
+    int kl = factor.lower;
+    int w = factor.width();
+    const double *l = factor.data.data();
+    for (int i = 0; i < n; i++) {
+      int jBegin = std::max(0, i - kl);
+      const double *row = l + (size_t)i * w + (jBegin - i + kl);
+      double sum = x[i];
+      for (int j = jBegin; j < i; j++) {
+        sum -= row[j - jBegin] * x[j];
+      }
+      x[i] = sum / l[(size_t)i * w + kl];
+    }
+    for (int i = n - 1; i >= 0; i--) {
+      x[i] /= l[(size_t)i * w + kl];
+      double xi = x[i];
+      const double *row = l + (size_t)i * w;
+      for (int j = std::max(0, i - kl); j < i; j++) {
+        x[j] -= row[j - i + kl] * xi;
+      }
+    }
+    return x;
+  }
+};
+
+inline BandMatrix::LU BandMatrix::lu(const BandMatrix &A) {
+  MORPHEUS_OP("BandMatrix::lu", 0, 0, A.size, A.lower, A.upper);
+  int n = A.size;
+  int kl = A.lower;
+  int ku = A.lower + A.upper;
+
+  LU Result{BandMatrix(n, kl, ku), std::vector<int>(n)};
+  BandMatrix &f = Result.factors;
+  int w = f.width();
+  for (int i = 0; i < n; i++) {
+    int jEnd = std::min(n - 1, i + A.upper);
+    for (int j = std::max(0, i - kl); j <= jEnd; j++) {
+      f.data[(size_t)i * w + (j - i + kl)] = A.get(i, j);
+    }
+  }
+
+  double *a = f.data.data();
+  for (int k = 0; k < n; k++) {
+    int iEnd = std::min(n - 1, k + kl);
+    int jEnd = std::min(n - 1, k + ku);
+
+    int p = k;
+    double best = std::abs(a[(size_t)k * w + kl]);
+    for (int i = k + 1; i <= iEnd; i++) {
+      double v = std::abs(a[(size_t)i * w + (k - i + kl)]);
+      if (v > best) {
+        best = v;
+        p = i;
+      }
+    }
+    if (best == 0) {
+      throw std::invalid_argument("SINGULAR MATRIX! Zero pivot in column " +
+                                  std::to_string(k) + " of banded LU");
+    }
+    Result.pivots[k] = p;
+
+    // Only columns k.. are swapped: earlier multipliers belong to earlier
+    // elimination steps and are applied in that order by solve().
+    if (p != k) {
+      for (int j = k; j <= jEnd; j++) {
+        std::swap(a[(size_t)k * w + (j - k + kl)], a[(size_t)p * w + (j - p + kl)]);
+      }
+    }
+
+    const double *pivotRow = a + (size_t)k * w + kl;
+    for (int i = k + 1; i <= iEnd; i++) {
+      double *row = a + (size_t)i * w + (k - i + kl);
+      double l = row[0] / pivotRow[0];
+      row[0] = l;
+      for (int j = 1; j <= jEnd - k; j++) {
+        row[j] -= l * pivotRow[j];
+      }
+    }
+  }
+  return Result;
+}
+
+inline BandMatrix::Cholesky BandMatrix::cholesky(const BandMatrix &A) {
+  MORPHEUS_OP("BandMatrix::cholesky", 0, 0, A.size, A.lower, A.upper);
+  if (A.lower != A.upper) {
+    throw std::invalid_argument(
+        "INVALID OPERATION! Banded Cholesky needs equal lower and upper "
+        "bandwidths");
+  }
+
+  int n = A.size;
+  int kl = A.lower;
+  Cholesky Result{BandMatrix(n, kl, 0)};
+  BandMatrix &f = Result.factor;
+  int w = f.width();
+  double *l = f.data.data();
+  for (int j = 0; j < n; j++) {
+    const double *rowJ = l + (size_t)j * w;
+    double s = A.get(j, j);
+    for (int k = std::max(0, j - kl); k < j; k++) {
+      s -= rowJ[k - j + kl] * rowJ[k - j + kl];
+    }
+    if (s <= 0) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! Matrix is not positive definite at row " +
+          std::to_string(j));
+    }
+    double d = std::sqrt(s);
+    l[(size_t)j * w + kl] = d;
+
+    int iEnd = std::min(n - 1, j + kl);
+    for (int i = j + 1; i <= iEnd; i++) {
+      double *rowI = l + (size_t)i * w;
+      double v = A.get(i, j);
+      for (int k = std::max(0, i - kl); k < j; k++) {
+        v -= rowI[k - i + kl] * rowJ[k - j + kl];
+      }
+      rowI[j - i + kl] = v / d;
+    }
+  }
+  return Result;
+}
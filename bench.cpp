@@ -0,0 +1,400 @@
+// Benchmark harness. Times the core operations over a few sizes and prints
+// a JSON report to stdout (or to the file given with --out). Built with
+// MORPHEUS_PERF and MORPHEUS_TRACE, so the report also carries the
+// per-operation hardware counter totals from instrument.h, and --trace
+// writes every timed call as a Chrome trace.
+//
+// --roofline additionally measures the machine's peak FLOP/s and STREAM
+// triad bandwidth, on one thread and on all of the executor's threads,
+// places every benchmark on the roofline for the threads it runs on and
+// prints how far each one is from its bound. The element-wise cases are
+// then sized past the last-level cache, and memory-bound points that still
+// fit in it are marked rather than held to the DRAM roof.
+//
+//   bench [--quick] [--roofline] [--out report.json] [--trace trace.json]
+
+#include "epilogue.h"
+#include "matrix.h"
+#include "parallel.h"
+#include "reduce.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+struct BenchResult {
+    std::string name;
+    int size;
+    int repetitions;
+    double bestSeconds;
+    double meanSeconds;
+    double flops;
+    double bytes;
+    bool threaded = false; // runs on all of the executor's threads
+};
+
+Matrix randomMatrix(int rows, int cols, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    Matrix m({}, std::make_tuple(rows, cols));
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            m.matrix[i][j] = dist(rng);
+        }
+    }
+    return m;
+}
+
+// Runs fn until at least minSeconds have passed (and at least twice).
+BenchResult measure(const std::string& name, int size, double flops, double bytes,
+                    double minSeconds, const std::function<void()>& fn) {
+    using clock = std::chrono::steady_clock;
+    BenchResult r{name, size, 0, 1e300, 0, flops, bytes};
+    double total = 0;
+    while (r.repetitions < 2 || total < minSeconds) {
+        auto start = clock::now();
+        fn();
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        r.bestSeconds = std::min(r.bestSeconds, seconds);
+        total += seconds;
+        r.repetitions++;
+    }
+    r.meanSeconds = total / r.repetitions;
+    return r;
+}
+
+// Marks a benchmark of an operation that splits its work over the executor.
+BenchResult threaded(BenchResult r) {
+    r.threaded = true;
+    return r;
+}
+
+struct Machine {
+    double peakFlops = 0;        // FLOP/s over all threads
+    double bandwidth = 0;        // bytes/s, STREAM triad over all threads
+    double serialPeakFlops = 0;  // the same on one thread
+    double serialBandwidth = 0;
+    double cacheBytes = 0;       // last-level cache
+};
+
+// Size of the last-level cache, or 32 MiB when the system does not say.
+double lastLevelCacheBytes() {
+    long bytes = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (bytes <= 0) {
+        bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+#endif
+    return bytes > 0 ? (double)bytes : 32.0 * (1 << 20);
+}
+
+// Peak floating-point rate of `threads` threads: each runs independent
+// multiply-add chains, enough of them to hide the FMA latency and fill the
+// vector units.
+double measurePeakFlops(size_t threads, double minSeconds) {
+    const int lanes = 32;
+    const long iterations = 1 << 20;
+    double best = 0;
+    double total = 0;
+    while (total < minSeconds) {
+        std::vector<double> sinks(threads);
+        auto start = std::chrono::steady_clock::now();
+        morpheus::parallelFor(threads, 1, [&](size_t chunk, size_t, size_t) {
+            double acc[lanes];
+            for (int j = 0; j < lanes; j++) {
+                acc[j] = 1.0 + j * 1e-3;
+            }
+            const double scale = 0.999999;
+            const double shift = 1e-7;
+            for (long it = 0; it < iterations; it++) {
+                for (int j = 0; j < lanes; j++) {
+                    acc[j] = acc[j] * scale + shift;
+                }
+            }
+            double sum = 0;
+            for (int j = 0; j < lanes; j++) {
+                sum += acc[j];
+            }
+            sinks[chunk] = sum;
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        total += seconds;
+        best = std::max(best, 2.0 * lanes * iterations * threads / seconds);
+        if (sinks[0] == 0) {
+            std::fprintf(stderr, "unexpected result\n");
+        }
+    }
+    return best;
+}
+
+// STREAM triad a = b + s * c on `threads` threads over arrays much larger
+// than the caches. Unlike STREAM it counts 32 bytes per element: the stores
+// are ordinary cached ones, so every line of a is also read before it is
+// written. In-place kernels such as operator+= read what they write and
+// move exactly the bytes they are charged for, so counting 24 would put
+// them above the roof.
+double measureBandwidth(size_t elements, size_t threads, double minSeconds) {
+    std::vector<double> a(elements), b(elements, 1.0), c(elements, 2.0);
+    size_t grain = elements / threads + 1;
+    // First touch from the threads that will use the pages
+    morpheus::parallelFor(elements, grain, [&](size_t, size_t first, size_t last) {
+        std::fill(a.begin() + first, a.begin() + last, 0.0);
+    });
+    double best = 0;
+    double total = 0;
+    // At least a few passes: one pass over arrays this large can take
+    // longer than the quick mode's minimum time on its own
+    for (int pass = 0; pass < 3 || total < minSeconds; pass++) {
+        auto start = std::chrono::steady_clock::now();
+        morpheus::parallelFor(elements, grain, [&](size_t, size_t first, size_t last) {
+            const double s = 3.0;
+            for (size_t i = first; i < last; i++) {
+                a[i] = b[i] + s * c[i];
+            }
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        total += seconds;
+        best = std::max(best, 32.0 * elements / seconds);
+    }
+    return best;
+}
+
+// Where a measurement sits against min(peak, intensity * bandwidth), with
+// the ceilings of the threads it runs on. A memory-bound operation whose
+// data fits in the last-level cache is not held to the DRAM roof.
+struct RooflinePoint {
+    double intensity;  // FLOPs per byte
+    double achieved;   // FLOP/s, or bytes/s for operations without FLOPs
+    double bound;      // attainable rate in the same unit
+    bool memoryBound;
+    bool cacheResident;
+};
+
+RooflinePoint place(const BenchResult& r, const Machine& m) {
+    double peak = r.threaded ? m.peakFlops : m.serialPeakFlops;
+    double bandwidth = r.threaded ? m.bandwidth : m.serialBandwidth;
+    RooflinePoint p;
+    p.intensity = r.bytes > 0 ? r.flops / r.bytes : 0;
+    if (r.flops == 0) {
+        p.achieved = r.bytes / r.bestSeconds;
+        p.bound = bandwidth;
+        p.memoryBound = true;
+    } else {
+        p.achieved = r.flops / r.bestSeconds;
+        p.bound = std::min(peak, p.intensity * bandwidth);
+        p.memoryBound = p.intensity * bandwidth < peak;
+    }
+    p.cacheResident = p.memoryBound && r.bytes < m.cacheBytes;
+    return p;
+}
+
+void printRoofline(std::ostream& out, const std::vector<BenchResult>& results, const Machine& m) {
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "1 thread:    peak %.2f GFLOP/s, bandwidth %.2f GB/s, ridge point %.2f FLOP/byte\n",
+                  m.serialPeakFlops * 1e-9, m.serialBandwidth * 1e-9,
+                  m.serialPeakFlops / m.serialBandwidth);
+    out << line;
+    size_t threads = morpheus::currentExecutor()->concurrency();
+    if (threads > 1) {
+        std::snprintf(line, sizeof(line),
+                      "%zu threads:   peak %.2f GFLOP/s, bandwidth %.2f GB/s, ridge point %.2f FLOP/byte\n",
+                      threads, m.peakFlops * 1e-9, m.bandwidth * 1e-9, m.peakFlops / m.bandwidth);
+        out << line;
+    }
+    out << "\n";
+    std::snprintf(line, sizeof(line), "%-20s %6s %7s %10s %12s %12s %8s  %s\n", "operation",
+                  "size", "threads", "FLOP/byte", "achieved", "bound", "of bound", "limited by");
+    out << line;
+    for (const BenchResult& r : results) {
+        RooflinePoint p = place(r, m);
+        const char* unit = r.flops == 0 ? "GB/s" : "GF/s";
+        char fraction[16] = "       -";
+        if (!p.cacheResident) {
+            std::snprintf(fraction, sizeof(fraction), "%7.1f%%", 100.0 * p.achieved / p.bound);
+        }
+        std::snprintf(line, sizeof(line),
+                      "%-20s %6d %7s %10.3f %7.2f %-4s %7.2f %-4s %8s  %s\n",
+                      r.name.c_str(), r.size, r.threaded ? "all" : "1", p.intensity,
+                      p.achieved * 1e-9, unit, p.bound * 1e-9, unit, fraction,
+                      p.cacheResident ? "cache resident, no DRAM bound"
+                      : p.memoryBound ? "memory bandwidth"
+                                      : "compute");
+        out << line;
+    }
+}
+
+// The machine entry carries the roofline ceilings when they were measured
+// (peakFlops > 0), and each benchmark then its position under the ceilings
+// of the threads it runs on.
+void writeJson(std::ostream& out, const std::vector<BenchResult>& results, const Machine& m) {
+    bool roofline = m.peakFlops > 0;
+    out << "{\n  \"machine\": {\"threads\": " << morpheus::currentExecutor()->concurrency()
+        << ", \"perf_counters\": " << (perfCountersAvailable() ? "true" : "false");
+    if (roofline) {
+        out << ", \"peak_gflops\": " << m.peakFlops * 1e-9
+            << ", \"bandwidth_gbytes_per_second\": " << m.bandwidth * 1e-9
+            << ", \"single_thread_peak_gflops\": " << m.serialPeakFlops * 1e-9
+            << ", \"single_thread_bandwidth_gbytes_per_second\": "
+            << m.serialBandwidth * 1e-9;
+    }
+    out << "},\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name
+            << "\", \"size\": " << r.size << ", \"repetitions\": " << r.repetitions
+            << ", \"best_seconds\": " << r.bestSeconds
+            << ", \"mean_seconds\": " << r.meanSeconds
+            << ", \"gflops\": " << r.flops / r.bestSeconds * 1e-9
+            << ", \"gbytes_per_second\": " << r.bytes / r.bestSeconds * 1e-9
+            << ", \"threaded\": " << (r.threaded ? "true" : "false");
+        if (roofline) {
+            RooflinePoint p = place(r, m);
+            out << ", \"intensity\": " << p.intensity;
+            if (!p.cacheResident) {
+                out << ", \"fraction_of_bound\": " << p.achieved / p.bound;
+            }
+            out << ", \"bound\": \"" << (p.memoryBound ? "memory" : "compute") << "\""
+                << ", \"cache_resident\": " << (p.cacheResident ? "true" : "false");
+        }
+        out << "}";
+    }
+    out << "\n  ],\n  \"operations\": ";
+    writePerfJson(out);
+    out << "\n}\n";
+}
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    bool roofline = false;
+    std::string outPath;
+    std::string tracePath;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (std::strcmp(argv[i], "--roofline") == 0) {
+            roofline = true;
+        } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--quick] [--roofline] [--out report.json] [--trace trace.json]\n";
+            return 2;
+        }
+    }
+
+    double minSeconds = quick ? 0.02 : 0.5;
+    std::vector<int> dotSizes = quick ? std::vector<int>{16, 64} : std::vector<int>{64, 128, 256, 512};
+    int elementwiseSize = quick ? 256 : 2048;
+    Machine machine;
+    machine.cacheBytes = lastLevelCacheBytes();
+    if (roofline) {
+        // Operands of twice the last-level cache each, so the element-wise
+        // points measure DRAM traffic and can be held to its roof
+        elementwiseSize = std::max(elementwiseSize, (int)std::ceil(std::sqrt(machine.cacheBytes / 4)));
+    }
+    std::mt19937_64 rng(42);
+    std::vector<BenchResult> results;
+    perfReset();
+    traceClear();
+
+    for (int n : dotSizes) {
+        Matrix a = randomMatrix(n, n, rng);
+        Matrix b = randomMatrix(n, n, rng);
+        double flops = 2.0 * n * n * n;
+        double bytes = 24.0 * n * n;
+        results.push_back(measure("dot", n, flops, bytes, minSeconds,
+                                  [&] { Matrix::dot(a, b); }));
+        Matrix c;
+        results.push_back(measure("dotInto", n, flops, bytes, minSeconds,
+                                  [&] { Matrix::dotInto(a, b, c); }));
+        for (Summation mode : {Summation::Pairwise, Summation::Neumaier, Summation::BlockedFma}) {
+            const char* names[] = {"dotInto", "dotInto Pairwise", "dotInto Neumaier",
+                                   "dotInto BlockedFma"};
+            results.push_back(measure(names[(int)mode], n, flops, bytes, minSeconds,
+                                      [&] { Matrix::dotInto(a, b, c, mode); }));
+        }
+        // Inference-style dense layer: bias and ReLU fused into the product
+        GemmEpilogue layer;
+        layer.columnBias = vec(n, 0.5);
+        layer.activation = GemmEpilogue::Activation::ReLU;
+        results.push_back(measure("dotFusedInto", n, flops, bytes, minSeconds,
+                                  [&] { dotFusedInto(a, b, c, layer); }));
+    }
+
+    int n = elementwiseSize;
+    Matrix a = randomMatrix(n, n, rng);
+    Matrix b = randomMatrix(n, n, rng);
+    double cells = (double)n * n;
+    results.push_back(measure("AddMatrix", n, cells, 24 * cells, minSeconds,
+                              [&] { Matrix::AddMatrix(a, b); }));
+    results.push_back(measure("SubtractMatix", n, cells, 24 * cells, minSeconds,
+                              [&] { Matrix::SubtractMatix(a, b); }));
+    results.push_back(measure("Constmultiplication", n, cells, 16 * cells, minSeconds,
+                              [&] { Matrix::Constmultiplication(a, 3); }));
+    Matrix acc = a;
+    results.push_back(threaded(measure("operator+=", n, cells, 24 * cells, minSeconds,
+                                       [&] { acc += b; })));
+    results.push_back(threaded(measure("axpy", n, 2 * cells, 24 * cells, minSeconds,
+                                       [&] { acc.axpy(0.5, b); })));
+    results.push_back(threaded(measure("sum", n, cells, 8 * cells, minSeconds,
+                                       [&] { sum(a); })));
+    results.push_back(threaded(measure("sumPerColumn", n, cells, 8 * cells, minSeconds,
+                                       [&] { sum(a, Axis::PerColumn); })));
+    const std::pair<const char*, Summation> modes[] = {
+        {"Pairwise", Summation::Pairwise},
+        {"Neumaier", Summation::Neumaier},
+        {"BlockedFma", Summation::BlockedFma}};
+    for (auto [modeName, mode] : modes) {
+        results.push_back(threaded(measure(std::string("sum ") + modeName, n, cells,
+                                           8 * cells, minSeconds,
+                                           [&, mode = mode] { sum(a, mode); })));
+    }
+    results.push_back(threaded(measure("norm", n, 2 * cells, 8 * cells, minSeconds,
+                                       [&] { norm(a); })));
+    results.push_back(measure("transpose", n, 0, 16 * cells, minSeconds,
+                              [&] { Matrix::transpose(a); }));
+
+    if (roofline) {
+        size_t threads = morpheus::currentExecutor()->concurrency();
+        // Three arrays of 8-byte elements, twice the last-level cache
+        size_t elements = std::max<size_t>(quick ? 1 << 21 : 1 << 23,
+                                           (size_t)(2 * machine.cacheBytes / 24));
+        machine.peakFlops = measurePeakFlops(threads, minSeconds);
+        machine.bandwidth = measureBandwidth(elements, threads, minSeconds);
+        machine.serialPeakFlops = machine.peakFlops;
+        machine.serialBandwidth = machine.bandwidth;
+        if (threads > 1) {
+            machine.serialPeakFlops = measurePeakFlops(1, minSeconds);
+            machine.serialBandwidth = measureBandwidth(elements, 1, minSeconds);
+        }
+        printRoofline(outPath.empty() ? std::cerr : std::cout, results, machine);
+    }
+
+    if (outPath.empty()) {
+        writeJson(std::cout, results, machine);
+    } else {
+        std::ofstream out(outPath);
+        if (!out) {
+            std::cerr << "cannot open " << outPath << "\n";
+            return 1;
+        }
+        writeJson(out, results, machine);
+    }
+    if (!tracePath.empty()) {
+        writeChromeTrace(tracePath);
+    }
+    return 0;
+}
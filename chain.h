@@ -0,0 +1,153 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace morpheus {
+
+// Cheapest parenthesization of the product of n matrices where factor i is
+// dims[i] x dims[i + 1], by the classic O(n^3) dynamic program over the
+// number of scalar multiply-adds.
+class ChainOrder {
+
+public:
+  explicit ChainOrder(const std::vector<int> &dims)
+      : n((int)dims.size() - 1), splits((size_t)n * n, 0),
+        costs((size_t)n * n, 0.0) {
+    for (int length = 2; length <= n; length++) {
+      for (int i = 0; i + length - 1 < n; i++) {
+        int j = i + length - 1;
+        double best = std::numeric_limits<double>::infinity();
+        for (int k = i; k < j; k++) {
+          double c = costs[index(i, k)] + costs[index(k + 1, j)] +
+                     (double)dims[i] * dims[k + 1] * dims[j + 1];
+          if (c < best) {
+            best = c;
+            splits[index(i, j)] = k;
+          }
+        }
+        costs[index(i, j)] = best;
+      }
+    }
+  }
+
+  int factors() const { return n; }
+
+  // The product of factors i..j is (i..split) * (split + 1..j).
+  int split(int i, int j) const { return splits[index(i, j)]; }
+
+  // Multiply-adds of the best order for factors i..j.
+  double cost(int i, int j) const { return costs[index(i, j)]; }
+  double cost() const { return n == 0 ? 0 : cost(0, n - 1); }
+
+private:
+  size_t index(int i, int j) const { return (size_t)i * n + j; }
+
+  int n;
+  std::vector<int> splits;
+  std::vector<double> costs;
+};
+
+// Intermediate results that are no longer needed, kept for reuse by later
+// results of the same shape.
+class BufferPool {
+
+public:
+  Matrix take(int rows, int cols) {
+    for (size_t i = 0; i < free.size(); i++) {
+      if ((int)free[i].rowsize == rows && (int)free[i].columnsize == cols) {
+        Matrix m = std::move(free[i]);
+        free.erase(free.begin() + i);
+        return m;
+      }
+    }
+    return Matrix({}, std::make_tuple(rows, cols));
+  }
+
+  void give(Matrix &&m) { free.push_back(std::move(m)); }
+
+private:
+  std::vector<Matrix> free;
+};
+
+struct NoEpilogue {
+  void operator()(int, double *) const {}
+};
+
+// Product of factors[i..j] in `order`, calling epilogue(row, data) on the
+// rows of the final product. Each product's buffer is taken from pool only
+// after its operands are computed, and the operands' buffers are given
+// back right after, so a chain of same-shaped products cycles through two
+// buffers.
+template <typename Epilogue>
+Matrix chainProduct(const std::vector<const Matrix *> &factors,
+                    const ChainOrder &order, int i, int j, BufferPool &pool,
+                    Epilogue &&epilogue) {
+  if (i == j) {
+    const Matrix &only = *factors[i];
+    Matrix out = pool.take(only.rowsize, only.columnsize);
+    for (int r = 0; r < (int)out.rowsize; r++) {
+      std::copy(only.matrix[r].begin(), only.matrix[r].end(),
+                out.matrix[r].begin());
+      epilogue(r, out.matrix[r].data());
+    }
+    return out;
+  }
+  int k = order.split(i, j);
+  Matrix left({}, std::make_tuple(0, 0));
+  Matrix right({}, std::make_tuple(0, 0));
+  if (i != k) {
+    left = chainProduct(factors, order, i, k, pool, NoEpilogue());
+  }
+  if (k + 1 != j) {
+    right = chainProduct(factors, order, k + 1, j, pool, NoEpilogue());
+  }
+  Matrix out = pool.take(factors[i]->rowsize, factors[j]->columnsize);
+  Matrix::dotInto(i == k ? *factors[i] : left,
+                  k + 1 == j ? *factors[j] : right, out, epilogue);
+  if (i != k) {
+    pool.give(std::move(left));
+  }
+  if (k + 1 != j) {
+    pool.give(std::move(right));
+  }
+  return out;
+}
+
+} // namespace morpheus
+
+// Product of matrices[0] * matrices[1] * ... in the order with the fewest
+// multiply-adds (ChainOrder), instead of the left-to-right order nested
+// Matrix::dot calls give. The buffers of intermediate products are reused
+// once consumed.
+inline Matrix
+multi_dot(const std::vector<std::reference_wrapper<const Matrix>> &matrices) {
+  if (matrices.empty()) {
+    throw std::invalid_argument(
+        "INVALID OPERATION! multi_dot needs at least one Matrix");
+  }
+  std::vector<const Matrix *> factors;
+  std::vector<int> dims{(int)matrices[0].get().rowsize};
+  for (const Matrix &m : matrices) {
+    if ((int)m.rowsize != dims.back()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
+          std::to_string(dims.back()) + " and Matrix of rowsize of " +
+          std::to_string((int)m.rowsize));
+    }
+    factors.push_back(&m);
+    dims.push_back(m.columnsize);
+  }
+
+  morpheus::ChainOrder order(dims);
+  MORPHEUS_OP("multi_dot", 2.0 * order.cost(), 0, dims.front(), dims.back(),
+              (int)factors.size());
+  morpheus::BufferPool pool;
+  return morpheus::chainProduct(factors, order, 0, (int)factors.size() - 1,
+                                pool, morpheus::NoEpilogue());
+}
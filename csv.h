@@ -0,0 +1,378 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "matrix.h"
+#include "parallel.h"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct CsvOptions {
+  char delimiter = ',';
+  bool header = false; // skip the first line
+};
+
+namespace morpheus {
+
+// Number of '\n' bytes in [begin, end). With SSE2 this compares 16 bytes at
+// a time and counts the matches from the movemask.
+inline size_t countNewlines(const char *begin, const char *end) {
+  size_t count = 0;
+  const char *p = begin;
+#ifdef __SSE2__
+  const __m128i newline = _mm_set1_epi8('\n');
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+    count += __builtin_popcount(mask);
+  }
+#endif
+  for (; p < end; p++) {
+    count += *p == '\n';
+  }
+  return count;
+}
+
+// Position just past the first '\n' at or after p, or end.
+inline const char *nextLine(const char *p, const char *end) {
+  const void *nl = std::memchr(p, '\n', end - p);
+  return nl ? static_cast<const char *>(nl) + 1 : end;
+}
+
+inline bool isBlank(char c, char delimiter) {
+  return (c == ' ' || c == '\t' || c == '\r') && c != delimiter;
+}
+
+// Lines holding only spaces, tabs and '\r' carry no row; parseCsv and
+// CsvReader both skip them.
+inline bool isBlankLine(const char *p, const char *e) {
+  for (; p < e; p++) {
+    if (*p != ' ' && *p != '\t' && *p != '\r') {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct CsvDataLine {
+  bool operator()(const char *p, const char *e) const {
+    return !isBlankLine(p, e);
+  }
+};
+
+inline std::runtime_error csvError(size_t row, size_t column,
+                                   const std::string &what) {
+  return std::runtime_error("INVALID CSV! Row " + std::to_string(row + 1) +
+                            ", column " + std::to_string(column + 1) + ": " +
+                            what);
+}
+
+// Parses one line (without its '\n') into `out`, which must already have
+// the expected number of columns. `row` is only used in error messages.
+inline void parseCsvLine(const char *p, const char *end, char delimiter,
+                         double *out, size_t columns, size_t row) {
+  for (size_t c = 0; c < columns; c++) {
+    while (p < end && isBlank(*p, delimiter)) {
+      p++;
+    }
+    if (p < end && *p == '+') {
+      p++;
+    }
+    auto parsed = std::from_chars(p, end, out[c]);
+    if (parsed.ec != std::errc()) {
+      throw csvError(row, c, parsed.ec == std::errc::result_out_of_range
+                                 ? "value out of range"
+                                 : "expected a number");
+    }
+    p = parsed.ptr;
+    while (p < end && isBlank(*p, delimiter)) {
+      p++;
+    }
+    if (c + 1 < columns) {
+      if (p == end || *p != delimiter) {
+        throw csvError(row, c,
+                       "expected " + std::to_string(columns) + " columns");
+      }
+      p++;
+    }
+  }
+  if (p != end) {
+    throw csvError(row, columns,
+                   "expected " + std::to_string(columns) + " columns");
+  }
+}
+
+inline size_t countCsvColumns(const char *p, const char *end, char delimiter) {
+  size_t columns = 1;
+  for (; p < end; p++) {
+    columns += *p == delimiter;
+  }
+  return columns;
+}
+
+inline const char *lineEnd(const char *p, const char *end) {
+  const void *nl = std::memchr(p, '\n', end - p);
+  return nl ? static_cast<const char *>(nl) : end;
+}
+
+struct EveryLine {
+  bool operator()(const char *, const char *) const { return true; }
+};
+
+// Runs fn(line, lineBegin, lineEnd) on every line of [begin, end) for which
+// keep(lineBegin, lineEnd) holds, where `line` is the 0-based number of the
+// line among the kept ones, and returns the number of kept lines. The text
+// is cut into chunks at line boundaries: a first parallel pass counts the
+// lines of every chunk (so each chunk knows its first line number), then
+// prepare(lines) runs once, then a second parallel pass calls fn. `end`
+// should not be preceded by a trailing newline.
+template <typename Keep, typename Prepare, typename F>
+size_t parallelLines(const char *begin, const char *end, Keep &&keep,
+                     Prepare &&prepare, F &&fn) {
+  size_t bytes = end - begin;
+  const size_t grain = 1 << 20;
+  size_t chunks = chunkCount(bytes, grain);
+
+  // Chunk c covers the lines starting in [c * bytes / chunks, ...).
+  std::vector<const char *> starts(chunks + 1);
+  for (size_t c = 0; c <= chunks; c++) {
+    size_t offset = bytes * c / chunks;
+    starts[c] = offset == 0       ? begin
+                : offset >= bytes ? end
+                                  : nextLine(begin + offset - 1, end);
+  }
+
+  std::vector<size_t> firstLine(chunks + 1, 0);
+  parallelFor(chunks, 1, [&](size_t, size_t first, size_t last) {
+    for (size_t c = first; c < last; c++) {
+      const char *a = starts[c];
+      const char *b = starts[c + 1];
+      if constexpr (std::is_same_v<std::decay_t<Keep>, EveryLine>) {
+        // Every chunk but the last ends right after a '\n'.
+        firstLine[c + 1] = countNewlines(a, b) + (b == end && a < b);
+      } else {
+        for (const char *p = a; p < b;) {
+          const char *e = lineEnd(p, b);
+          firstLine[c + 1] += keep(p, e);
+          p = e + 1;
+        }
+      }
+    }
+  });
+  for (size_t c = 0; c < chunks; c++) {
+    firstLine[c + 1] += firstLine[c];
+  }
+
+  prepare(firstLine[chunks]);
+  parallelFor(chunks, 1, [&](size_t, size_t first, size_t last) {
+    for (size_t c = first; c < last; c++) {
+      const char *p = starts[c];
+      for (size_t line = firstLine[c]; line < firstLine[c + 1];) {
+        const char *e = lineEnd(p, starts[c + 1]);
+        if (keep(p, e)) {
+          fn(line++, p, e);
+        }
+        p = e + 1;
+      }
+    }
+  });
+  return firstLine[chunks];
+}
+
+// parallelLines over every line.
+template <typename Prepare, typename F>
+size_t parallelLines(const char *begin, const char *end, Prepare &&prepare,
+                     F &&fn) {
+  return parallelLines(begin, end, EveryLine(), prepare, fn);
+}
+
+} // namespace morpheus
+
+// Parses delimited numeric text held in memory, in parallel (see
+// parallelLines), straight into the rows of the result with
+// std::from_chars. Lines must all have the same number of fields; blank
+// lines are skipped, as CsvReader does, and do not count as rows.
+inline Matrix parseCsv(const char *data, size_t size, CsvOptions options = {}) {
+  const char *begin = data;
+  const char *end = data + size;
+  if (options.header) {
+    begin = morpheus::nextLine(begin, end);
+  }
+  while (end > begin && (end[-1] == '\n' || end[-1] == '\r' ||
+                         morpheus::isBlank(end[-1], options.delimiter))) {
+    end--;
+  }
+  while (begin < end &&
+         morpheus::isBlankLine(begin, morpheus::lineEnd(begin, end))) {
+    begin = morpheus::nextLine(begin, end);
+  }
+  if (begin == end) {
+    return Matrix(Mat{}, std::make_tuple(0, 0));
+  }
+
+  size_t columns = morpheus::countCsvColumns(
+      begin, morpheus::lineEnd(begin, end), options.delimiter);
+  Mat result;
+  size_t rows = morpheus::parallelLines(
+      begin, end, morpheus::CsvDataLine(),
+      [&](size_t lines) { result.assign(lines, vec(columns)); },
+      [&](size_t r, const char *p, const char *e) {
+        morpheus::parseCsvLine(p, e, options.delimiter, result[r].data(),
+                               columns, r);
+      });
+  return Matrix(std::move(result), std::make_tuple((int)rows, (int)columns));
+}
+
+// Maps the file and parses it with parseCsv.
+inline Matrix readCsv(const std::string &path, CsvOptions options = {}) {
+  MappedFile file(path);
+  return parseCsv(reinterpret_cast<const char *>(file.data()), file.size(),
+                  options);
+}
+
+// Reads delimited text from a stream in fixed-size blocks, handing out up to
+// maxRows rows at a time. Only one block plus one partial line is held in
+// memory, so arbitrarily long inputs can be processed.
+class CsvReader {
+
+public:
+  CsvReader(std::istream &in, CsvOptions options = {},
+            size_t blockSize = 1 << 20)
+      : in(in), options(options), blockSize(blockSize) {
+    skipHeader = options.header;
+  }
+
+  // Replaces `chunk` with the next rows (at most maxRows). Returns false once
+  // the input is exhausted and no rows were read. The row vectors of `chunk`
+  // are reused when the shape allows it.
+  bool readRows(Matrix &chunk, int maxRows) {
+    Mat &rows = chunk.matrix;
+    size_t count = 0;
+    std::string line;
+    while ((int)count < maxRows && nextLine(line)) {
+      if (columns == 0) {
+        columns = morpheus::countCsvColumns(line.data(),
+                                            line.data() + line.size(),
+                                            options.delimiter);
+      }
+      if (count == rows.size()) {
+        rows.emplace_back();
+      }
+      rows[count].resize(columns);
+      morpheus::parseCsvLine(line.data(), line.data() + line.size(),
+                             options.delimiter, rows[count].data(), columns,
+                             rowsRead);
+      count++;
+      rowsRead++;
+    }
+    rows.resize(count);
+    chunk.Dimension = std::make_tuple((int)count, (int)columns);
+    chunk.rowsize = count;
+    chunk.columnsize = columns;
+    return count > 0;
+  }
+
+  size_t rowsRead = 0;
+  size_t columns = 0;
+
+private:
+  // Next non-blank line, or false at the end of the input.
+  bool nextLine(std::string &line) {
+    while (true) {
+      const char *base = buffer.data();
+      const char *nl = static_cast<const char *>(
+          std::memchr(base + position, '\n', buffer.size() - position));
+      if (nl) {
+        line.assign(base + position, nl);
+        position = nl - base + 1;
+      } else if (!refill()) {
+        if (position == buffer.size()) {
+          return false;
+        }
+        line.assign(buffer.data() + position, buffer.size() - position);
+        position = buffer.size();
+      } else {
+        continue;
+      }
+
+      if (skipHeader) {
+        skipHeader = false;
+        continue;
+      }
+      if (morpheus::isBlankLine(line.data(), line.data() + line.size())) {
+        continue;
+      }
+      line.resize(line.find_last_not_of(" \t\r") + 1);
+      return true;
+    }
+  }
+
+  // Appends the next block to the unread tail of the buffer.
+  bool refill() {
+    if (!in) {
+      return false;
+    }
+    buffer.erase(0, position);
+    position = 0;
+    size_t old = buffer.size();
+    buffer.resize(old + blockSize);
+    in.read(&buffer[old], blockSize);
+    buffer.resize(old + in.gcount());
+    return in.gcount() > 0;
+  }
+
+  std::istream &in;
+  CsvOptions options;
+  size_t blockSize;
+  bool skipHeader = false;
+  std::string buffer;
+  size_t position = 0;
+};
+
+// Writes m as delimited text using std::to_chars (shortest representation
+// that round-trips) into a large buffer that is flushed in blocks.
+inline void writeCsv(const Matrix &m, std::ostream &out,
+                     CsvOptions options = {}) {
+  const size_t blockSize = 1 << 20;
+  // Longest shortest-round-trip double is 24 characters.
+  const size_t maxField = 32;
+  std::vector<char> buffer(blockSize + maxField);
+  char *p = buffer.data();
+  char *flushAt = buffer.data() + blockSize;
+  int cols = m.columnsize;
+  for (int i = 0; i < m.rowsize; i++) {
+    const double *row = m.matrix[i].data();
+    for (int j = 0; j < cols; j++) {
+      p = std::to_chars(p, p + maxField - 1, row[j]).ptr;
+      *p++ = j + 1 < cols ? options.delimiter : '\n';
+      if (p >= flushAt) {
+        out.write(buffer.data(), p - buffer.data());
+        p = buffer.data();
+      }
+    }
+  }
+  out.write(buffer.data(), p - buffer.data());
+}
+
+inline void writeCsv(const Matrix &m, const std::string &path,
+                     CsvOptions options = {}) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("CANNOT OPEN FILE! " + path);
+  }
+  writeCsv(m, out, options);
+  if (!out) {
+    throw std::runtime_error("CANNOT WRITE FILE! " + path);
+  }
+}
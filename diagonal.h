@@ -0,0 +1,293 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// n x n diagonal matrix stored as its n diagonal entries. Products with a
+// dense Matrix are row or column scalings.
+class DiagonalMatrix {
+
+public:
+  vec diagonal;
+
+  DiagonalMatrix(vec diagonal = {}) { this->diagonal = std::move(diagonal); }
+
+  static DiagonalMatrix identity(int n) { return DiagonalMatrix(vec(n, 1.0)); }
+
+  int size() const { return diagonal.size(); }
+
+  Matrix toMatrix() const {
+    int n = size();
+    Matrix Result({}, std::make_tuple(n, n));
+    for (int i = 0; i < n; i++) {
+      Result.matrix[i][i] = diagonal[i];
+    }
+    return Result;
+  }
+
+  // D A: row i of A scaled by d_i.
+  static Matrix dot(const DiagonalMatrix &D, const Matrix &A) {
+    if (D.size() != A.rowsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! DiagonalMatrix of size " +
+          std::to_string(D.size()) + " and Matrix of rowsize of " +
+          std::to_string((int)A.rowsize));
+    }
+
+    int cols = A.columnsize;
+    Matrix Result({}, std::make_tuple((int)A.rowsize, cols));
+    for (int i = 0; i < A.rowsize; i++) {
+      double d = D.diagonal[i];
+      const double *in = A.matrix[i].data();
+      double *out = Result.matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        out[j] = d * in[j];
+      }
+    }
+    return Result;
+  }
+
+  // A D: column j of A scaled by d_j.
+  static Matrix dot(const Matrix &A, const DiagonalMatrix &D) {
+    if (A.columnsize != D.size()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
+          std::to_string((int)A.columnsize) + " and DiagonalMatrix of size " +
+          std::to_string(D.size()));
+    }
+
+    int cols = A.columnsize;
+    Matrix Result({}, std::make_tuple((int)A.rowsize, cols));
+    const double *d = D.diagonal.data();
+    for (int i = 0; i < A.rowsize; i++) {
+      const double *in = A.matrix[i].data();
+      double *out = Result.matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        out[j] = in[j] * d[j];
+      }
+    }
+    return Result;
+  }
+
+  static DiagonalMatrix dot(const DiagonalMatrix &D1, const DiagonalMatrix &D2) {
+    if (D1.size() != D2.size()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! DiagonalMatrix of size " +
+          std::to_string(D1.size()) + " and DiagonalMatrix of size " +
+          std::to_string(D2.size()));
+    }
+
+    vec Result(D1.size());
+    for (int i = 0; i < D1.size(); i++) {
+      Result[i] = D1.diagonal[i] * D2.diagonal[i];
+    }
+    return DiagonalMatrix(std::move(Result));
+  }
+
+  // Scales the rows of A in place.
+  static void scaleRows(const DiagonalMatrix &D, Matrix &A) {
+    if (D.size() != A.rowsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! DiagonalMatrix of size " +
+          std::to_string(D.size()) + " and Matrix of rowsize of " +
+          std::to_string((int)A.rowsize));
+    }
+
+    for (int i = 0; i < A.rowsize; i++) {
+      double d = D.diagonal[i];
+      for (double &x : A.matrix[i]) {
+        x *= d;
+      }
+    }
+  }
+
+  // Scales the columns of A in place.
+  static void scaleColumns(Matrix &A, const DiagonalMatrix &D) {
+    if (A.columnsize != D.size()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
+          std::to_string((int)A.columnsize) + " and DiagonalMatrix of size " +
+          std::to_string(D.size()));
+    }
+
+    int cols = A.columnsize;
+    const double *d = D.diagonal.data();
+    for (int i = 0; i < A.rowsize; i++) {
+      double *row = A.matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        row[j] *= d[j];
+      }
+    }
+  }
+};
+
+// n x n permutation matrix stored as an index map: row i of P A is row
+// perm[i] of A, i.e. P has a one at (i, perm[i]).
+class PermutationMatrix {
+
+public:
+  std::vector<int> perm;
+
+  PermutationMatrix(std::vector<int> perm = {}) {
+    std::vector<bool> seen(perm.size(), false);
+    for (int p : perm) {
+      if (p < 0 || p >= (int)perm.size() || seen[p]) {
+        throw std::invalid_argument(
+            "INVALID PERMUTATION! Index " + std::to_string(p) +
+            " is out of range or repeated");
+      }
+      seen[p] = true;
+    }
+    this->perm = std::move(perm);
+  }
+
+  static PermutationMatrix identity(int n) {
+    std::vector<int> perm(n);
+    for (int i = 0; i < n; i++) {
+      perm[i] = i;
+    }
+    return PermutationMatrix(std::move(perm));
+  }
+
+  // Builds the permutation described by a LAPACK-style pivot sequence,
+  // where step k swapped rows k and pivots[k] (as BandMatrix::LU records).
+  static PermutationMatrix fromPivots(const std::vector<int> &pivots) {
+    PermutationMatrix Result = identity(pivots.size());
+    for (int k = 0; k < (int)pivots.size(); k++) {
+      if (pivots[k] < 0 || pivots[k] >= (int)pivots.size()) {
+        throw std::invalid_argument("INVALID PERMUTATION! Pivot " +
+                                    std::to_string(pivots[k]) +
+                                    " is out of range");
+      }
+      std::swap(Result.perm[k], Result.perm[pivots[k]]);
+    }
+    return Result;
+  }
+
+  int size() const { return perm.size(); }
+
+  PermutationMatrix inverse() const {
+    std::vector<int> inv(perm.size());
+    for (int i = 0; i < size(); i++) {
+      inv[perm[i]] = i;
+    }
+    PermutationMatrix Result;
+    Result.perm = std::move(inv);
+    return Result;
+  }
+
+  Matrix toMatrix() const {
+    int n = size();
+    Matrix Result({}, std::make_tuple(n, n));
+    for (int i = 0; i < n; i++) {
+      Result.matrix[i][perm[i]] = 1;
+    }
+    return Result;
+  }
+
+  // P A: gathers the rows of A.
+  static Matrix dot(const PermutationMatrix &P, const Matrix &A) {
+    if (P.size() != A.rowsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! PermutationMatrix of size " +
+          std::to_string(P.size()) + " and Matrix of rowsize of " +
+          std::to_string((int)A.rowsize));
+    }
+
+    Mat rows(P.size());
+    for (int i = 0; i < P.size(); i++) {
+      rows[i] = A.matrix[P.perm[i]];
+    }
+    return Matrix(std::move(rows), A.Dimension);
+  }
+
+  // A P: column perm[k] of the result is column k of A.
+  static Matrix dot(const Matrix &A, const PermutationMatrix &P) {
+    if (A.columnsize != P.size()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
+          std::to_string((int)A.columnsize) + " and PermutationMatrix of size " +
+          std::to_string(P.size()));
+    }
+
+    int cols = A.columnsize;
+    Matrix Result({}, A.Dimension);
+    const int *p = P.perm.data();
+    for (int i = 0; i < A.rowsize; i++) {
+      const double *in = A.matrix[i].data();
+      double *out = Result.matrix[i].data();
+      for (int k = 0; k < cols; k++) {
+        out[p[k]] = in[k];
+      }
+    }
+    return Result;
+  }
+
+  static PermutationMatrix dot(const PermutationMatrix &P1,
+                               const PermutationMatrix &P2) {
+    if (P1.size() != P2.size()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! PermutationMatrix of size " +
+          std::to_string(P1.size()) + " and PermutationMatrix of size " +
+          std::to_string(P2.size()));
+    }
+
+    // Row i of P1 P2 A is row P2[P1[i]] of A.
+    PermutationMatrix Result;
+    Result.perm.resize(P1.size());
+    for (int i = 0; i < P1.size(); i++) {
+      Result.perm[i] = P2.perm[P1.perm[i]];
+    }
+    return Result;
+  }
+
+  // A <- P A. Rows are moved by swapping the row vectors along the cycles
+  // of the permutation, so no element is copied.
+  static void permuteRows(const PermutationMatrix &P, Matrix &A) {
+    if (P.size() != A.rowsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! PermutationMatrix of size " +
+          std::to_string(P.size()) + " and Matrix of rowsize of " +
+          std::to_string((int)A.rowsize));
+    }
+
+    std::vector<bool> done(P.size(), false);
+    for (int start = 0; start < P.size(); start++) {
+      if (done[start]) {
+        continue;
+      }
+      int i = start;
+      done[i] = true;
+      while (!done[P.perm[i]]) {
+        std::swap(A.matrix[i], A.matrix[P.perm[i]]);
+        i = P.perm[i];
+        done[i] = true;
+      }
+    }
+  }
+
+  // A <- A P, reusing a single row buffer for every row.
+  static void permuteColumns(Matrix &A, const PermutationMatrix &P) {
+    if (A.columnsize != P.size()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
+          std::to_string((int)A.columnsize) + " and PermutationMatrix of size " +
+          std::to_string(P.size()));
+    }
+
+    int cols = A.columnsize;
+    vec buffer(cols);
+    const int *p = P.perm.data();
+    for (int i = 0; i < A.rowsize; i++) {
+      const double *in = A.matrix[i].data();
+      for (int k = 0; k < cols; k++) {
+        buffer[p[k]] = in[k];
+      }
+      A.matrix[i].swap(buffer);
+    }
+  }
+};
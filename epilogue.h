@@ -0,0 +1,158 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// Element-wise work fused into a product. Every element of m1 * m2 becomes
+//
+//   activation(scale * (m1 * m2)[i][j] + rowBias[i] + columnBias[j])
+//
+// computed as each output row is finished, while it is still in cache, so
+// the usual bias add and activation cost no extra passes over the result.
+// An empty bias is skipped.
+struct GemmEpilogue {
+  enum class Activation { None, ReLU, Sigmoid, Tanh, GELU };
+
+  double scale = 1;
+  vec rowBias;    // one entry per row of the product, or empty
+  vec columnBias; // one entry per column of the product, or empty
+  Activation activation = Activation::None;
+};
+
+namespace morpheus {
+
+struct Identity {
+  double operator()(double v) const { return v; }
+};
+
+struct Relu {
+  double operator()(double v) const { return v > 0 ? v : 0; }
+};
+
+struct Sigmoid {
+  double operator()(double v) const { return 1 / (1 + std::exp(-v)); }
+};
+
+struct Tanh {
+  double operator()(double v) const { return std::tanh(v); }
+};
+
+// The tanh approximation used by most inference runtimes.
+struct Gelu {
+  double operator()(double v) const {
+    const double k = 0.7978845608028654; // sqrt(2 / pi)
+    return 0.5 * v * (1 + std::tanh(k * (v + 0.044715 * v * v * v)));
+  }
+};
+
+// Element callback that leaves the value as the built-in stages left it.
+struct KeepValue {
+  double operator()(double v, int, int) const { return v; }
+};
+
+// Row epilogue for Matrix::dotInto applying a GemmEpilogue and then
+// element(value, i, j). The activation is chosen once per row, so the inner
+// loop is a single inlined expression.
+template <typename Element> class EpilogueRows {
+
+public:
+  EpilogueRows(const GemmEpilogue &epilogue, int cols, Element &element)
+      : epilogue(epilogue), cols(cols), element(element) {}
+
+  void operator()(int i, double *row) const {
+    switch (epilogue.activation) {
+    case GemmEpilogue::Activation::None:
+      finish(i, row, Identity());
+      break;
+    case GemmEpilogue::Activation::ReLU:
+      finish(i, row, Relu());
+      break;
+    case GemmEpilogue::Activation::Sigmoid:
+      finish(i, row, Sigmoid());
+      break;
+    case GemmEpilogue::Activation::Tanh:
+      finish(i, row, Tanh());
+      break;
+    case GemmEpilogue::Activation::GELU:
+      finish(i, row, Gelu());
+      break;
+    }
+  }
+
+private:
+  template <typename Activation>
+  void finish(int i, double *row, Activation activate) const {
+    const double scale = epilogue.scale;
+    const double shift = epilogue.rowBias.empty() ? 0 : epilogue.rowBias[i];
+    if (epilogue.columnBias.empty()) {
+      for (int j = 0; j < cols; j++) {
+        row[j] = element(activate(scale * row[j] + shift), i, j);
+      }
+    } else {
+      const double *bias = epilogue.columnBias.data();
+      for (int j = 0; j < cols; j++) {
+        row[j] = element(activate(scale * row[j] + shift + bias[j]), i, j);
+      }
+    }
+  }
+
+  const GemmEpilogue &epilogue;
+  int cols;
+  Element &element;
+};
+
+inline void checkEpilogue(const Matrix &m1, const Matrix &m2,
+                          const GemmEpilogue &epilogue) {
+  if (!epilogue.rowBias.empty() && epilogue.rowBias.size() != m1.rowsize) {
+    throw std::invalid_argument(
+        "INVALID OPERATION UNEQUAL DIMENSIONS! row bias of size " +
+        std::to_string(epilogue.rowBias.size()) + " for a product of rowsize " +
+        std::to_string((int)m1.rowsize));
+  }
+  if (!epilogue.columnBias.empty() &&
+      epilogue.columnBias.size() != m2.columnsize) {
+    throw std::invalid_argument(
+        "INVALID OPERATION UNEQUAL DIMENSIONS! column bias of size " +
+        std::to_string(epilogue.columnBias.size()) +
+        " for a product of columnsize " + std::to_string((int)m2.columnsize));
+  }
+}
+
+} // namespace morpheus
+
+// Matrix::dotInto followed by `epilogue` and then element(value, i, j) on
+// every element of the product, all in the same pass. element is the hook
+// for element-wise work the built-in stages do not cover; it is inlined
+// like the rest of the kernel.
+template <typename Element>
+void dotFusedInto(const Matrix &m1, const Matrix &m2, Matrix &out,
+                  const GemmEpilogue &epilogue, Element &&element) {
+  morpheus::checkEpilogue(m1, m2, epilogue);
+  morpheus::EpilogueRows<std::remove_reference_t<Element>> rows(
+      epilogue, m2.columnsize, element);
+  Matrix::dotInto(m1, m2, out, rows);
+}
+
+inline void dotFusedInto(const Matrix &m1, const Matrix &m2, Matrix &out,
+                         const GemmEpilogue &epilogue) {
+  dotFusedInto(m1, m2, out, epilogue, morpheus::KeepValue());
+}
+
+// Matrix::dot with a fused epilogue; see dotFusedInto.
+template <typename Element>
+Matrix dotFused(const Matrix &m1, const Matrix &m2,
+                const GemmEpilogue &epilogue, Element &&element) {
+  Matrix out({}, std::make_tuple(0, 0));
+  dotFusedInto(m1, m2, out, epilogue, std::forward<Element>(element));
+  return out;
+}
+
+inline Matrix dotFused(const Matrix &m1, const Matrix &m2,
+                       const GemmEpilogue &epilogue) {
+  return dotFused(m1, m2, epilogue, morpheus::KeepValue());
+}
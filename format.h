@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <ios>
+#include <locale>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MORPHEUS_HAS_FD 1
+#include <unistd.h>
+#endif
+
+// How matrices are rendered as text. Every row is written as
+// rowBegin, the elements joined by `separator`, then rowEnd.
+struct FormatOptions {
+  int precision = -1; // significant digits, -1 = shortest round-trip
+  int width = 0;      // minimum field width, right-aligned
+  // Rows / columns shown from each end; the rest is elided with "...".
+  // -1 shows everything.
+  int headRows = -1;
+  int tailRows = 0;
+  int headColumns = -1;
+  int tailColumns = 0;
+  std::string separator = "\t";
+  std::string rowBegin = "";
+  std::string rowEnd = "\n";
+};
+
+namespace morpheus {
+
+// Output buffer that hands its contents to `sink` in large blocks. Call
+// flush() once done; the destructor does not.
+class BlockWriter {
+
+public:
+  using Sink = std::function<void(const char *, size_t)>;
+
+  explicit BlockWriter(Sink sink, size_t blockSize = 1 << 20)
+      : sink(std::move(sink)), buffer(blockSize + reserve),
+        flushAt(blockSize) {}
+
+  void put(const char *text, size_t length) {
+    if (length > reserve) {
+      flush();
+      sink(text, length);
+      return;
+    }
+    std::memcpy(buffer.data() + used, text, length);
+    advance(length);
+  }
+
+  void put(const std::string &text) { put(text.data(), text.size()); }
+
+  // Writes v in the general format with `precision` significant digits
+  // (shortest round-trip for -1), right-aligned to `width`.
+  void number(double v, int precision = -1, int width = 0) {
+    char digits[64];
+    std::to_chars_result r =
+        precision < 0
+            ? std::to_chars(digits, digits + sizeof(digits), v)
+            : std::to_chars(digits, digits + sizeof(digits), v,
+                            std::chars_format::general, precision);
+    size_t length = r.ptr - digits;
+    size_t pad = width > (int)length ? width - length : 0;
+    while (pad > 0) {
+      size_t n = std::min(pad, reserve);
+      std::memset(buffer.data() + used, ' ', n);
+      advance(n);
+      pad -= n;
+    }
+    put(digits, length);
+  }
+
+  template <typename I> void integer(I v) {
+    char digits[24];
+    put(digits, std::to_chars(digits, digits + sizeof(digits), v).ptr - digits);
+  }
+
+  void flush() {
+    if (used > 0) {
+      sink(buffer.data(), used);
+      used = 0;
+    }
+  }
+
+private:
+  static constexpr size_t reserve = 256; // room for one field past flushAt
+
+  void advance(size_t length) {
+    used += length;
+    if (used >= flushAt) {
+      flush();
+    }
+  }
+
+  Sink sink;
+  std::vector<char> buffer;
+  size_t flushAt;
+  size_t used = 0;
+};
+
+inline BlockWriter::Sink streamSink(std::ostream &out) {
+  return [&out](const char *p, size_t n) { out.write(p, n); };
+}
+
+#ifdef MORPHEUS_HAS_FD
+// Writes everything to a file descriptor, retrying short writes.
+inline BlockWriter::Sink fdSink(int fd) {
+  return [fd](const char *p, size_t n) {
+    while (n > 0) {
+      ssize_t written = ::write(fd, p, n);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(),
+                                "CANNOT WRITE FILE DESCRIPTOR!");
+      }
+      p += written;
+      n -= written;
+    }
+  };
+}
+#endif
+
+// Whether `out` is in its default number format (apart from precision), in
+// which case to_chars with out.precision() significant digits writes
+// numbers exactly as operator<< would.
+inline bool plainNumberFormat(const std::ostream &out) {
+  const std::ios_base::fmtflags formatting =
+      std::ios_base::floatfield | std::ios_base::showpos |
+      std::ios_base::showpoint | std::ios_base::uppercase |
+      std::ios_base::showbase | std::ios_base::oct | std::ios_base::hex;
+  return (out.flags() & formatting) == 0 && out.width() == 0 &&
+         out.getloc() == std::locale::classic();
+}
+
+inline void checkFormatOptions(const FormatOptions &options) {
+  if (options.headRows < -1 || options.headColumns < -1 ||
+      options.tailRows < 0 || options.tailColumns < 0) {
+    throw std::invalid_argument(
+        "INVALID OPERATION! FormatOptions head counts must be -1 or more and "
+        "tail counts 0 or more");
+  }
+}
+
+// Number of indices shown out of n when `head` come from the front and `tail` from
+// the back; `elided` is set when something in between is skipped.
+inline int shownCount(int n, int head, int tail, bool &elided) {
+  elided = head >= 0 && head + tail < n;
+  return elided ? head + tail : n;
+}
+
+// Renders a rows x cols matrix whose row i starts at row(i).
+template <typename RowAt>
+void formatRows(BlockWriter &out, int rows, int cols, RowAt row,
+                const FormatOptions &options) {
+  checkFormatOptions(options);
+  bool rowsElided, colsElided;
+  int shownRows =
+      shownCount(rows, options.headRows, options.tailRows, rowsElided);
+  int shownCols =
+      shownCount(cols, options.headColumns, options.tailColumns, colsElided);
+  int headRows = rowsElided ? options.headRows : rows;
+  int headCols = colsElided ? options.headColumns : cols;
+
+  auto elision = [&] {
+    out.put(options.rowBegin);
+    out.put("...", 3);
+    out.put(options.rowEnd);
+  };
+  for (int k = 0; k < shownRows; k++) {
+    if (rowsElided && k == headRows) {
+      elision();
+    }
+    int i = k < headRows ? k : rows - (shownRows - k);
+    const double *r = row(i);
+    out.put(options.rowBegin);
+    for (int c = 0; c < shownCols; c++) {
+      if (colsElided && c == headCols) {
+        out.put("...", 3);
+        out.put(options.separator);
+      }
+      int j = c < headCols ? c : cols - (shownCols - c);
+      out.number(r[j], options.precision, options.width);
+      if (c + 1 < shownCols) {
+        out.put(options.separator);
+      }
+    }
+    if (colsElided && shownCols == headCols) {
+      out.put(shownCols > 0 ? options.separator : std::string());
+      out.put("...", 3);
+    }
+    out.put(options.rowEnd);
+  }
+  if (rowsElided && shownRows == headRows) {
+    elision();
+  }
+}
+
+} // namespace morpheus
@@ -0,0 +1,356 @@
+#pragma once
+
+#include "alloc.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#define MORPHEUS_HAS_PERF_EVENTS 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Per-operation totals. Counter fields stay zero when hardware counters are
+// unavailable (non-Linux, or perf_event_paranoid forbids them).
+struct OpStats {
+  uint64_t calls = 0;
+  double flops = 0;
+  double bytes = 0; // bytes the operation has to read and write
+  uint64_t nanoseconds = 0;
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t l1Misses = 0;  // L1 data read misses
+  uint64_t llcMisses = 0; // last-level cache read misses
+};
+
+namespace morpheus {
+
+enum PerfCounter { Cycles, Instructions, L1Misses, LLCMisses, CounterCount };
+
+// One perf_event group per thread, counting user-space events of the
+// calling thread. Members that the CPU or kernel refuse are left out.
+class PerfGroup {
+
+public:
+  PerfGroup() {
+#ifdef MORPHEUS_HAS_PERF_EVENTS
+    const uint32_t types[CounterCount] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HW_CACHE};
+    const uint64_t configs[CounterCount] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+    for (int c = 0; c < CounterCount; c++) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = types[c];
+      attr.config = configs[c];
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      int fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+      if (fd < 0) {
+        if (leader < 0) {
+          return; // no cycles counter, so no group at all
+        }
+        continue;
+      }
+      if (leader < 0) {
+        leader = fd;
+      } else {
+        members.push_back(fd);
+      }
+      slot[c] = opened++;
+    }
+#endif
+  }
+
+  ~PerfGroup() {
+#ifdef MORPHEUS_HAS_PERF_EVENTS
+    for (int fd : members) {
+      ::close(fd);
+    }
+    if (leader >= 0) {
+      ::close(leader);
+    }
+#endif
+  }
+
+  PerfGroup(const PerfGroup &) = delete;
+  PerfGroup &operator=(const PerfGroup &) = delete;
+
+  bool available() const { return leader >= 0; }
+
+  // Current counter values, zero for counters that are not available.
+  void read(uint64_t (&values)[CounterCount]) const {
+    for (uint64_t &v : values) {
+      v = 0;
+    }
+#ifdef MORPHEUS_HAS_PERF_EVENTS
+    if (leader < 0) {
+      return;
+    }
+    uint64_t buffer[1 + CounterCount];
+    if (::read(leader, buffer, sizeof(buffer)) <= 0) {
+      return;
+    }
+    for (int c = 0; c < CounterCount; c++) {
+      if (slot[c] >= 0 && (uint64_t)slot[c] < buffer[0]) {
+        values[c] = buffer[1 + slot[c]];
+      }
+    }
+#endif
+  }
+
+  static PerfGroup &forThisThread() {
+    thread_local PerfGroup group;
+    return group;
+  }
+
+private:
+  int leader = -1;
+  std::vector<int> members;
+  int slot[CounterCount] = {-1, -1, -1, -1}; // position in the group read
+  int opened = 0;
+};
+
+// Counter deltas that tasks run on other threads add to the operation that
+// started them, since each PerfGroup only sees its own thread.
+struct OpCounters {
+  std::atomic<uint64_t> values[CounterCount] = {};
+
+  void add(const uint64_t (&delta)[CounterCount]) {
+    for (int c = 0; c < CounterCount; c++) {
+      values[c].fetch_add(delta[c], std::memory_order_relaxed);
+    }
+  }
+
+  // Operation the calling thread is working for, or null.
+  static OpCounters *&current() {
+    thread_local OpCounters *op = nullptr;
+    return op;
+  }
+};
+
+// Charges the calling thread's counters to `op`, which may be null, until
+// it goes out of scope; parallelFor wraps every task in one. A thread that
+// already works for `op` (the one that started it, or an enclosing task)
+// is counted there, so it is not counted twice.
+class PerfHandoff {
+
+public:
+  explicit PerfHandoff(OpCounters *op)
+      : op(op), outer(OpCounters::current()), counting(op && op != outer) {
+    if (counting) {
+      PerfGroup::forThisThread().read(start);
+    }
+    OpCounters::current() = op;
+  }
+
+  ~PerfHandoff() {
+    OpCounters::current() = outer;
+    if (counting) {
+      uint64_t now[CounterCount];
+      PerfGroup::forThisThread().read(now);
+      for (int c = 0; c < CounterCount; c++) {
+        now[c] -= start[c];
+      }
+      op->add(now);
+    }
+  }
+
+  PerfHandoff(const PerfHandoff &) = delete;
+  PerfHandoff &operator=(const PerfHandoff &) = delete;
+
+private:
+  OpCounters *op;
+  OpCounters *outer;
+  bool counting;
+  uint64_t start[CounterCount];
+};
+
+class OpRegistry {
+
+public:
+  static OpRegistry &instance() {
+    static OpRegistry registry;
+    return registry;
+  }
+
+  void add(std::string_view name, const OpStats &delta) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = ops.find(name);
+    if (found == ops.end()) {
+      found = ops.emplace(std::string(name), OpStats()).first;
+    }
+    OpStats &s = found->second;
+    s.calls += delta.calls;
+    s.flops += delta.flops;
+    s.bytes += delta.bytes;
+    s.nanoseconds += delta.nanoseconds;
+    s.cycles += delta.cycles;
+    s.instructions += delta.instructions;
+    s.l1Misses += delta.l1Misses;
+    s.llcMisses += delta.llcMisses;
+  }
+
+  std::map<std::string, OpStats, std::less<>> snapshot() {
+    std::lock_guard<std::mutex> guard(lock);
+    return ops;
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    ops.clear();
+  }
+
+private:
+  std::mutex lock;
+  std::map<std::string, OpStats, std::less<>> ops;
+};
+
+// Measures one call of an operation from construction to destruction and
+// adds it to the registry. Nested operations are counted inclusively. The
+// hardware counters cover the calling thread plus the tasks parallelFor
+// runs for the operation on other threads.
+class OpScope {
+
+public:
+  OpScope(const char *name, double flops, double bytes, int = -1, int = -1,
+          int = -1)
+      : name(name), flops(flops), bytes(bytes),
+        start(std::chrono::steady_clock::now()),
+        outer(OpCounters::current()) {
+    OpCounters::current() = &workers;
+    PerfGroup::forThisThread().read(counters);
+  }
+
+  ~OpScope() {
+    uint64_t now[CounterCount];
+    PerfGroup::forThisThread().read(now);
+    OpCounters::current() = outer;
+    uint64_t other[CounterCount];
+    for (int c = 0; c < CounterCount; c++) {
+      other[c] = workers.values[c].load(std::memory_order_relaxed);
+      now[c] += other[c];
+    }
+    // The enclosing operation's own thread did not see this work either
+    if (outer) {
+      outer->add(other);
+    }
+    OpStats delta;
+    delta.calls = 1;
+    delta.flops = flops;
+    delta.bytes = bytes;
+    delta.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+    delta.cycles = now[Cycles] - counters[Cycles];
+    delta.instructions = now[Instructions] - counters[Instructions];
+    delta.l1Misses = now[L1Misses] - counters[L1Misses];
+    delta.llcMisses = now[LLCMisses] - counters[LLCMisses];
+    OpRegistry::instance().add(name, delta);
+  }
+
+  OpScope(const OpScope &) = delete;
+  OpScope &operator=(const OpScope &) = delete;
+
+private:
+  const char *name;
+  double flops;
+  double bytes;
+  std::chrono::steady_clock::time_point start;
+  uint64_t counters[CounterCount];
+  OpCounters workers;
+  OpCounters *outer;
+};
+
+} // namespace morpheus
+
+// MORPHEUS_OP(name, flops, bytes[, d0[, d1[, d2]]]) goes at the top of a
+// public operation; the optional dimensions describe its shape for traces.
+// Hardware counters are collected when MORPHEUS_PERF is defined, trace
+// events recorded when MORPHEUS_TRACE is and storage allocations attributed
+// to the operation when MORPHEUS_TRACK_ALLOCATIONS is; with none of them the
+// macro compiles to nothing and its arguments are not evaluated.
+#define MORPHEUS_CONCAT_(a, b) a##b
+#define MORPHEUS_CONCAT(a, b) MORPHEUS_CONCAT_(a, b)
+#ifdef MORPHEUS_PERF
+#define MORPHEUS_PERF_SCOPE(...)                                               \
+  morpheus::OpScope MORPHEUS_CONCAT(morpheusOp, __LINE__)(__VA_ARGS__)
+#else
+#define MORPHEUS_PERF_SCOPE(...) ((void)0)
+#endif
+#ifdef MORPHEUS_TRACE
+#define MORPHEUS_TRACE_SCOPE(...)                                              \
+  morpheus::TraceScope MORPHEUS_CONCAT(morpheusTrace, __LINE__)(__VA_ARGS__)
+#else
+#define MORPHEUS_TRACE_SCOPE(...) ((void)0)
+#endif
+#ifdef MORPHEUS_TRACK_ALLOCATIONS
+#define MORPHEUS_ALLOC_SCOPE(...)                                              \
+  morpheus::AllocationScope MORPHEUS_CONCAT(morpheusAlloc, __LINE__)(          \
+      __VA_ARGS__)
+#else
+#define MORPHEUS_ALLOC_SCOPE(...) ((void)0)
+#endif
+#define MORPHEUS_OP(...)                                                       \
+  MORPHEUS_PERF_SCOPE(__VA_ARGS__);                                            \
+  MORPHEUS_TRACE_SCOPE(__VA_ARGS__);                                           \
+  MORPHEUS_ALLOC_SCOPE(__VA_ARGS__)
+
+inline bool perfCountersAvailable() {
+  return morpheus::PerfGroup::forThisThread().available();
+}
+
+// Totals per operation name since the last perfReset().
+inline std::map<std::string, OpStats, std::less<>> perfReport() {
+  return morpheus::OpRegistry::instance().snapshot();
+}
+
+inline void perfReset() { morpheus::OpRegistry::instance().reset(); }
+
+// Writes the report as a JSON array of objects, one per operation, with the
+// raw totals plus derived GFLOP/s, IPC and misses per kilo-instruction.
+inline void writePerfJson(std::ostream &out) {
+  out << "[";
+  bool first = true;
+  for (const auto &[name, s] : perfReport()) {
+    double seconds = s.nanoseconds * 1e-9;
+    out << (first ? "\n" : ",\n") << "    {\"name\": \"" << name
+        << "\", \"calls\": " << s.calls << ", \"flops\": ";
+    morpheus::writeShortest(out, s.flops);
+    out << ", \"bytes\": ";
+    morpheus::writeShortest(out, s.bytes);
+    out << ", \"seconds\": ";
+    morpheus::writeShortest(out, seconds);
+    out << ", \"gflops\": ";
+    morpheus::writeShortest(out, seconds > 0 ? s.flops / seconds * 1e-9 : 0);
+    out << ", \"cycles\": " << s.cycles
+        << ", \"instructions\": " << s.instructions << ", \"ipc\": ";
+    morpheus::writeShortest(
+        out, s.cycles > 0 ? (double)s.instructions / s.cycles : 0);
+    out << ", \"l1_misses\": " << s.l1Misses
+        << ", \"llc_misses\": " << s.llcMisses << ", \"l1_mpki\": ";
+    morpheus::writeShortest(
+        out, s.instructions > 0 ? s.l1Misses * 1000.0 / s.instructions : 0);
+    out << "}";
+    first = false;
+  }
+  out << (first ? "]" : "\n  ]");
+}
@@ -0,0 +1,426 @@
+#pragma once
+
+#include "chain.h"
+#include "matrix.h"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace morpheus {
+
+struct LazyNode {
+  enum Kind { Leaf, Dot, Add, Subtract, Scale };
+
+  Kind kind = Leaf;
+  int rows = 0;
+  int cols = 0;
+  std::shared_ptr<LazyNode> left;
+  std::shared_ptr<LazyNode> right; // null for Scale
+  double scalar = 1;               // Scale only
+  const Matrix *value = nullptr;   // leaves, and nodes already evaluated
+  std::shared_ptr<const Matrix> owned; // keeps value alive when owned
+};
+
+// How one expression DAG is computed. Nodes are first merged by structure
+// (common-subexpression elimination), then every node whose value is needed
+// on its own (the root, the factors of products and nodes used twice or
+// more) becomes a step of one of two kinds:
+//  - a product chain, flattened through single-use products and multiplied
+//    in the cheapest ChainOrder, or
+//  - a linear combination sum(c_t * T_t) of the terms reached through
+//    single-use additions, subtractions and scalings, with equal terms
+//    merged. When a term is a single-use product chain, the rest of the
+//    sum runs as the epilogue of that product.
+// Equal terms are merged only when their coefficients are nonzero and of
+// one sign, and terms with a zero coefficient are kept, so Inf and NaN
+// elements give the same results as the eager operations (X - X is NaN
+// where X is infinite, not 0).
+// Steps run in dependency order and each intermediate's buffer goes back
+// to a BufferPool after its last reader, for later steps of the same shape.
+// The plan shares ownership of the matrices the expression owns, so it
+// can run after the expression is gone.
+class LazyPlan {
+
+public:
+  explicit LazyPlan(const std::shared_ptr<LazyNode> &root) {
+    std::map<const LazyNode *, int> seen;
+    int top = intern(root.get(), seen);
+    uses.assign(nodes.size(), 0);
+    std::vector<bool> reachable(nodes.size(), false);
+    reachable[top] = true;
+    for (int id = top; id >= 0; id--) {
+      if (!reachable[id]) {
+        continue;
+      }
+      for (int child : {nodes[id].a, nodes[id].b}) {
+        if (child >= 0) {
+          uses[child]++;
+          reachable[child] = true;
+        }
+      }
+    }
+    std::vector<int> slotOf(nodes.size(), -1);
+    result = slot(top, slotOf);
+  }
+
+  // Steps and matrix products the plan runs, and the multiply-adds of those
+  // products.
+  size_t steps() const { return plan.size(); }
+  size_t products() const {
+    size_t n = 0;
+    for (const Step &s : plan) {
+      n += s.factors.empty() ? 0 : s.factors.size() - 1;
+    }
+    return n;
+  }
+  double multiplyAdds() const {
+    double total = 0;
+    for (const Step &s : plan) {
+      if (!s.factors.empty()) {
+        total += ChainOrder(chainDims(s)).cost();
+      }
+    }
+    return total;
+  }
+
+  Matrix run() {
+    MORPHEUS_OP("LazyMatrix::eval", 2.0 * multiplyAdds(), 0,
+                slots[result].rows, slots[result].cols);
+    if (slots[result].external) {
+      return *slots[result].external;
+    }
+    BufferPool pool;
+    for (const Step &s : plan) {
+      slots[s.output].buffer = execute(s, pool);
+      for (int input : inputs(s)) {
+        Slot &in = slots[input];
+        if (--in.readers == 0 && !in.external) {
+          pool.give(std::move(in.buffer));
+        }
+      }
+    }
+    return std::move(slots[result].buffer);
+  }
+
+private:
+  struct Canonical {
+    LazyNode::Kind kind;
+    int rows;
+    int cols;
+    int a;
+    int b;
+    double scalar;
+    const Matrix *value;
+  };
+
+  // A value: a matrix that already exists, or the buffer of a step.
+  struct Slot {
+    int rows;
+    int cols;
+    const Matrix *external;
+    Matrix buffer{{}, std::make_tuple(0, 0)};
+    int readers = 0;
+  };
+
+  struct Step {
+    int output;
+    std::vector<int> factors;                  // product chain, may be empty
+    double productCoefficient = 1;
+    std::vector<std::pair<int, double>> terms; // added to the product
+  };
+
+  int intern(const LazyNode *node, std::map<const LazyNode *, int> &seen) {
+    auto found = seen.find(node);
+    if (found != seen.end()) {
+      return found->second;
+    }
+    Canonical c{node->kind, node->rows, node->cols, -1, -1, 0, node->value};
+    if (node->value) {
+      c.kind = LazyNode::Leaf;
+      if (node->owned) {
+        owned.push_back(node->owned);
+      }
+    } else {
+      c.a = intern(node->left.get(), seen);
+      c.b = node->right ? intern(node->right.get(), seen) : -1;
+      if (c.kind == LazyNode::Add && c.b < c.a) {
+        std::swap(c.a, c.b);
+      }
+      c.scalar = c.kind == LazyNode::Scale ? node->scalar : 0;
+    }
+    uint64_t scalarBits;
+    std::memcpy(&scalarBits, &c.scalar, sizeof(scalarBits));
+    auto key = std::make_tuple((int)c.kind, c.a, c.b, scalarBits, c.value);
+    auto existing = interned.find(key);
+    int id;
+    if (existing != interned.end()) {
+      id = existing->second;
+    } else {
+      id = (int)nodes.size();
+      nodes.push_back(c);
+      interned.emplace(key, id);
+    }
+    seen.emplace(node, id);
+    return id;
+  }
+
+  bool elementwise(int id) const {
+    LazyNode::Kind k = nodes[id].kind;
+    return k == LazyNode::Add || k == LazyNode::Subtract ||
+           k == LazyNode::Scale;
+  }
+
+  // Slot holding the value of node id, adding the steps that compute it.
+  int slot(int id, std::vector<int> &slotOf) {
+    if (slotOf[id] >= 0) {
+      return slotOf[id];
+    }
+    const Canonical &c = nodes[id];
+    Step s;
+    if (c.kind == LazyNode::Dot) {
+      flatten(id, id, s.factors, slotOf);
+    } else if (c.kind != LazyNode::Leaf) {
+      std::vector<std::pair<int, double>> linear;
+      expand(id, id, 1.0, linear);
+      bool fused = false;
+      for (auto &[term, coefficient] : linear) {
+        if (!fused && nodes[term].kind == LazyNode::Dot && uses[term] == 1 &&
+            occurrences(linear, term) == 1) {
+          flatten(term, term, s.factors, slotOf);
+          s.productCoefficient = coefficient;
+          fused = true;
+        } else {
+          s.terms.emplace_back(slot(term, slotOf), coefficient);
+        }
+      }
+    }
+    slotOf[id] = (int)slots.size();
+    slots.push_back(Slot{c.rows, c.cols,
+                         c.kind == LazyNode::Leaf ? c.value : nullptr});
+    if (c.kind != LazyNode::Leaf) {
+      s.output = slotOf[id];
+      for (int input : inputs(s)) {
+        slots[input].readers++;
+      }
+      plan.push_back(std::move(s));
+    }
+    return slotOf[id];
+  }
+
+  // Factors of the product chain rooted at id, looking through products
+  // that nothing else uses.
+  void flatten(int id, int top, std::vector<int> &factors,
+               std::vector<int> &slotOf) {
+    if (nodes[id].kind == LazyNode::Dot && (id == top || uses[id] == 1)) {
+      flatten(nodes[id].a, top, factors, slotOf);
+      flatten(nodes[id].b, top, factors, slotOf);
+    } else {
+      factors.push_back(slot(id, slotOf));
+    }
+  }
+
+  // Terms of the linear combination rooted at id, merging repeated terms
+  // of the same sign.
+  void expand(int id, int top, double coefficient,
+              std::vector<std::pair<int, double>> &linear) {
+    const Canonical &c = nodes[id];
+    if (elementwise(id) && (id == top || uses[id] == 1)) {
+      if (c.kind == LazyNode::Scale) {
+        expand(c.a, top, coefficient * c.scalar, linear);
+      } else {
+        expand(c.a, top, coefficient, linear);
+        expand(c.b, top,
+               c.kind == LazyNode::Subtract ? -coefficient : coefficient,
+               linear);
+      }
+      return;
+    }
+    for (auto &entry : linear) {
+      if (entry.first == id && ((entry.second > 0 && coefficient > 0) ||
+                                (entry.second < 0 && coefficient < 0))) {
+        entry.second += coefficient;
+        return;
+      }
+    }
+    linear.emplace_back(id, coefficient);
+  }
+
+  static int occurrences(const std::vector<std::pair<int, double>> &linear,
+                         int id) {
+    int n = 0;
+    for (const auto &entry : linear) {
+      n += entry.first == id;
+    }
+    return n;
+  }
+
+  static std::vector<int> inputs(const Step &s) {
+    std::vector<int> all = s.factors;
+    for (const auto &term : s.terms) {
+      all.push_back(term.first);
+    }
+    return all;
+  }
+
+  std::vector<int> chainDims(const Step &s) const {
+    std::vector<int> dims{slots[s.factors[0]].rows};
+    for (int f : s.factors) {
+      dims.push_back(slots[f].cols);
+    }
+    return dims;
+  }
+
+  const Matrix &valueOf(int id) const {
+    return slots[id].external ? *slots[id].external : slots[id].buffer;
+  }
+
+  Matrix execute(const Step &s, BufferPool &pool) const {
+    int cols = slots[s.output].cols;
+    auto addTerms = [&](int i, double *row, bool overwrite) {
+      if (overwrite) {
+        std::fill(row, row + cols, 0.0);
+      } else if (s.productCoefficient != 1) {
+        for (int j = 0; j < cols; j++) {
+          row[j] *= s.productCoefficient;
+        }
+      }
+      for (size_t t = 0; t < s.terms.size(); t++) {
+        const double *in = valueOf(s.terms[t].first).matrix[i].data();
+        double coefficient = s.terms[t].second;
+        for (int j = 0; j < cols; j++) {
+          row[j] += coefficient * in[j];
+        }
+      }
+    };
+    if (s.factors.empty()) {
+      Matrix out = pool.take(slots[s.output].rows, cols);
+      for (int i = 0; i < (int)out.rowsize; i++) {
+        addTerms(i, out.matrix[i].data(), true);
+      }
+      return out;
+    }
+    std::vector<const Matrix *> factors;
+    for (int f : s.factors) {
+      factors.push_back(&valueOf(f));
+    }
+    return chainProduct(factors, ChainOrder(chainDims(s)), 0,
+                        (int)factors.size() - 1, pool,
+                        [&](int i, double *row) { addTerms(i, row, false); });
+  }
+
+  std::vector<Canonical> nodes;
+  std::vector<std::shared_ptr<const Matrix>> owned;
+  std::map<std::tuple<int, int, int, uint64_t, const Matrix *>, int> interned;
+  std::vector<int> uses;
+  std::vector<Slot> slots;
+  std::vector<Step> plan;
+  int result;
+};
+
+} // namespace morpheus
+
+// Deferred matrix expression. The static operations mirror Matrix's but
+// only record a node in a DAG; nothing is computed until eval(), which
+// optimizes the whole DAG (see LazyPlan) and runs it once. Leaves built
+// from an lvalue Matrix refer to it, so it must outlive the evaluation;
+// leaves built from an rvalue own their matrix.
+class LazyMatrix {
+
+public:
+  LazyMatrix(const Matrix &m) : node(std::make_shared<morpheus::LazyNode>()) {
+    node->rows = m.rowsize;
+    node->cols = m.columnsize;
+    node->value = &m;
+  }
+
+  LazyMatrix(Matrix &&m) : node(std::make_shared<morpheus::LazyNode>()) {
+    node->rows = m.rowsize;
+    node->cols = m.columnsize;
+    node->owned = std::make_shared<const Matrix>(std::move(m));
+    node->value = node->owned.get();
+  }
+
+  int rows() const { return node->rows; }
+  int cols() const { return node->cols; }
+
+  static LazyMatrix dot(const LazyMatrix &m1, const LazyMatrix &m2) {
+    if (m1.cols() != m2.rows()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
+          std::to_string(m1.cols()) + " and Matrix of rowsize of " +
+          std::to_string(m2.rows()));
+    }
+    return LazyMatrix(morpheus::LazyNode::Dot, m1.rows(), m2.cols(), m1.node,
+                      m2.node);
+  }
+
+  static LazyMatrix AddMatrix(const LazyMatrix &Mat1, const LazyMatrix &Mat2) {
+    if (Mat1.rows() != Mat2.rows() || Mat1.cols() != Mat2.cols()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix addition operation "
+          "should have = dimensions");
+    }
+    return LazyMatrix(morpheus::LazyNode::Add, Mat1.rows(), Mat1.cols(),
+                      Mat1.node, Mat2.node);
+  }
+
+  static LazyMatrix SubtractMatix(const LazyMatrix &Mat1,
+                                  const LazyMatrix &Mat2) {
+    if (Mat1.rows() != Mat2.rows() || Mat1.cols() != Mat2.cols()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix addition operation "
+          "should have = dimensions");
+    }
+    return LazyMatrix(morpheus::LazyNode::Subtract, Mat1.rows(), Mat1.cols(),
+                      Mat1.node, Mat2.node);
+  }
+
+  static LazyMatrix Constmultiplication(const LazyMatrix &TargetedMat,
+                                        double k) {
+    LazyMatrix Result(morpheus::LazyNode::Scale, TargetedMat.rows(),
+                      TargetedMat.cols(), TargetedMat.node, nullptr);
+    Result.node->scalar = k;
+    return Result;
+  }
+
+  // Computes the expression on first use; later calls, and expressions
+  // built on this one, reuse the value. Matrices the leaves refer to are
+  // read at the first eval().
+  const Matrix &eval() const {
+    if (!node->value) {
+      morpheus::LazyPlan plan(node);
+      node->owned = std::make_shared<const Matrix>(plan.run());
+      node->value = node->owned.get();
+      node->left.reset();
+      node->right.reset();
+    }
+    return *node->value;
+  }
+
+  bool evaluated() const { return node->value != nullptr; }
+
+  // The plan eval() would run, for inspection. It may outlive this
+  // expression, but not the lvalue matrices its leaves refer to.
+  morpheus::LazyPlan plan() const { return morpheus::LazyPlan(node); }
+
+private:
+  LazyMatrix(morpheus::LazyNode::Kind kind, int rows, int cols,
+             std::shared_ptr<morpheus::LazyNode> left,
+             std::shared_ptr<morpheus::LazyNode> right)
+      : node(std::make_shared<morpheus::LazyNode>()) {
+    node->kind = kind;
+    node->rows = rows;
+    node->cols = cols;
+    node->left = std::move(left);
+    node->right = std::move(right);
+  }
+
+  std::shared_ptr<morpheus::LazyNode> node;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "matrix.h"
+#include "parallel.h"
+
+#include <stdexcept>
+#include <string>
+
+// Anything that can compute y = A x. Iterative solvers only talk to this
+// interface, so the same code runs on dense and sparse matrices.
+class LinearOperator {
+
+public:
+  virtual ~LinearOperator() = default;
+
+  virtual int rows() const = 0;
+  virtual int cols() const = 0;
+
+  // y must already have rows() entries; it is overwritten.
+  virtual void apply(const vec &x, vec &y) const = 0;
+
+  vec apply(const vec &x) const {
+    checkInput(x);
+    vec y(rows());
+    apply(x, y);
+    return y;
+  }
+
+protected:
+  void checkInput(const vec &x) const {
+    if ((int)x.size() != cols()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Operator of columnsize " +
+          std::to_string(cols()) + " and vector of size " +
+          std::to_string(x.size()));
+    }
+  }
+};
+
+// Dense Matrix seen as a LinearOperator. Holds a reference, so the Matrix
+// must outlive the operator.
+class MatrixOperator : public LinearOperator {
+
+public:
+  const Matrix &A;
+
+  MatrixOperator(const Matrix &A) : A(A) {}
+
+  int rows() const override { return A.rowsize; }
+  int cols() const override { return A.columnsize; }
+
+  void apply(const vec &x, vec &y) const override {
+    MORPHEUS_OP("MatrixOperator::apply", 2.0 * A.rowsize * A.columnsize,
+                8.0 * (A.rowsize * A.columnsize + A.rowsize + A.columnsize),
+                A.rowsize, A.columnsize);
+    checkInput(x);
+    y.resize(rows());
+    int n = cols();
+    morpheus::parallelFor(rows(), morpheus::rowGrain(n),
+                          [&](size_t, size_t begin, size_t end) {
+                            for (size_t i = begin; i < end; i++) {
+                              const double *row = A.matrix[i].data();
+                              double sum{};
+                              for (int j = 0; j < n; j++) {
+                                sum += row[j] * x[j];
+                              }
+                              y[i] = sum;
+                            }
+                          });
+  }
+  using LinearOperator::apply;
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MORPHEUS_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum class MapMode { ReadOnly, ReadWrite };
+
+// View of a file or of a window into one. On POSIX systems the file is
+// mmap'ed, so opening it costs nothing up front and pages are read on first
+// touch; elsewhere it falls back to reading the bytes into memory.
+// ReadWrite windows are shared with the file: stores reach it at the latest
+// when the mapping is destroyed.
+class MappedFile {
+
+public:
+  MappedFile() = default;
+
+  explicit MappedFile(const std::string &path) { open(path, 0, 0, true, false); }
+
+  // Maps `length` bytes starting at `offset`, which need not be page
+  // aligned.
+  MappedFile(const std::string &path, size_t offset, size_t length,
+             MapMode mode = MapMode::ReadOnly) {
+    open(path, offset, length, false, mode == MapMode::ReadWrite);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&other) noexcept { swap(other); }
+  MappedFile &operator=(MappedFile &&other) noexcept {
+    MappedFile(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  ~MappedFile() {
+#ifdef MORPHEUS_HAS_MMAP
+    if (base) {
+      ::munmap(base, mappedLength);
+    }
+#else
+    if (writable && !path.empty()) {
+      std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+      out.seekp(offset);
+      out.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+    }
+#endif
+  }
+
+  const unsigned char *data() const { return bytes; }
+  // Only meaningful for ReadWrite windows.
+  unsigned char *writableData() { return bytes; }
+  size_t size() const { return length; }
+  bool mapped() const {
+#ifdef MORPHEUS_HAS_MMAP
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void swap(MappedFile &other) noexcept {
+    std::swap(bytes, other.bytes);
+    std::swap(length, other.length);
+    std::swap(base, other.base);
+    std::swap(mappedLength, other.mappedLength);
+    std::swap(writable, other.writable);
+    std::swap(offset, other.offset);
+    path.swap(other.path);
+    buffer.swap(other.buffer);
+  }
+
+private:
+  void open(const std::string &path, size_t offset, size_t length,
+            bool wholeFile, bool writable) {
+#ifdef MORPHEUS_HAS_MMAP
+    int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("CANNOT OPEN FILE! " + path + ": " +
+                               std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      int err = errno;
+      ::close(fd);
+      throw std::runtime_error("CANNOT OPEN FILE! " + path + ": " +
+                               std::strerror(err));
+    }
+    if (wholeFile) {
+      length = st.st_size;
+    } else if (offset + length > (size_t)st.st_size) {
+      ::close(fd);
+      throw std::runtime_error("CANNOT MAP FILE! " + path +
+                               ": window is past the end of the file");
+    }
+    if (length > 0) {
+      // mmap offsets must be page aligned; map from the enclosing page.
+      size_t page = ::sysconf(_SC_PAGESIZE);
+      size_t skip = offset % page;
+      int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+      void *p = ::mmap(nullptr, length + skip, protection, MAP_SHARED, fd,
+                       offset - skip);
+      if (p == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        throw std::runtime_error("CANNOT MAP FILE! " + path + ": " +
+                                 std::strerror(err));
+      }
+      base = p;
+      mappedLength = length + skip;
+      bytes = static_cast<unsigned char *>(p) + skip;
+    }
+    ::close(fd);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+      throw std::runtime_error("CANNOT OPEN FILE! " + path);
+    }
+    size_t fileSize = in.tellg();
+    if (wholeFile) {
+      length = fileSize;
+    } else if (offset + length > fileSize) {
+      throw std::runtime_error("CANNOT MAP FILE! " + path +
+                               ": window is past the end of the file");
+    }
+    buffer.resize(length);
+    in.seekg(offset);
+    in.read(reinterpret_cast<char *>(buffer.data()), length);
+    bytes = buffer.data();
+    if (writable) {
+      this->path = path;
+    }
+#endif
+    this->length = length;
+    this->offset = offset;
+    this->writable = writable;
+  }
+
+  unsigned char *bytes = nullptr;
+  size_t length = 0;
+  void *base = nullptr; // start of the mapping, page aligned
+  size_t mappedLength = 0;
+  bool writable = false;
+  size_t offset = 0;
+  std::string path;                  // write-back target without mmap
+  std::vector<unsigned char> buffer; // only used without mmap
+};
@@ -0,0 +1,308 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace morpheus {
+
+inline void checkSquare(const Matrix &A, const std::string &operation) {
+  if (A.rowsize != A.columnsize) {
+    throw std::invalid_argument(
+        "INVALID OPERATION! " + operation + " needs a square Matrix, got " +
+        std::to_string((int)A.rowsize) + "x" +
+        std::to_string((int)A.columnsize));
+  }
+}
+
+inline double norm1(const Matrix &A) {
+  vec columnSums(A.columnsize, 0.0);
+  for (int i = 0; i < A.rowsize; i++) {
+    for (int j = 0; j < A.columnsize; j++) {
+      columnSums[j] += std::abs(A.matrix[i][j]);
+    }
+  }
+  double best = 0;
+  for (double s : columnSums) {
+    best = std::max(best, s);
+  }
+  return best;
+}
+
+// out = sum of coefficients[i] * terms[i]; every term has out's shape.
+inline void linearCombination(const std::vector<double> &coefficients,
+                              const std::vector<const Matrix *> &terms,
+                              Matrix &out) {
+  int rows = out.rowsize;
+  int cols = out.columnsize;
+  for (int i = 0; i < rows; i++) {
+    double *o = out.matrix[i].data();
+    std::fill(o, o + cols, 0.0);
+    for (size_t t = 0; t < terms.size(); t++) {
+      double c = coefficients[t];
+      if (c == 0) {
+        continue;
+      }
+      const double *in = terms[t]->matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        o[j] += c * in[j];
+      }
+    }
+  }
+}
+
+// Solves A X = B with Gaussian elimination and partial pivoting. A and B are
+// taken by value because both are overwritten; X is returned in B.
+inline Matrix solveDense(Matrix A, Matrix B) {
+  int n = A.rowsize;
+  int cols = B.columnsize;
+  for (int k = 0; k < n; k++) {
+    int p = k;
+    for (int i = k + 1; i < n; i++) {
+      if (std::abs(A.matrix[i][k]) > std::abs(A.matrix[p][k])) {
+        p = i;
+      }
+    }
+    if (A.matrix[p][k] == 0) {
+      throw std::invalid_argument("SINGULAR MATRIX! Zero pivot in column " +
+                                  std::to_string(k));
+    }
+    std::swap(A.matrix[k], A.matrix[p]);
+    std::swap(B.matrix[k], B.matrix[p]);
+
+    const double *pivotRow = A.matrix[k].data();
+    const double *pivotB = B.matrix[k].data();
+    for (int i = k + 1; i < n; i++) {
+      double *row = A.matrix[i].data();
+      double l = row[k] / pivotRow[k];
+      if (l == 0) {
+        continue;
+      }
+      for (int j = k + 1; j < n; j++) {
+        row[j] -= l * pivotRow[j];
+      }
+      double *b = B.matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        b[j] -= l * pivotB[j];
+      }
+    }
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    double *b = B.matrix[i].data();
+    const double *row = A.matrix[i].data();
+    for (int k = i + 1; k < n; k++) {
+      const double *x = B.matrix[k].data();
+      for (int j = 0; j < cols; j++) {
+        b[j] -= row[k] * x[j];
+      }
+    }
+    for (int j = 0; j < cols; j++) {
+      b[j] /= row[i];
+    }
+  }
+  return B;
+}
+
+} // namespace morpheus
+
+// A^k for k >= 0 by repeated squaring: about 2 log2(k) products instead of
+// k - 1. The three working buffers are reused for every product.
+inline Matrix pow(const Matrix &A, int k) {
+  MORPHEUS_OP("pow", 0, 0, A.rowsize, A.columnsize);
+  morpheus::checkSquare(A, "Matrix power");
+  if (k < 0) {
+    throw std::invalid_argument("INVALID OPERATION! Matrix power " +
+                                std::to_string(k) + " is negative");
+  }
+  if (k == 0) {
+    return Matrix::identity(A.rowsize);
+  }
+
+  Matrix base = A;
+  Matrix Result;
+  Matrix scratch;
+  bool started = false;
+  while (true) {
+    if (k & 1) {
+      if (started) {
+        Matrix::dotInto(Result, base, scratch);
+        std::swap(Result, scratch);
+      } else {
+        Result = base;
+        started = true;
+      }
+    }
+    k >>= 1;
+    if (k == 0) {
+      break;
+    }
+    Matrix::dotInto(base, base, scratch);
+    std::swap(base, scratch);
+  }
+  return Result;
+}
+
+// p(A) = coefficients[0] I + coefficients[1] A + ... + coefficients[d] A^d
+// with the Paterson-Stockmeyer scheme: with s ~ sqrt(d), the powers
+// A^2 .. A^s are formed once and p is evaluated as a polynomial in A^s whose
+// coefficients are degree < s polynomials in A. That takes about 2 sqrt(d)
+// full products instead of d for Horner's rule.
+inline Matrix polyval(const vec &coefficients, const Matrix &A) {
+  MORPHEUS_OP("polyval", 0, 0, A.rowsize, A.columnsize);
+  morpheus::checkSquare(A, "Matrix polynomial");
+  int n = A.rowsize;
+  if (coefficients.empty()) {
+    return Matrix({}, std::make_tuple(n, n));
+  }
+
+  int degree = coefficients.size() - 1;
+  int s = std::max(1, (int)std::lround(std::sqrt((double)degree + 1)));
+  s = std::min(s, std::max(1, degree));
+
+  // powers[i] = A^i for i = 0 .. s
+  std::vector<Matrix> powers;
+  powers.reserve(s + 1);
+  powers.push_back(Matrix::identity(n));
+  powers.push_back(A);
+  for (int i = 2; i <= s; i++) {
+    powers.emplace_back();
+    Matrix::dotInto(powers[i - 1], A, powers[i]);
+  }
+
+  // Block j is sum_{i < s} coefficients[j * s + i] A^i.
+  int blocks = degree / s;
+  Matrix block({}, std::make_tuple(n, n));
+  auto formBlock = [&](int j, Matrix &out) {
+    std::vector<double> c;
+    std::vector<const Matrix *> terms;
+    int count = j == blocks ? degree - j * s + 1 : s;
+    for (int i = 0; i < count; i++) {
+      c.push_back(coefficients[j * s + i]);
+      terms.push_back(&powers[i]);
+    }
+    morpheus::linearCombination(c, terms, out);
+  };
+
+  Matrix Result({}, std::make_tuple(n, n));
+  Matrix scratch;
+  formBlock(blocks, Result);
+  for (int j = blocks - 1; j >= 0; j--) {
+    Matrix::dotInto(Result, powers[s], scratch);
+    formBlock(j, block);
+    for (int i = 0; i < n; i++) {
+      double *out = scratch.matrix[i].data();
+      const double *in = block.matrix[i].data();
+      for (int c = 0; c < n; c++) {
+        out[c] += in[c];
+      }
+    }
+    std::swap(Result, scratch);
+  }
+  return Result;
+}
+
+// Matrix exponential by scaling and squaring with a diagonal Pade
+// approximant (Higham, "The scaling and squaring method for the matrix
+// exponential revisited", 2005). The Pade degree is the lowest of 3, 5, 7, 9
+// and 13 whose error bound holds for ||A||_1; beyond that A is scaled by 2^-s
+// and the [13/13] result squared s times.
+inline Matrix expm(const Matrix &A) {
+  MORPHEUS_OP("expm", 0, 0, A.rowsize, A.columnsize);
+  morpheus::checkSquare(A, "Matrix exponential");
+  int n = A.rowsize;
+  if (n == 0) {
+    return Matrix({}, std::make_tuple(0, 0));
+  }
+
+  static const double theta[] = {1.495585217958292e-2, 2.539398330063230e-1,
+                                 9.504178996162932e-1, 2.097847961257068e0,
+                                 5.371920351148152e0};
+  static const std::vector<std::vector<double>> pade = {
+      {120, 60, 12, 1},
+      {30240, 15120, 3360, 420, 30, 1},
+      {17297280, 8648640, 1995840, 277200, 25200, 1512, 56, 1},
+      {17643225600, 8821612800, 2075673600, 302702400, 30270240, 2162160,
+       110880, 3960, 90, 1},
+      {64764752532480000, 32382376266240000, 7771770303897600,
+       1187353796428800, 129060195264000, 10559470521600, 670442572800,
+       33522128640, 1323241920, 40840800, 960960, 16380, 182, 1}};
+
+  double norm = morpheus::norm1(A);
+  Matrix I = Matrix::identity(n);
+  Matrix U;
+  Matrix V({}, std::make_tuple(n, n));
+  Matrix scratch({}, std::make_tuple(n, n));
+  int squarings = 0;
+
+  int choice = 0;
+  while (choice < 4 && norm > theta[choice]) {
+    choice++;
+  }
+
+  if (choice < 4) {
+    const std::vector<double> &b = pade[choice];
+    int m = b.size() - 1;
+    // Even powers I, A^2, A^4, ... up to A^(m - 1)
+    std::vector<Matrix> even;
+    even.push_back(I);
+    Matrix A2;
+    Matrix::dotInto(A, A, A2);
+    even.push_back(A2);
+    while ((int)even.size() * 2 <= m) {
+      even.emplace_back();
+      Matrix::dotInto(even[even.size() - 2], A2, even.back());
+    }
+    std::vector<double> odd;
+    std::vector<double> evenC;
+    std::vector<const Matrix *> terms;
+    for (size_t i = 0; i < even.size(); i++) {
+      odd.push_back(b[2 * i + 1]);
+      evenC.push_back(b[2 * i]);
+      terms.push_back(&even[i]);
+    }
+    morpheus::linearCombination(odd, terms, scratch);
+    Matrix::dotInto(A, scratch, U);
+    morpheus::linearCombination(evenC, terms, V);
+  } else {
+    const std::vector<double> &b = pade[4];
+    squarings = std::max(0, (int)std::ceil(std::log2(norm / theta[4])));
+    Matrix As = A;
+    double scale = std::ldexp(1.0, -squarings);
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < n; j++) {
+        As.matrix[i][j] = A.matrix[i][j] * scale;
+      }
+    }
+    Matrix A2, A4, A6;
+    Matrix::dotInto(As, As, A2);
+    Matrix::dotInto(A2, A2, A4);
+    Matrix::dotInto(A4, A2, A6);
+
+    Matrix inner({}, std::make_tuple(n, n));
+    morpheus::linearCombination({b[13], b[11], b[9]}, {&A6, &A4, &A2}, inner);
+    Matrix::dotInto(A6, inner, scratch);
+    morpheus::linearCombination({1, b[7], b[5], b[3], b[1]},
+                                {&scratch, &A6, &A4, &A2, &I}, inner);
+    Matrix::dotInto(As, inner, U);
+
+    morpheus::linearCombination({b[12], b[10], b[8]}, {&A6, &A4, &A2}, inner);
+    Matrix::dotInto(A6, inner, scratch);
+    morpheus::linearCombination({1, b[6], b[4], b[2], b[0]},
+                                {&scratch, &A6, &A4, &A2, &I}, V);
+  }
+
+  // exp(A) ~ (V - U)^-1 (V + U)
+  Matrix P = Matrix::AddMatrix(V, U);
+  Matrix Q = Matrix::SubtractMatix(V, U);
+  Matrix Result = morpheus::solveDense(std::move(Q), std::move(P));
+  for (int i = 0; i < squarings; i++) {
+    Matrix::dotInto(Result, Result, scratch);
+    std::swap(Result, scratch);
+  }
+  return Result;
+}
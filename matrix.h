@@ -1,21 +1,60 @@
 #pragma once
 
+#include "alloc.h"
+#include "format.h"
+#include "instrument.h"
+#include "parallel.h"
+#include "summation.h"
+
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
 using Dim = std::tuple<int, int>;
-using Mat = std::vector<std::vector<double>>;
-using vec = std::vector<double>;
-
-template <typename T> void printContainer(const std::vector<T> &vec) {
-  std::cout << "--------------\n";
-  for (T item : vec) {
-    std::cout << item << "\n";
+using vec = std::vector<double, morpheus::StorageAllocator<double>>;
+using Mat = std::vector<vec, morpheus::StorageAllocator<vec>>;
+
+// Characters, bools and streams with flags set (std::fixed, std::hex, ...)
+// go through operator<<; everything else through the faster BlockWriter,
+// with the same result.
+// Takes any allocator, so both vec and plain std::vector work whatever the
+// tracking flags are.
+template <typename T, typename Allocator>
+void printContainer(const std::vector<T, Allocator> &vec,
+                    std::ostream &out = std::cout) {
+  if constexpr (std::is_floating_point_v<T> ||
+                (std::is_integral_v<T> && sizeof(T) > 1)) {
+    if (!morpheus::plainNumberFormat(out)) {
+      out << "--------------\n";
+      for (const T &item : vec) {
+        out << item << "\n";
+      }
+      out << "--------------\n";
+      return;
+    }
+    morpheus::BlockWriter writer(morpheus::streamSink(out));
+    writer.put("--------------\n", 15);
+    for (T item : vec) {
+      if constexpr (std::is_floating_point_v<T>) {
+        writer.number(item, out.precision() < 0 ? 6 : (int)out.precision());
+      } else {
+        writer.integer(item);
+      }
+      writer.put("\n", 1);
+    }
+    writer.put("--------------\n", 15);
+    writer.flush();
+  } else {
+    out << "--------------\n";
+    for (const T &item : vec) {
+      out << item << "\n";
+    }
+    out << "--------------\n";
   }
-  std::cout << "--------------\n";
 }
 
 class Matrix {
@@ -27,22 +66,24 @@ public:
   double columnsize = 0;
 
   Matrix(Mat mat = {}, Dim Dimension = std::make_tuple(2, 2)) {
-    this->matrix = mat;
+    this->matrix = std::move(mat);
     this->Dimension = Dimension;
     this->rowsize = std::get<0>(Dimension);
     this->columnsize = std::get<1>(Dimension);
-    if (mat.size() == 0) {
-      for (int i = 0; i < rowsize; i++) {
-        matrix.push_back({});
-
-        for (int j = 0; j < columnsize; j++) {
-          matrix[i].push_back(0);
-        }
+    if (matrix.size() == 0) {
+      // One allocation per row plus one for the row list.
+      matrix.resize(std::get<0>(Dimension));
+      for (vec &row : matrix) {
+        row.assign(std::get<1>(Dimension), 0.0);
       }
     }
   }
 
-  static Matrix dot(Matrix m1, Matrix m2) {
+  static Matrix dot(const Matrix &m1, const Matrix &m2) {
+    MORPHEUS_OP("Matrix::dot", 2.0 * m1.rowsize * m2.columnsize * m1.columnsize,
+                8.0 * (m1.rowsize * m1.columnsize + m2.rowsize * m2.columnsize +
+                       m1.rowsize * m2.columnsize),
+                m1.rowsize, m2.columnsize, m1.columnsize);
     if (m1.columnsize != m2.rowsize) { // m1.col != m2.rowj
       throw std::invalid_argument(
           "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
@@ -51,22 +92,102 @@ public:
     }
 
     Matrix matrixProduct({}, std::make_tuple(m1.rowsize, m2.columnsize));
+    multiply(m1, m2, matrixProduct, [](int, double *) {});
+    return matrixProduct;
+  }
 
-    for (int i = 0; i < m1.rowsize; i++) {
-      vec m1_row = m1.getRow(i);
-      for (int j = 0; j < m2.columnsize; j++) {
-        vec m2_col = m2.getCol(j);
+  // Same product as dot, written into an existing Matrix so loops that
+  // multiply repeatedly can reuse their buffers. out is resized if needed and
+  // must not be m1 or m2.
+  static void dotInto(const Matrix &m1, const Matrix &m2, Matrix &out) {
+    dotInto(m1, m2, out, [](int, double *) {});
+  }
 
-        double sum{};
-        for (unsigned int k = 0; k < m2_col.size(); k++) {
+  // dotInto that calls epilogue(i, row) on each row of the product as soon
+  // as it is complete, while it is still in cache, so element-wise work on
+  // the result does not need a second pass over it.
+  template <typename Epilogue>
+  static void dotInto(const Matrix &m1, const Matrix &m2, Matrix &out,
+                      Epilogue &&epilogue) {
+    MORPHEUS_OP("Matrix::dotInto",
+                2.0 * m1.rowsize * m2.columnsize * m1.columnsize,
+                8.0 * (m1.rowsize * m1.columnsize + m2.rowsize * m2.columnsize +
+                       m1.rowsize * m2.columnsize),
+                m1.rowsize, m2.columnsize, m1.columnsize);
+    prepareProduct(m1, m2, out);
+    multiply(m1, m2, out, epilogue);
+  }
 
-          sum += (m1_row[k] * m2_col[k]);
+  // dot with every element's inner sum accumulated in `mode` (see
+  // Summation). Summation::Naive is plain dot.
+  static Matrix dot(const Matrix &m1, const Matrix &m2, Summation mode) {
+    if (mode == Summation::Naive) {
+      return dot(m1, m2);
+    }
+    Matrix out({}, std::make_tuple(0, 0));
+    dotInto(m1, m2, out, mode);
+    return out;
+  }
+
+  static void dotInto(const Matrix &m1, const Matrix &m2, Matrix &out,
+                      Summation mode) {
+    if (mode == Summation::Naive) {
+      dotInto(m1, m2, out);
+      return;
+    }
+    MORPHEUS_OP("Matrix::dotInto",
+                2.0 * m1.rowsize * m2.columnsize * m1.columnsize,
+                8.0 * (m1.rowsize * m1.columnsize + m2.rowsize * m2.columnsize +
+                       m1.rowsize * m2.columnsize),
+                m1.rowsize, m2.columnsize, m1.columnsize);
+    prepareProduct(m1, m2, out);
+
+    // Row i of out is the sum over k of m1[i][k] * row k of m2, so the
+    // same row-wise kernel as multiply applies, summed in `mode`.
+    int inner = m1.columnsize;
+    int cols = m2.columnsize;
+    vec scratch((size_t)morpheus::rowsScratch(mode, inner) * cols);
+    for (int i = 0; i < m1.rowsize; i++) {
+      const double *a = m1.matrix[i].data();
+      morpheus::sumRows(
+          mode, inner, cols,
+          [&](int k) {
+            return morpheus::ScaledTerms{a[k], m2.matrix[k].data()};
+          },
+          out.matrix[i].data(), scratch.data());
+    }
+  }
+
+  // Copies in square blocks so both the rows read and the rows written stay
+  // in cache.
+  static Matrix transpose(const Matrix &m) {
+    MORPHEUS_OP("Matrix::transpose", 0, 16.0 * m.rowsize * m.columnsize,
+                m.rowsize, m.columnsize);
+    const int block = 32;
+    int rows = m.rowsize;
+    int cols = m.columnsize;
+    Matrix Result({}, std::make_tuple(cols, rows));
+    for (int ib = 0; ib < rows; ib += block) {
+      int iEnd = std::min(ib + block, rows);
+      for (int jb = 0; jb < cols; jb += block) {
+        int jEnd = std::min(jb + block, cols);
+        for (int j = jb; j < jEnd; j++) {
+          double *out = Result.matrix[j].data();
+          for (int i = ib; i < iEnd; i++) {
+            out[i] = m.matrix[i][j];
+          }
         }
-        matrixProduct.matrix[i][j] = sum;
       }
     }
+    return Result;
+  }
 
-    return matrixProduct;
+  static Matrix identity(int n) {
+    Matrix Result({}, std::make_tuple(n, n));
+    for (int i = 0; i < n; i++) {
+      Result.matrix[i][i] = 1;
+    }
+    return Result;
   }
 
   vec getRow(int n) { return this->matrix[n]; }
@@ -78,19 +199,54 @@ public:
     return res;
   }
 
-  void print() {
-    for (int i = 0; i < rowsize; i++) {
-
-      std::cout << "\n";
-      std::cout << "(";
-      for (int j = 0; j < columnsize; j++) {
-        std::cout << matrix[i][j];
-        j != columnsize - 1 ? std::cout << "\t" : std::cout << "";
+  // Same layout as always ("\n(" then tab-separated elements then ")" per
+  // row), honouring out's precision and flags as operator<< does. Streams
+  // in the default number format are rendered in one buffer.
+  void print(std::ostream &out = std::cout) const {
+    if (!morpheus::plainNumberFormat(out)) {
+      for (int i = 0; i < rowsize; i++) {
+        out << "\n(";
+        for (int j = 0; j < columnsize; j++) {
+          out << matrix[i][j] << (j != columnsize - 1 ? "\t" : "");
+        }
+        out << ")";
       }
-      std::cout << ")";
+      return;
     }
+    FormatOptions options;
+    options.precision = out.precision() < 0 ? 6 : (int)out.precision();
+    options.rowBegin = "\n(";
+    options.rowEnd = ")";
+    format(out, options);
+  }
+
+  // Renders the matrix as text, by default one row per line with the
+  // shortest round-trip representation of every element.
+  void format(std::ostream &out, const FormatOptions &options = {}) const {
+    morpheus::BlockWriter writer(morpheus::streamSink(out));
+    formatTo(writer, options);
+  }
+
+#ifdef MORPHEUS_HAS_FD
+  void format(int fd, const FormatOptions &options = {}) const {
+    morpheus::BlockWriter writer(morpheus::fdSink(fd));
+    formatTo(writer, options);
+  }
+#endif
+
+  std::string toString(const FormatOptions &options = {}) const {
+    std::string text;
+    morpheus::BlockWriter writer(
+        [&text](const char *p, size_t n) { text.append(p, n); });
+    formatTo(writer, options);
+    return text;
   }
-  static Matrix Constmultiplication(Matrix TargetedMat, int k) {
+
+  static Matrix Constmultiplication(const Matrix &TargetedMat, int k) {
+    MORPHEUS_OP("Matrix::Constmultiplication",
+                TargetedMat.rowsize * TargetedMat.columnsize,
+                16.0 * TargetedMat.rowsize * TargetedMat.columnsize,
+                TargetedMat.rowsize, TargetedMat.columnsize);
 
     Matrix Result({},
                   std::make_tuple(TargetedMat.rowsize, TargetedMat.columnsize));
@@ -106,7 +262,10 @@ public:
     return Result;
   }
 
-  static Matrix AddMatrix(Matrix Mat1, Matrix Mat2) {
+  static Matrix AddMatrix(const Matrix &Mat1, const Matrix &Mat2) {
+    MORPHEUS_OP("Matrix::AddMatrix", Mat1.rowsize * Mat1.columnsize,
+                24.0 * Mat1.rowsize * Mat1.columnsize, Mat1.rowsize,
+                Mat1.columnsize);
 
     if (Mat1.Dimension != Mat2.Dimension) {
       throw std::invalid_argument(
@@ -129,7 +288,10 @@ public:
     }
   }
 
-  static Matrix SubtractMatix(Matrix Mat1, Matrix Mat2) {
+  static Matrix SubtractMatix(const Matrix &Mat1, const Matrix &Mat2) {
+    MORPHEUS_OP("Matrix::SubtractMatix", Mat1.rowsize * Mat1.columnsize,
+                24.0 * Mat1.rowsize * Mat1.columnsize, Mat1.rowsize,
+                Mat1.columnsize);
 
     if (Mat1.Dimension != Mat2.Dimension) {
       throw std::invalid_argument(
@@ -152,4 +314,121 @@ public:
       return Result;
     }
   }
+
+  // In-place forms of AddMatrix, SubtractMatix and Constmultiplication,
+  // for accumulation loops: they update this matrix's storage and never
+  // allocate. other may be *this.
+  Matrix &operator+=(const Matrix &other) {
+    MORPHEUS_OP("Matrix::operator+=", rowsize * columnsize,
+                24.0 * rowsize * columnsize, rowsize, columnsize);
+    checkSameDimensions(other);
+    updateRows(other, [](double a, double x) { return a + x; });
+    return *this;
+  }
+
+  Matrix &operator-=(const Matrix &other) {
+    MORPHEUS_OP("Matrix::operator-=", rowsize * columnsize,
+                24.0 * rowsize * columnsize, rowsize, columnsize);
+    checkSameDimensions(other);
+    updateRows(other, [](double a, double x) { return a - x; });
+    return *this;
+  }
+
+  Matrix &operator*=(double k) {
+    MORPHEUS_OP("Matrix::operator*=", rowsize * columnsize,
+                16.0 * rowsize * columnsize, rowsize, columnsize);
+    updateRows(*this, [k](double a, double) { return a * k; });
+    return *this;
+  }
+
+  // *this += alpha * x, in one pass.
+  Matrix &axpy(double alpha, const Matrix &x) {
+    MORPHEUS_OP("Matrix::axpy", 2.0 * rowsize * columnsize,
+                24.0 * rowsize * columnsize, rowsize, columnsize);
+    checkSameDimensions(x);
+    updateRows(x, [alpha](double a, double b) { return a + alpha * b; });
+    return *this;
+  }
+
+private:
+  // Checks that out = m1 * m2 is valid and sizes out for it.
+  static void prepareProduct(const Matrix &m1, const Matrix &m2, Matrix &out) {
+    if (m1.columnsize != m2.rowsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
+          std::to_string(m1.columnsize) + " and Matrix of rowsize of " +
+          std::to_string(m2.rowsize));
+    }
+    if (&out == &m1 || &out == &m2) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! dotInto output must not alias an input");
+    }
+
+    Dim outDim = std::make_tuple((int)m1.rowsize, (int)m2.columnsize);
+    if (out.Dimension != outDim || (int)out.matrix.size() != m1.rowsize) {
+      out = Matrix({}, outDim);
+    }
+  }
+
+  void checkSameDimensions(const Matrix &other) const {
+    if (Dimension != other.Dimension) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix addition operation "
+          "should have = dimensions");
+    }
+  }
+
+  // morpheus::updateRow over every row of this and other. Rows are split
+  // over the executor once the matrix reaches parallelGrain elements;
+  // smaller ones run inline, without touching the executor, so tight loops
+  // over small matrices pay nothing for the threading.
+  template <typename Op> void updateRows(const Matrix &other, Op op) {
+    int cols = columnsize;
+    auto rows = [&](size_t, size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        morpheus::updateRow(matrix[i].data(), other.matrix[i].data(), cols,
+                            op);
+      }
+    };
+    size_t n = rowsize;
+    if (n * cols < morpheus::parallelGrain) {
+      rows(0, 0, n);
+    } else {
+      morpheus::parallelFor(n, morpheus::rowGrain(cols), rows);
+    }
+  }
+
+  // out = m1 * m2 for a correctly sized out. Row i of out accumulates
+  // m1[i][k] * row k of m2 in increasing k, so every element is summed in
+  // the same order as the textbook dot product. rowDone(i, row) runs once
+  // row i is final.
+  template <typename RowDone>
+  static void multiply(const Matrix &m1, const Matrix &m2, Matrix &out,
+                       RowDone &&rowDone) {
+    int inner = m1.columnsize;
+    int cols = m2.columnsize;
+    for (int i = 0; i < m1.rowsize; i++) {
+      double *c = out.matrix[i].data();
+      const double *a = m1.matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        c[j] = 0;
+      }
+      for (int k = 0; k < inner; k++) {
+        double aik = a[k];
+        const double *b = m2.matrix[k].data();
+        for (int j = 0; j < cols; j++) {
+          c[j] += aik * b[j];
+        }
+      }
+      rowDone(i, c);
+    }
+  }
+
+  void formatTo(morpheus::BlockWriter &writer,
+                const FormatOptions &options) const {
+    morpheus::formatRows(
+        writer, rowsize, columnsize,
+        [this](int i) { return matrix[i].data(); }, options);
+    writer.flush();
+  }
 };
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+// Read-only, non-owning row-major view over contiguous doubles, e.g. a
+// memory-mapped file. `owner` keeps whatever backs the data alive for as
+// long as any copy of the view exists.
+class MatrixView {
+
+public:
+  int rowsize = 0;
+  int columnsize = 0;
+  const double *data = nullptr;
+  size_t stride = 0; // elements between the starts of consecutive rows
+  std::shared_ptr<const void> owner;
+
+  MatrixView() = default;
+
+  MatrixView(const double *data, int rows, int cols, size_t stride = 0,
+             std::shared_ptr<const void> owner = nullptr) {
+    this->data = data;
+    this->rowsize = rows;
+    this->columnsize = cols;
+    this->stride = stride == 0 ? cols : stride;
+    this->owner = std::move(owner);
+  }
+
+  Dim Dimension() const { return std::make_tuple(rowsize, columnsize); }
+
+  const double *row(int i) const { return data + (size_t)i * stride; }
+  double operator()(int i, int j) const { return row(i)[j]; }
+
+  // Rows [begin, end) as a view sharing the same owner.
+  MatrixView rows(int begin, int end) const {
+    return MatrixView(row(begin), end - begin, columnsize, stride, owner);
+  }
+
+  Matrix toMatrix() const {
+    Mat rows(rowsize);
+    for (int i = 0; i < rowsize; i++) {
+      rows[i].assign(row(i), row(i) + columnsize);
+    }
+    return Matrix(std::move(rows), Dimension());
+  }
+};
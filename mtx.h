@@ -0,0 +1,378 @@
+#pragma once
+
+#include "csv.h"
+#include "mapped_file.h"
+#include "matrix.h"
+#include "sparse.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+// Matrix Market (.mtx) files: "coordinate" and "array" formats with real,
+// integer or pattern fields and general, symmetric or skew-symmetric
+// storage. Symmetric files are expanded to both triangles on read.
+
+using MtxMatrix = std::variant<Matrix, SparseMatrix>;
+
+namespace morpheus {
+
+enum class MtxSymmetry { General, Symmetric, SkewSymmetric };
+
+struct MtxHeader {
+  bool coordinate = true;
+  bool pattern = false;
+  MtxSymmetry symmetry = MtxSymmetry::General;
+  int rows = 0;
+  int columns = 0;
+  size_t entries = 0; // lines of data expected
+  const char *data = nullptr;
+  const char *end = nullptr;
+};
+
+inline std::runtime_error mtxError(const std::string &source,
+                                   const std::string &what) {
+  return std::runtime_error("INVALID MATRIX MARKET! " + source + ": " + what);
+}
+
+inline std::string lowercase(std::string s) {
+  for (char &c : s) {
+    c = std::tolower((unsigned char)c);
+  }
+  return s;
+}
+
+inline MtxHeader parseMtxHeader(const char *begin, const char *end,
+                                const std::string &source) {
+  MtxHeader h;
+  const char *p = begin;
+  const char *e = lineEnd(p, end);
+  std::istringstream banner(std::string(p, e));
+  std::string tag, object, format, field, symmetry;
+  banner >> tag >> object >> format >> field >> symmetry;
+  if (tag != "%%MatrixMarket" || lowercase(object) != "matrix") {
+    throw mtxError(source, "missing %%MatrixMarket matrix banner");
+  }
+  format = lowercase(format);
+  field = lowercase(field);
+  symmetry = lowercase(symmetry);
+
+  if (format == "coordinate") {
+    h.coordinate = true;
+  } else if (format == "array") {
+    h.coordinate = false;
+  } else {
+    throw mtxError(source, "unknown format " + format);
+  }
+  if (field == "pattern") {
+    h.pattern = true;
+    if (!h.coordinate) {
+      throw mtxError(source, "pattern field needs the coordinate format");
+    }
+  } else if (field != "real" && field != "integer" && field != "double") {
+    throw mtxError(source, "unsupported field " + field);
+  }
+  if (symmetry == "general") {
+    h.symmetry = MtxSymmetry::General;
+  } else if (symmetry == "symmetric" || symmetry == "hermitian") {
+    // Hermitian with a real field is just symmetric.
+    h.symmetry = MtxSymmetry::Symmetric;
+  } else if (symmetry == "skew-symmetric") {
+    h.symmetry = MtxSymmetry::SkewSymmetric;
+  } else {
+    throw mtxError(source, "unknown symmetry " + symmetry);
+  }
+
+  // Skip comments and blank lines up to the size line.
+  p = e < end ? e + 1 : end;
+  while (p < end) {
+    e = lineEnd(p, end);
+    const char *q = p;
+    while (q < e && std::isspace((unsigned char)*q)) {
+      q++;
+    }
+    if (q < e && *q != '%') {
+      break;
+    }
+    p = e < end ? e + 1 : end;
+  }
+  if (p >= end) {
+    throw mtxError(source, "missing size line");
+  }
+
+  std::istringstream sizes(std::string(p, e));
+  long long rows = -1, columns = -1, entries = -1;
+  sizes >> rows >> columns;
+  if (h.coordinate) {
+    sizes >> entries;
+  }
+  if (!sizes || rows < 0 || columns < 0 || rows > INT32_MAX ||
+      columns > INT32_MAX || (h.coordinate && entries < 0)) {
+    throw mtxError(source, "malformed size line");
+  }
+  if (h.symmetry != MtxSymmetry::General && rows != columns) {
+    throw mtxError(source, "symmetric matrices must be square");
+  }
+  h.rows = rows;
+  h.columns = columns;
+  if (h.coordinate) {
+    h.entries = entries;
+  } else if (h.symmetry == MtxSymmetry::Symmetric) {
+    h.entries = (size_t)rows * (rows + 1) / 2;
+  } else if (h.symmetry == MtxSymmetry::SkewSymmetric) {
+    h.entries = (size_t)rows * (rows - 1) / 2;
+  } else {
+    h.entries = (size_t)rows * columns;
+  }
+
+  h.data = e < end ? e + 1 : end;
+  h.end = end;
+  while (h.end > h.data && std::isspace((unsigned char)h.end[-1])) {
+    h.end--;
+  }
+  return h;
+}
+
+// Parses up to `count` whitespace-separated numbers from one line.
+inline int parseMtxFields(const char *p, const char *e, double *out,
+                          int count) {
+  int n = 0;
+  while (n < count) {
+    while (p < e && std::isspace((unsigned char)*p)) {
+      p++;
+    }
+    if (p == e) {
+      break;
+    }
+    if (*p == '+') {
+      p++;
+    }
+    auto parsed = std::from_chars(p, e, out[n]);
+    if (parsed.ec != std::errc()) {
+      return -1;
+    }
+    p = parsed.ptr;
+    n++;
+  }
+  return n;
+}
+
+// Parses a 1-based index in [1, limit] as an integer and returns it 0-based
+// after advancing p past it, or -1 if the field is missing, not an integer or
+// out of range.
+inline long long parseMtxIndex(const char *&p, const char *e, long long limit) {
+  while (p < e && std::isspace((unsigned char)*p)) {
+    p++;
+  }
+  if (p < e && *p == '+') {
+    p++;
+  }
+  long long index = 0;
+  auto parsed = std::from_chars(p, e, index);
+  if (parsed.ec != std::errc() ||
+      (parsed.ptr < e && !std::isspace((unsigned char)*parsed.ptr)) ||
+      index < 1 || index > limit) {
+    return -1;
+  }
+  p = parsed.ptr;
+  return index - 1;
+}
+
+// Blank lines in the data section are not entries.
+struct MtxDataLine {
+  bool operator()(const char *p, const char *e) const {
+    while (p < e && std::isspace((unsigned char)*p)) {
+      p++;
+    }
+    return p < e;
+  }
+};
+
+// Reads the data lines of a coordinate file into triplets (0-based),
+// expanding symmetric storage.
+inline std::vector<Triplet> readMtxCoordinates(const MtxHeader &h,
+                                               const std::string &source) {
+  std::vector<Triplet> entries;
+  parallelLines(
+      h.data, h.end, MtxDataLine(),
+      [&](size_t count) {
+        if (count != h.entries) {
+          throw mtxError(source, "expected " + std::to_string(h.entries) +
+                                     " entries, found " +
+                                     std::to_string(count));
+        }
+        entries.resize(count);
+      },
+      [&](size_t line, const char *p, const char *e) {
+        long long i = parseMtxIndex(p, e, h.rows);
+        long long j = i < 0 ? -1 : parseMtxIndex(p, e, h.columns);
+        if (i < 0 || j < 0) {
+          throw mtxError(source, "entry " + std::to_string(line + 1) +
+                                     " has a malformed or out of range index");
+        }
+        double v = 1;
+        if (!h.pattern && parseMtxFields(p, e, &v, 1) != 1) {
+          throw mtxError(source, "malformed entry " + std::to_string(line + 1));
+        }
+        entries[line] = Triplet((int)i, (int)j, v);
+      });
+
+  if (h.symmetry != MtxSymmetry::General) {
+    double sign = h.symmetry == MtxSymmetry::SkewSymmetric ? -1 : 1;
+    size_t stored = entries.size();
+    for (size_t k = 0; k < stored; k++) {
+      int i = std::get<0>(entries[k]);
+      int j = std::get<1>(entries[k]);
+      if (i != j) {
+        entries.emplace_back(j, i, sign * std::get<2>(entries[k]));
+      }
+    }
+  }
+  return entries;
+}
+
+// Reads an array file; values are listed column by column (only the lower
+// triangle for symmetric storage).
+inline Matrix readMtxArray(const MtxHeader &h, const std::string &source) {
+  Matrix Result({}, std::make_tuple(h.rows, h.columns));
+  int n = h.rows;
+  bool skew = h.symmetry == MtxSymmetry::SkewSymmetric;
+  // Start of each column's run of values inside the stored sequence.
+  std::vector<size_t> columnStart(h.columns + 1, 0);
+  for (int j = 0; j < h.columns; j++) {
+    size_t length = h.symmetry == MtxSymmetry::General ? n
+                    : skew                             ? n - j - 1
+                                                       : n - j;
+    columnStart[j + 1] = columnStart[j] + length;
+  }
+
+  parallelLines(
+      h.data, h.end, MtxDataLine(),
+      [&](size_t count) {
+        if (count != h.entries) {
+          throw mtxError(source, "expected " + std::to_string(h.entries) +
+                                     " values, found " +
+                                     std::to_string(count));
+        }
+      },
+      [&](size_t line, const char *p, const char *e) {
+        double v;
+        if (parseMtxFields(p, e, &v, 1) != 1) {
+          throw mtxError(source, "malformed value " + std::to_string(line + 1));
+        }
+        int j = std::upper_bound(columnStart.begin(), columnStart.end(), line) -
+                columnStart.begin() - 1;
+        int i = line - columnStart[j];
+        if (h.symmetry != MtxSymmetry::General) {
+          i += j + skew;
+          Result.matrix[j][i] = skew ? -v : v;
+        }
+        Result.matrix[i][j] = v;
+      });
+  return Result;
+}
+
+inline Matrix triplets2Dense(int rows, int cols,
+                             const std::vector<Triplet> &entries) {
+  Matrix Result({}, std::make_tuple(rows, cols));
+  for (const Triplet &t : entries) {
+    Result.matrix[std::get<0>(t)][std::get<1>(t)] += std::get<2>(t);
+  }
+  return Result;
+}
+
+template <typename T> void writeMtxNumber(std::ostream &out, T value) {
+  char buffer[32];
+  char *end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+  out.write(buffer, end - buffer);
+}
+
+inline std::ofstream openForWrite(const std::string &path) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("CANNOT OPEN FILE! " + path);
+  }
+  return out;
+}
+
+} // namespace morpheus
+
+// Reads a Matrix Market file. Coordinate files whose density (after
+// symmetric expansion) is at least denseThreshold come back as a dense
+// Matrix, sparser ones as a SparseMatrix; array files are always dense.
+// Data lines are parsed in parallel.
+inline MtxMatrix readMtx(const std::string &path, double denseThreshold = 0.25) {
+  MappedFile file(path);
+  const char *begin = reinterpret_cast<const char *>(file.data());
+  morpheus::MtxHeader h =
+      morpheus::parseMtxHeader(begin, begin + file.size(), path);
+  if (!h.coordinate) {
+    return morpheus::readMtxArray(h, path);
+  }
+
+  std::vector<Triplet> entries = morpheus::readMtxCoordinates(h, path);
+  double cells = (double)h.rows * h.columns;
+  if (cells > 0 && entries.size() >= denseThreshold * cells) {
+    return morpheus::triplets2Dense(h.rows, h.columns, entries);
+  }
+  return SparseMatrix::fromTriplets(h.rows, h.columns, std::move(entries));
+}
+
+inline Matrix readMtxDense(const std::string &path) {
+  MtxMatrix m = readMtx(path, 0.0);
+  if (SparseMatrix *s = std::get_if<SparseMatrix>(&m)) {
+    return s->toMatrix();
+  }
+  return std::get<Matrix>(std::move(m));
+}
+
+inline SparseMatrix readMtxSparse(const std::string &path) {
+  MtxMatrix m = readMtx(path, 2.0);
+  if (Matrix *d = std::get_if<Matrix>(&m)) {
+    return SparseMatrix::fromMatrix(*d);
+  }
+  return std::get<SparseMatrix>(std::move(m));
+}
+
+// Writes a dense Matrix in the array format (column by column).
+inline void writeMtx(const Matrix &m, const std::string &path) {
+  std::ofstream out = morpheus::openForWrite(path);
+  out << "%%MatrixMarket matrix array real general\n"
+      << (int)m.rowsize << " " << (int)m.columnsize << "\n";
+  for (int j = 0; j < m.columnsize; j++) {
+    for (int i = 0; i < m.rowsize; i++) {
+      morpheus::writeMtxNumber(out, m.matrix[i][j]);
+      out.put('\n');
+    }
+  }
+  if (!out) {
+    throw std::runtime_error("CANNOT WRITE FILE! " + path);
+  }
+}
+
+// Writes a SparseMatrix in the coordinate format.
+inline void writeMtx(const SparseMatrix &m, const std::string &path) {
+  std::ofstream out = morpheus::openForWrite(path);
+  out << "%%MatrixMarket matrix coordinate real general\n"
+      << m.rowsize << " " << m.columnsize << " " << m.nonZeros() << "\n";
+  for (int i = 0; i < m.rowsize; i++) {
+    for (size_t k = m.rowStart[i]; k < m.rowStart[i + 1]; k++) {
+      morpheus::writeMtxNumber(out, i + 1);
+      out.put(' ');
+      morpheus::writeMtxNumber(out, m.columnIndex[k] + 1);
+      out.put(' ');
+      morpheus::writeMtxNumber(out, m.values[k]);
+      out.put('\n');
+    }
+  }
+  if (!out) {
+    throw std::runtime_error("CANNOT WRITE FILE! " + path);
+  }
+}
@@ -0,0 +1,587 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "matrix.h"
+#include "matrix_view.h"
+#include "serialize.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// NumPy .npy files (format versions 1.0 to 3.0) and uncompressed .npz
+// archives. 2-D arrays map to matrices of the same shape, 1-D arrays to a
+// single row and 0-D arrays to 1x1. Supported dtypes are f8, f4 and i4 in
+// either byte order, in C or Fortran order.
+
+namespace morpheus {
+
+struct NpyHeader {
+  DType dtype = DType::F64;
+  bool swap = false;
+  bool fortranOrder = false;
+  int rows = 0;
+  int columns = 0;
+  size_t dataOffset = 0; // from the start of the .npy data
+};
+
+inline bool littleEndianHost() {
+  uint16_t one = 1;
+  unsigned char first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+inline std::runtime_error npyError(const std::string &source,
+                                   const std::string &what) {
+  return std::runtime_error("INVALID NPY! " + source + ": " + what);
+}
+
+// Value that follows 'key': in a NumPy header dict, with surrounding spaces
+// removed. Only the flat dicts NumPy writes are supported.
+inline std::string npyField(const std::string &header, const std::string &key,
+                            const std::string &source) {
+  size_t at = header.find("'" + key + "'");
+  if (at == std::string::npos) {
+    at = header.find("\"" + key + "\"");
+  }
+  if (at == std::string::npos) {
+    throw npyError(source, "header has no '" + key + "'");
+  }
+  size_t colon = header.find(':', at);
+  if (colon == std::string::npos) {
+    throw npyError(source, "malformed header");
+  }
+  size_t begin = header.find_first_not_of(' ', colon + 1);
+  size_t end = begin;
+  if (begin != std::string::npos && header[begin] == '(') {
+    end = header.find(')', begin);
+    end = end == std::string::npos ? end : end + 1;
+  } else if (begin != std::string::npos &&
+             (header[begin] == '\'' || header[begin] == '"')) {
+    end = header.find(header[begin], begin + 1);
+    end = end == std::string::npos ? end : end + 1;
+  } else if (begin != std::string::npos) {
+    end = header.find_first_of(",}", begin);
+  }
+  if (begin == std::string::npos || end == std::string::npos) {
+    throw npyError(source, "malformed value for '" + key + "'");
+  }
+  std::string value = header.substr(begin, end - begin);
+  while (!value.empty() && value.back() == ' ') {
+    value.pop_back();
+  }
+  return value;
+}
+
+inline NpyHeader parseNpyHeader(const unsigned char *bytes, size_t size,
+                                const std::string &source) {
+  static const char magic[6] = {'\x93', 'N', 'U', 'M', 'P', 'Y'};
+  if (size < 10 || std::memcmp(bytes, magic, 6) != 0) {
+    throw npyError(source, "missing .npy magic");
+  }
+  int major = bytes[6];
+  size_t headerLength;
+  size_t prefix;
+  if (major == 1) {
+    headerLength = bytes[8] | (bytes[9] << 8);
+    prefix = 10;
+  } else if (major == 2 || major == 3) {
+    if (size < 12) {
+      throw npyError(source, "truncated header");
+    }
+    headerLength = (size_t)bytes[8] | ((size_t)bytes[9] << 8) |
+                   ((size_t)bytes[10] << 16) | ((size_t)bytes[11] << 24);
+    prefix = 12;
+  } else {
+    throw npyError(source, "unsupported format version " +
+                               std::to_string(major));
+  }
+  if (size < prefix + headerLength) {
+    throw npyError(source, "truncated header");
+  }
+  std::string header(reinterpret_cast<const char *>(bytes) + prefix,
+                     headerLength);
+
+  NpyHeader Result;
+  Result.dataOffset = prefix + headerLength;
+
+  std::string descr = npyField(header, "descr", source);
+  if (descr.size() < 4) {
+    throw npyError(source, "unsupported dtype " + descr);
+  }
+  char order = descr[1];
+  std::string type = descr.substr(2, descr.size() - 3);
+  if (type == "f8") {
+    Result.dtype = DType::F64;
+  } else if (type == "f4") {
+    Result.dtype = DType::F32;
+  } else if (type == "i4") {
+    Result.dtype = DType::I32;
+  } else {
+    throw npyError(source, "unsupported dtype " + descr);
+  }
+  bool little = order == '<' || ((order == '=' || order == '|') &&
+                                 littleEndianHost());
+  Result.swap = little != littleEndianHost();
+
+  std::string fortran = npyField(header, "fortran_order", source);
+  if (fortran != "True" && fortran != "False") {
+    throw npyError(source, "malformed fortran_order " + fortran);
+  }
+  Result.fortranOrder = fortran == "True";
+
+  std::string shape = npyField(header, "shape", source);
+  std::vector<long long> dims;
+  for (size_t p = 1; p < shape.size();) {
+    size_t digit = shape.find_first_of("0123456789", p);
+    if (digit == std::string::npos) {
+      break;
+    }
+    size_t used;
+    dims.push_back(std::stoll(shape.substr(digit), &used));
+    p = digit + used;
+  }
+  if (dims.size() > 2) {
+    throw npyError(source, "arrays with " + std::to_string(dims.size()) +
+                               " dimensions cannot be loaded as a Matrix");
+  }
+  long long rows = dims.size() == 2 ? dims[0] : 1;
+  long long columns = dims.empty() ? 1 : dims.back();
+  if (rows > INT32_MAX || columns > INT32_MAX) {
+    throw npyError(source, "dimensions too large for a Matrix");
+  }
+  Result.rows = rows;
+  Result.columns = columns;
+
+  size_t elementSize = dtypeSize(Result.dtype);
+  uint64_t elements = (uint64_t)rows * columns;
+  if ((size - Result.dataOffset) / elementSize < elements) {
+    throw npyError(source, "data is truncated");
+  }
+  return Result;
+}
+
+// Decodes .npy data into a row-major buffer of doubles.
+inline void decodeNpy(const unsigned char *bytes, const NpyHeader &h,
+                      double *out) {
+  const unsigned char *data = bytes + h.dataOffset;
+  size_t elementSize = dtypeSize(h.dtype);
+  if (!h.fortranOrder) {
+    decodeElements(data, h.dtype, h.swap, (size_t)h.rows * h.columns, out);
+    return;
+  }
+  // Fortran order stores columns contiguously; decode a column at a time
+  // and scatter it into the rows.
+  vec column(h.rows);
+  for (int j = 0; j < h.columns; j++) {
+    decodeElements(data + (size_t)j * h.rows * elementSize, h.dtype, h.swap,
+                   h.rows, column.data());
+    for (int i = 0; i < h.rows; i++) {
+      out[(size_t)i * h.columns + j] = column[i];
+    }
+  }
+}
+
+inline Matrix npyToMatrix(const unsigned char *bytes, size_t size,
+                          const std::string &source) {
+  NpyHeader h = parseNpyHeader(bytes, size, source);
+  if (!h.fortranOrder) {
+    size_t elementSize = dtypeSize(h.dtype);
+    Mat rows(h.rows, vec(h.columns));
+    for (int i = 0; i < h.rows; i++) {
+      decodeElements(bytes + h.dataOffset +
+                         (size_t)i * h.columns * elementSize,
+                     h.dtype, h.swap, h.columns, rows[i].data());
+    }
+    return Matrix(std::move(rows), std::make_tuple(h.rows, h.columns));
+  }
+  vec flat((size_t)h.rows * h.columns);
+  decodeNpy(bytes, h, flat.data());
+  Mat rows(h.rows);
+  for (int i = 0; i < h.rows; i++) {
+    rows[i].assign(flat.begin() + (size_t)i * h.columns,
+                   flat.begin() + (size_t)(i + 1) * h.columns);
+  }
+  return Matrix(std::move(rows), std::make_tuple(h.rows, h.columns));
+}
+
+// View over .npy data. Native-endian C-order f8 data that is suitably
+// aligned is used in place and `owner` keeps it alive; anything else is
+// decoded into a buffer owned by the view.
+inline MatrixView npyToView(const unsigned char *bytes, size_t size,
+                            const std::string &source,
+                            std::shared_ptr<const void> owner) {
+  NpyHeader h = parseNpyHeader(bytes, size, source);
+  const unsigned char *data = bytes + h.dataOffset;
+  if (h.dtype == DType::F64 && !h.swap && !h.fortranOrder &&
+      reinterpret_cast<uintptr_t>(data) % alignof(double) == 0) {
+    return MatrixView(reinterpret_cast<const double *>(data), h.rows,
+                      h.columns, h.columns, std::move(owner));
+  }
+  auto converted = std::make_shared<vec>((size_t)h.rows * h.columns);
+  decodeNpy(bytes, h, converted->data());
+  return MatrixView(converted->data(), h.rows, h.columns, h.columns,
+                    converted);
+}
+
+// Serializes m as a complete .npy file.
+inline std::string matrixToNpy(const Matrix &m, DType dtype,
+                               bool fortranOrder) {
+  const char *type = dtype == DType::F64   ? "f8"
+                     : dtype == DType::F32 ? "f4"
+                                           : "i4";
+  std::string header = std::string("{'descr': '") +
+                       (littleEndianHost() ? "<" : ">") + type +
+                       "', 'fortran_order': " +
+                       (fortranOrder ? "True" : "False") + ", 'shape': (" +
+                       std::to_string((int)m.rowsize) + ", " +
+                       std::to_string((int)m.columnsize) + "), }";
+  // Pad with spaces so the data starts on a 64-byte boundary; the header
+  // ends with a newline.
+  size_t prefix = 10;
+  size_t total = (prefix + header.size() + 1 + 63) / 64 * 64;
+  if (total - prefix > 0xFFFF) {
+    throw std::invalid_argument("INVALID OPERATION! .npy header too long");
+  }
+  header.append(total - prefix - header.size() - 1, ' ');
+  header.push_back('\n');
+
+  size_t rows = m.rowsize;
+  size_t cols = m.columnsize;
+  size_t elementSize = dtypeSize(dtype);
+  std::string Result;
+  Result.reserve(total + rows * cols * elementSize);
+  Result.append("\x93NUMPY\x01\x00", 8);
+  Result.push_back(char(header.size() & 0xFF));
+  Result.push_back(char(header.size() >> 8));
+  Result += header;
+
+  size_t offset = Result.size();
+  Result.resize(offset + rows * cols * elementSize);
+  unsigned char *out = reinterpret_cast<unsigned char *>(&Result[offset]);
+  if (!fortranOrder) {
+    for (size_t i = 0; i < rows; i++) {
+      encodeElements(m.matrix[i].data(), dtype, cols,
+                     out + i * cols * elementSize);
+    }
+  } else {
+    vec column(rows);
+    for (size_t j = 0; j < cols; j++) {
+      for (size_t i = 0; i < rows; i++) {
+        column[i] = m.matrix[i][j];
+      }
+      encodeElements(column.data(), dtype, rows, out + j * rows * elementSize);
+    }
+  }
+  return Result;
+}
+
+inline void writeFile(const std::string &path, const std::string &bytes) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("CANNOT OPEN FILE! " + path);
+  }
+  out.write(bytes.data(), bytes.size());
+  if (!out) {
+    throw std::runtime_error("CANNOT WRITE FILE! " + path);
+  }
+}
+
+inline uint32_t crc32(const unsigned char *data, size_t size) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> t(256);
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      t[i] = c;
+    }
+    return t;
+  }();
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+inline uint64_t readLE(const unsigned char *p, int bytes) {
+  uint64_t v = 0;
+  for (int i = bytes - 1; i >= 0; i--) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+inline void writeLE(std::string &out, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out.push_back(char((v >> (8 * i)) & 0xFF));
+  }
+}
+
+struct ZipEntry {
+  std::string name;
+  const unsigned char *data;
+  size_t size;
+};
+
+// Lists the members of a zip archive held in memory. Only stored
+// (uncompressed) members are accepted, which is what np.savez writes;
+// ZIP64 archives are understood: the entry count and directory offset come
+// from the ZIP64 end-of-central-directory record when a locator precedes
+// the classic record, and member sizes and offsets from each entry's ZIP64
+// extra field.
+inline std::vector<ZipEntry> zipEntries(const unsigned char *bytes, size_t size,
+                                        const std::string &source) {
+  auto fail = [&](const std::string &what) {
+    return std::runtime_error("INVALID NPZ! " + source + ": " + what);
+  };
+  if (size < 22) {
+    throw fail("too small for a zip archive");
+  }
+  // The end-of-central-directory record sits in the last 22 + 65535 bytes.
+  size_t eocd = size - 22;
+  size_t stop = size > 22 + 0xFFFF ? size - 22 - 0xFFFF : 0;
+  while (readLE(bytes + eocd, 4) != 0x06054b50) {
+    if (eocd == stop) {
+      throw fail("no end of central directory record");
+    }
+    eocd--;
+  }
+  uint64_t count = readLE(bytes + eocd + 10, 2);
+  uint64_t directory = readLE(bytes + eocd + 16, 4);
+
+  // A ZIP64 locator sits right before the classic record and points at the
+  // ZIP64 record, whose 8-byte fields replace the saturated 2- and 4-byte
+  // ones.
+  if (eocd >= 20 && readLE(bytes + eocd - 20, 4) == 0x07064b50) {
+    uint64_t record = readLE(bytes + eocd - 20 + 8, 8);
+    if (record > eocd - 20 || eocd - 20 - record < 56 ||
+        readLE(bytes + record, 4) != 0x06064b50) {
+      throw fail("corrupt ZIP64 end of central directory record");
+    }
+    count = readLE(bytes + record + 32, 8);
+    directory = readLE(bytes + record + 48, 8);
+  }
+  if (directory > size) {
+    throw fail("corrupt central directory");
+  }
+
+  std::vector<ZipEntry> Result;
+  size_t p = directory;
+  for (uint64_t e = 0; e < count; e++) {
+    if (p + 46 > size || readLE(bytes + p, 4) != 0x02014b50) {
+      throw fail("corrupt central directory");
+    }
+    int method = readLE(bytes + p + 10, 2);
+    uint64_t compressed = readLE(bytes + p + 20, 4);
+    uint64_t local = readLE(bytes + p + 42, 4);
+    size_t nameLength = readLE(bytes + p + 28, 2);
+    size_t extraLength = readLE(bytes + p + 30, 2);
+    size_t commentLength = readLE(bytes + p + 32, 2);
+    if (p + 46 + nameLength + extraLength > size) {
+      throw fail("corrupt central directory");
+    }
+    std::string name(reinterpret_cast<const char *>(bytes + p + 46),
+                     nameLength);
+
+    // ZIP64 extra field: the 8-byte values appear in this order, but only
+    // for the fields whose 4-byte slot is 0xFFFFFFFF.
+    uint64_t uncompressed = readLE(bytes + p + 24, 4);
+    const unsigned char *extra = bytes + p + 46 + nameLength;
+    for (size_t x = 0; x + 4 <= extraLength;) {
+      size_t id = readLE(extra + x, 2);
+      size_t length = readLE(extra + x + 2, 2);
+      if (id == 0x0001) {
+        size_t q = x + 4;
+        if (uncompressed == 0xFFFFFFFF && q + 8 <= x + 4 + length) {
+          uncompressed = readLE(extra + q, 8);
+          q += 8;
+        }
+        if (compressed == 0xFFFFFFFF && q + 8 <= x + 4 + length) {
+          compressed = readLE(extra + q, 8);
+          q += 8;
+        }
+        if (local == 0xFFFFFFFF && q + 8 <= x + 4 + length) {
+          local = readLE(extra + q, 8);
+        }
+      }
+      x += 4 + length;
+    }
+    if (method != 0) {
+      throw fail(name + " is compressed; only uncompressed archives "
+                        "(np.savez) are supported");
+    }
+    if (local + 30 > size || readLE(bytes + local, 4) != 0x04034b50) {
+      throw fail("corrupt local header for " + name);
+    }
+    size_t start = local + 30 + readLE(bytes + local + 26, 2) +
+                   readLE(bytes + local + 28, 2);
+    if (start > size || size - start < compressed) {
+      throw fail(name + " is truncated");
+    }
+    Result.push_back({name, bytes + start, (size_t)compressed});
+    p += 46 + nameLength + extraLength + commentLength;
+  }
+  return Result;
+}
+
+inline std::string npzKey(const std::string &name) {
+  const std::string suffix = ".npy";
+  if (name.size() >= suffix.size() &&
+      name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+    return name.substr(0, name.size() - suffix.size());
+  }
+  return name;
+}
+
+} // namespace morpheus
+
+inline Matrix loadNpy(const std::string &path) {
+  MappedFile file(path);
+  return morpheus::npyToMatrix(file.data(), file.size(), path);
+}
+
+// Maps a .npy file; see npyToView for when the data is used in place.
+inline MatrixView mapNpy(const std::string &path) {
+  auto file = std::make_shared<MappedFile>(path);
+  return morpheus::npyToView(file->data(), file->size(), path, file);
+}
+
+inline void saveNpy(const Matrix &m, const std::string &path,
+                    DType dtype = DType::F64, bool fortranOrder = false) {
+  morpheus::writeFile(path, morpheus::matrixToNpy(m, dtype, fortranOrder));
+}
+
+// Loads every array of an uncompressed .npz archive, keyed by name without
+// the ".npy" suffix.
+inline std::map<std::string, Matrix> loadNpz(const std::string &path) {
+  MappedFile file(path);
+  std::map<std::string, Matrix> Result;
+  for (const morpheus::ZipEntry &e :
+       morpheus::zipEntries(file.data(), file.size(), path)) {
+    Result.emplace(morpheus::npzKey(e.name),
+                   morpheus::npyToMatrix(e.data, e.size, path + "/" + e.name));
+  }
+  return Result;
+}
+
+// Maps an uncompressed .npz archive. Stored members are contiguous inside
+// the archive, so f8 arrays that happen to be 8-byte aligned are viewed in
+// place; the rest are decoded.
+inline std::map<std::string, MatrixView> mapNpz(const std::string &path) {
+  auto file = std::make_shared<MappedFile>(path);
+  std::map<std::string, MatrixView> Result;
+  for (const morpheus::ZipEntry &e :
+       morpheus::zipEntries(file->data(), file->size(), path)) {
+    Result.emplace(morpheus::npzKey(e.name),
+                   morpheus::npyToView(e.data, e.size, path + "/" + e.name,
+                                       file));
+  }
+  return Result;
+}
+
+// Writes an uncompressed .npz archive readable by np.load. Each member is
+// padded through the local header's extra field so its data starts on a
+// 64-byte boundary, which lets mapNpz use f8 arrays in place.
+// Archives with 65535 or more members, or whose central directory lies past
+// 4 GiB, get ZIP64 end records; members themselves must start below 4 GiB
+// and be smaller than it.
+inline void saveNpz(const std::string &path,
+                    const std::map<std::string, Matrix> &arrays,
+                    DType dtype = DType::F64) {
+  using morpheus::writeLE;
+  std::string archive;
+  std::string directory;
+  for (const auto &entry : arrays) {
+    std::string name = entry.first + ".npy";
+    std::string npy = morpheus::matrixToNpy(entry.second, dtype, false);
+    if (npy.size() >= 0xFFFFFFFF || archive.size() >= 0xFFFFFFFF) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! .npz members over 4 GiB or starting past 4 GiB "
+          "are not supported");
+    }
+    uint32_t crc = morpheus::crc32(
+        reinterpret_cast<const unsigned char *>(npy.data()), npy.size());
+    size_t local = archive.size();
+    size_t padding = (64 - (local + 30 + name.size() + 4) % 64) % 64;
+
+    writeLE(archive, 0x04034b50, 4);
+    writeLE(archive, 20, 2); // version needed
+    writeLE(archive, 0, 2);  // flags
+    writeLE(archive, 0, 2);  // stored
+    writeLE(archive, 0, 2);  // time
+    writeLE(archive, 0x21, 2); // date: 1980-01-01
+    writeLE(archive, crc, 4);
+    writeLE(archive, npy.size(), 4);
+    writeLE(archive, npy.size(), 4);
+    writeLE(archive, name.size(), 2);
+    writeLE(archive, 4 + padding, 2);
+    archive += name;
+    writeLE(archive, 0xCAFE, 2); // private padding field
+    writeLE(archive, padding, 2);
+    archive.append(padding, '\0');
+    archive += npy;
+
+    writeLE(directory, 0x02014b50, 4);
+    writeLE(directory, 20, 2); // version made by
+    writeLE(directory, 20, 2); // version needed
+    writeLE(directory, 0, 2);
+    writeLE(directory, 0, 2);
+    writeLE(directory, 0, 2);
+    writeLE(directory, 0x21, 2);
+    writeLE(directory, crc, 4);
+    writeLE(directory, npy.size(), 4);
+    writeLE(directory, npy.size(), 4);
+    writeLE(directory, name.size(), 2);
+    writeLE(directory, 0, 2); // extra
+    writeLE(directory, 0, 2); // comment
+    writeLE(directory, 0, 2); // disk
+    writeLE(directory, 0, 2); // internal attributes
+    writeLE(directory, 0, 4); // external attributes
+    writeLE(directory, local, 4);
+    directory += name;
+  }
+
+  size_t directoryOffset = archive.size();
+  archive += directory;
+
+  // Counts and offsets that overflow the classic end record go in a ZIP64
+  // end record, found through the locator right before the classic one,
+  // whose fields are then saturated.
+  bool zip64 = arrays.size() >= 0xFFFF || directory.size() >= 0xFFFFFFFF ||
+               directoryOffset >= 0xFFFFFFFF;
+  if (zip64) {
+    size_t record = archive.size();
+    writeLE(archive, 0x06064b50, 4);
+    writeLE(archive, 44, 8); // size of the rest of the record
+    writeLE(archive, 45, 2); // version made by
+    writeLE(archive, 45, 2); // version needed
+    writeLE(archive, 0, 4);
+    writeLE(archive, 0, 4);
+    writeLE(archive, arrays.size(), 8);
+    writeLE(archive, arrays.size(), 8);
+    writeLE(archive, directory.size(), 8);
+    writeLE(archive, directoryOffset, 8);
+    writeLE(archive, 0x07064b50, 4);
+    writeLE(archive, 0, 4);
+    writeLE(archive, record, 8);
+    writeLE(archive, 1, 4); // disks
+  }
+  writeLE(archive, 0x06054b50, 4);
+  writeLE(archive, 0, 2);
+  writeLE(archive, 0, 2);
+  writeLE(archive, zip64 ? 0xFFFF : arrays.size(), 2);
+  writeLE(archive, zip64 ? 0xFFFF : arrays.size(), 2);
+  writeLE(archive, zip64 ? 0xFFFFFFFF : directory.size(), 4);
+  writeLE(archive, zip64 ? 0xFFFFFFFF : directoryOffset, 4);
+  writeLE(archive, 0, 2);
+  morpheus::writeFile(path, archive);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "alloc.h"
+#include "instrument.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <vector>
+
+namespace morpheus {
+
+// Work below this many elements per chunk is not worth a thread.
+const size_t parallelGrain = 1 << 16;
+
+// Rows per chunk for row-wise kernels over rows of `cols` elements.
+inline size_t rowGrain(size_t cols) { return parallelGrain / (cols + 1) + 1; }
+
+// Chunks per thread. More than one lets idle threads steal from a slow
+// one on irregular work or a busy machine.
+const size_t chunksPerThread = 4;
+
+// Number of chunks parallelFor splits [0, n) into: one per `grain` items,
+// capped at a few per thread of the current executor. Kernels that reduce
+// per chunk size their partial-result arrays with this.
+inline size_t chunkCount(size_t n, size_t grain) {
+  size_t threads = currentExecutor()->concurrency();
+  size_t cap = threads <= 1 ? 1 : threads * chunksPerThread;
+  size_t chunks = grain == 0 ? n : n / grain;
+  return std::max<size_t>(1, std::min(chunks, cap));
+}
+
+// Calls fn(chunk, begin, end) for chunkCount(n, grain) contiguous ranges
+// covering [0, n), as tasks on the current executor. fn may itself call
+// parallelFor. The chunking only depends on n, grain and the executor's
+// concurrency, so per-chunk reductions are reproducible from run to run.
+// The first exception thrown by a chunk is rethrown once all have finished.
+// Allocations and hardware counter counts of the chunks are charged to the
+// caller's operation.
+template <typename F> void parallelFor(size_t n, size_t grain, F &&fn) {
+  size_t chunks = chunkCount(n, grain);
+  if (chunks == 1) {
+    fn(size_t(0), size_t(0), n);
+    return;
+  }
+
+  std::shared_ptr<Executor> executor = currentExecutor();
+  std::vector<std::exception_ptr> errors(chunks);
+  OpAllocations *op = AllocationRegistry::current();
+  OpCounters *counters = OpCounters::current();
+  executor->run(chunks, [&](size_t c) {
+    AllocationHandoff handoff(op);
+    PerfHandoff perf(counters);
+    try {
+      fn(c, n * c / chunks, n * (c + 1) / chunks);
+    } catch (...) {
+      errors[c] = std::current_exception();
+    }
+  });
+  for (std::exception_ptr &e : errors) {
+    if (e) {
+      std::rethrow_exception(e);
+    }
+  }
+}
+
+} // namespace morpheus
@@ -0,0 +1,499 @@
+#pragma once
+
+#include "matrix.h"
+#include "parallel.h"
+#include "summation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Direction of a reduction: one result per row or one per column.
+enum class Axis { PerRow, PerColumn };
+
+// Vector norms. Over a whole matrix they are taken entry-wise, treating all
+// elements as one vector, so there L2 and Frobenius are the same norm.
+enum class Norm { L1, L2, Inf, Frobenius };
+
+namespace morpheus {
+
+// A reduction folds map(element) into combine(), starting from identity.
+// The sums also provide fold(acc, v), combine(acc, map(v)) with a single
+// rounding where possible, for Summation::BlockedFma, and compensate, the
+// compensated addition of the exact map(v) for Summation::Neumaier.
+struct SumOf {
+  static constexpr double identity = 0;
+  static double map(double v) { return v; }
+  static double combine(double a, double b) { return a + b; }
+  static double fold(double acc, double v) { return acc + v; }
+  static void compensate(double &sum, double &error, double v) {
+    neumaierAdd(sum, error, v);
+  }
+};
+
+struct AbsSumOf {
+  static constexpr double identity = 0;
+  static double map(double v) { return std::abs(v); }
+  static double combine(double a, double b) { return a + b; }
+  static double fold(double acc, double v) { return acc + std::abs(v); }
+  static void compensate(double &sum, double &error, double v) {
+    neumaierAdd(sum, error, std::abs(v));
+  }
+};
+
+struct SquareSumOf {
+  static constexpr double identity = 0;
+  static double map(double v) { return v * v; }
+  static double combine(double a, double b) { return a + b; }
+  static double fold(double acc, double v) { return multiplyAdd(v, v, acc); }
+  static void compensate(double &sum, double &error, double v) {
+    double p = v * v;
+    neumaierAdd(sum, error, p);
+    error += productError(v, v, p);
+  }
+};
+
+// The extremes propagate NaN from either side, unlike std::max and
+// std::min, whose result depends on which argument is NaN and so on the
+// lane or chunk it lands in. The comparisons still vectorize.
+struct AbsMaxOf {
+  static constexpr double identity = 0;
+  static double map(double v) { return std::abs(v); }
+  static double combine(double a, double b) {
+    return a != a || a >= b ? a : b;
+  }
+};
+
+struct MaxOf {
+  static constexpr double identity = -std::numeric_limits<double>::infinity();
+  static double map(double v) { return v; }
+  static double combine(double a, double b) {
+    return a != a || a >= b ? a : b;
+  }
+};
+
+struct MinOf {
+  static constexpr double identity = std::numeric_limits<double>::infinity();
+  static double map(double v) { return v; }
+  static double combine(double a, double b) {
+    return a != a || a <= b ? a : b;
+  }
+};
+
+// Orders for argmax and argmin, under which NaN beats every number, so the
+// first NaN is the answer, as maximum and minimum are NaN.
+struct Greater {
+  bool operator()(double a, double b) const {
+    return a > b || (a != a && b == b);
+  }
+};
+
+struct Less {
+  bool operator()(double a, double b) const {
+    return a < b || (a != a && b == b);
+  }
+};
+
+// Op over n contiguous elements in four independent lanes, which the
+// compiler keeps in vector registers, combined at the end.
+template <typename Op> double reduceRow(const double *a, int n) {
+  double lane[4] = {Op::identity, Op::identity, Op::identity, Op::identity};
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    for (int l = 0; l < 4; l++) {
+      lane[l] = Op::combine(lane[l], Op::map(a[j + l]));
+    }
+  }
+  for (; j < n; j++) {
+    lane[0] = Op::combine(lane[0], Op::map(a[j]));
+  }
+  return Op::combine(Op::combine(lane[0], lane[1]),
+                     Op::combine(lane[2], lane[3]));
+}
+
+// Chunks a reduction splits m's rows into. Below parallelGrain elements
+// there is one and the reduction runs inline, without the executor.
+inline size_t reductionChunks(const Matrix &m) {
+  size_t rows = m.rowsize;
+  size_t cols = m.columnsize;
+  if (rows * cols < parallelGrain) {
+    return 1;
+  }
+  return chunkCount(rows, rowGrain(cols));
+}
+
+// fn(chunk, firstRow, lastRow) over the reductionChunks(m) row ranges.
+template <typename F>
+void forRowChunks(const Matrix &m, size_t chunks, F &&fn) {
+  if (chunks == 1) {
+    fn(size_t(0), size_t(0), (size_t)m.rowsize);
+  } else {
+    parallelFor((size_t)m.rowsize, rowGrain(m.columnsize), fn);
+  }
+}
+
+// Op over every element. Per-chunk results are combined in chunk order, so
+// the result does not change from run to run.
+template <typename Op>
+double reduceAll(const Matrix &m, [[maybe_unused]] const char *name) {
+  MORPHEUS_OP(name, m.rowsize * m.columnsize, 8.0 * m.rowsize * m.columnsize,
+              m.rowsize, m.columnsize);
+  size_t chunks = reductionChunks(m);
+  std::vector<double> partial(chunks, Op::identity);
+  int cols = m.columnsize;
+  forRowChunks(m, chunks, [&](size_t c, size_t first, size_t last) {
+    double acc = Op::identity;
+    for (size_t i = first; i < last; i++) {
+      acc = Op::combine(acc, reduceRow<Op>(m.matrix[i].data(), cols));
+    }
+    partial[c] = acc;
+  });
+  double acc = Op::identity;
+  for (double p : partial) {
+    acc = Op::combine(acc, p);
+  }
+  return acc;
+}
+
+// Op along every row, or down every column. Columns are reduced a whole
+// row at a time into a row-length accumulator per chunk, so the matrix is
+// read contiguously rather than one strided column after another.
+template <typename Op>
+vec reduceAxis(const Matrix &m, Axis axis, [[maybe_unused]] const char *name) {
+  MORPHEUS_OP(name, m.rowsize * m.columnsize, 8.0 * m.rowsize * m.columnsize,
+              m.rowsize, m.columnsize);
+  int cols = m.columnsize;
+  size_t chunks = reductionChunks(m);
+  if (axis == Axis::PerRow) {
+    vec out(m.rowsize);
+    forRowChunks(m, chunks, [&](size_t, size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        out[i] = reduceRow<Op>(m.matrix[i].data(), cols);
+      }
+    });
+    return out;
+  }
+
+  std::vector<vec> partial(chunks, vec(cols, Op::identity));
+  forRowChunks(m, chunks, [&](size_t c, size_t first, size_t last) {
+    double *acc = partial[c].data();
+    for (size_t i = first; i < last; i++) {
+      updateRow(acc, m.matrix[i].data(), cols, [](double a, double v) {
+        return Op::combine(a, Op::map(v));
+      });
+    }
+  });
+  for (size_t c = 1; c < chunks; c++) {
+    updateRow(partial[0].data(), partial[c].data(), cols, Op::combine);
+  }
+  return std::move(partial[0]);
+}
+
+// Terms Op::map(x[j]) of a sum, for the Summation kernels.
+template <typename Op> struct MappedTerms {
+  const double *x;
+  double value(int j) const { return Op::map(x[j]); }
+  double fold(double acc, int j) const { return Op::fold(acc, x[j]); }
+  void compensate(double &sum, double &error, int j) const {
+    Op::compensate(sum, error, x[j]);
+  }
+};
+
+// reduceAxis for the sums, accumulated in `mode`. Column sums are chunks
+// of whole rows summed element-wise by sumRows, then the chunks' results
+// summed the same way. In Neumaier mode the chunks' rounding errors are
+// summed along with their sums, so cancellation between chunks is exact.
+template <typename Op>
+vec sumAxis(const Matrix &m, Axis axis, Summation mode,
+            [[maybe_unused]] const char *name) {
+  if (mode == Summation::Naive) {
+    return reduceAxis<Op>(m, axis, name);
+  }
+  MORPHEUS_OP(name, m.rowsize * m.columnsize, 8.0 * m.rowsize * m.columnsize,
+              m.rowsize, m.columnsize);
+  int cols = m.columnsize;
+  size_t chunks = reductionChunks(m);
+  if (axis == Axis::PerRow) {
+    vec out(m.rowsize);
+    forRowChunks(m, chunks, [&](size_t, size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        out[i] = sumTerms(mode, MappedTerms<Op>{m.matrix[i].data()}, cols);
+      }
+    });
+    return out;
+  }
+
+  bool compensated = mode == Summation::Neumaier;
+  std::vector<vec> partial(compensated ? 2 * chunks : chunks, vec(cols));
+  forRowChunks(m, chunks, [&](size_t c, size_t first, size_t last) {
+    auto rowTerms = [&](int k) {
+      return MappedTerms<Op>{m.matrix[first + k].data()};
+    };
+    int count = last - first;
+    if (compensated) {
+      neumaierRows(count, cols, rowTerms, partial[c].data(),
+                   partial[chunks + c].data());
+    } else {
+      sumRows(mode, count, cols, rowTerms, partial[c].data());
+    }
+  });
+  if (partial.size() == 1) {
+    return std::move(partial[0]);
+  }
+  vec out(cols);
+  sumRows(
+      mode, (int)partial.size(), cols,
+      [&](int k) { return PlainTerms{partial[k].data()}; }, out.data());
+  return out;
+}
+
+// reduceAll for the sums, accumulated in `mode`: the sums of the rows,
+// summed in turn. In Neumaier mode every chunk runs one compensated sum
+// over all of its rows, and the chunks' errors are added along with their
+// sums.
+template <typename Op>
+double sumAll(const Matrix &m, Summation mode, const char *name) {
+  if (mode == Summation::Naive) {
+    return reduceAll<Op>(m, name);
+  }
+  if (mode != Summation::Neumaier) {
+    vec rows = sumAxis<Op>(m, Axis::PerRow, mode, name);
+    return sumTerms(mode, PlainTerms{rows.data()}, (int)rows.size());
+  }
+  MORPHEUS_OP(name, m.rowsize * m.columnsize, 8.0 * m.rowsize * m.columnsize,
+              m.rowsize, m.columnsize);
+  int cols = m.columnsize;
+  size_t chunks = reductionChunks(m);
+  std::vector<Compensated> partial(chunks);
+  forRowChunks(m, chunks, [&](size_t c, size_t first, size_t last) {
+    NeumaierLanes lanes;
+    for (size_t i = first; i < last; i++) {
+      lanes.add(MappedTerms<Op>{m.matrix[i].data()}, cols);
+    }
+    partial[c] = lanes.total();
+  });
+  Compensated total;
+  for (const Compensated &p : partial) {
+    neumaierAdd(total.sum, total.error, p.sum);
+    total.error += p.error;
+  }
+  return total.value();
+}
+
+// Row and column of the first element (in row-major order) that no other
+// element is better than.
+template <typename Better>
+std::pair<int, int> argBest(const Matrix &m, const char *name) {
+  MORPHEUS_OP(name, 0, 8.0 * m.rowsize * m.columnsize, m.rowsize,
+              m.columnsize);
+  if (m.rowsize == 0 || m.columnsize == 0) {
+    throw std::invalid_argument(std::string("INVALID OPERATION! ") + name +
+                                " of an empty Matrix");
+  }
+  struct Best {
+    double value;
+    int row;
+    int col;
+  };
+  Better better;
+  int cols = m.columnsize;
+  size_t chunks = reductionChunks(m);
+  std::vector<Best> partial(chunks);
+  forRowChunks(m, chunks, [&](size_t c, size_t first, size_t last) {
+    Best best{m.matrix[first][0], (int)first, 0};
+    for (size_t i = first; i < last; i++) {
+      const double *a = m.matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        if (better(a[j], best.value)) {
+          best = Best{a[j], (int)i, j};
+        }
+      }
+    }
+    partial[c] = best;
+  });
+  Best best = partial[0];
+  for (size_t c = 1; c < chunks; c++) {
+    if (better(partial[c].value, best.value)) {
+      best = partial[c];
+    }
+  }
+  return std::make_pair(best.row, best.col);
+}
+
+// Index of the first best element of every row, or of every column.
+template <typename Better>
+std::vector<int> argBestAxis(const Matrix &m, Axis axis, const char *name) {
+  MORPHEUS_OP(name, 0, 8.0 * m.rowsize * m.columnsize, m.rowsize,
+              m.columnsize);
+  if ((axis == Axis::PerRow ? m.columnsize : m.rowsize) == 0) {
+    throw std::invalid_argument(std::string("INVALID OPERATION! ") + name +
+                                " along an empty dimension");
+  }
+  Better better;
+  int cols = m.columnsize;
+  size_t chunks = reductionChunks(m);
+  if (axis == Axis::PerRow) {
+    std::vector<int> out(m.rowsize);
+    forRowChunks(m, chunks, [&](size_t, size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        const double *a = m.matrix[i].data();
+        int best = 0;
+        for (int j = 1; j < cols; j++) {
+          if (better(a[j], a[best])) {
+            best = j;
+          }
+        }
+        out[i] = best;
+      }
+    });
+    return out;
+  }
+
+  // Per chunk, the best value and its row for every column, updated a
+  // whole row at a time.
+  std::vector<vec> values(chunks);
+  std::vector<std::vector<int>> rows(chunks);
+  forRowChunks(m, chunks, [&](size_t c, size_t first, size_t last) {
+    vec &value = values[c];
+    std::vector<int> &row = rows[c];
+    value = m.matrix[first];
+    row.assign(cols, (int)first);
+    for (size_t i = first + 1; i < last; i++) {
+      const double *a = m.matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        if (better(a[j], value[j])) {
+          value[j] = a[j];
+          row[j] = (int)i;
+        }
+      }
+    }
+  });
+  for (size_t c = 1; c < chunks; c++) {
+    for (int j = 0; j < cols; j++) {
+      if (better(values[c][j], values[0][j])) {
+        values[0][j] = values[c][j];
+        rows[0][j] = rows[c][j];
+      }
+    }
+  }
+  return std::move(rows[0]);
+}
+
+} // namespace morpheus
+
+// Whole-matrix and per-row / per-column reductions. They are multithreaded
+// above morpheus::parallelGrain elements; partial results are combined in a
+// fixed order, so a given executor always gives the same answer. The sums
+// (sum, mean and the L1 and L2 norms) accumulate in a selectable Summation
+// mode; the default Naive is the fastest.
+
+inline double sum(const Matrix &m, Summation mode = Summation::Naive) {
+  return morpheus::sumAll<morpheus::SumOf>(m, mode, "sum");
+}
+
+inline vec sum(const Matrix &m, Axis axis,
+               Summation mode = Summation::Naive) {
+  return morpheus::sumAxis<morpheus::SumOf>(m, axis, mode, "sum");
+}
+
+inline double mean(const Matrix &m, Summation mode = Summation::Naive) {
+  if (m.rowsize == 0 || m.columnsize == 0) {
+    throw std::invalid_argument(
+        "INVALID OPERATION! mean of an empty Matrix");
+  }
+  return sum(m, mode) / (m.rowsize * m.columnsize);
+}
+
+inline vec mean(const Matrix &m, Axis axis,
+                Summation mode = Summation::Naive) {
+  double count = axis == Axis::PerRow ? m.columnsize : m.rowsize;
+  if (count == 0) {
+    throw std::invalid_argument(
+        "INVALID OPERATION! mean along an empty dimension");
+  }
+  vec out = sum(m, axis, mode);
+  for (double &v : out) {
+    v /= count;
+  }
+  return out;
+}
+
+// mode applies to the L1 and L2 sums; Inf needs no summing.
+inline double norm(const Matrix &m, Norm kind = Norm::Frobenius,
+                   Summation mode = Summation::Naive) {
+  switch (kind) {
+  case Norm::L1:
+    return morpheus::sumAll<morpheus::AbsSumOf>(m, mode, "norm");
+  case Norm::Inf:
+    return morpheus::reduceAll<morpheus::AbsMaxOf>(m, "norm");
+  case Norm::L2:
+  case Norm::Frobenius:
+    break;
+  }
+  return std::sqrt(morpheus::sumAll<morpheus::SquareSumOf>(m, mode, "norm"));
+}
+
+inline vec norm(const Matrix &m, Axis axis, Norm kind = Norm::L2,
+                Summation mode = Summation::Naive) {
+  switch (kind) {
+  case Norm::L1:
+    return morpheus::sumAxis<morpheus::AbsSumOf>(m, axis, mode, "norm");
+  case Norm::Inf:
+    return morpheus::reduceAxis<morpheus::AbsMaxOf>(m, axis, "norm");
+  case Norm::L2:
+  case Norm::Frobenius:
+    break;
+  }
+  vec out = morpheus::sumAxis<morpheus::SquareSumOf>(m, axis, mode, "norm");
+  for (double &v : out) {
+    v = std::sqrt(v);
+  }
+  return out;
+}
+
+// minimum and maximum of an empty Matrix (or along an empty dimension) are
+// +/- infinity; argmin and argmax of one throw. NaN propagates: minimum,
+// maximum and the Inf norm are NaN wherever an element is, and argmin and
+// argmax point at the first NaN.
+
+inline double minimum(const Matrix &m) {
+  return morpheus::reduceAll<morpheus::MinOf>(m, "minimum");
+}
+
+inline vec minimum(const Matrix &m, Axis axis) {
+  return morpheus::reduceAxis<morpheus::MinOf>(m, axis, "minimum");
+}
+
+inline double maximum(const Matrix &m) {
+  return morpheus::reduceAll<morpheus::MaxOf>(m, "maximum");
+}
+
+inline vec maximum(const Matrix &m, Axis axis) {
+  return morpheus::reduceAxis<morpheus::MaxOf>(m, axis, "maximum");
+}
+
+// Row and column of the first smallest element, in row-major order.
+inline std::pair<int, int> argmin(const Matrix &m) {
+  return morpheus::argBest<morpheus::Less>(m, "argmin");
+}
+
+// Column of the first smallest element of each row, or row of the first
+// smallest element of each column.
+inline std::vector<int> argmin(const Matrix &m, Axis axis) {
+  return morpheus::argBestAxis<morpheus::Less>(m, axis, "argmin");
+}
+
+// Row and column of the first largest element, in row-major order.
+inline std::pair<int, int> argmax(const Matrix &m) {
+  return morpheus::argBest<morpheus::Greater>(m, "argmax");
+}
+
+// Column of the first largest element of each row, or row of the first
+// largest element of each column.
+inline std::vector<int> argmax(const Matrix &m, Axis axis) {
+  return morpheus::argBestAxis<morpheus::Greater>(m, axis, "argmax");
+}
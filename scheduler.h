@@ -0,0 +1,416 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the chunks of the library's parallel loops. The default is a
+// work-stealing pool; install an application's own thread pool with
+// setExecutor to route all of the library's parallelism through it.
+class Executor {
+
+public:
+  virtual ~Executor() = default;
+
+  // Threads that can work on a loop at once, including the caller.
+  virtual size_t concurrency() const = 0;
+
+  // Calls task(i) for every i in [0, count) and returns once all calls have
+  // finished. The tasks do not throw, may run on any thread (the caller
+  // included) and may themselves call run again.
+  virtual void run(size_t count, const std::function<void(size_t)> &task) = 0;
+
+  // Runs task at some later point without waiting for it; used by the
+  // asynchronous operations. The fallback starts a detached thread per task.
+  virtual void post(std::function<void()> task) {
+    std::thread(std::move(task)).detach();
+  }
+};
+
+namespace morpheus {
+
+inline size_t hardwareThreads() {
+  size_t n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+// Chase-Lev deque of pointers. The owning thread pushes and pops at the
+// bottom; any thread steals from the top. Arrays outgrown by push are kept
+// until the deque is destroyed, since a thief may still be reading one.
+template <typename T> class WorkStealingDeque {
+
+public:
+  explicit WorkStealingDeque(size_t capacity = 64) {
+    arrays.push_back(std::make_unique<Array>(capacity));
+    array.store(arrays.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque &) = delete;
+  WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+  // Owner only.
+  void push(T *item) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Array *a = array.load(std::memory_order_relaxed);
+    if (b - t >= (int64_t)a->capacity) {
+      a = grow(a, t, b);
+    }
+    a->put(b, item);
+    bottom.store(b + 1, std::memory_order_release);
+  }
+
+  // Owner only; the most recently pushed item, or null.
+  T *pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Array *a = array.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T *item = a->get(b);
+    if (t == b) {
+      // Last item: race the thieves for it.
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Any thread; the oldest item, or null when empty or lost to another
+  // thief.
+  T *steal() {
+    int64_t t = top.load(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b) {
+      return nullptr;
+    }
+    T *item = array.load(std::memory_order_acquire)->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  bool empty() const {
+    return top.load(std::memory_order_acquire) >=
+           bottom.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Array {
+    explicit Array(size_t capacity)
+        : capacity(capacity), slots(new std::atomic<T *>[capacity]) {}
+
+    T *get(int64_t i) const {
+      return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+    }
+    void put(int64_t i, T *item) {
+      slots[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+    }
+
+    const size_t capacity; // a power of two
+    std::unique_ptr<std::atomic<T *>[]> slots;
+  };
+
+  Array *grow(Array *a, int64_t t, int64_t b) {
+    arrays.push_back(std::make_unique<Array>(a->capacity * 2));
+    Array *bigger = arrays.back().get();
+    for (int64_t i = t; i < b; i++) {
+      bigger->put(i, a->get(i));
+    }
+    array.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  std::atomic<int64_t> top{0};
+  std::atomic<int64_t> bottom{0};
+  std::atomic<Array *> array;
+  std::vector<std::unique_ptr<Array>> arrays; // owner only
+};
+
+// Fixed set of workers, each with its own deque. A thread that calls run
+// pushes the tasks onto its deque (or, if it is not a worker, a shared
+// queue), runs one itself and then keeps taking loop tasks, its own first
+// and stolen ones otherwise, until all of its tasks are done. Workers never
+// block while waiting, so loops nested in tasks cannot deadlock the pool;
+// other threads block once nothing is left to take. Posted tasks have a
+// queue of their own that only idle workers drain, so a waiting thread never
+// runs an unrelated (possibly blocking) posted task on its stack.
+class WorkStealingPool : public Executor {
+
+public:
+  // `threads` includes the calling thread, so threads - 1 workers start;
+  // one always does, so posted tasks run even when threads is 1.
+  explicit WorkStealingPool(size_t threads = hardwareThreads())
+      : width(std::max<size_t>(threads, 1)) {
+    size_t n = std::max<size_t>(width - 1, 1);
+    for (size_t i = 0; i < n; i++) {
+      workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < n; i++) {
+      workers[i]->thread = std::thread([this, i] { work(i); });
+    }
+  }
+
+  ~WorkStealingPool() override {
+    {
+      std::lock_guard<std::mutex> guard(sleepLock);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers) {
+      w->thread.join();
+    }
+    for (Job *job : posted) {
+      delete job; // never started
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  size_t concurrency() const override { return width; }
+
+  void run(size_t count, const std::function<void(size_t)> &task) override {
+    if (count == 0) {
+      return;
+    }
+    Loop loop(task, count);
+    std::vector<Job> jobs(count);
+    for (size_t i = 0; i < count; i++) {
+      jobs[i] = Job{&loop, i, nullptr};
+    }
+    Worker *self = current();
+    if (count > 1) {
+      if (self) {
+        for (size_t i = count - 1; i > 0; i--) {
+          self->deque.push(&jobs[i]);
+        }
+      } else {
+        std::lock_guard<std::mutex> guard(sharedLock);
+        for (size_t i = 1; i < count; i++) {
+          shared.push_back(&jobs[i]);
+        }
+      }
+      notify();
+    }
+    execute(&jobs[0]);
+    int idle = 0;
+    while (loop.pending.load(std::memory_order_acquire) > 0) {
+      if (Job *job = find(false)) {
+        execute(job);
+        idle = 0;
+      } else if (self || ++idle < spinLimit) {
+        std::this_thread::yield();
+      } else {
+        break; // the rest are running elsewhere
+      }
+    }
+    // Returning destroys loop, so wait for the last task to be done with it.
+    std::unique_lock<std::mutex> lock(loop.lock);
+    loop.done.wait(lock, [&] { return loop.finished; });
+  }
+
+  void post(std::function<void()> task) override {
+    Job *job = new Job{nullptr, 0, std::move(task)};
+    {
+      std::lock_guard<std::mutex> guard(sharedLock);
+      posted.push_back(job);
+    }
+    notify();
+  }
+
+  // Tasks stolen from another worker's deque since construction.
+  size_t steals() const { return stealCount.load(std::memory_order_relaxed); }
+
+private:
+  // Yields before a thread outside the pool blocks, or an idle worker
+  // sleeps.
+  static const int spinLimit = 64;
+
+  // A call to run. The task that finishes last sets finished under lock.
+  struct Loop {
+    Loop(const std::function<void(size_t)> &task, size_t count)
+        : task(task), pending(count) {}
+
+    const std::function<void(size_t)> &task;
+    std::atomic<size_t> pending;
+    std::mutex lock;
+    std::condition_variable done;
+    bool finished = false;
+  };
+
+  // One task of a run, or a posted task that owns its function.
+  struct Job {
+    Loop *loop;
+    size_t index;
+    std::function<void()> posted;
+  };
+
+  struct Worker {
+    WorkStealingDeque<Job> deque;
+    std::thread thread;
+  };
+
+  static void execute(Job *job) {
+    Loop *loop = job->loop;
+    if (!loop) {
+      job->posted();
+      delete job;
+      return;
+    }
+    loop->task(job->index);
+    if (loop->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> guard(loop->lock);
+      loop->finished = true;
+      loop->done.notify_all();
+    }
+  }
+
+  // The calling thread's worker if it belongs to this pool.
+  Worker *current() const {
+    return currentPool() == this ? workers[currentIndex()].get() : nullptr;
+  }
+
+  static const WorkStealingPool *&currentPool() {
+    thread_local const WorkStealingPool *pool = nullptr;
+    return pool;
+  }
+
+  static size_t &currentIndex() {
+    thread_local size_t index = 0;
+    return index;
+  }
+
+  // Own deque first, then the shared queue, then the other workers, and
+  // posted tasks last if the caller takes them.
+  Job *find(bool takePosted) {
+    Worker *self = current();
+    if (self) {
+      if (Job *job = self->deque.pop()) {
+        return job;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> guard(sharedLock);
+      if (!shared.empty()) {
+        Job *job = shared.front();
+        shared.pop_front();
+        return job;
+      }
+    }
+    size_t n = workers.size();
+    size_t start = self ? currentIndex() + 1 : victim++;
+    for (size_t k = 0; k < n; k++) {
+      Worker *w = workers[(start + k) % n].get();
+      if (w == self) {
+        continue;
+      }
+      if (Job *job = w->deque.steal()) {
+        stealCount.fetch_add(1, std::memory_order_relaxed);
+        return job;
+      }
+    }
+    if (takePosted) {
+      std::lock_guard<std::mutex> guard(sharedLock);
+      if (!posted.empty()) {
+        Job *job = posted.front();
+        posted.pop_front();
+        return job;
+      }
+    }
+    return nullptr;
+  }
+
+  void notify() {
+    {
+      std::lock_guard<std::mutex> guard(sleepLock);
+      epoch++;
+    }
+    wake.notify_all();
+  }
+
+  // Workers spin briefly after running out of tasks, so back-to-back loops
+  // do not pay for a wake-up, then sleep until the next run.
+  void work(size_t index) {
+    currentPool() = this;
+    currentIndex() = index;
+    while (true) {
+      uint64_t seen;
+      {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        seen = epoch;
+      }
+      Job *job = nullptr;
+      for (int spin = 0; spin < spinLimit && !job; spin++) {
+        job = find(true);
+        if (!job) {
+          std::this_thread::yield();
+        }
+      }
+      if (job) {
+        execute(job);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleepLock);
+      wake.wait(lock, [&] { return stopping || epoch != seen; });
+      if (stopping) {
+        return;
+      }
+    }
+  }
+
+  const size_t width;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::mutex sharedLock;
+  std::deque<Job *> shared; // loop tasks from threads outside the pool
+  std::deque<Job *> posted;
+  std::atomic<size_t> victim{0};
+  std::atomic<size_t> stealCount{0};
+  std::mutex sleepLock;
+  std::condition_variable wake;
+  uint64_t epoch = 0;
+  bool stopping = false;
+};
+
+inline std::shared_ptr<Executor> &installedExecutor() {
+  static std::shared_ptr<Executor> executor;
+  return executor;
+}
+
+inline std::shared_ptr<Executor> defaultExecutor() {
+  static std::shared_ptr<Executor> pool = std::make_shared<WorkStealingPool>();
+  return pool;
+}
+
+// The executor parallel loops run on: the installed one, or the default
+// pool (started on first use).
+inline std::shared_ptr<Executor> currentExecutor() {
+  std::shared_ptr<Executor> executor = std::atomic_load(&installedExecutor());
+  return executor ? executor : defaultExecutor();
+}
+
+} // namespace morpheus
+
+// Routes the library's parallel loops through `executor`; null restores the
+// default work-stealing pool. Do not switch while library calls are running
+// on other threads, as loops size their per-chunk buffers from the
+// executor's concurrency.
+inline void setExecutor(std::shared_ptr<Executor> executor) {
+  std::atomic_store(&morpheus::installedExecutor(), std::move(executor));
+}
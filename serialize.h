@@ -0,0 +1,264 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "matrix.h"
+#include "matrix_view.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Element types that can be stored on disk. Matrices are always double in
+// memory; other types are converted on save and load.
+enum class DType : uint16_t { F64 = 1, F32 = 2, I32 = 3 };
+
+// Binary matrix file, version 1:
+//
+//   offset  size  field
+//        0     8  magic "MORPHMAT"
+//        8     4  byte-order mark 0x01020304 in the writer's byte order
+//       12     2  format version
+//       14     2  dtype (DType)
+//       16     8  rows
+//       24     8  columns
+//       32     8  offset of the first element from the start of the file
+//       40     4  alignment of that offset in bytes
+//       44    20  reserved, zero
+//       64        padding up to the data offset, then rows * columns
+//                 row-major elements
+//
+// All header integers are in the writer's byte order; the byte-order mark
+// tells the reader whether it has to swap.
+struct BinaryHeader {
+  char magic[8];
+  uint32_t byteOrder;
+  uint16_t version;
+  uint16_t dtype;
+  uint64_t rows;
+  uint64_t columns;
+  uint64_t dataOffset;
+  uint32_t alignment;
+  unsigned char reserved[20];
+};
+static_assert(sizeof(BinaryHeader) == 64, "BinaryHeader must be 64 bytes");
+
+namespace morpheus {
+
+const char binaryMagic[8] = {'M', 'O', 'R', 'P', 'H', 'M', 'A', 'T'};
+const uint32_t byteOrderMark = 0x01020304;
+const uint16_t binaryVersion = 1;
+
+inline size_t dtypeSize(DType dtype) {
+  switch (dtype) {
+  case DType::F64:
+    return 8;
+  case DType::F32:
+  case DType::I32:
+    return 4;
+  }
+  throw std::runtime_error("INVALID FORMAT! Unknown dtype " +
+                           std::to_string((int)dtype));
+}
+
+template <typename T> T byteSwap(T value) {
+  unsigned char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  for (size_t i = 0; i < sizeof(T) / 2; i++) {
+    std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+  }
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+// Converts `count` stored elements to doubles.
+inline void decodeElements(const unsigned char *in, DType dtype, bool swap,
+                           size_t count, double *out) {
+  for (size_t i = 0; i < count; i++) {
+    switch (dtype) {
+    case DType::F64: {
+      double v;
+      std::memcpy(&v, in + i * 8, 8);
+      out[i] = swap ? byteSwap(v) : v;
+      break;
+    }
+    case DType::F32: {
+      float v;
+      std::memcpy(&v, in + i * 4, 4);
+      out[i] = swap ? byteSwap(v) : v;
+      break;
+    }
+    case DType::I32: {
+      int32_t v;
+      std::memcpy(&v, in + i * 4, 4);
+      out[i] = swap ? byteSwap(v) : v;
+      break;
+    }
+    }
+  }
+}
+
+inline void encodeElements(const double *in, DType dtype, size_t count,
+                           unsigned char *out) {
+  for (size_t i = 0; i < count; i++) {
+    switch (dtype) {
+    case DType::F64:
+      std::memcpy(out + i * 8, in + i, 8);
+      break;
+    case DType::F32: {
+      float v = in[i];
+      std::memcpy(out + i * 4, &v, 4);
+      break;
+    }
+    case DType::I32: {
+      int32_t v = (int32_t)std::lround(in[i]);
+      std::memcpy(out + i * 4, &v, 4);
+      break;
+    }
+    }
+  }
+}
+
+struct ParsedHeader {
+  BinaryHeader header;
+  bool swap;
+};
+
+inline ParsedHeader parseBinaryHeader(const unsigned char *bytes, size_t size,
+                                      const std::string &path) {
+  ParsedHeader Result;
+  BinaryHeader &h = Result.header;
+  if (size < sizeof(BinaryHeader)) {
+    throw std::runtime_error("INVALID FORMAT! " + path +
+                             " is too small for a matrix header");
+  }
+  std::memcpy(&h, bytes, sizeof(BinaryHeader));
+  if (std::memcmp(h.magic, binaryMagic, sizeof(binaryMagic)) != 0) {
+    throw std::runtime_error("INVALID FORMAT! " + path +
+                             " is not a Morpheus matrix file");
+  }
+  if (h.byteOrder == byteOrderMark) {
+    Result.swap = false;
+  } else if (h.byteOrder == byteSwap(byteOrderMark)) {
+    Result.swap = true;
+    h.version = byteSwap(h.version);
+    h.dtype = byteSwap(h.dtype);
+    h.rows = byteSwap(h.rows);
+    h.columns = byteSwap(h.columns);
+    h.dataOffset = byteSwap(h.dataOffset);
+    h.alignment = byteSwap(h.alignment);
+  } else {
+    throw std::runtime_error("INVALID FORMAT! " + path +
+                             " has an unknown byte-order mark");
+  }
+  if (h.version != binaryVersion) {
+    throw std::runtime_error("INVALID FORMAT! " + path + " has version " +
+                             std::to_string(h.version) + ", expected " +
+                             std::to_string(binaryVersion));
+  }
+  if (h.rows > INT32_MAX || h.columns > INT32_MAX) {
+    throw std::runtime_error("INVALID FORMAT! " + path +
+                             " has dimensions too large for a Matrix");
+  }
+  uint64_t elements = h.rows * h.columns;
+  size_t elementSize = dtypeSize(static_cast<DType>(h.dtype));
+  if (h.dataOffset < sizeof(BinaryHeader) || h.dataOffset > size ||
+      (size - h.dataOffset) / elementSize < elements) {
+    throw std::runtime_error("INVALID FORMAT! " + path +
+                             " is truncated or has a bad data offset");
+  }
+  return Result;
+}
+
+} // namespace morpheus
+
+// Writes m in the binary format above. The data offset is rounded up to
+// `alignment` (a power of two) so mapped loads can use the data in place.
+inline void saveBinary(const Matrix &m, const std::string &path,
+                       DType dtype = DType::F64, uint32_t alignment = 64) {
+  if (alignment < 8 || (alignment & (alignment - 1)) != 0) {
+    throw std::invalid_argument("INVALID ALIGNMENT! " +
+                                std::to_string(alignment) +
+                                " is not a power of two >= 8");
+  }
+
+  BinaryHeader h{};
+  std::memcpy(h.magic, morpheus::binaryMagic, sizeof(h.magic));
+  h.byteOrder = morpheus::byteOrderMark;
+  h.version = morpheus::binaryVersion;
+  h.dtype = static_cast<uint16_t>(dtype);
+  h.rows = (uint64_t)m.rowsize;
+  h.columns = (uint64_t)m.columnsize;
+  h.alignment = alignment;
+  h.dataOffset = (sizeof(BinaryHeader) + alignment - 1) / alignment * alignment;
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("CANNOT OPEN FILE! " + path);
+  }
+  out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  std::vector<char> padding(h.dataOffset - sizeof(h), 0);
+  out.write(padding.data(), padding.size());
+
+  size_t cols = m.columnsize;
+  size_t elementSize = morpheus::dtypeSize(dtype);
+  std::vector<unsigned char> row(cols * elementSize);
+  for (int i = 0; i < m.rowsize; i++) {
+    morpheus::encodeElements(m.matrix[i].data(), dtype, cols, row.data());
+    out.write(reinterpret_cast<const char *>(row.data()), row.size());
+  }
+  if (!out) {
+    throw std::runtime_error("CANNOT WRITE FILE! " + path);
+  }
+}
+
+// Maps a binary matrix file and returns a read-only view of it. When the
+// file holds native-endian F64 data the view points straight into the
+// mapping and nothing is copied; other dtypes or byte orders are converted
+// into a buffer owned by the view.
+inline MatrixView mapBinary(const std::string &path) {
+  auto file = std::make_shared<MappedFile>(path);
+  morpheus::ParsedHeader parsed =
+      morpheus::parseBinaryHeader(file->data(), file->size(), path);
+  const BinaryHeader &h = parsed.header;
+  DType dtype = static_cast<DType>(h.dtype);
+  const unsigned char *data = file->data() + h.dataOffset;
+  int rows = h.rows;
+  int cols = h.columns;
+
+  if (dtype == DType::F64 && !parsed.swap &&
+      reinterpret_cast<uintptr_t>(data) % alignof(double) == 0) {
+    return MatrixView(reinterpret_cast<const double *>(data), rows, cols, cols,
+                      file);
+  }
+
+  auto converted = std::make_shared<vec>((size_t)rows * cols);
+  morpheus::decodeElements(data, dtype, parsed.swap, converted->size(),
+                           converted->data());
+  return MatrixView(converted->data(), rows, cols, cols, converted);
+}
+
+// Reads a binary matrix file into an ordinary Matrix.
+inline Matrix loadBinary(const std::string &path) {
+  MappedFile file(path);
+  morpheus::ParsedHeader parsed =
+      morpheus::parseBinaryHeader(file.data(), file.size(), path);
+  const BinaryHeader &h = parsed.header;
+  DType dtype = static_cast<DType>(h.dtype);
+  size_t elementSize = morpheus::dtypeSize(dtype);
+  int rows = h.rows;
+  int cols = h.columns;
+
+  Mat data(rows, vec(cols));
+  const unsigned char *in = file.data() + h.dataOffset;
+  for (int i = 0; i < rows; i++) {
+    morpheus::decodeElements(in + (size_t)i * cols * elementSize, dtype,
+                             parsed.swap, cols, data[i].data());
+  }
+  return Matrix(std::move(data), std::make_tuple(rows, cols));
+}
@@ -0,0 +1,433 @@
+#pragma once
+
+#include "linear_operator.h"
+#include "matrix.h"
+#include "parallel.h"
+#include "sparse.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace morpheus {
+
+// Parallel dot product. Partial sums are combined in chunk order, so the
+// result does not change from run to run.
+inline double dot(const vec &x, const vec &y) {
+  std::vector<double> partial(chunkCount(x.size(), parallelGrain));
+  parallelFor(x.size(), parallelGrain, [&](size_t c, size_t begin, size_t end) {
+    double sum{};
+    for (size_t i = begin; i < end; i++) {
+      sum += x[i] * y[i];
+    }
+    partial[c] = sum;
+  });
+  double sum{};
+  for (double p : partial) {
+    sum += p;
+  }
+  return sum;
+}
+
+// p = z + beta * p
+inline void xpby(const vec &z, double beta, vec &p) {
+  parallelFor(p.size(), parallelGrain, [&](size_t, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      p[i] = z[i] + beta * p[i];
+    }
+  });
+}
+
+struct CGUpdate {
+  double rr = 0; // r . r after the update
+  double rz = 0; // r . z after the update (r . r without a preconditioner)
+};
+
+// The whole vector part of a CG iteration in one pass over memory:
+//   x += alpha p,  r -= alpha q,  z = invDiag * r  (when invDiag is given)
+// returning r . r and r . z of the updated residual.
+inline CGUpdate cgUpdate(double alpha, const vec &p, const vec &q, vec &x,
+                         vec &r, const vec *invDiag, vec &z) {
+  size_t chunks = chunkCount(x.size(), parallelGrain);
+  std::vector<CGUpdate> partial(chunks);
+  parallelFor(x.size(), parallelGrain, [&](size_t c, size_t begin, size_t end) {
+    double rr{};
+    double rz{};
+    if (invDiag) {
+      const double *d = invDiag->data();
+      for (size_t i = begin; i < end; i++) {
+        x[i] += alpha * p[i];
+        double ri = r[i] - alpha * q[i];
+        r[i] = ri;
+        double zi = d[i] * ri;
+        z[i] = zi;
+        rr += ri * ri;
+        rz += ri * zi;
+      }
+    } else {
+      for (size_t i = begin; i < end; i++) {
+        x[i] += alpha * p[i];
+        double ri = r[i] - alpha * q[i];
+        r[i] = ri;
+        rr += ri * ri;
+      }
+      rz = rr;
+    }
+    partial[c] = {rr, rz};
+  });
+  CGUpdate Result;
+  for (const CGUpdate &u : partial) {
+    Result.rr += u.rr;
+    Result.rz += u.rz;
+  }
+  return Result;
+}
+
+inline void checkSystem(const LinearOperator &A, const vec &b, vec &x) {
+  if (A.rows() != A.cols() || (int)b.size() != A.rows()) {
+    throw std::invalid_argument(
+        "INVALID OPERATION UNEQUAL DIMENSIONS! Operator of size " +
+        std::to_string(A.rows()) + "x" + std::to_string(A.cols()) +
+        " and right-hand side of size " + std::to_string(b.size()));
+  }
+  if (x.size() != b.size()) {
+    x.assign(b.size(), 0.0);
+  }
+}
+
+} // namespace morpheus
+
+// z = M^-1 r for some approximation M of the system matrix.
+class Preconditioner {
+
+public:
+  virtual ~Preconditioner() = default;
+
+  virtual void apply(const vec &r, vec &z) const = 0;
+
+  // Diagonal preconditioners expose M^-1 so solvers can fuse it into their
+  // vector updates.
+  virtual const vec *inverseDiagonal() const { return nullptr; }
+};
+
+class JacobiPreconditioner : public Preconditioner {
+
+public:
+  vec inverse;
+
+  JacobiPreconditioner(const Matrix &A) {
+    checkSquare(A.rowsize, A.columnsize);
+    inverse.resize(A.rowsize);
+    for (int i = 0; i < A.rowsize; i++) {
+      inverse[i] = invert(A.matrix[i][i], i);
+    }
+  }
+
+  JacobiPreconditioner(const SparseMatrix &A) {
+    checkSquare(A.rowsize, A.columnsize);
+    inverse.resize(A.rowsize);
+    for (int i = 0; i < A.rowsize; i++) {
+      inverse[i] = invert(A.get(i, i), i);
+    }
+  }
+
+  void apply(const vec &r, vec &z) const override {
+    z.resize(r.size());
+    for (size_t i = 0; i < r.size(); i++) {
+      z[i] = inverse[i] * r[i];
+    }
+  }
+
+  const vec *inverseDiagonal() const override { return &inverse; }
+
+private:
+  static void checkSquare(int rows, int cols) {
+    if (rows != cols) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! Preconditioner needs a square matrix, got " +
+          std::to_string(rows) + "x" + std::to_string(cols));
+    }
+  }
+
+  static double invert(double d, int i) {
+    if (d == 0) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! Zero diagonal entry at row " + std::to_string(i));
+    }
+    return 1.0 / d;
+  }
+};
+
+// Incomplete LU with zero fill-in: L and U share the sparsity pattern of A
+// (L has an implicit unit diagonal).
+class ILU0Preconditioner : public Preconditioner {
+
+public:
+  SparseMatrix factors;
+  std::vector<size_t> diagonal;
+
+  ILU0Preconditioner(const Matrix &A) : ILU0Preconditioner(SparseMatrix::fromMatrix(A)) {}
+
+  ILU0Preconditioner(const SparseMatrix &A) : factors(A) {
+    if (A.rowsize != A.columnsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! ILU(0) needs a square matrix, got " +
+          std::to_string(A.rowsize) + "x" + std::to_string(A.columnsize));
+    }
+
+    int n = factors.rowsize;
+    diagonal.resize(n);
+    for (int i = 0; i < n; i++) {
+      long d = factors.diagonalIndex(i);
+      if (d < 0) {
+        throw std::invalid_argument(
+            "INVALID OPERATION! ILU(0) needs a stored diagonal at row " +
+            std::to_string(i));
+      }
+      diagonal[i] = d;
+    }
+
+    // position[j] is the index of column j in the current row, or -1.
+    std::vector<long> position(n, -1);
+    const std::vector<size_t> &start = factors.rowStart;
+    const std::vector<int> &col = factors.columnIndex;
+    vec &a = factors.values;
+    for (int i = 0; i < n; i++) {
+      for (size_t k = start[i]; k < start[i + 1]; k++) {
+        position[col[k]] = k;
+      }
+      for (size_t k = start[i]; k < diagonal[i]; k++) {
+        int kc = col[k];
+        double pivot = a[diagonal[kc]];
+        if (pivot == 0) {
+          throw std::invalid_argument(
+              "SINGULAR MATRIX! Zero pivot in ILU(0) at row " +
+              std::to_string(kc));
+        }
+        double l = a[k] / pivot;
+        a[k] = l;
+        for (size_t kk = diagonal[kc] + 1; kk < start[kc + 1]; kk++) {
+          long p = position[col[kk]];
+          if (p >= 0) {
+            a[p] -= l * a[kk];
+          }
+        }
+      }
+      for (size_t k = start[i]; k < start[i + 1]; k++) {
+        position[col[k]] = -1;
+      }
+    }
+  }
+
+  void apply(const vec &r, vec &z) const override {
+    int n = factors.rowsize;
+    const std::vector<size_t> &start = factors.rowStart;
+    const std::vector<int> &col = factors.columnIndex;
+    const vec &a = factors.values;
+    z = r;
+    for (int i = 0; i < n; i++) {
+      double sum = z[i];
+      for (size_t k = start[i]; k < diagonal[i]; k++) {
+        sum -= a[k] * z[col[k]];
+      }
+      z[i] = sum;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+      double sum = z[i];
+      for (size_t k = diagonal[i] + 1; k < start[i + 1]; k++) {
+        sum -= a[k] * z[col[k]];
+      }
+      z[i] = sum / a[diagonal[i]];
+    }
+  }
+};
+
+struct SolverOptions {
+  double tolerance = 1e-10; // on ||b - A x|| / ||b||
+  int maxIterations = 1000;
+  int restart = 30; // GMRES only
+};
+
+struct SolverResult {
+  bool converged = false;
+  int iterations = 0;
+  double residual = 0; // relative residual at exit
+};
+
+// Preconditioned conjugate gradient for symmetric positive definite A.
+// x is used as the initial guess (zeros if it has the wrong size) and holds
+// the solution on return.
+inline SolverResult conjugateGradient(const LinearOperator &A, const vec &b,
+                                      vec &x, const Preconditioner *M = nullptr,
+                                      SolverOptions options = {}) {
+  MORPHEUS_OP("conjugateGradient", 0, 0, A.rows());
+  morpheus::checkSystem(A, b, x);
+  SolverResult Result;
+  size_t n = b.size();
+  double bnorm = std::sqrt(morpheus::dot(b, b));
+  if (bnorm == 0) {
+    std::fill(x.begin(), x.end(), 0.0);
+    Result.converged = true;
+    return Result;
+  }
+
+  vec q(n);
+  vec r(n);
+  A.apply(x, q);
+  for (size_t i = 0; i < n; i++) {
+    r[i] = b[i] - q[i];
+  }
+
+  const vec *invDiag = M ? M->inverseDiagonal() : nullptr;
+  vec z;
+  if (M) {
+    M->apply(r, z);
+  }
+  const vec &zr = M ? z : r;
+  vec p = zr;
+  double rz = morpheus::dot(r, zr);
+  Result.residual = std::sqrt(morpheus::dot(r, r)) / bnorm;
+
+  while (Result.residual > options.tolerance &&
+         Result.iterations < options.maxIterations) {
+    A.apply(p, q);
+    double pq = morpheus::dot(p, q);
+    if (pq <= 0) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! Conjugate gradient needs a symmetric positive "
+          "definite operator");
+    }
+    double alpha = rz / pq;
+
+    morpheus::CGUpdate u = morpheus::cgUpdate(alpha, p, q, x, r, invDiag, z);
+    double rzNew = u.rz;
+    if (M && !invDiag) {
+      M->apply(r, z);
+      rzNew = morpheus::dot(r, z);
+    }
+    Result.iterations++;
+    Result.residual = std::sqrt(u.rr) / bnorm;
+
+    morpheus::xpby(zr, rzNew / rz, p);
+    rz = rzNew;
+  }
+  Result.converged = Result.residual <= options.tolerance;
+  return Result;
+}
+
+// Restarted GMRES(m) with right preconditioning, so the monitored residual is
+// the true residual of the original system. Arnoldi uses modified
+// Gram-Schmidt and the least-squares problem is updated with Givens
+// rotations.
+inline SolverResult gmres(const LinearOperator &A, const vec &b, vec &x,
+                          const Preconditioner *M = nullptr,
+                          SolverOptions options = {}) {
+  MORPHEUS_OP("gmres", 0, 0, A.rows());
+  morpheus::checkSystem(A, b, x);
+  SolverResult Result;
+  size_t n = b.size();
+  int m = std::max(1, options.restart);
+  double bnorm = std::sqrt(morpheus::dot(b, b));
+  if (bnorm == 0) {
+    std::fill(x.begin(), x.end(), 0.0);
+    Result.converged = true;
+    return Result;
+  }
+
+  Mat V(m + 1, vec(n));
+  Mat H(m + 1, vec(m, 0.0));
+  vec cs(m), sn(m), g(m + 1), y(m);
+  vec w(n), z(n);
+
+  while (true) {
+    A.apply(x, w);
+    for (size_t i = 0; i < n; i++) {
+      V[0][i] = b[i] - w[i];
+    }
+    double beta = std::sqrt(morpheus::dot(V[0], V[0]));
+    Result.residual = beta / bnorm;
+    if (Result.residual <= options.tolerance ||
+        Result.iterations >= options.maxIterations) {
+      break;
+    }
+    for (size_t i = 0; i < n; i++) {
+      V[0][i] /= beta;
+    }
+    std::fill(g.begin(), g.end(), 0.0);
+    g[0] = beta;
+
+    int k = 0;
+    while (k < m && Result.iterations < options.maxIterations) {
+      if (M) {
+        M->apply(V[k], z);
+        A.apply(z, w);
+      } else {
+        A.apply(V[k], w);
+      }
+      for (int i = 0; i <= k; i++) {
+        double h = morpheus::dot(w, V[i]);
+        H[i][k] = h;
+        for (size_t t = 0; t < n; t++) {
+          w[t] -= h * V[i][t];
+        }
+      }
+      double h = std::sqrt(morpheus::dot(w, w));
+      H[k + 1][k] = h;
+      if (h != 0) {
+        for (size_t t = 0; t < n; t++) {
+          V[k + 1][t] = w[t] / h;
+        }
+      }
+
+      for (int i = 0; i < k; i++) {
+        double t = cs[i] * H[i][k] + sn[i] * H[i + 1][k];
+        H[i + 1][k] = -sn[i] * H[i][k] + cs[i] * H[i + 1][k];
+        H[i][k] = t;
+      }
+      double r = std::hypot(H[k][k], H[k + 1][k]);
+      cs[k] = r == 0 ? 1 : H[k][k] / r;
+      sn[k] = r == 0 ? 0 : H[k + 1][k] / r;
+      H[k][k] = r;
+      H[k + 1][k] = 0;
+      g[k + 1] = -sn[k] * g[k];
+      g[k] = cs[k] * g[k];
+
+      k++;
+      Result.iterations++;
+      Result.residual = std::abs(g[k]) / bnorm;
+      if (Result.residual <= options.tolerance || h == 0) {
+        break;
+      }
+    }
+
+    for (int i = k - 1; i >= 0; i--) {
+      double sum = g[i];
+      for (int j = i + 1; j < k; j++) {
+        sum -= H[i][j] * y[j];
+      }
+      if (H[i][i] == 0) {
+        throw std::invalid_argument(
+            "SINGULAR MATRIX! GMRES hit a singular Hessenberg system");
+      }
+      y[i] = sum / H[i][i];
+    }
+    std::fill(w.begin(), w.end(), 0.0);
+    for (int i = 0; i < k; i++) {
+      for (size_t t = 0; t < n; t++) {
+        w[t] += y[i] * V[i][t];
+      }
+    }
+    if (M) {
+      M->apply(w, z);
+    } else {
+      z.swap(w);
+    }
+    for (size_t t = 0; t < n; t++) {
+      x[t] += z[t];
+    }
+  }
+  Result.converged = Result.residual <= options.tolerance;
+  return Result;
+}
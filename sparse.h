@@ -0,0 +1,148 @@
+#pragma once
+
+#include "linear_operator.h"
+#include "matrix.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// (row, column, value) entry used to assemble sparse matrices.
+using Triplet = std::tuple<int, int, double>;
+
+// Compressed sparse row matrix: the non-zeros of row i are
+// values[rowStart[i] .. rowStart[i + 1]), with column indices sorted
+// ascending inside each row.
+class SparseMatrix : public LinearOperator {
+
+public:
+  int rowsize = 0;
+  int columnsize = 0;
+  std::vector<size_t> rowStart;
+  std::vector<int> columnIndex;
+  vec values;
+
+  SparseMatrix(int rows = 0, int cols = 0) {
+    if (rows < 0 || cols < 0) {
+      throw std::invalid_argument(
+          "INVALID SIZE! SparseMatrix dimensions must be >= 0");
+    }
+    this->rowsize = rows;
+    this->columnsize = cols;
+    this->rowStart.assign(rows + 1, 0);
+  }
+
+  int rows() const override { return rowsize; }
+  int cols() const override { return columnsize; }
+  size_t nonZeros() const { return values.size(); }
+
+  // Entries with the same position are summed.
+  static SparseMatrix fromTriplets(int rows, int cols,
+                                   std::vector<Triplet> triplets) {
+    SparseMatrix Result(rows, cols);
+    for (const Triplet &t : triplets) {
+      int i = std::get<0>(t);
+      int j = std::get<1>(t);
+      if (i < 0 || i >= rows || j < 0 || j >= cols) {
+        throw std::invalid_argument("INVALID INDEX! Entry (" +
+                                    std::to_string(i) + ", " +
+                                    std::to_string(j) + ") is out of range");
+      }
+    }
+    std::sort(triplets.begin(), triplets.end(),
+              [](const Triplet &a, const Triplet &b) {
+                return std::tie(std::get<0>(a), std::get<1>(a)) <
+                       std::tie(std::get<0>(b), std::get<1>(b));
+              });
+
+    Result.columnIndex.reserve(triplets.size());
+    Result.values.reserve(triplets.size());
+    for (size_t k = 0; k < triplets.size(); k++) {
+      int i = std::get<0>(triplets[k]);
+      int j = std::get<1>(triplets[k]);
+      double v = std::get<2>(triplets[k]);
+      if (k > 0 && std::get<0>(triplets[k - 1]) == i &&
+          std::get<1>(triplets[k - 1]) == j) {
+        Result.values.back() += v;
+        continue;
+      }
+      Result.columnIndex.push_back(j);
+      Result.values.push_back(v);
+      Result.rowStart[i + 1]++;
+    }
+    for (int i = 0; i < rows; i++) {
+      Result.rowStart[i + 1] += Result.rowStart[i];
+    }
+    return Result;
+  }
+
+  // Keeps the entries whose magnitude is above dropTolerance.
+  static SparseMatrix fromMatrix(const Matrix &m, double dropTolerance = 0) {
+    int rows = m.rowsize;
+    int cols = m.columnsize;
+    SparseMatrix Result(rows, cols);
+    for (int i = 0; i < rows; i++) {
+      const double *row = m.matrix[i].data();
+      for (int j = 0; j < cols; j++) {
+        if (std::abs(row[j]) > dropTolerance) {
+          Result.columnIndex.push_back(j);
+          Result.values.push_back(row[j]);
+        }
+      }
+      Result.rowStart[i + 1] = Result.values.size();
+    }
+    return Result;
+  }
+
+  Matrix toMatrix() const {
+    Matrix Result({}, std::make_tuple(rowsize, columnsize));
+    for (int i = 0; i < rowsize; i++) {
+      for (size_t k = rowStart[i]; k < rowStart[i + 1]; k++) {
+        Result.matrix[i][columnIndex[k]] = values[k];
+      }
+    }
+    return Result;
+  }
+
+  double get(int i, int j) const {
+    auto begin = columnIndex.begin() + rowStart[i];
+    auto end = columnIndex.begin() + rowStart[i + 1];
+    auto it = std::lower_bound(begin, end, j);
+    return it != end && *it == j ? values[it - columnIndex.begin()] : 0.0;
+  }
+
+  // Position of the diagonal entry of row i in values, or -1 if absent.
+  long diagonalIndex(int i) const {
+    auto begin = columnIndex.begin() + rowStart[i];
+    auto end = columnIndex.begin() + rowStart[i + 1];
+    auto it = std::lower_bound(begin, end, i);
+    return it != end && *it == i ? it - columnIndex.begin() : -1;
+  }
+
+  void apply(const vec &x, vec &y) const override {
+    MORPHEUS_OP("SparseMatrix::apply", 2.0 * nonZeros(),
+                12.0 * nonZeros() + 8.0 * (rowsize + columnsize), rowsize,
+                columnsize);
+    checkInput(x);
+    y.resize(rowsize);
+    size_t perRow = rowsize == 0 ? 0 : nonZeros() / rowsize;
+    morpheus::parallelFor(rowsize, morpheus::rowGrain(perRow),
+                          [&](size_t, size_t begin, size_t end) {
+                            for (size_t i = begin; i < end; i++) {
+                              double sum{};
+                              for (size_t k = rowStart[i]; k < rowStart[i + 1];
+                                   k++) {
+                                sum += values[k] * x[columnIndex[k]];
+                              }
+                              y[i] = sum;
+                            }
+                          });
+  }
+  using LinearOperator::apply;
+
+  static vec spmv(const SparseMatrix &A, const vec &x) { return A.apply(x); }
+};
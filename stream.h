@@ -0,0 +1,188 @@
+#pragma once
+
+#include "csv.h"
+#include "matrix.h"
+#include "matrix_view.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// Something that hands out rows of a matrix a chunk at a time. next()
+// replaces `chunk` with up to maxRows further rows and returns false once
+// there are none left. Implementations should reuse the row vectors already
+// in `chunk` so that streaming does not allocate per chunk.
+class RowSource {
+
+public:
+  virtual ~RowSource() = default;
+  virtual bool next(Matrix &chunk, int maxRows) = 0;
+};
+
+namespace morpheus {
+
+// Makes `chunk` rows x cols, keeping existing row storage where it can.
+inline void reshapeChunk(Matrix &chunk, int rows, int cols) {
+  chunk.matrix.resize(rows);
+  for (vec &row : chunk.matrix) {
+    row.resize(cols);
+  }
+  chunk.Dimension = std::make_tuple(rows, cols);
+  chunk.rowsize = rows;
+  chunk.columnsize = cols;
+}
+
+inline void checkChunkColumns(const Matrix &chunk, int expected) {
+  if (chunk.columnsize != expected) {
+    throw std::invalid_argument(
+        "INVALID OPERATION UNEQUAL DIMENSIONS! Chunk of columnsize " +
+        std::to_string((int)chunk.columnsize) + " in a stream of columnsize " +
+        std::to_string(expected));
+  }
+}
+
+} // namespace morpheus
+
+// Rows from a CsvReader.
+class CsvRowSource : public RowSource {
+
+public:
+  explicit CsvRowSource(CsvReader &reader) : reader(reader) {}
+
+  bool next(Matrix &chunk, int maxRows) override {
+    return reader.readRows(chunk, maxRows);
+  }
+
+private:
+  CsvReader &reader;
+};
+
+// Rows of a MatrixView, e.g. a mapped binary or .npy file.
+class ViewRowSource : public RowSource {
+
+public:
+  explicit ViewRowSource(MatrixView view) : view(std::move(view)) {}
+
+  bool next(Matrix &chunk, int maxRows) override {
+    int rows = std::min(maxRows, view.rowsize - position);
+    if (rows <= 0) {
+      return false;
+    }
+    morpheus::reshapeChunk(chunk, rows, view.columnsize);
+    for (int i = 0; i < rows; i++) {
+      const double *src = view.row(position + i);
+      std::copy(src, src + view.columnsize, chunk.matrix[i].begin());
+    }
+    position += rows;
+    return true;
+  }
+
+private:
+  MatrixView view;
+  int position = 0;
+};
+
+// Rows produced by a callable with the same contract as RowSource::next.
+class GeneratorRowSource : public RowSource {
+
+public:
+  explicit GeneratorRowSource(std::function<bool(Matrix &, int)> generate)
+      : generate(std::move(generate)) {}
+
+  bool next(Matrix &chunk, int maxRows) override {
+    return generate(chunk, maxRows);
+  }
+
+private:
+  std::function<bool(Matrix &, int)> generate;
+};
+
+// Calls fn(chunk, firstRow) on every chunk of `source`, where firstRow is
+// the index of the chunk's first row in the stream. Two chunk buffers are
+// used in turn: while fn works on one, the next chunk is read into the other
+// on a background thread. Memory use is therefore two chunks regardless of
+// the length of the stream. Returns the number of rows seen.
+template <typename F>
+size_t forEachRowChunk(RowSource &source, int chunkRows, F &&fn) {
+  if (chunkRows <= 0) {
+    throw std::invalid_argument("INVALID CHUNK SIZE! chunkRows must be "
+                                "positive");
+  }
+  Matrix buffers[2] = {Matrix({}, std::make_tuple(0, 0)),
+                       Matrix({}, std::make_tuple(0, 0))};
+  int current = 0;
+  size_t rows = 0;
+  bool more = source.next(buffers[current], chunkRows);
+  while (more) {
+    Matrix &next = buffers[1 - current];
+    std::future<bool> ahead = std::async(std::launch::async, [&] {
+      return source.next(next, chunkRows);
+    });
+    try {
+      fn(static_cast<const Matrix &>(buffers[current]), rows);
+    } catch (...) {
+      ahead.wait();
+      throw;
+    }
+    rows += buffers[current].rowsize;
+    more = ahead.get();
+    current = 1 - current;
+  }
+  return rows;
+}
+
+// Sum of every column of the streamed matrix.
+inline vec streamColumnSums(RowSource &source, int chunkRows = 4096) {
+  vec sums;
+  forEachRowChunk(source, chunkRows, [&](const Matrix &chunk, size_t) {
+    if (sums.empty()) {
+      sums.assign(chunk.columnsize, 0.0);
+    }
+    morpheus::checkChunkColumns(chunk, sums.size());
+    for (int i = 0; i < chunk.rowsize; i++) {
+      const double *row = chunk.matrix[i].data();
+      for (int j = 0; j < chunk.columnsize; j++) {
+        sums[j] += row[j];
+      }
+    }
+  });
+  return sums;
+}
+
+// X^T X of the streamed matrix X, accumulated one chunk at a time. Only the
+// upper triangle is accumulated; it is mirrored at the end.
+inline Matrix streamGram(RowSource &source, int chunkRows = 4096) {
+  Mat gram;
+  int n = 0;
+  forEachRowChunk(source, chunkRows, [&](const Matrix &chunk, size_t) {
+    if (gram.empty()) {
+      n = chunk.columnsize;
+      gram.assign(n, vec(n, 0.0));
+    }
+    morpheus::checkChunkColumns(chunk, n);
+    morpheus::parallelFor(
+        n, morpheus::rowGrain((size_t)chunk.rowsize * n / 2),
+        [&](size_t, size_t first, size_t last) {
+          for (int r = 0; r < chunk.rowsize; r++) {
+            const double *x = chunk.matrix[r].data();
+            for (size_t i = first; i < last; i++) {
+              double xi = x[i];
+              double *out = gram[i].data();
+              for (int j = i; j < n; j++) {
+                out[j] += xi * x[j];
+              }
+            }
+          }
+        });
+  });
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < i; j++) {
+      gram[i][j] = gram[j][i];
+    }
+  }
+  return Matrix(std::move(gram), std::make_tuple(n, n));
+}
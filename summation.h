@@ -0,0 +1,347 @@
+#pragma once
+
+#include "alloc.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// How long sums are accumulated, trading speed for accuracy. With n terms
+// and unit roundoff u the error is bounded by roughly
+//
+//   Naive       n u sum|x|          a running sum (in a few vector lanes)
+//   Pairwise    log2(n) u sum|x|    halves summed recursively
+//   Neumaier    2 u |sum|           Neumaier's variant of Kahan summation
+//                + n u^2 sum|x|
+//   BlockedFma  (b + n/b) u sum|x|  blocks of b fused multiply-adds
+//
+// Neumaier is accurate however much the terms cancel. Where the terms are
+// products (dot, the L2 norm) their rounding errors are added in as well,
+// as in Ogita, Rump and Oishi's Dot2, so the bound holds for the products
+// themselves. Pairwise and BlockedFma are nearly as fast as Naive on long
+// sums; Neumaier does several times the arithmetic of Naive, which vector
+// units wider than SSE2 hide better.
+enum class Summation { Naive, Pairwise, Neumaier, BlockedFma };
+
+namespace morpheus {
+
+// a[j] = f(a[j], j) for j < n. Each block of four computes all its results
+// (and so does all its loads) before storing any, which lets the compiler
+// turn it into vector instructions at -O2 without proving that the arrays
+// f reads are apart from a.
+template <typename F> void updateLanes(double *a, int n, F f) {
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    double r0 = f(a[j], j);
+    double r1 = f(a[j + 1], j + 1);
+    double r2 = f(a[j + 2], j + 2);
+    double r3 = f(a[j + 3], j + 3);
+    a[j] = r0;
+    a[j + 1] = r1;
+    a[j + 2] = r2;
+    a[j + 3] = r3;
+  }
+  for (; j < n; j++) {
+    a[j] = f(a[j], j);
+  }
+}
+
+// a[j] = op(a[j], x[j]) for j < n; x may be a.
+template <typename Op>
+void updateRow(double *a, const double *x, int n, Op op) {
+  updateLanes(a, n, [x, &op](double v, int j) { return op(v, x[j]); });
+}
+
+// Terms at or below this count are summed naively by Pairwise.
+const int pairwiseBlock = 128;
+
+// Terms per block of BlockedFma.
+const int fmaBlock = 64;
+
+// c + a * b, as one rounding where the target has fused multiply-add
+// instructions. Elsewhere std::fma is a slow library call, so it is the
+// plain expression there (which the compiler may still contract).
+inline double multiplyAdd(double a, double b, double c) {
+#ifdef FP_FAST_FMA
+  return std::fma(a, b, c);
+#else
+  return a * b + c;
+#endif
+}
+
+// The rounding error of p = a * b: a * b is p plus it exactly, barring
+// underflow. Without fused multiply-add it is Dekker's product, whose
+// splitting overflows for |a| or |b| above about 2^996.
+inline double productError(double a, double b, double p) {
+#ifdef FP_FAST_FMA
+  return std::fma(a, b, -p);
+#else
+  const double split = 134217729.0; // 2^27 + 1
+  double t = split * a;
+  double aHigh = t - (t - a);
+  double aLow = a - aHigh;
+  t = split * b;
+  double bHigh = t - (t - b);
+  double bLow = b - bHigh;
+  return ((aHigh * bHigh - p) + aHigh * bLow + aLow * bHigh) + aLow * bLow;
+#endif
+}
+
+// s + c += v, with the rounding error of s + v kept in c. The error is the
+// one Neumaier's branch picks out, found without a branch (Knuth's TwoSum)
+// so the kernels vectorize.
+inline void neumaierAdd(double &s, double &c, double v) {
+  double t = s + v;
+  double z = t - s;
+  c += (s - (t - z)) + (v - z);
+  s = t;
+}
+
+// The terms x[j] of a sum. Term types provide value(j); fold(acc, j),
+// which is acc + value(j) with a single rounding where possible; and
+// compensate(sum, error, j), which adds the exact term to sum + error and
+// keeps every rounding error in error.
+struct PlainTerms {
+  const double *x;
+  double value(int j) const { return x[j]; }
+  double fold(double acc, int j) const { return acc + x[j]; }
+  void compensate(double &sum, double &error, int j) const {
+    neumaierAdd(sum, error, x[j]);
+  }
+};
+
+// The terms s * x[j], as in a row of a matrix product.
+struct ScaledTerms {
+  double s;
+  const double *x;
+  double value(int j) const { return s * x[j]; }
+  double fold(double acc, int j) const { return multiplyAdd(s, x[j], acc); }
+  void compensate(double &sum, double &error, int j) const {
+    double p = s * x[j];
+    neumaierAdd(sum, error, p);
+    error += productError(s, x[j], p);
+  }
+};
+
+// Sum of terms [lo, hi) in four independent lanes. fused uses fold.
+template <bool fused, typename Terms>
+double laneSum(const Terms &terms, int lo, int hi) {
+  double lane[4] = {0, 0, 0, 0};
+  int j = lo;
+  for (; j + 4 <= hi; j += 4) {
+    for (int l = 0; l < 4; l++) {
+      lane[l] = fused ? terms.fold(lane[l], j + l)
+                      : lane[l] + terms.value(j + l);
+    }
+  }
+  for (; j < hi; j++) {
+    lane[0] = fused ? terms.fold(lane[0], j) : lane[0] + terms.value(j);
+  }
+  return (lane[0] + lane[1]) + (lane[2] + lane[3]);
+}
+
+template <typename Terms>
+double pairwiseSum(const Terms &terms, int lo, int hi) {
+  if (hi - lo <= pairwiseBlock) {
+    return laneSum<false>(terms, lo, hi);
+  }
+  int mid = lo + (hi - lo) / 2;
+  return pairwiseSum(terms, lo, mid) + pairwiseSum(terms, mid, hi);
+}
+
+// A sum and the rounding error it has accumulated, kept apart so that
+// combining compensated sums does not round them first.
+struct Compensated {
+  double sum = 0;
+  double error = 0;
+  double value() const { return sum + error; }
+};
+
+// Running compensated sum in eight lanes: enough independent additions to
+// hide their latency, as the error-free addition has six dependent steps.
+// A long sum can be fed in several pieces and is combined only once.
+class NeumaierLanes {
+
+public:
+  template <typename Terms> void add(const Terms &terms, int n) {
+    // Local copies, which the compiler knows the terms cannot alias, so
+    // the loop is vectorized without runtime overlap checks.
+    double ls[width], lc[width];
+    std::copy(s, s + width, ls);
+    std::copy(c, c + width, lc);
+    int j = 0;
+    for (; j + width <= n; j += width) {
+      for (int l = 0; l < width; l++) {
+        terms.compensate(ls[l], lc[l], j + l);
+      }
+    }
+    for (; j < n; j++) {
+      terms.compensate(ls[0], lc[0], j);
+    }
+    std::copy(ls, ls + width, s);
+    std::copy(lc, lc + width, c);
+  }
+
+  Compensated total() const {
+    Compensated total;
+    for (int l = 0; l < width; l++) {
+      neumaierAdd(total.sum, total.error, s[l]);
+      total.error += c[l];
+    }
+    return total;
+  }
+
+private:
+  static const int width = 8;
+  double s[width] = {};
+  double c[width] = {};
+};
+
+template <typename Terms> Compensated neumaierSum(const Terms &terms, int n) {
+  NeumaierLanes lanes;
+  lanes.add(terms, n);
+  return lanes.total();
+}
+
+// Sum of terms [0, n) in `mode`.
+template <typename Terms>
+double sumTerms(Summation mode, const Terms &terms, int n) {
+  switch (mode) {
+  case Summation::Naive:
+    break;
+  case Summation::Pairwise:
+    return pairwiseSum(terms, 0, n);
+  case Summation::Neumaier:
+    return neumaierSum(terms, n).value();
+  case Summation::BlockedFma: {
+    double total = 0;
+    for (int lo = 0; lo < n; lo += fmaBlock) {
+      total += laneSum<true>(terms, lo, std::min(lo + fmaBlock, n));
+    }
+    return total;
+  }
+  }
+  return laneSum<false>(terms, 0, n);
+}
+
+// out[j] = sum of rowTerms(k).value(j) over k in [lo, hi), in order.
+template <typename RowTerms>
+void naiveRows(int lo, int hi, int cols, const RowTerms &rowTerms,
+               double *out) {
+  std::fill(out, out + cols, 0.0);
+  for (int k = lo; k < hi; k++) {
+    auto terms = rowTerms(k);
+    updateLanes(out, cols,
+                [&terms](double acc, int j) { return acc + terms.value(j); });
+  }
+}
+
+template <typename RowTerms>
+void pairwiseRows(int lo, int hi, int cols, const RowTerms &rowTerms,
+                  double *out, double *scratch) {
+  if (hi - lo <= pairwiseBlock) {
+    naiveRows(lo, hi, cols, rowTerms, out);
+    return;
+  }
+  int mid = lo + (hi - lo) / 2;
+  pairwiseRows(lo, mid, cols, rowTerms, out, scratch);
+  pairwiseRows(mid, hi, cols, rowTerms, scratch, scratch + cols);
+  updateRow(out, scratch, cols, [](double a, double b) { return a + b; });
+}
+
+// Compensated sumRows, leaving the sums in out and their rounding errors
+// in error.
+template <typename RowTerms>
+void neumaierRows(int count, int cols, const RowTerms &rowTerms, double *out,
+                  double *error) {
+  std::fill(out, out + cols, 0.0);
+  std::fill(error, error + cols, 0.0);
+  for (int k = 0; k < count; k++) {
+    auto terms = rowTerms(k);
+    int j = 0;
+    for (; j + 4 <= cols; j += 4) {
+      double s[4], c[4];
+      for (int l = 0; l < 4; l++) {
+        s[l] = out[j + l];
+        c[l] = error[j + l];
+        terms.compensate(s[l], c[l], j + l);
+      }
+      for (int l = 0; l < 4; l++) {
+        out[j + l] = s[l];
+        error[j + l] = c[l];
+      }
+    }
+    for (; j < cols; j++) {
+      terms.compensate(out[j], error[j], j);
+    }
+  }
+}
+
+inline int pairwiseDepth(int count) {
+  int depth = 0;
+  for (; count > pairwiseBlock; count = (count + 1) / 2) {
+    depth++;
+  }
+  return depth;
+}
+
+// Scratch rows sumRows needs for `count` rows in `mode`.
+inline int rowsScratch(Summation mode, int count) {
+  switch (mode) {
+  case Summation::Naive:
+    return 0;
+  case Summation::Pairwise:
+    return pairwiseDepth(count);
+  case Summation::Neumaier:
+  case Summation::BlockedFma:
+    return 1;
+  }
+  return 0;
+}
+
+// Element-wise sums of rows of terms in `mode`: out[j] = sum over k < count
+// of rowTerms(k).value(j), for j < cols. Each row is added to all the sums
+// at once, so rows are read contiguously and every kernel vectorizes
+// across j. scratch holds the rowsScratch(mode, count) * cols doubles the
+// mode needs.
+template <typename RowTerms>
+void sumRows(Summation mode, int count, int cols, const RowTerms &rowTerms,
+             double *out, double *scratch) {
+  switch (mode) {
+  case Summation::Naive:
+    break;
+  case Summation::Pairwise:
+    pairwiseRows(0, count, cols, rowTerms, out, scratch);
+    return;
+  case Summation::Neumaier:
+    neumaierRows(count, cols, rowTerms, out, scratch);
+    updateRow(out, scratch, cols, [](double a, double b) { return a + b; });
+    return;
+  case Summation::BlockedFma: {
+    double *block = scratch;
+    std::fill(out, out + cols, 0.0);
+    for (int lo = 0; lo < count; lo += fmaBlock) {
+      std::fill(block, block + cols, 0.0);
+      for (int k = lo; k < std::min(lo + fmaBlock, count); k++) {
+        auto terms = rowTerms(k);
+        updateLanes(block, cols,
+                    [&terms](double acc, int j) { return terms.fold(acc, j); });
+      }
+      updateRow(out, block, cols, [](double a, double b) { return a + b; });
+    }
+    return;
+  }
+  }
+  naiveRows(0, count, cols, rowTerms, out);
+}
+
+// sumRows with its own scratch.
+template <typename RowTerms>
+void sumRows(Summation mode, int count, int cols, const RowTerms &rowTerms,
+             double *out) {
+  std::vector<double, StorageAllocator<double>> scratch(
+      (size_t)rowsScratch(mode, count) * cols);
+  sumRows(mode, count, cols, rowTerms, out, scratch.data());
+}
+
+} // namespace morpheus
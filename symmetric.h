@@ -0,0 +1,167 @@
+#pragma once
+
+#include "matrix.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Symmetric n x n matrix that only keeps the lower triangle, packed row by
+// row: element (i, j) with j <= i lives at i * (i + 1) / 2 + j.
+class SymmetricMatrix {
+
+public:
+  int size = 0;
+  vec data;
+
+  SymmetricMatrix(int n = 2) {
+    if (n < 0) {
+      throw std::invalid_argument("INVALID SIZE! SymmetricMatrix size " +
+                                  std::to_string(n) + " is negative");
+    }
+    this->size = n;
+    this->data.assign(packedSize(n), 0.0);
+  }
+
+  static size_t packedSize(int n) { return (size_t)n * (n + 1) / 2; }
+
+  static size_t index(int i, int j) {
+    if (j > i) {
+      std::swap(i, j);
+    }
+    return (size_t)i * (i + 1) / 2 + j;
+  }
+
+  double get(int i, int j) const { return data[index(i, j)]; }
+  void set(int i, int j, double value) { data[index(i, j)] = value; }
+
+  // Builds from the lower triangle of a dense square matrix. When tolerance
+  // is non-negative the upper triangle is checked against it.
+  static SymmetricMatrix fromMatrix(const Matrix &m, double tolerance = -1) {
+    if (m.rowsize != m.columnsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! SymmetricMatrix needs a square Matrix, got " +
+          std::to_string((int)m.rowsize) + "x" +
+          std::to_string((int)m.columnsize));
+    }
+
+    int n = m.rowsize;
+    SymmetricMatrix Result(n);
+    double *out = Result.data.data();
+    for (int i = 0; i < n; i++) {
+      const double *row = m.matrix[i].data();
+      for (int j = 0; j <= i; j++) {
+        if (tolerance >= 0 && std::abs(row[j] - m.matrix[j][i]) > tolerance) {
+          throw std::invalid_argument(
+              "INVALID OPERATION! Matrix is not symmetric at (" +
+              std::to_string(i) + ", " + std::to_string(j) + ")");
+        }
+        *out++ = row[j];
+      }
+    }
+    return Result;
+  }
+
+  Matrix toMatrix() const {
+    Matrix Result({}, std::make_tuple(size, size));
+    const double *in = data.data();
+    for (int i = 0; i < size; i++) {
+      for (int j = 0; j <= i; j++) {
+        Result.matrix[i][j] = *in;
+        Result.matrix[j][i] = *in++;
+      }
+    }
+    return Result;
+  }
+
+  // y = A x. Each stored element is read once and used for both its (i, j)
+  // and (j, i) contributions.
+  static vec symv(const SymmetricMatrix &A, const vec &x) {
+    MORPHEUS_OP("SymmetricMatrix::symv", 2.0 * A.size * A.size,
+                8.0 * (A.data.size() + 2.0 * A.size), A.size);
+    if ((int)x.size() != A.size) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! SymmetricMatrix of size " +
+          std::to_string(A.size) + " and vector of size " +
+          std::to_string(x.size()));
+    }
+
+    vec y(A.size, 0.0);
+    const double *a = A.data.data();
+    for (int i = 0; i < A.size; i++) {
+      double xi = x[i];
+      double sum{};
+      for (int j = 0; j < i; j++) {
+        sum += a[j] * x[j];
+        y[j] += a[j] * xi;
+      }
+      y[i] += sum + a[i] * xi;
+      a += i + 1;
+    }
+    return y;
+  }
+
+  // C = A B. Like symv, every stored element of A is read once; the rows of
+  // B and C are walked contiguously.
+  static Matrix symm(const SymmetricMatrix &A, const Matrix &B) {
+    MORPHEUS_OP("SymmetricMatrix::symm", 2.0 * A.size * A.size * B.columnsize,
+                8.0 * (A.data.size() + 2.0 * B.rowsize * B.columnsize), A.size,
+                B.columnsize);
+    if (A.size != B.rowsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! SymmetricMatrix of size " +
+          std::to_string(A.size) + " and Matrix of rowsize of " +
+          std::to_string((int)B.rowsize));
+    }
+
+    int n = A.size;
+    int cols = B.columnsize;
+    Matrix Result({}, std::make_tuple(n, cols));
+    const double *a = A.data.data();
+    for (int i = 0; i < n; i++) {
+      double *ci = Result.matrix[i].data();
+      const double *bi = B.matrix[i].data();
+      for (int j = 0; j < i; j++) {
+        double aij = a[j];
+        double *cj = Result.matrix[j].data();
+        const double *bj = B.matrix[j].data();
+        for (int c = 0; c < cols; c++) {
+          ci[c] += aij * bj[c];
+          cj[c] += aij * bi[c];
+        }
+      }
+      double aii = a[i];
+      for (int c = 0; c < cols; c++) {
+        ci[c] += aii * bi[c];
+      }
+      a += i + 1;
+    }
+    return Result;
+  }
+
+  static SymmetricMatrix AddMatrix(const SymmetricMatrix &Mat1,
+                                   const SymmetricMatrix &Mat2) {
+    if (Mat1.size != Mat2.size) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix addition operation "
+          "should have = dimensions");
+    }
+
+    SymmetricMatrix Result(Mat1.size);
+    for (size_t i = 0; i < Result.data.size(); i++) {
+      Result.data[i] = Mat1.data[i] + Mat2.data[i];
+    }
+    return Result;
+  }
+
+  static SymmetricMatrix Constmultiplication(const SymmetricMatrix &TargetedMat,
+                                             double k) {
+    SymmetricMatrix Result(TargetedMat.size);
+    for (size_t i = 0; i < Result.data.size(); i++) {
+      Result.data[i] = TargetedMat.data[i] * k;
+    }
+    return Result;
+  }
+};
@@ -1,12 +1,46 @@
+// Count matrix storage allocations so tests can assert on them
+#define MORPHEUS_TRACK_ALLOCATIONS
 #include "acutest.h"
 #include "matrix.h" // Your matrix library header
+#include "symmetric.h"
+#include "banded.h"
+#include "diagonal.h"
+#include "solvers.h"
+#include "matfunc.h"
+#include "serialize.h"
+#include "csv.h"
+#include "npy.h"
+#include "mtx.h"
+#include "tiled.h"
+#include "stream.h"
+#include "async.h"
+#include "lazy.h"
+#include "epilogue.h"
+#include "reduce.h"
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
 
 // Helper function to compare doubles with tolerance
 bool doubleEquals(double a, double b, double epsilon = 1e-9) {
     return std::abs(a - b) < epsilon;
 }
 
+// Number of matrix storage allocations made while fn runs
+template <typename F>
+uint64_t allocationsDuring(F&& fn) {
+    uint64_t before = allocationStats().allocations;
+    fn();
+    return allocationStats().allocations - before;
+}
+
 // Helper function to compare matrices
 bool matricesEqual(const Matrix& m1, const Matrix& m2, double epsilon = 1e-9) {
     if (m1.rowsize != m2.rowsize || m1.columnsize != m2.columnsize) {
@@ -919,78 +953,3854 @@ void test_very_small_values(void) {
 }
 
 // ============================================================================
-// Test List
+// SymmetricMatrix Tests
 // ============================================================================
 
-TEST_LIST = {
-    // Constructor tests
-    { "default-constructor", test_default_constructor },
-    { "constructor-with-dimension", test_constructor_with_dimension },
-    { "constructor-with-data", test_constructor_with_data },
-    { "constructor-1x1", test_constructor_1x1 },
-    { "constructor-tall-matrix", test_constructor_tall_matrix },
-    { "constructor-wide-matrix", test_constructor_wide_matrix },
-    { "constructor-with-negative-data", test_constructor_with_negative_data },
+void test_symmetric_round_trip(void) {
+    Mat data = {{4.0, 1.0, 2.0}, {1.0, 5.0, 3.0}, {2.0, 3.0, 6.0}};
+    Matrix m(data, std::make_tuple(3, 3));
     
-    // getRow and getCol tests
-    { "getRow", test_getRow },
-    { "getCol", test_getCol },
-    { "getRow-single-row-matrix", test_getRow_single_row_matrix },
-    { "getCol-single-column-matrix", test_getCol_single_column_matrix },
-    { "getRow-with-negatives", test_getRow_with_negatives },
-    { "getCol-from-non-square", test_getCol_from_non_square },
+    SymmetricMatrix s = SymmetricMatrix::fromMatrix(m, 0.0);
     
-    // Matrix multiplication tests
-    { "dot-basic", test_dot_basic },
-    { "dot-non-square", test_dot_non_square },
-    { "dot-identity", test_dot_identity },
-    { "dot-1x3-times-3x1", test_dot_1x3_times_3x1 },
-    { "dot-3x2-times-2x4", test_dot_3x2_times_2x4 },
-    { "dot-4x1-times-1x4", test_dot_4x1_times_1x4 },
-    { "dot-3x3-times-3x3", test_dot_3x3_times_3x3 },
-    { "dot-with-zeros", test_dot_with_zeros },
-    { "dot-with-negatives", test_dot_with_negatives },
-    { "dot-incompatible-dimensions", test_dot_incompatible_dimensions },
+    TEST_CHECK(s.data.size() == 6);
+    TEST_CHECK(doubleEquals(s.get(0, 2), 2.0));
+    TEST_CHECK(doubleEquals(s.get(2, 0), 2.0));
+    TEST_CHECK(matricesEqual(s.toMatrix(), m));
+}
+
+void test_symmetric_rejects_non_symmetric(void) {
+    Mat data = {{1.0, 2.0}, {3.0, 4.0}};
+    Matrix m(data, std::make_tuple(2, 2));
     
-    // Scalar multiplication tests
-    { "const-multiplication-basic", test_const_multiplication_basic },
-    { "const-multiplication-zero", test_const_multiplication_zero },
-    { "const-multiplication-negative", test_const_multiplication_negative },
-    { "const-multiplication-non-square", test_const_multiplication_non_square },
-    { "const-multiplication-fractional", test_const_multiplication_fractional },
-    { "const-multiplication-large-scalar", test_const_multiplication_large_scalar },
-    { "const-multiplication-one", test_const_multiplication_one },
+    bool caught = false;
+    try {
+        SymmetricMatrix::fromMatrix(m, 1e-12);
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
     
-    // Matrix addition tests
-    { "add-basic", test_add_basic },
-    { "add-with-negatives", test_add_with_negatives },
-    { "add-non-square", test_add_non_square },
-    { "add-incompatible-dimensions", test_add_incompatible_dimensions },
-    { "add-single-row", test_add_single_row },
-    { "add-single-column", test_add_single_column },
-    { "add-large-matrices", test_add_large_matrices },
-    { "add-zero-matrix", test_add_zero_matrix },
+    TEST_CHECK_(caught, "Should throw for a non-symmetric matrix");
+}
+
+void test_symmetric_symv(void) {
+    Mat data = {{4.0, 1.0, 2.0}, {1.0, 5.0, 3.0}, {2.0, 3.0, 6.0}};
+    SymmetricMatrix s = SymmetricMatrix::fromMatrix(Matrix(data, std::make_tuple(3, 3)));
     
-    // Matrix subtraction tests
-    { "subtract-basic", test_subtract_basic },
-    { "subtract-with-negatives", test_subtract_with_negatives },
-    { "subtract-same-matrix", test_subtract_same_matrix },
-    { "subtract-non-square", test_subtract_non_square },
-    { "subtract-incompatible-dimensions", test_subtract_incompatible_dimensions },
-    { "subtract-single-row", test_subtract_single_row },
-    { "subtract-single-column", test_subtract_single_column },
-    { "subtract-resulting-in-negatives", test_subtract_resulting_in_negatives },
-    { "subtract-zero-matrix", test_subtract_zero_matrix },
+    vec y = SymmetricMatrix::symv(s, {1.0, 2.0, 3.0});
     
-    // Edge case tests
-    { "single-element-matrix", test_single_element_matrix },
-    { "large-matrix-dimensions", test_large_matrix_dimensions },
-    { "floating-point-precision", test_floating_point_precision },
-    { "commutative-addition", test_commutative_addition },
-    { "associative-addition", test_associative_addition },
-    { "distributive-scalar-multiplication", test_distributive_scalar_multiplication },
-    { "dot-associativity", test_dot_associativity },
-    { "very-small-values", test_very_small_values },
+    // Expected: [4+2+6, 1+10+9, 2+6+18] = [12, 20, 26]
+    TEST_CHECK(y.size() == 3);
+    TEST_CHECK(doubleEquals(y[0], 12.0));
+    TEST_CHECK(doubleEquals(y[1], 20.0));
+    TEST_CHECK(doubleEquals(y[2], 26.0));
+}
+
+void test_symmetric_symm_matches_dot(void) {
+    Mat data = {{4.0, 1.0, 2.0}, {1.0, 5.0, 3.0}, {2.0, 3.0, 6.0}};
+    Mat other = {{1.0, -2.0}, {0.5, 3.0}, {-1.0, 4.0}};
+    Matrix a(data, std::make_tuple(3, 3));
+    Matrix b(other, std::make_tuple(3, 2));
+    
+    Matrix result = SymmetricMatrix::symm(SymmetricMatrix::fromMatrix(a), b);
+    
+    TEST_CHECK(matricesEqual(result, Matrix::dot(a, b)));
+}
+
+void test_symmetric_add_and_scale(void) {
+    SymmetricMatrix a(2);
+    SymmetricMatrix b(2);
+    a.set(0, 0, 1.0);
+    a.set(1, 0, 2.0);
+    a.set(1, 1, 3.0);
+    b.set(0, 1, 4.0);
+    
+    SymmetricMatrix sum = SymmetricMatrix::AddMatrix(a, b);
+    SymmetricMatrix scaled = SymmetricMatrix::Constmultiplication(sum, 0.5);
+    
+    TEST_CHECK(doubleEquals(scaled.get(0, 0), 0.5));
+    TEST_CHECK(doubleEquals(scaled.get(0, 1), 3.0));
+    TEST_CHECK(doubleEquals(scaled.get(1, 0), 3.0));
+    TEST_CHECK(doubleEquals(scaled.get(1, 1), 1.5));
+    
+    bool caught = false;
+    try {
+        SymmetricMatrix::AddMatrix(a, SymmetricMatrix(3));
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should throw exception for unequal sizes");
+}
+
+// ============================================================================
+// BandMatrix Tests
+// ============================================================================
+
+void test_band_round_trip_and_gbmv(void) {
+    Mat data = {{2.0, 1.0, 0.0, 0.0},
+                {3.0, 2.0, 1.0, 0.0},
+                {4.0, 3.0, 2.0, 1.0},
+                {0.0, 4.0, 3.0, 2.0}};
+    Matrix m(data, std::make_tuple(4, 4));
+    
+    BandMatrix b = BandMatrix::fromMatrix(m, 2, 1);
+    
+    TEST_CHECK(b.data.size() == 16);
+    TEST_CHECK(matricesEqual(b.toMatrix(), m));
+    
+    vec y = BandMatrix::gbmv(b, {1.0, -1.0, 2.0, 0.5});
+    Matrix expected = Matrix::dot(m, Matrix({{1.0}, {-1.0}, {2.0}, {0.5}}, std::make_tuple(4, 1)));
+    for (int i = 0; i < 4; i++) {
+        TEST_CHECK(doubleEquals(y[i], expected.matrix[i][0]));
+    }
+}
+
+void test_band_set_outside_band_throws(void) {
+    BandMatrix b(4, 1, 1);
+    
+    bool caught = false;
+    try {
+        b.set(0, 3, 1.0);
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    
+    TEST_CHECK_(caught, "Should throw when writing outside the band");
+    TEST_CHECK(doubleEquals(b.get(0, 3), 0.0));
+}
+
+void test_band_lu_solve_with_pivoting(void) {
+    // The small leading entry forces a row swap in the first column
+    Mat data = {{1e-12, 1.0, 0.0, 0.0, 0.0},
+                {2.0, 1.0, 3.0, 0.0, 0.0},
+                {0.0, 1.0, 4.0, 1.0, 0.0},
+                {0.0, 0.0, 2.0, 5.0, 1.0},
+                {0.0, 0.0, 0.0, 1.0, 3.0}};
+    Matrix m(data, std::make_tuple(5, 5));
+    vec x = {1.0, 2.0, -1.0, 0.5, 3.0};
+    
+    BandMatrix a = BandMatrix::fromMatrix(m, 1, 1);
+    vec b = BandMatrix::gbmv(a, x);
+    vec solved = BandMatrix::lu(a).solve(b);
+    
+    for (int i = 0; i < 5; i++) {
+        TEST_CHECK_(doubleEquals(solved[i], x[i], 1e-9),
+                   "x[%d] should be %f, got %f", i, x[i], solved[i]);
+    }
+}
+
+void test_band_cholesky_solve(void) {
+    // 1D Laplacian with a shifted diagonal, pentadiagonal and SPD
+    int n = 8;
+    BandMatrix a(n, 2, 2);
+    for (int i = 0; i < n; i++) {
+        a.set(i, i, 6.0);
+        if (i + 1 < n) { a.set(i, i + 1, -2.0); a.set(i + 1, i, -2.0); }
+        if (i + 2 < n) { a.set(i, i + 2, 0.5); a.set(i + 2, i, 0.5); }
+    }
+    vec x(n);
+    for (int i = 0; i < n; i++) {
+        x[i] = i - 3.5;
+    }
+    
+    vec solved = BandMatrix::cholesky(a).solve(BandMatrix::gbmv(a, x));
+    
+    for (int i = 0; i < n; i++) {
+        TEST_CHECK(doubleEquals(solved[i], x[i], 1e-9));
+    }
+}
+
+void test_band_cholesky_not_positive_definite(void) {
+    BandMatrix a(2, 1, 1);
+    a.set(0, 0, 1.0);
+    a.set(0, 1, 2.0);
+    a.set(1, 0, 2.0);
+    a.set(1, 1, 1.0);
+    
+    bool caught = false;
+    try {
+        BandMatrix::cholesky(a);
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    
+    TEST_CHECK_(caught, "Should throw for an indefinite matrix");
+}
+
+void test_tridiagonal_thomas(void) {
+    vec sub = {1.0, 1.0, 1.0};
+    vec diag = {4.0, 4.0, 4.0, 4.0};
+    vec super = {1.0, 1.0, 1.0};
+    // A * [1, 2, 3, 4] = [6, 12, 18, 19]
+    vec x = BandMatrix::solveTridiagonal(sub, diag, super, {6.0, 12.0, 18.0, 19.0});
+    
+    TEST_CHECK(doubleEquals(x[0], 1.0));
+    TEST_CHECK(doubleEquals(x[1], 2.0));
+    TEST_CHECK(doubleEquals(x[2], 3.0));
+    TEST_CHECK(doubleEquals(x[3], 4.0));
+}
+
+void test_tridiagonal_batched_matches_single(void) {
+    int n = 5;
+    int batch = 3;
+    vec sub((n - 1) * batch), diag(n * batch), super((n - 1) * batch), rhs(n * batch);
+    for (int s = 0; s < batch; s++) {
+        for (int i = 0; i < n; i++) {
+            diag[i * batch + s] = 5.0 + s;
+            rhs[i * batch + s] = i * (s + 1) - 1.0;
+            if (i + 1 < n) {
+                sub[i * batch + s] = -1.0 - 0.5 * s;
+                super[i * batch + s] = 2.0 - s;
+            }
+        }
+    }
+    vec batched = rhs;
+    
+    BandMatrix::solveTridiagonalBatched(n, batch, sub, diag, super, batched);
+    
+    for (int s = 0; s < batch; s++) {
+        vec a(n - 1), b(n), c(n - 1), d(n);
+        for (int i = 0; i < n; i++) {
+            b[i] = diag[i * batch + s];
+            d[i] = rhs[i * batch + s];
+            if (i + 1 < n) {
+                a[i] = sub[i * batch + s];
+                c[i] = super[i * batch + s];
+            }
+        }
+        vec single = BandMatrix::solveTridiagonal(a, b, c, d);
+        for (int i = 0; i < n; i++) {
+            TEST_CHECK(doubleEquals(batched[i * batch + s], single[i]));
+        }
+    }
+}
+
+// ============================================================================
+// DiagonalMatrix and PermutationMatrix Tests
+// ============================================================================
+
+void test_diagonal_products_match_dot(void) {
+    Mat data = {{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}};
+    Matrix a(data, std::make_tuple(2, 3));
+    DiagonalMatrix left({2.0, -1.0});
+    DiagonalMatrix right({0.5, 3.0, -2.0});
+    
+    TEST_CHECK(matricesEqual(DiagonalMatrix::dot(left, a), Matrix::dot(left.toMatrix(), a)));
+    TEST_CHECK(matricesEqual(DiagonalMatrix::dot(a, right), Matrix::dot(a, right.toMatrix())));
+    
+    Matrix inPlace = a;
+    DiagonalMatrix::scaleRows(left, inPlace);
+    DiagonalMatrix::scaleColumns(inPlace, right);
+    TEST_CHECK(matricesEqual(inPlace, Matrix::dot(Matrix::dot(left.toMatrix(), a), right.toMatrix())));
+}
+
+void test_diagonal_incompatible_dimensions(void) {
+    Matrix a({}, std::make_tuple(2, 3));
+    
+    bool caught = false;
+    try {
+        DiagonalMatrix::dot(DiagonalMatrix({1.0, 2.0, 3.0}), a);
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    
+    TEST_CHECK_(caught, "Should throw exception for incompatible dimensions");
+}
+
+void test_permutation_products_match_dot(void) {
+    Mat data = {{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}, {7.0, 8.0, 9.0}};
+    Matrix a(data, std::make_tuple(3, 3));
+    PermutationMatrix p({2, 0, 1});
+    
+    Matrix rows = PermutationMatrix::dot(p, a);
+    TEST_CHECK(matricesEqual(rows, Matrix::dot(p.toMatrix(), a)));
+    TEST_CHECK(doubleEquals(rows.matrix[0][0], 7.0));
+    
+    TEST_CHECK(matricesEqual(PermutationMatrix::dot(a, p), Matrix::dot(a, p.toMatrix())));
+    
+    Matrix back = PermutationMatrix::dot(p.inverse(), rows);
+    TEST_CHECK(matricesEqual(back, a));
+}
+
+void test_permutation_in_place(void) {
+    Mat data = {{1.0, 2.0, 3.0, 4.0}, {5.0, 6.0, 7.0, 8.0},
+                {9.0, 10.0, 11.0, 12.0}, {13.0, 14.0, 15.0, 16.0}};
+    Matrix a(data, std::make_tuple(4, 4));
+    PermutationMatrix p({1, 3, 0, 2});
+    
+    Matrix rows = a;
+    PermutationMatrix::permuteRows(p, rows);
+    TEST_CHECK(matricesEqual(rows, PermutationMatrix::dot(p, a)));
+    
+    Matrix cols = a;
+    PermutationMatrix::permuteColumns(cols, p);
+    TEST_CHECK(matricesEqual(cols, PermutationMatrix::dot(a, p)));
+}
+
+void test_permutation_from_pivots(void) {
+    // Swap rows 0<->2, then 1<->2
+    PermutationMatrix p = PermutationMatrix::fromPivots({2, 2, 2});
+    
+    TEST_CHECK(p.perm[0] == 2);
+    TEST_CHECK(p.perm[1] == 0);
+    TEST_CHECK(p.perm[2] == 1);
+    
+    PermutationMatrix composed = PermutationMatrix::dot(p, p.inverse());
+    TEST_CHECK(composed.perm == PermutationMatrix::identity(3).perm);
+}
+
+void test_permutation_rejects_invalid(void) {
+    bool caught = false;
+    try {
+        PermutationMatrix p({0, 0, 1});
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    
+    TEST_CHECK_(caught, "Should throw for a repeated index");
+}
+
+// ============================================================================
+// Sparse Matrix and Iterative Solver Tests
+// ============================================================================
+
+// 2D Poisson matrix on a k x k grid, optionally with a convection term that
+// makes it non-symmetric
+SparseMatrix poissonMatrix(int k, double convection = 0.0) {
+    std::vector<Triplet> entries;
+    for (int i = 0; i < k; i++) {
+        for (int j = 0; j < k; j++) {
+            int row = i * k + j;
+            entries.push_back({row, row, 4.0});
+            if (i > 0) entries.push_back({row, row - k, -1.0});
+            if (i < k - 1) entries.push_back({row, row + k, -1.0});
+            if (j > 0) entries.push_back({row, row - 1, -1.0 - convection});
+            if (j < k - 1) entries.push_back({row, row + 1, -1.0 + convection});
+        }
+    }
+    return SparseMatrix::fromTriplets(k * k, k * k, entries);
+}
+
+double residualNorm(const LinearOperator& A, const vec& x, const vec& b) {
+    vec ax = A.apply(x);
+    double sum = 0.0;
+    for (size_t i = 0; i < b.size(); i++) {
+        sum += (b[i] - ax[i]) * (b[i] - ax[i]);
+    }
+    return std::sqrt(sum);
+}
+
+void test_sparse_round_trip_and_spmv(void) {
+    Mat data = {{1.0, 0.0, 2.0}, {0.0, 0.0, 3.0}, {4.0, 5.0, 0.0}};
+    Matrix m(data, std::make_tuple(3, 3));
+    
+    SparseMatrix s = SparseMatrix::fromMatrix(m);
+    
+    TEST_CHECK(s.nonZeros() == 5);
+    TEST_CHECK(matricesEqual(s.toMatrix(), m));
+    TEST_CHECK(doubleEquals(s.get(2, 1), 5.0));
+    TEST_CHECK(doubleEquals(s.get(1, 1), 0.0));
+    
+    vec y = SparseMatrix::spmv(s, {1.0, 2.0, 3.0});
+    vec dense = MatrixOperator(m).apply({1.0, 2.0, 3.0});
+    for (int i = 0; i < 3; i++) {
+        TEST_CHECK(doubleEquals(y[i], dense[i]));
+    }
+}
+
+void test_sparse_triplets_sum_duplicates(void) {
+    SparseMatrix s = SparseMatrix::fromTriplets(2, 2, {{1, 0, 1.5}, {0, 1, 2.0}, {1, 0, 0.5}});
+    
+    TEST_CHECK(s.nonZeros() == 2);
+    TEST_CHECK(doubleEquals(s.get(1, 0), 2.0));
+    TEST_CHECK(doubleEquals(s.get(0, 1), 2.0));
+}
+
+void test_cg_sparse_with_preconditioners(void) {
+    SparseMatrix a = poissonMatrix(10);
+    vec b(a.rows());
+    for (size_t i = 0; i < b.size(); i++) {
+        b[i] = std::sin(0.1 * i) + 1.0;
+    }
+    JacobiPreconditioner jacobi(a);
+    ILU0Preconditioner ilu(a);
+    
+    vec x0, x1, x2;
+    SolverResult plain = conjugateGradient(a, b, x0);
+    SolverResult withJacobi = conjugateGradient(a, b, x1, &jacobi);
+    SolverResult withIlu = conjugateGradient(a, b, x2, &ilu);
+    
+    TEST_CHECK(plain.converged && withJacobi.converged && withIlu.converged);
+    TEST_CHECK(residualNorm(a, x0, b) < 1e-8);
+    TEST_CHECK(residualNorm(a, x1, b) < 1e-8);
+    TEST_CHECK(residualNorm(a, x2, b) < 1e-8);
+    TEST_CHECK_(withIlu.iterations < plain.iterations,
+               "ILU(0) should need fewer iterations (%d vs %d)",
+               withIlu.iterations, plain.iterations);
+}
+
+void test_cg_dense_operator(void) {
+    Mat data = {{4.0, 1.0, 0.0}, {1.0, 3.0, 1.0}, {0.0, 1.0, 2.0}};
+    Matrix m(data, std::make_tuple(3, 3));
+    MatrixOperator a(m);
+    vec b = {1.0, 2.0, 3.0};
+    
+    vec x;
+    SolverResult result = conjugateGradient(a, b, x);
+    
+    TEST_CHECK(result.converged);
+    TEST_CHECK(result.iterations <= 3);
+    TEST_CHECK(residualNorm(a, x, b) < 1e-9);
+}
+
+void test_gmres_non_symmetric(void) {
+    SparseMatrix a = poissonMatrix(8, 0.4);
+    vec b(a.rows(), 1.0);
+    ILU0Preconditioner ilu(a);
+    SolverOptions options;
+    options.restart = 10;
+    
+    vec x0, x1;
+    SolverResult plain = gmres(a, b, x0, nullptr, options);
+    SolverResult withIlu = gmres(a, b, x1, &ilu, options);
+    
+    TEST_CHECK(plain.converged && withIlu.converged);
+    TEST_CHECK(residualNorm(a, x0, b) < 1e-8);
+    TEST_CHECK(residualNorm(a, x1, b) < 1e-8);
+    TEST_CHECK(withIlu.iterations < plain.iterations);
+}
+
+void test_gmres_exact_ilu_converges_immediately(void) {
+    // ILU(0) of a tridiagonal matrix has no dropped fill, so it is exact
+    Mat data = {{3.0, -1.0, 0.0, 0.0}, {2.0, 3.0, -1.0, 0.0},
+                {0.0, 2.0, 3.0, -1.0}, {0.0, 0.0, 2.0, 3.0}};
+    Matrix m(data, std::make_tuple(4, 4));
+    ILU0Preconditioner ilu(m);
+    vec b = {1.0, 0.0, -1.0, 2.0};
+    
+    vec x;
+    SolverResult result = gmres(MatrixOperator(m), b, x, &ilu);
+    
+    TEST_CHECK(result.converged);
+    TEST_CHECK(result.iterations == 1);
+    TEST_CHECK(residualNorm(MatrixOperator(m), x, b) < 1e-9);
+}
+
+void test_solver_incompatible_dimensions(void) {
+    SparseMatrix a = poissonMatrix(3);
+    vec x;
+    
+    bool caught = false;
+    try {
+        conjugateGradient(a, vec(4, 1.0), x);
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    
+    TEST_CHECK_(caught, "Should throw exception for incompatible dimensions");
+}
+
+// ============================================================================
+// Matrix Power, Exponential and Polynomial Tests
+// ============================================================================
+
+void test_dot_into_matches_dot(void) {
+    Mat data1 = {{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}};
+    Mat data2 = {{7.0, 8.0}, {9.0, 10.0}, {11.0, 12.0}};
+    Matrix m1(data1, std::make_tuple(2, 3));
+    Matrix m2(data2, std::make_tuple(3, 2));
+    
+    Matrix out;
+    Matrix::dotInto(m1, m2, out);
+    
+    TEST_CHECK(matricesEqual(out, Matrix::dot(m1, m2)));
+    
+    bool caught = false;
+    try {
+        Matrix::dotInto(m1, m2, m1);
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should throw when the output aliases an input");
+}
+
+void test_pow_matches_repeated_dot(void) {
+    Mat data = {{0.5, 0.25, 0.25}, {0.2, 0.6, 0.2}, {0.1, 0.3, 0.6}};
+    Matrix a(data, std::make_tuple(3, 3));
+    
+    Matrix expected = Matrix::identity(3);
+    for (int k = 0; k <= 13; k++) {
+        TEST_CHECK_(matricesEqual(pow(a, k), expected, 1e-12), "A^%d mismatch", k);
+        expected = Matrix::dot(expected, a);
+    }
+}
+
+void test_pow_negative_throws(void) {
+    bool caught = false;
+    try {
+        pow(Matrix::identity(2), -1);
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    
+    TEST_CHECK_(caught, "Should throw for a negative exponent");
+}
+
+void test_polyval_matches_horner(void) {
+    Mat data = {{0.3, -0.2, 0.1}, {0.0, 0.5, 0.4}, {-0.1, 0.2, 0.2}};
+    Matrix a(data, std::make_tuple(3, 3));
+    
+    for (int degree = 0; degree <= 10; degree++) {
+        vec c;
+        for (int i = 0; i <= degree; i++) {
+            c.push_back(1.0 / (i + 1) - 0.3 * (i % 3));
+        }
+        
+        Matrix horner = Matrix::Constmultiplication(Matrix::identity(3), 0);
+        for (int i = degree; i >= 0; i--) {
+            horner = Matrix::dot(horner, a);
+            for (int r = 0; r < 3; r++) {
+                horner.matrix[r][r] += c[i];
+            }
+        }
+        
+        TEST_CHECK_(matricesEqual(polyval(c, a), horner, 1e-12),
+                   "Polynomial of degree %d mismatch", degree);
+    }
+}
+
+void test_expm_diagonal_and_nilpotent(void) {
+    // exp(diag(a, b)) = diag(e^a, e^b)
+    Mat diag = {{1.0, 0.0}, {0.0, -2.0}};
+    Matrix e = expm(Matrix(diag, std::make_tuple(2, 2)));
+    TEST_CHECK(doubleEquals(e.matrix[0][0], std::exp(1.0), 1e-12));
+    TEST_CHECK(doubleEquals(e.matrix[1][1], std::exp(-2.0), 1e-12));
+    TEST_CHECK(doubleEquals(e.matrix[0][1], 0.0, 1e-12));
+    
+    // exp([[0, t], [0, 0]]) = [[1, t], [0, 1]]
+    Mat nil = {{0.0, 3.0}, {0.0, 0.0}};
+    Mat expected = {{1.0, 3.0}, {0.0, 1.0}};
+    TEST_CHECK(matricesEqual(expm(Matrix(nil, std::make_tuple(2, 2))),
+                             Matrix(expected, std::make_tuple(2, 2)), 1e-12));
+}
+
+void test_expm_rotation_with_scaling(void) {
+    // exp([[0, -t], [t, 0]]) is a rotation by t; t = 20 forces squaring
+    for (double t : {0.01, 0.5, 2.0, 20.0}) {
+        Mat data = {{0.0, -t}, {t, 0.0}};
+        Matrix e = expm(Matrix(data, std::make_tuple(2, 2)));
+        TEST_CHECK_(doubleEquals(e.matrix[0][0], std::cos(t), 1e-10), "cos(%f)", t);
+        TEST_CHECK_(doubleEquals(e.matrix[0][1], -std::sin(t), 1e-10), "-sin(%f)", t);
+        TEST_CHECK_(doubleEquals(e.matrix[1][0], std::sin(t), 1e-10), "sin(%f)", t);
+        TEST_CHECK_(doubleEquals(e.matrix[1][1], std::cos(t), 1e-10), "cos(%f)", t);
+    }
+}
+
+// ============================================================================
+// Binary Serialization Tests
+// ============================================================================
+
+void test_binary_round_trip(void) {
+    Mat data = {{1.5, -2.25, 3.0}, {4.0, 5.125, -6.5}};
+    Matrix m(data, std::make_tuple(2, 3));
+    const char* path = "morpheus_test_round_trip.bin";
+    
+    saveBinary(m, path);
+    Matrix loaded = loadBinary(path);
+    
+    TEST_CHECK(loaded.rowsize == 2);
+    TEST_CHECK(loaded.columnsize == 3);
+    TEST_CHECK(matricesEqual(loaded, m));
+    std::remove(path);
+}
+
+void test_binary_map_is_zero_copy(void) {
+    Mat data = {{1.0, 2.0}, {3.0, 4.0}, {5.0, 6.0}};
+    Matrix m(data, std::make_tuple(3, 2));
+    const char* path = "morpheus_test_map.bin";
+    saveBinary(m, path);
+    
+    MatrixView view = mapBinary(path);
+    
+    TEST_CHECK(view.rowsize == 3);
+    TEST_CHECK(view.columnsize == 2);
+    TEST_CHECK(doubleEquals(view(2, 1), 6.0));
+    TEST_CHECK(reinterpret_cast<uintptr_t>(view.data) % 64 == 0);
+    TEST_CHECK(matricesEqual(view.toMatrix(), m));
+    TEST_CHECK(matricesEqual(view.rows(1, 3).toMatrix(),
+                             Matrix({{3.0, 4.0}, {5.0, 6.0}}, std::make_tuple(2, 2))));
+    std::remove(path);
+}
+
+void test_binary_converted_dtypes(void) {
+    Mat data = {{1.0, -2.0}, {3.0, 40000.0}};
+    Matrix m(data, std::make_tuple(2, 2));
+    const char* path = "morpheus_test_dtype.bin";
+    
+    saveBinary(m, path, DType::F32);
+    TEST_CHECK(matricesEqual(loadBinary(path), m));
+    TEST_CHECK(matricesEqual(mapBinary(path).toMatrix(), m));
+    
+    saveBinary(m, path, DType::I32, 4096);
+    TEST_CHECK(matricesEqual(loadBinary(path), m));
+    std::remove(path);
+}
+
+void test_binary_byte_swapped_file(void) {
+    Mat data = {{1.25, 2.5}};
+    Matrix m(data, std::make_tuple(1, 2));
+    const char* path = "morpheus_test_swapped.bin";
+    saveBinary(m, path);
+    
+    // Rewrite the file as if a machine of the other endianness wrote it
+    std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+    BinaryHeader h;
+    f.read(reinterpret_cast<char*>(&h), sizeof(h));
+    h.byteOrder = morpheus::byteSwap(h.byteOrder);
+    h.version = morpheus::byteSwap(h.version);
+    h.dtype = morpheus::byteSwap(h.dtype);
+    h.rows = morpheus::byteSwap(h.rows);
+    h.columns = morpheus::byteSwap(h.columns);
+    h.dataOffset = morpheus::byteSwap(h.dataOffset);
+    h.alignment = morpheus::byteSwap(h.alignment);
+    double values[2] = {morpheus::byteSwap(1.25), morpheus::byteSwap(2.5)};
+    f.seekp(0);
+    f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    f.write(reinterpret_cast<const char*>(values), sizeof(values));
+    f.close();
+    
+    TEST_CHECK(matricesEqual(loadBinary(path), m));
+    TEST_CHECK(matricesEqual(mapBinary(path).toMatrix(), m));
+    std::remove(path);
+}
+
+void test_binary_rejects_bad_files(void) {
+    const char* path = "morpheus_test_bad.bin";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "definitely not a matrix file, but long enough to hold a header......";
+    }
+    
+    bool caught = false;
+    try {
+        loadBinary(path);
+    } catch (const std::runtime_error& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should throw for a file without the magic");
+    
+    caught = false;
+    try {
+        mapBinary("morpheus_test_missing.bin");
+    } catch (const std::runtime_error& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should throw for a missing file");
+    std::remove(path);
+}
+
+// ============================================================================
+// CSV Reader and Writer Tests
+// ============================================================================
+
+void test_csv_parse_basic(void) {
+    std::string text = "1,2.5,-3\n4, +5e1 ,6\r\n\n";
+    
+    Matrix m = parseCsv(text.data(), text.size());
+    
+    Mat expected = {{1.0, 2.5, -3.0}, {4.0, 50.0, 6.0}};
+    TEST_CHECK(m.rowsize == 2);
+    TEST_CHECK(m.columnsize == 3);
+    TEST_CHECK(matricesEqual(m, Matrix(expected, std::make_tuple(2, 3))));
+}
+
+void test_csv_parse_tsv_with_header(void) {
+    std::string text = "a\tb\n0.5\t1\n2\t-0.25";
+    CsvOptions options;
+    options.delimiter = '\t';
+    options.header = true;
+    
+    Matrix m = parseCsv(text.data(), text.size(), options);
+    
+    Mat expected = {{0.5, 1.0}, {2.0, -0.25}};
+    TEST_CHECK(matricesEqual(m, Matrix(expected, std::make_tuple(2, 2))));
+}
+
+void test_csv_parse_errors(void) {
+    std::string ragged = "1,2,3\n4,5\n";
+    std::string garbage = "1,2\n3,x\n";
+    
+    bool caught = false;
+    try {
+        parseCsv(ragged.data(), ragged.size());
+    } catch (const std::runtime_error& e) {
+        caught = true;
+        TEST_CHECK(std::string(e.what()).find("Row 2") != std::string::npos);
+    }
+    TEST_CHECK_(caught, "Should throw for a row with missing fields");
+    
+    caught = false;
+    try {
+        parseCsv(garbage.data(), garbage.size());
+    } catch (const std::runtime_error& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should throw for a non-numeric field");
+}
+
+void test_csv_count_newlines(void) {
+    std::string text;
+    size_t expected = 0;
+    for (int i = 0; i < 1000; i++) {
+        text += (i % 7 == 0) ? '\n' : 'x';
+        expected += i % 7 == 0;
+    }
+    
+    TEST_CHECK(morpheus::countNewlines(text.data(), text.data() + text.size()) == expected);
+    TEST_CHECK(morpheus::countNewlines(text.data() + 3, text.data() + 20) == 2);
+}
+
+void test_csv_write_round_trip(void) {
+    Mat data = {{0.1, -1e300, 3.0}, {1.0 / 3.0, 5e-324, -0.0}};
+    Matrix m(data, std::make_tuple(2, 3));
+    
+    std::ostringstream out;
+    writeCsv(m, out);
+    std::string text = out.str();
+    Matrix back = parseCsv(text.data(), text.size());
+    
+    TEST_CHECK(back.rowsize == 2 && back.columnsize == 3);
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 3; j++) {
+            TEST_CHECK_(back.matrix[i][j] == m.matrix[i][j], "[%d][%d] should round-trip", i, j);
+        }
+    }
+}
+
+void test_csv_file_round_trip(void) {
+    Matrix m({}, std::make_tuple(50, 4));
+    for (int i = 0; i < 50; i++) {
+        for (int j = 0; j < 4; j++) {
+            m.matrix[i][j] = i * 0.5 - j;
+        }
+    }
+    const char* path = "morpheus_test.csv";
+    
+    writeCsv(m, path);
+    
+    TEST_CHECK(matricesEqual(readCsv(path), m));
+    std::remove(path);
+}
+
+void test_csv_streaming_reader(void) {
+    std::string text = "x,y\n1,2\n3,4\n\n5,6\n7,8\n9,10";
+    std::istringstream in(text);
+    CsvOptions options;
+    options.header = true;
+    // Tiny blocks force lines to straddle block boundaries
+    CsvReader reader(in, options, 3);
+    
+    Matrix chunk;
+    std::vector<double> firsts;
+    int chunks = 0;
+    while (reader.readRows(chunk, 2)) {
+        chunks++;
+        TEST_CHECK(chunk.columnsize == 2);
+        for (int i = 0; i < chunk.rowsize; i++) {
+            firsts.push_back(chunk.matrix[i][0]);
+            TEST_CHECK(doubleEquals(chunk.matrix[i][1], chunk.matrix[i][0] + 1));
+        }
+    }
+    
+    TEST_CHECK(chunks == 3);
+    TEST_CHECK(reader.rowsRead == 5);
+    TEST_CHECK((firsts == std::vector<double>{1.0, 3.0, 5.0, 7.0, 9.0}));
+}
+
+void test_csv_blank_lines_match_reader(void) {
+    // parseCsv and CsvReader skip the same blank lines and number rows alike
+    auto viaReader = [](const std::string& text) {
+        std::istringstream in(text);
+        CsvReader reader(in, {}, 5);
+        Matrix all({}, std::make_tuple(0, 0));
+        Matrix chunk;
+        while (reader.readRows(chunk, 3)) {
+            all.matrix.insert(all.matrix.end(), chunk.matrix.begin(), chunk.matrix.end());
+            all.columnsize = chunk.columnsize;
+        }
+        all.rowsize = all.matrix.size();
+        all.Dimension = std::make_tuple((int)all.rowsize, (int)all.columnsize);
+        return all;
+    };
+    std::string text = "\n \t\r\n1,2\n\n3,4\r\n  \n\n5,6\n\n";
+    Matrix parsed = parseCsv(text.data(), text.size());
+    Matrix expected(Mat{{1, 2}, {3, 4}, {5, 6}}, std::make_tuple(3, 2));
+    TEST_CHECK(matricesEqual(parsed, expected));
+    TEST_CHECK(matricesEqual(viaReader(text), expected));
+    TEST_CHECK(parseCsv("1,2\n\n3,4\n", 9).rowsize == 2);
+
+    std::string bad = "1,2\n\n3,x\n";
+    std::string parseError, readerError;
+    try {
+        parseCsv(bad.data(), bad.size());
+    } catch (const std::runtime_error& e) {
+        parseError = e.what();
+    }
+    try {
+        viaReader(bad);
+    } catch (const std::runtime_error& e) {
+        readerError = e.what();
+    }
+    TEST_CHECK(parseError.find("Row 2") != std::string::npos);
+    TEST_CHECK(parseError == readerError);
+
+    // Blank lines spread over several parallel chunks
+    std::string big;
+    for (int i = 0; i < 200000; i++) {
+        big += std::to_string(i) + ",1\n" + (i % 3 == 0 ? "\n" : "");
+    }
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(4));
+    Matrix many = parseCsv(big.data(), big.size());
+    setExecutor(nullptr);
+    TEST_ASSERT(many.rowsize == 200000);
+    bool ordered = true;
+    for (int i = 0; i < 200000; i++) {
+        ordered = ordered && many.matrix[i][0] == i;
+    }
+    TEST_CHECK(ordered);
+}
+
+// ============================================================================
+// NumPy .npy / .npz Tests
+// ============================================================================
+
+// Builds a .npy file the way NumPy lays it out
+std::string makeNpy(const std::string& dict, const std::string& data) {
+    std::string header = dict;
+    size_t total = (10 + header.size() + 1 + 63) / 64 * 64;
+    header.append(total - 10 - header.size() - 1, ' ');
+    header.push_back('\n');
+    std::string file("\x93NUMPY\x01\x00", 8);
+    file.push_back(char(header.size() & 0xFF));
+    file.push_back(char(header.size() >> 8));
+    return file + header + data;
+}
+
+void test_npy_round_trip_and_map(void) {
+    Mat data = {{1.5, -2.0, 3.25}, {4.0, 5.0, -6.125}};
+    Matrix m(data, std::make_tuple(2, 3));
+    const char* path = "morpheus_test.npy";
+    
+    saveNpy(m, path);
+    Matrix loaded = loadNpy(path);
+    MatrixView view = mapNpy(path);
+    
+    TEST_CHECK(matricesEqual(loaded, m));
+    TEST_CHECK(view.rowsize == 2 && view.columnsize == 3);
+    TEST_CHECK(reinterpret_cast<uintptr_t>(view.data) % 64 == 0);
+    TEST_CHECK(matricesEqual(view.toMatrix(), m));
+    std::remove(path);
+}
+
+void test_npy_fortran_and_dtypes(void) {
+    Mat data = {{1.0, 2.0, 3.0}, {-4.0, 5.0, 600.0}};
+    Matrix m(data, std::make_tuple(2, 3));
+    const char* path = "morpheus_test_dtypes.npy";
+    
+    for (DType dtype : {DType::F64, DType::F32, DType::I32}) {
+        for (bool fortran : {false, true}) {
+            saveNpy(m, path, dtype, fortran);
+            TEST_CHECK_(matricesEqual(loadNpy(path), m), "dtype %d fortran %d", (int)dtype, fortran);
+            TEST_CHECK(matricesEqual(mapNpy(path).toMatrix(), m));
+        }
+    }
+    std::remove(path);
+}
+
+void test_npy_reads_numpy_layouts(void) {
+    // np.asfortranarray(np.array([[1, 2, 3], [4, 5, 6]], dtype='<f4'))
+    float columnMajor[6] = {1, 4, 2, 5, 3, 6};
+    std::string f4 = makeNpy("{'descr': '<f4', 'fortran_order': True, 'shape': (2, 3), }",
+                             std::string(reinterpret_cast<const char*>(columnMajor), sizeof(columnMajor)));
+    Matrix a = morpheus::npyToMatrix(reinterpret_cast<const unsigned char*>(f4.data()), f4.size(), "f4");
+    Mat expected = {{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}};
+    TEST_CHECK(matricesEqual(a, Matrix(expected, std::make_tuple(2, 3))));
+    
+    // np.array([-1, 0, 7], dtype='>i4'): a 1-D big-endian array becomes one row
+    std::string bigEndian("\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x07", 12);
+    std::string i4 = makeNpy("{'descr': '>i4', 'fortran_order': False, 'shape': (3,), }", bigEndian);
+    Matrix b = morpheus::npyToMatrix(reinterpret_cast<const unsigned char*>(i4.data()), i4.size(), "i4");
+    TEST_CHECK(b.rowsize == 1 && b.columnsize == 3);
+    TEST_CHECK(doubleEquals(b.matrix[0][0], -1.0));
+    TEST_CHECK(doubleEquals(b.matrix[0][2], 7.0));
+    
+    std::string cube = makeNpy("{'descr': '<f8', 'fortran_order': False, 'shape': (1, 1, 1), }",
+                               std::string(8, '\0'));
+    bool caught = false;
+    try {
+        morpheus::npyToMatrix(reinterpret_cast<const unsigned char*>(cube.data()), cube.size(), "cube");
+    } catch (const std::runtime_error& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should throw for a 3-D array");
+}
+
+void test_npz_round_trip(void) {
+    Mat data1 = {{1.0, 2.0}, {3.0, 4.0}};
+    Mat data2 = {{-0.5, 0.25, 8.0}};
+    std::map<std::string, Matrix> arrays;
+    arrays.emplace("weights", Matrix(data1, std::make_tuple(2, 2)));
+    arrays.emplace("bias", Matrix(data2, std::make_tuple(1, 3)));
+    const char* path = "morpheus_test.npz";
+    
+    saveNpz(path, arrays);
+    std::map<std::string, Matrix> loaded = loadNpz(path);
+    std::map<std::string, MatrixView> mapped = mapNpz(path);
+    
+    TEST_CHECK(loaded.size() == 2 && mapped.size() == 2);
+    TEST_CHECK(matricesEqual(loaded.at("weights"), arrays.at("weights")));
+    TEST_CHECK(matricesEqual(loaded.at("bias"), arrays.at("bias")));
+    TEST_CHECK(matricesEqual(mapped.at("weights").toMatrix(), arrays.at("weights")));
+    TEST_CHECK(reinterpret_cast<uintptr_t>(mapped.at("bias").data) % 64 == 0);
+    std::remove(path);
+}
+
+void test_npz_zip64_end_record(void) {
+    std::map<std::string, Matrix> arrays;
+    Mat data = {{1.5, -2.0, 3.0}, {0.25, 8.0, -1e10}};
+    arrays.emplace("a", Matrix(data, std::make_tuple(2, 3)));
+    arrays.emplace("b", Matrix::identity(2));
+    const char* path = "morpheus_test_zip64.npz";
+    auto rewrite = [&](const std::string& bytes) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << bytes;
+    };
+    saveNpz(path, arrays);
+
+    // Rewrite the end of the archive the way ZIP64 writers do: saturate the
+    // classic record and put the real count and offset in a ZIP64 record
+    // reached through its locator.
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    size_t eocd = bytes.size() - 22;
+    uint64_t count = morpheus::readLE(reinterpret_cast<const unsigned char*>(&bytes[eocd + 10]), 2);
+    uint64_t length = morpheus::readLE(reinterpret_cast<const unsigned char*>(&bytes[eocd + 12]), 4);
+    uint64_t directory = morpheus::readLE(reinterpret_cast<const unsigned char*>(&bytes[eocd + 16]), 4);
+    bytes.resize(eocd);
+    std::string tail;
+    morpheus::writeLE(tail, 0x06064b50, 4);
+    morpheus::writeLE(tail, 44, 8);
+    morpheus::writeLE(tail, 45, 2);
+    morpheus::writeLE(tail, 45, 2);
+    morpheus::writeLE(tail, 0, 4);
+    morpheus::writeLE(tail, 0, 4);
+    morpheus::writeLE(tail, count, 8);
+    morpheus::writeLE(tail, count, 8);
+    morpheus::writeLE(tail, length, 8);
+    morpheus::writeLE(tail, directory, 8);
+    morpheus::writeLE(tail, 0x07064b50, 4);
+    morpheus::writeLE(tail, 0, 4);
+    morpheus::writeLE(tail, eocd, 8);
+    morpheus::writeLE(tail, 1, 4);
+    morpheus::writeLE(tail, 0x06054b50, 4);
+    morpheus::writeLE(tail, 0, 2);
+    morpheus::writeLE(tail, 0, 2);
+    morpheus::writeLE(tail, 0xFFFF, 2);
+    morpheus::writeLE(tail, 0xFFFF, 2);
+    morpheus::writeLE(tail, 0xFFFFFFFF, 4);
+    morpheus::writeLE(tail, 0xFFFFFFFF, 4);
+    morpheus::writeLE(tail, 0, 2);
+    bytes += tail;
+    rewrite(bytes);
+
+    std::map<std::string, Matrix> loaded = loadNpz(path);
+    TEST_CHECK(loaded.size() == 2);
+    TEST_CHECK(matricesEqual(loaded.at("a"), arrays.at("a")));
+    TEST_CHECK(matricesEqual(loaded.at("b"), arrays.at("b")));
+
+    // A locator pointing past itself is rejected
+    bytes[bytes.size() - 22 - 20 + 8] = char(0xFF);
+    rewrite(bytes);
+    bool caught = false;
+    try {
+        loadNpz(path);
+    } catch (const std::runtime_error& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should throw for a corrupt ZIP64 locator");
+    std::remove(path);
+}
+
+void test_npz_writes_zip64_for_many_members(void) {
+    // 65535 members overflow the classic end record's 2-byte count
+    std::map<std::string, Matrix> arrays;
+    for (int i = 0; i < 0xFFFF; i++) {
+        arrays.emplace("m" + std::to_string(i), Matrix({{(double)i}}, std::make_tuple(1, 1)));
+    }
+    const char* path = "morpheus_test_many.npz";
+    saveNpz(path, arrays);
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    TEST_CHECK(bytes.compare(bytes.size() - 22 - 20, 4, "PK\x06\x07", 4) == 0);
+    std::map<std::string, Matrix> loaded = loadNpz(path);
+    TEST_CHECK(loaded.size() == 0xFFFF);
+    TEST_CHECK(loaded.at("m65534").matrix[0][0] == 65534.0);
+    std::remove(path);
+
+    // Small archives keep the classic layout
+    arrays.clear();
+    arrays.emplace("a", Matrix::identity(2));
+    saveNpz(path, arrays);
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    TEST_CHECK(bytes.find(std::string("PK\x06\x06", 4)) == std::string::npos);
+    TEST_CHECK(loadNpz(path).size() == 1);
+    std::remove(path);
+}
+
+void test_npz_rejects_compressed(void) {
+    std::map<std::string, Matrix> arrays;
+    arrays.emplace("a", Matrix::identity(2));
+    const char* path = "morpheus_test_deflate.npz";
+    saveNpz(path, arrays);
+    
+    // Mark the member as deflated in the central directory
+    std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+    std::string bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    size_t central = bytes.find(std::string("PK\x01\x02", 4));
+    f.seekp(central + 10);
+    f.put(8);
+    f.close();
+    
+    bool caught = false;
+    try {
+        loadNpz(path);
+    } catch (const std::runtime_error& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should throw for a compressed member");
+    std::remove(path);
+}
+
+// ============================================================================
+// Matrix Market Tests
+// ============================================================================
+
+void writeText(const char* path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary);
+    out << text;
+}
+
+void test_mtx_coordinate_sparse_and_dense(void) {
+    const char* path = "morpheus_test_coordinate.mtx";
+    writeText(path, "%%MatrixMarket matrix coordinate real general\n"
+                    "% a comment\n"
+                    "\n"
+                    "4 5 3\n"
+                    "1 1 2.5\n"
+                    "3 5 -1e2\n"
+                    "4   2\t+7\n");
+    MtxMatrix m = readMtx(path);
+    TEST_ASSERT(std::holds_alternative<SparseMatrix>(m));
+    SparseMatrix s = std::get<SparseMatrix>(m);
+    TEST_CHECK(s.rowsize == 4 && s.columnsize == 5);
+    TEST_CHECK(s.nonZeros() == 3);
+    TEST_CHECK(s.get(0, 0) == 2.5);
+    TEST_CHECK(s.get(2, 4) == -100.0);
+    TEST_CHECK(s.get(3, 1) == 7.0);
+
+    // A low threshold turns the same file into a dense Matrix
+    MtxMatrix d = readMtx(path, 0.1);
+    TEST_ASSERT(std::holds_alternative<Matrix>(d));
+    TEST_CHECK(matricesEqual(std::get<Matrix>(d), s.toMatrix()));
+    TEST_CHECK(matricesEqual(readMtxDense(path), s.toMatrix()));
+    std::remove(path);
+}
+
+void test_mtx_symmetric_and_pattern(void) {
+    const char* path = "morpheus_test_symmetric.mtx";
+    writeText(path, "%%MatrixMarket matrix coordinate integer symmetric\n"
+                    "3 3 4\n1 1 4\n2 1 -1\n3 2 -1\n3 3 4\n");
+    Matrix sym = readMtxDense(path);
+    Matrix expected({{4, -1, 0}, {-1, 0, -1}, {0, -1, 4}}, std::make_tuple(3, 3));
+    TEST_CHECK(matricesEqual(sym, expected));
+
+    writeText(path, "%%MatrixMarket matrix coordinate real skew-symmetric\n"
+                    "3 3 2\n2 1 3\n3 1 -2\n");
+    Matrix skew = readMtxDense(path);
+    Matrix skewExpected({{0, -3, 2}, {3, 0, 0}, {-2, 0, 0}}, std::make_tuple(3, 3));
+    TEST_CHECK(matricesEqual(skew, skewExpected));
+
+    writeText(path, "%%MatrixMarket matrix coordinate pattern general\n"
+                    "2 3 2\n1 3\n2 1\n");
+    SparseMatrix pattern = readMtxSparse(path);
+    TEST_CHECK(pattern.nonZeros() == 2);
+    TEST_CHECK(pattern.get(0, 2) == 1.0);
+    TEST_CHECK(pattern.get(1, 0) == 1.0);
+    std::remove(path);
+}
+
+void test_mtx_array_format(void) {
+    const char* path = "morpheus_test_array.mtx";
+    // Column-major values
+    writeText(path, "%%MatrixMarket matrix array real general\n"
+                    "2 3\n1\n4\n2\n5\n3\n6\n");
+    Matrix general = readMtxDense(path);
+    Matrix expected({{1, 2, 3}, {4, 5, 6}}, std::make_tuple(2, 3));
+    TEST_CHECK(matricesEqual(general, expected));
+
+    // Only the lower triangle is stored, column by column
+    writeText(path, "%%MatrixMarket matrix array real symmetric\n"
+                    "3 3\n1\n2\n3\n4\n5\n6\n");
+    Matrix sym = readMtxDense(path);
+    Matrix symExpected({{1, 2, 3}, {2, 4, 5}, {3, 5, 6}}, std::make_tuple(3, 3));
+    TEST_CHECK(matricesEqual(sym, symExpected));
+
+    // Blank lines between values are not entries
+    writeText(path, "%%MatrixMarket matrix array real general\n"
+                    "2 3\n1\n4\n\n2\n5\n  \t\n3\n6\n");
+    TEST_CHECK(matricesEqual(readMtxDense(path), expected));
+    writeText(path, "%%MatrixMarket matrix coordinate real general\n"
+                    "2 3 2\n\n1 3 2.5\n \n2 1 -1\n\n");
+    Matrix sparse = readMtxDense(path);
+    TEST_CHECK(sparse.matrix[0][2] == 2.5 && sparse.matrix[1][0] == -1.0);
+    std::remove(path);
+}
+
+void test_mtx_write_round_trip(void) {
+    const char* path = "morpheus_test_round_trip.mtx";
+    Matrix dense({{0.1, -2.0, 3e-300}, {1.0 / 3.0, 0, 1e10}}, std::make_tuple(2, 3));
+    writeMtx(dense, path);
+    Matrix back = readMtxDense(path);
+    TEST_CHECK(back.matrix == dense.matrix);
+
+    SparseMatrix sparse = SparseMatrix::fromTriplets(
+        50, 40, {Triplet(0, 0, 1.5), Triplet(49, 39, -0.1), Triplet(7, 3, 1.0 / 7.0)});
+    writeMtx(sparse, path);
+    SparseMatrix sparseBack = readMtxSparse(path);
+    TEST_CHECK(sparseBack.toMatrix().matrix == sparse.toMatrix().matrix);
+    std::remove(path);
+}
+
+void test_mtx_rejects_bad_files(void) {
+    const char* path = "morpheus_test_bad.mtx";
+    const char* bad[] = {
+        "not a matrix market file\n1 1 1\n1 1 1\n",
+        "%%MatrixMarket matrix coordinate complex general\n1 1 1\n1 1 1 0\n",
+        "%%MatrixMarket matrix coordinate real general\n2 2 2\n1 1 1\n",
+        "%%MatrixMarket matrix coordinate real general\n2 2 1\n3 1 1\n",
+        "%%MatrixMarket matrix coordinate real general\n2 2 1\n1 x 1\n",
+        "%%MatrixMarket matrix coordinate real general\n2 2 1\n1e300 1 1\n",
+        "%%MatrixMarket matrix coordinate real general\n2 2 1\nnan 1 1\n",
+        "%%MatrixMarket matrix coordinate real general\n2 2 1\n1.5 1 1\n",
+        "%%MatrixMarket matrix coordinate real general\n2 2 1\n"
+        "99999999999999999999 1 1\n",
+        "%%MatrixMarket matrix coordinate real general\n2 2 1\n1 -18446744073709551615 1\n",
+        "%%MatrixMarket matrix coordinate pattern general\n2 2 1\n1 0\n",
+        "%%MatrixMarket matrix coordinate real symmetric\n2 3 0\n",
+        "%%MatrixMarket matrix array real general\n2 2\n1\n2\n3\n",
+    };
+    for (const char* text : bad) {
+        writeText(path, text);
+        bool caught = false;
+        try {
+            readMtx(path);
+        } catch (const std::runtime_error& e) {
+            caught = true;
+        }
+        TEST_CHECK_(caught, "Should reject: %s", text);
+    }
+    std::remove(path);
+}
+
+// ============================================================================
+// Tiled Matrix Tests
+// ============================================================================
+
+Matrix patternedMatrix(int rows, int cols, int seed) {
+    Matrix m({}, std::make_tuple(rows, cols));
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            m.matrix[i][j] = ((i * 7 + j * 3 + seed) % 11) - 5.0 + 0.25 * seed;
+        }
+    }
+    return m;
+}
+
+void test_tiled_round_trip_and_reopen(void) {
+    const char* path = "morpheus_test_tiled.til";
+    Matrix m = patternedMatrix(7, 10, 1);
+    {
+        TiledMatrix t = TiledMatrix::fromMatrix(m, path, 3);
+        TEST_CHECK(t.tileRows() == 3 && t.tileColumns() == 4);
+        TEST_CHECK(t.get(6, 9) == m.matrix[6][9]);
+        t.set(4, 5, 42.0);
+        TEST_CHECK(t.get(4, 5) == 42.0);
+    }
+    m.matrix[4][5] = 42.0;
+
+    TiledMatrix reopened = TiledMatrix::open(path);
+    TEST_CHECK(reopened.Dimension() == m.Dimension);
+    TEST_CHECK(reopened.toMatrix().matrix == m.matrix);
+
+    bool caught = false;
+    try {
+        reopened.set(0, 0, 1.0);
+    } catch (const std::runtime_error& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should refuse writes to a read-only file");
+    std::remove(path);
+}
+
+void test_tiled_lru_cache_bounds_mappings(void) {
+    const char* path = "morpheus_test_tiled_lru.til";
+    Matrix m = patternedMatrix(8, 8, 2);
+    TiledMatrix t = TiledMatrix::fromMatrix(m, path, 2, 3);
+    t.flush();
+    size_t misses = t.cacheMisses();
+
+    // Same tile twice: the second access is a hit
+    t.get(0, 0);
+    t.get(1, 1);
+    TEST_CHECK(t.cacheMisses() == misses + 1);
+    TEST_CHECK(t.cacheHits() >= 1);
+
+    // Touching four other tiles evicts (0, 0) from a three-tile cache
+    t.get(0, 2);
+    t.get(0, 4);
+    t.get(0, 6);
+    t.get(2, 0);
+    size_t before = t.cacheMisses();
+    TEST_CHECK(t.get(0, 0) == m.matrix[0][0]);
+    TEST_CHECK(t.cacheMisses() == before + 1);
+    std::remove(path);
+}
+
+void test_tiled_dot_matches_in_memory(void) {
+    const char* pathA = "morpheus_test_tiled_a.til";
+    const char* pathB = "morpheus_test_tiled_b.til";
+    const char* pathC = "morpheus_test_tiled_c.til";
+    Matrix a = patternedMatrix(9, 7, 3);
+    Matrix b = patternedMatrix(7, 5, 4);
+    TiledMatrix ta = TiledMatrix::fromMatrix(a, pathA, 4, 2);
+    TiledMatrix tb = TiledMatrix::fromMatrix(b, pathB, 4, 2);
+    TiledMatrix tc = TiledMatrix::dot(ta, tb, pathC, 2);
+    TEST_CHECK(tc.Dimension() == std::make_tuple(9, 5));
+    TEST_CHECK(matricesEqual(tc.toMatrix(), Matrix::dot(a, b)));
+
+    bool caught = false;
+    try {
+        TiledMatrix::dot(ta, ta, pathC);
+    } catch (const std::invalid_argument& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Should reject mismatched inner dimensions");
+    std::remove(pathA);
+    std::remove(pathB);
+    std::remove(pathC);
+}
+
+void test_tiled_add_subtract_transpose(void) {
+    const char* pathA = "morpheus_test_tiled_a.til";
+    const char* pathB = "morpheus_test_tiled_b.til";
+    const char* pathC = "morpheus_test_tiled_c.til";
+    Matrix a = patternedMatrix(5, 11, 5);
+    Matrix b = patternedMatrix(5, 11, 6);
+    TiledMatrix ta = TiledMatrix::fromMatrix(a, pathA, 4);
+    TiledMatrix tb = TiledMatrix::fromMatrix(b, pathB, 4);
+
+    TEST_CHECK(TiledMatrix::AddMatrix(ta, tb, pathC).toMatrix().matrix ==
+               Matrix::AddMatrix(a, b).matrix);
+    TEST_CHECK(TiledMatrix::SubtractMatix(ta, tb, pathC).toMatrix().matrix ==
+               Matrix::SubtractMatix(a, b).matrix);
+
+    Matrix t = TiledMatrix::transpose(ta, pathC).toMatrix();
+    TEST_CHECK(t.Dimension == std::make_tuple(11, 5));
+    bool same = true;
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 11; j++) {
+            same = same && t.matrix[j][i] == a.matrix[i][j];
+        }
+    }
+    TEST_CHECK(same);
+    std::remove(pathA);
+    std::remove(pathB);
+    std::remove(pathC);
+}
+
+// Runs loops inline and keeps posted tasks until runPosted() is called, like
+// a pool with no idle worker.
+class DeferringExecutor : public Executor {
+
+public:
+    size_t concurrency() const override { return 1; }
+
+    void run(size_t count, const std::function<void(size_t)>& task) override {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+    }
+
+    void post(std::function<void()> task) override {
+        posted.push_back(std::move(task));
+    }
+
+    void runPosted() {
+        for (auto& task : posted) {
+            task();
+        }
+        posted.clear();
+    }
+
+    std::vector<std::function<void()>> posted;
+};
+
+void test_tiled_prefetch_uses_current_executor(void) {
+    const char* pathA = "morpheus_test_tiled_a.til";
+    const char* pathB = "morpheus_test_tiled_b.til";
+    const char* pathC = "morpheus_test_tiled_c.til";
+    Matrix a = patternedMatrix(9, 7, 7);
+    Matrix b = patternedMatrix(7, 5, 8);
+    auto executor = std::make_shared<DeferringExecutor>();
+    setExecutor(executor);
+    {
+        TiledMatrix ta = TiledMatrix::fromMatrix(a, pathA, 4, 2);
+        TiledMatrix tb = TiledMatrix::fromMatrix(b, pathB, 4, 2);
+        // Prefetches that never start are cancelled, not waited for.
+        TiledMatrix tc = TiledMatrix::dot(ta, tb, pathC, 2);
+        TEST_CHECK(matricesEqual(tc.toMatrix(), Matrix::dot(a, b)));
+        size_t steps = 3 * 2 * 2;
+        TEST_CHECK_(executor->posted.size() == 2 * (steps - 1),
+                    "Expected one posted prefetch per operand and step, got %zu",
+                    executor->posted.size());
+
+        executor->posted.clear();
+        Matrix t = TiledMatrix::transpose(ta, pathC).toMatrix();
+        TEST_CHECK(t.matrix == Matrix::transpose(a).matrix);
+        TEST_CHECK(executor->posted.size() == 3 * 2 - 1);
+    }
+    // Cancelled tasks do nothing once the matrices are gone.
+    executor->runPosted();
+    setExecutor(nullptr);
+
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(4));
+    {
+        TiledMatrix ta = TiledMatrix::fromMatrix(a, pathA, 4, 2);
+        TiledMatrix tb = TiledMatrix::fromMatrix(b, pathB, 4, 2);
+        TiledMatrix tc = TiledMatrix::dot(ta, tb, pathC, 2);
+        TEST_CHECK(matricesEqual(tc.toMatrix(), Matrix::dot(a, b)));
+    }
+    setExecutor(nullptr);
+    std::remove(pathA);
+    std::remove(pathB);
+    std::remove(pathC);
+}
+
+// ============================================================================
+// Streaming Row Chunk Tests
+// ============================================================================
+
+void test_stream_chunks_are_bounded_and_ordered(void) {
+    Matrix m = patternedMatrix(10, 3, 7);
+    std::vector<double> data;
+    for (const vec& row : m.matrix) {
+        data.insert(data.end(), row.begin(), row.end());
+    }
+    ViewRowSource view(MatrixView(data.data(), 10, 3));
+
+    std::vector<size_t> starts;
+    std::vector<int> sizes;
+    const double* firstBuffer = nullptr;
+    bool reused = true;
+    size_t rows = forEachRowChunk(view, 4, [&](const Matrix& chunk, size_t first) {
+        starts.push_back(first);
+        sizes.push_back(chunk.rowsize);
+        for (int i = 0; i < chunk.rowsize; i++) {
+            reused = reused && chunk.matrix[i] == m.matrix[first + i];
+        }
+        if (starts.size() == 1) {
+            firstBuffer = chunk.matrix[0].data();
+        } else if (starts.size() == 3) {
+            // Third chunk lands in the first buffer again
+            reused = reused && chunk.matrix[0].data() == firstBuffer;
+        }
+    });
+    TEST_CHECK(rows == 10);
+    TEST_CHECK((starts == std::vector<size_t>{0, 4, 8}));
+    TEST_CHECK((sizes == std::vector<int>{4, 4, 2}));
+    TEST_CHECK(reused);
+    ViewRowSource empty(MatrixView(nullptr, 0, 0));
+    TEST_CHECK(forEachRowChunk(empty, 4, [](const Matrix&, size_t) {}) == 0);
+}
+
+void test_stream_gram_and_column_sums(void) {
+    Matrix x = patternedMatrix(37, 5, 8);
+    std::istringstream text([&] {
+        std::ostringstream out;
+        writeCsv(x, out);
+        return out.str();
+    }());
+    CsvReader reader(text, {}, 64);
+    CsvRowSource csv(reader);
+    Matrix gram = streamGram(csv, 6);
+
+    Matrix xt({}, std::make_tuple(5, 37));
+    for (int i = 0; i < 37; i++) {
+        for (int j = 0; j < 5; j++) {
+            xt.matrix[j][i] = x.matrix[i][j];
+        }
+    }
+    TEST_CHECK(matricesEqual(gram, Matrix::dot(xt, x)));
+
+    // Generator producing the same rows
+    int produced = 0;
+    GeneratorRowSource generator([&](Matrix& chunk, int maxRows) {
+        int rows = std::min(maxRows, 37 - produced);
+        chunk = Matrix(Mat(x.matrix.begin() + produced, x.matrix.begin() + produced + rows),
+                       std::make_tuple(rows, 5));
+        produced += rows;
+        return rows > 0;
+    });
+    vec sums = streamColumnSums(generator, 8);
+    TEST_ASSERT(sums.size() == 5);
+    for (int j = 0; j < 5; j++) {
+        double expected = 0;
+        for (int i = 0; i < 37; i++) {
+            expected += x.matrix[i][j];
+        }
+        TEST_CHECK(doubleEquals(sums[j], expected));
+    }
+}
+
+void test_stream_propagates_errors(void) {
+    std::istringstream text("1,2\n3,4\n5\n");
+    CsvReader reader(text);
+    CsvRowSource csv(reader);
+    bool caught = false;
+    try {
+        streamColumnSums(csv, 1);
+    } catch (const std::runtime_error& e) {
+        caught = true;
+    }
+    TEST_CHECK_(caught, "Reader errors should reach the caller");
+}
+
+// ============================================================================
+// Formatting Tests
+// ============================================================================
+
+void test_format_print_matches_stream_output(void) {
+    Matrix m({{1.5, -2.0, 1e-7}, {1234567.0, 3.14159265, 0.0}}, std::make_tuple(2, 3));
+    std::ostringstream expected;
+    for (int i = 0; i < 2; i++) {
+        expected << "\n(";
+        for (int j = 0; j < 3; j++) {
+            expected << m.matrix[i][j] << (j != 2 ? "\t" : "");
+        }
+        expected << ")";
+    }
+    std::ostringstream printed;
+    m.print(printed);
+    TEST_CHECK(printed.str() == expected.str());
+    TEST_MSG("Got: %s", printed.str().c_str());
+
+    std::ostringstream container;
+    printContainer(std::vector<double>{0.1, 2.5e10}, container);
+    TEST_CHECK(container.str() == "--------------\n0.1\n2.5e+10\n--------------\n");
+    std::ostringstream ints;
+    printContainer(std::vector<int>{-3, 1234567}, ints);
+    TEST_CHECK(ints.str() == "--------------\n-3\n1234567\n--------------\n");
+    // A Matrix row (vec, a tracked vector in this build) prints the same way
+    std::ostringstream row;
+    printContainer(Matrix({{0.1, 2.5e10}}, std::make_tuple(1, 2)).getRow(0), row);
+    TEST_CHECK(row.str() == container.str());
+
+    // The stream's precision and flags apply as they do to operator<<
+    auto streamed = [&](std::ios_base::fmtflags flags, int precision) {
+        std::ostringstream out;
+        out.flags(flags);
+        out.precision(precision);
+        for (int i = 0; i < 2; i++) {
+            out << "\n(";
+            for (int j = 0; j < 3; j++) {
+                out << m.matrix[i][j] << (j != 2 ? "\t" : "");
+            }
+            out << ")";
+        }
+        return out.str();
+    };
+    for (std::ios_base::fmtflags flags : {std::ios_base::dec, std::ios_base::fixed,
+                                          std::ios_base::scientific | std::ios_base::showpos}) {
+        for (int precision : {0, 3, 12}) {
+            std::ostringstream out;
+            out.flags(flags);
+            out.precision(precision);
+            m.print(out);
+            TEST_CHECK(out.str() == streamed(flags, precision));
+            TEST_MSG("flags %x, precision %d: %s", (unsigned)flags, precision, out.str().c_str());
+        }
+    }
+    std::ostringstream hex;
+    hex << std::hex;
+    printContainer(std::vector<int>{255}, hex);
+    TEST_CHECK(hex.str() == "--------------\nff\n--------------\n");
+}
+
+void test_format_precision_and_width(void) {
+    Matrix m({{1.0 / 3.0, 2.0}, {-0.5, 100.0}}, std::make_tuple(2, 2));
+    TEST_CHECK(m.toString() == "0.3333333333333333\t2\n-0.5\t100\n");
+
+    FormatOptions options;
+    options.precision = 3;
+    options.width = 6;
+    options.separator = ",";
+    TEST_CHECK(m.toString(options) == " 0.333,     2\n  -0.5,   100\n");
+
+    // Fields wider than the writer's slack are padded in full
+    options.width = 1000;
+    std::string wide = m.toString(options);
+    TEST_CHECK(wide.size() == 4 * 1000 + 2 + 2);
+    TEST_CHECK(wide.compare(995, 5, "0.333") == 0);
+}
+
+void test_format_head_tail_truncation(void) {
+    Matrix m({}, std::make_tuple(6, 6));
+    for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 6; j++) {
+            m.matrix[i][j] = i * 10 + j;
+        }
+    }
+    FormatOptions options;
+    options.separator = " ";
+    options.headRows = 1;
+    options.tailRows = 1;
+    options.headColumns = 2;
+    options.tailColumns = 1;
+    TEST_CHECK(m.toString(options) == "0 1 ... 5\n...\n50 51 ... 55\n");
+
+    // Head only
+    options.tailRows = 0;
+    options.tailColumns = 0;
+    TEST_CHECK(m.toString(options) == "0 1 ...\n...\n");
+
+    // Limits larger than the matrix show everything
+    options.headRows = 10;
+    options.headColumns = 10;
+    FormatOptions everything;
+    everything.separator = " ";
+    TEST_CHECK(m.toString(options) == m.toString(everything));
+
+    FormatOptions negative;
+    negative.tailRows = -1;
+    TEST_EXCEPTION(m.toString(negative), std::invalid_argument);
+    negative.tailRows = 0;
+    negative.headColumns = -2;
+    TEST_EXCEPTION(m.toString(negative), std::invalid_argument);
+}
+
+void test_format_large_matrix_to_file_descriptor(void) {
+    Matrix m = patternedMatrix(300, 400, 3);
+    std::FILE* file = std::tmpfile();
+    TEST_ASSERT(file != NULL);
+    m.format(fileno(file));
+
+    std::string written;
+    std::rewind(file);
+    char block[4096];
+    size_t n;
+    while ((n = std::fread(block, 1, sizeof(block), file)) > 0) {
+        written.append(block, n);
+    }
+    std::fclose(file);
+    TEST_CHECK(written.size() > (1 << 20) / 8);
+    TEST_CHECK(written == m.toString());
+    TEST_CHECK(parseCsv(written.data(), written.size(), {'\t'}).matrix == m.matrix);
+}
+
+// ============================================================================
+// Instrumentation Tests
+// ============================================================================
+
+void test_perf_scopes_accumulate_per_operation(void) {
+    perfReset();
+    for (int i = 0; i < 3; i++) {
+        morpheus::OpScope scope("test-op", 100.0, 800.0);
+    }
+    {
+        morpheus::OpScope outer("test-outer", 1.0, 0.0);
+        morpheus::OpScope inner("test-op", 10.0, 0.0);
+    }
+    auto report = perfReport();
+    TEST_ASSERT(report.count("test-op") == 1);
+    TEST_CHECK(report["test-op"].calls == 4);
+    TEST_CHECK(report["test-op"].flops == 310.0);
+    TEST_CHECK(report["test-op"].bytes == 2400.0);
+    TEST_CHECK(report["test-outer"].calls == 1);
+    if (!perfCountersAvailable()) {
+        TEST_CHECK(report["test-op"].cycles == 0);
+    }
+
+    std::ostringstream json;
+    writePerfJson(json);
+    TEST_CHECK(json.str().find("\"name\": \"test-op\", \"calls\": 4") != std::string::npos);
+
+    perfReset();
+    TEST_CHECK(perfReport().empty());
+    std::ostringstream empty;
+    writePerfJson(empty);
+    TEST_CHECK(empty.str() == "[]");
+}
+
+void test_perf_json_precision_and_worker_counters(void) {
+    perfReset();
+    OpStats delta;
+    delta.calls = 1;
+    delta.flops = 123456789.0;
+    delta.nanoseconds = 1234567891;
+    morpheus::OpRegistry::instance().add("test-long", delta);
+    std::ostringstream json;
+    writePerfJson(json);
+    TEST_CHECK(json.str().find("\"flops\": 123456789, \"bytes\": 0, \"seconds\": 1.234567891,") !=
+               std::string::npos);
+    TEST_MSG("Got: %s", json.str().c_str());
+    perfReset();
+
+    // Tasks parallelFor runs on pool threads are charged to the operation
+    // that started them
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(4));
+    std::mutex lock;
+    std::set<morpheus::OpCounters*> seen;
+    morpheus::OpCounters* inScope = nullptr;
+    {
+        morpheus::OpScope scope("test-parallel", 0.0, 0.0);
+        inScope = morpheus::OpCounters::current();
+        morpheus::parallelFor(1 << 20, 1, [&](size_t, size_t, size_t) {
+            std::lock_guard<std::mutex> guard(lock);
+            seen.insert(morpheus::OpCounters::current());
+        });
+    }
+    setExecutor(nullptr);
+    TEST_CHECK(inScope != nullptr);
+    TEST_CHECK(seen.size() == 1 && *seen.begin() == inScope);
+    TEST_CHECK(morpheus::OpCounters::current() == nullptr);
+    perfReset();
+}
+
+void test_trace_records_events_per_thread(void) {
+    traceClear();
+    {
+        morpheus::TraceScope scope("test-dot", 16.0, 0.0, 2, 2, 2);
+        morpheus::noteAllocation(32);
+    }
+    std::thread worker([] {
+        morpheus::TraceScope scope("test-add", 4.0, 0.0, 2, 2);
+    });
+    worker.join();
+
+    std::ostringstream out;
+    writeChromeTrace(out);
+    std::string json = out.str();
+    TEST_CHECK(json.rfind("{\"traceEvents\": [", 0) == 0);
+    size_t dot = json.find("\"name\": \"test-dot\"");
+    size_t add = json.find("\"name\": \"test-add\"");
+    TEST_ASSERT(dot != std::string::npos && add != std::string::npos);
+    TEST_CHECK(json.find("\"shape\": [2, 2, 2], \"flops\": 16, \"allocated_bytes\": 32", dot) != std::string::npos);
+    TEST_CHECK(json.find("\"shape\": [2, 2], \"flops\": 4, \"allocated_bytes\": 0", add) != std::string::npos);
+
+    // The two events are on different thread tracks
+    std::string dotTid = json.substr(json.find("\"tid\": ", dot), 10);
+    std::string addTid = json.substr(json.find("\"tid\": ", add), 10);
+    TEST_CHECK(dotTid != addTid);
+
+    traceClear();
+    std::ostringstream cleared;
+    writeChromeTrace(cleared);
+    TEST_CHECK(cleared.str().find("test-dot") == std::string::npos);
+}
+
+void test_trace_keeps_nanosecond_resolution(void) {
+    traceClear();
+    // Past about a second, 6 significant digits would round to milliseconds
+    morpheus::TraceEvent e{"test-late", 5000123456ull, 5000123456ull + 7089, {3, -1, -1}, 134217728.0, 0};
+    morpheus::TraceRegistry::instance().forThisThread().record(e);
+    std::ostringstream out;
+    writeChromeTrace(out);
+    std::string json = out.str();
+    TEST_CHECK(json.find("\"ts\": 5000123.456, \"dur\": 7.089") != std::string::npos);
+    TEST_CHECK(json.find("\"flops\": 134217728,") != std::string::npos);
+    TEST_MSG("Got: %s", json.c_str());
+    traceClear();
+}
+
+void test_trace_ring_keeps_latest_events(void) {
+    traceClear();
+    size_t total = morpheus::TraceBuffer::capacity + 100;
+    for (size_t i = 0; i < total; i++) {
+        morpheus::TraceScope scope(i < 100 ? "test-old" : "test-new", 0.0, 0.0);
+    }
+    std::vector<morpheus::TraceEvent> events =
+        morpheus::TraceRegistry::instance().forThisThread().snapshot();
+    TEST_CHECK(events.size() == morpheus::TraceBuffer::capacity);
+    bool allNew = true;
+    bool ordered = true;
+    for (size_t i = 0; i < events.size(); i++) {
+        allNew = allNew && std::string(events[i].name) == "test-new";
+        ordered = ordered && (i == 0 || events[i - 1].end <= events[i].begin);
+    }
+    TEST_CHECK(allNew);
+    TEST_CHECK(ordered);
+    traceClear();
+}
+
+void test_trace_concurrent_snapshot_and_clear(void) {
+    auto buffer = std::make_unique<morpheus::TraceBuffer>(99);
+    const uint64_t total = 4 * morpheus::TraceBuffer::capacity;
+    std::atomic<uint64_t> recorded{0};
+    std::thread writer([&] {
+        for (uint64_t k = 0; k < total; k++) {
+            morpheus::TraceEvent e;
+            e.name = "test-concurrent";
+            e.begin = e.end = e.allocatedBytes = k;
+            e.shape[0] = e.shape[1] = e.shape[2] = (int)k;
+            e.flops = (double)k;
+            buffer->record(e);
+            recorded.store(k + 1, std::memory_order_release);
+        }
+    });
+
+    // Every event a reader sees is whole, and none predates the last clear
+    bool whole = true;
+    bool afterClear = true;
+    while (recorded.load(std::memory_order_acquire) < total) {
+        uint64_t before = recorded.load(std::memory_order_acquire);
+        buffer->clear();
+        for (const morpheus::TraceEvent& e : buffer->snapshot()) {
+            whole = whole && e.end == e.begin && e.allocatedBytes == e.begin &&
+                    e.shape[2] == (int)e.begin && e.flops == (double)e.begin;
+            afterClear = afterClear && e.begin >= before;
+        }
+    }
+    writer.join();
+    TEST_CHECK(whole);
+    TEST_CHECK(afterClear);
+
+    buffer->clear();
+    TEST_CHECK(buffer->snapshot().empty());
+    morpheus::TraceEvent last{"test-last", 1, 2, {-1, -1, -1}, 0.0, 0};
+    buffer->record(last);
+    std::vector<morpheus::TraceEvent> events = buffer->snapshot();
+    TEST_ASSERT(events.size() == 1);
+    TEST_CHECK(std::string(events[0].name) == "test-last");
+}
+
+// ============================================================================
+// Allocation Accounting Tests
+// ============================================================================
+
+void test_alloc_operations_do_not_copy_inputs(void) {
+    Matrix a = patternedMatrix(4, 3, 1);
+    Matrix b = patternedMatrix(3, 5, 2);
+    Matrix c = patternedMatrix(4, 3, 3);
+
+    // A result of r rows costs r row buffers plus the row list; copying
+    // an operand would add at least as many again.
+    TEST_CHECK(allocationsDuring([&] { Matrix::dot(a, b); }) == 5);
+    TEST_CHECK(allocationsDuring([&] { Matrix::AddMatrix(a, c); }) == 5);
+    TEST_CHECK(allocationsDuring([&] { Matrix::SubtractMatix(a, c); }) == 5);
+    TEST_CHECK(allocationsDuring([&] { Matrix::Constmultiplication(a, 2); }) == 5);
+
+    Matrix out;
+    Matrix::dotInto(a, b, out);
+    TEST_CHECK(allocationsDuring([&] { Matrix::dotInto(a, b, out); }) == 0);
+}
+
+void test_alloc_report_per_operation(void) {
+    Matrix a = patternedMatrix(6, 6, 4);
+    allocationReset();
+    AllocationStats start = allocationStats();
+    TEST_CHECK(start.allocations == 0);
+    TEST_CHECK(start.peakBytes == start.liveBytes);
+
+    {
+        Matrix p = Matrix::dot(a, a);
+        Matrix q = Matrix::AddMatrix(p, a);
+        AllocationStats during = allocationStats();
+        TEST_CHECK(during.liveBytes == start.liveBytes + 2 * (6 * 6 * sizeof(double) + 6 * sizeof(vec)));
+    }
+    AllocationStats after = allocationStats();
+    TEST_CHECK(after.liveBytes == start.liveBytes);
+    TEST_CHECK(after.peakBytes >= start.liveBytes + 2 * 6 * 6 * sizeof(double));
+    TEST_CHECK(after.deallocations == after.allocations);
+
+    std::map<std::string, AllocationStats> report = allocationReport();
+    TEST_CHECK(report["Matrix::dot"].allocations == 7);
+    TEST_CHECK(report["Matrix::dot"].bytesAllocated == 6 * 6 * sizeof(double) + 6 * sizeof(vec));
+    TEST_CHECK(report["Matrix::AddMatrix"].allocations == 7);
+    TEST_CHECK(report.count("Matrix::SubtractMatix") == 0);
+
+    allocationReset();
+    TEST_CHECK(allocationReport().empty());
+}
+
+void test_alloc_report_across_threads(void) {
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(4));
+    allocationReset();
+    std::mutex lock;
+    std::set<std::thread::id> threads;
+    {
+        morpheus::AllocationScope scope("parallel chunks");
+        morpheus::parallelFor(16, 1, [&](size_t, size_t, size_t) {
+            vec scratch(8);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            std::lock_guard<std::mutex> guard(lock);
+            threads.insert(std::this_thread::get_id());
+        });
+    }
+    // Chunks run on pool threads are charged to the caller's operation
+    TEST_CHECK(threads.size() > 1);
+    TEST_CHECK(allocationReport()["parallel chunks"].allocations == 16);
+
+    // and the workers do not keep the operation afterwards
+    morpheus::parallelFor(16, 1, [](size_t, size_t, size_t) {
+        vec scratch(8);
+    });
+    TEST_CHECK(allocationReport()["parallel chunks"].allocations == 16);
+    setExecutor(nullptr);
+}
+
+// ============================================================================
+// Transpose Tests
+// ============================================================================
+
+void test_transpose(void) {
+    Matrix m({{1, 2, 3}, {4, 5, 6}}, std::make_tuple(2, 3));
+    Matrix t = Matrix::transpose(m);
+    Matrix expected({{1, 4}, {2, 5}, {3, 6}}, std::make_tuple(3, 2));
+    TEST_CHECK(t.Dimension == std::make_tuple(3, 2));
+    TEST_CHECK(t.matrix == expected.matrix);
+
+    // Sizes that do not divide the block size
+    Matrix big = patternedMatrix(70, 33, 5);
+    Matrix back = Matrix::transpose(Matrix::transpose(big));
+    TEST_CHECK(back.matrix == big.matrix);
+    TEST_CHECK(Matrix::transpose(big).matrix[32][69] == big.matrix[69][32]);
+}
+
+// ============================================================================
+// Differential Tests
+// ============================================================================
+//
+// Each optimized path is compared with a naive long double reference on
+// random shapes and values. Case c of a test uses seed base + c; a failure
+// prints its seed, and
+//   MORPHEUS_STRESS_SEED=<seed> MORPHEUS_STRESS_CASES=1 ./tests <test-name>
+// replays exactly that case. Raise MORPHEUS_STRESS_CASES for soak runs.
+
+uint64_t stressEnv(const char* name, uint64_t fallback) {
+    const char* value = std::getenv(name);
+    return value && *value ? std::strtoull(value, nullptr, 0) : fallback;
+}
+
+uint64_t stressSeed() { return stressEnv("MORPHEUS_STRESS_SEED", 0x5eed); }
+
+uint64_t stressCases(uint64_t fallback) { return stressEnv("MORPHEUS_STRESS_CASES", fallback); }
+
+// Mostly the awkward sizes around block and vector widths, otherwise any
+// size up to 70.
+int stressDimension(std::mt19937_64& rng) {
+    static const int edges[] = {1, 2, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65};
+    if (rng() % 3 == 0) {
+        return 1 + rng() % 70;
+    }
+    return edges[rng() % (sizeof(edges) / sizeof(edges[0]))];
+}
+
+// Uniform values, values spread over 60 binary orders of magnitude, small
+// integers (exact products) or mostly zeros, picked per matrix.
+Matrix stressMatrix(int rows, int cols, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    int kind = rng() % 4;
+    Matrix m({}, std::make_tuple(rows, cols));
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            double v = unit(rng);
+            if (kind == 1) {
+                v = std::ldexp(v, (int)(rng() % 61) - 30);
+            } else if (kind == 2) {
+                v = std::round(v * 8);
+            } else if (kind == 3 && rng() % 4 != 0) {
+                v = 0;
+            }
+            m.matrix[i][j] = v;
+        }
+    }
+    return m;
+}
+
+// A shape of at least parallelGrain elements, so row-split kernels hand it
+// to the executor; either tall or wide.
+std::pair<int, int> stressLargeShape(std::mt19937_64& rng) {
+    int narrow = stressDimension(rng);
+    int wide = (int)(morpheus::parallelGrain / narrow) + 1 + (int)(rng() % 70);
+    return rng() % 2 ? std::make_pair(wide, narrow) : std::make_pair(narrow, wide);
+}
+
+Matrix columnMatrix(const vec& v) {
+    Matrix m({}, std::make_tuple((int)v.size(), 1));
+    for (size_t i = 0; i < v.size(); i++) {
+        m.matrix[i][0] = v[i];
+    }
+    return m;
+}
+
+// Exact-as-possible result, and per element the sum of the magnitudes of
+// its terms: any summation order of n products is within n units in the
+// last place of that sum.
+struct Reference {
+    int rows = 0;
+    int cols = 0;
+    std::vector<long double> value;
+    std::vector<long double> scale;
+};
+
+Reference referenceProduct(const Matrix& a, const Matrix& b) {
+    Reference r;
+    r.rows = a.rowsize;
+    r.cols = b.columnsize;
+    r.value.assign((size_t)r.rows * r.cols, 0.0L);
+    r.scale.assign((size_t)r.rows * r.cols, 0.0L);
+    for (int i = 0; i < r.rows; i++) {
+        for (int j = 0; j < r.cols; j++) {
+            long double sum = 0;
+            long double magnitude = 0;
+            for (int k = 0; k < a.columnsize; k++) {
+                long double term = (long double)a.matrix[i][k] * b.matrix[k][j];
+                sum += term;
+                magnitude += std::fabs(term);
+            }
+            r.value[(size_t)i * r.cols + j] = sum;
+            r.scale[(size_t)i * r.cols + j] = magnitude;
+        }
+    }
+    return r;
+}
+
+// Element-wise reference; op combines the long double operands.
+template <typename Op>
+Reference referenceElementwise(const Matrix& a, Op op) {
+    Reference r;
+    r.rows = a.rowsize;
+    r.cols = a.columnsize;
+    for (int i = 0; i < r.rows; i++) {
+        for (int j = 0; j < r.cols; j++) {
+            long double v = op(i, j);
+            r.value.push_back(v);
+            r.scale.push_back(std::fabs(v));
+        }
+    }
+    return r;
+}
+
+// |computed - reference| in units in the last place of scale.
+double ulpError(double computed, long double reference, long double scale) {
+    long double error = std::fabs((long double)computed - reference);
+    if (error == 0) {
+        return 0;
+    }
+    double s = (double)scale;
+    return (double)(error / (std::nextafter(s, INFINITY) - s));
+}
+
+void checkUlps(const Matrix& computed, const Reference& ref, double maxUlps,
+               const char* what, uint64_t seed) {
+    if (!TEST_CHECK_(computed.rowsize == ref.rows && computed.columnsize == ref.cols,
+                     "%s shape (seed %llu)", what, (unsigned long long)seed)) {
+        return;
+    }
+    double worst = 0;
+    int wi = 0;
+    int wj = 0;
+    for (int i = 0; i < ref.rows; i++) {
+        for (int j = 0; j < ref.cols; j++) {
+            size_t k = (size_t)i * ref.cols + j;
+            double e = ulpError(computed.matrix[i][j], ref.value[k], ref.scale[k]);
+            if (!(e <= worst)) {
+                worst = e;
+                wi = i;
+                wj = j;
+            }
+        }
+    }
+    if (!TEST_CHECK_(worst <= maxUlps, "%s %dx%d within %g ulps (seed %llu)", what,
+                     ref.rows, ref.cols, maxUlps, (unsigned long long)seed)) {
+        size_t k = (size_t)wi * ref.cols + wj;
+        TEST_MSG("element (%d, %d) is %.17g, reference %.21Lg: %g ulps", wi, wj,
+                 computed.matrix[wi][wj], ref.value[k], worst);
+        TEST_MSG("replay with MORPHEUS_STRESS_SEED=%llu MORPHEUS_STRESS_CASES=1",
+                 (unsigned long long)seed);
+    }
+}
+
+void test_differential_dot(void) {
+    uint64_t base = stressSeed();
+    Matrix reused;
+    for (uint64_t c = 0; c < stressCases(400); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int m = stressDimension(rng);
+        int k = stressDimension(rng);
+        int n = stressDimension(rng);
+        Matrix a = stressMatrix(m, k, rng);
+        Matrix b = stressMatrix(k, n, rng);
+        Reference ref = referenceProduct(a, b);
+        checkUlps(Matrix::dot(a, b), ref, k, "dot", seed);
+        Matrix::dotInto(a, b, reused);
+        checkUlps(reused, ref, k, "dotInto", seed);
+    }
+}
+
+void test_differential_transpose(void) {
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(400); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        Matrix a = stressMatrix(stressDimension(rng), stressDimension(rng), rng);
+        Matrix t = Matrix::transpose(a);
+        Reference ref = referenceElementwise(t, [&](int i, int j) { return (long double)a.matrix[j][i]; });
+        checkUlps(t, ref, 0, "transpose", seed);
+    }
+}
+
+void test_differential_elementwise(void) {
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(400); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int m = stressDimension(rng);
+        int n = stressDimension(rng);
+        Matrix a = stressMatrix(m, n, rng);
+        Matrix b = stressMatrix(m, n, rng);
+        int scalar = (int)(rng() % 201) - 100;
+        checkUlps(Matrix::AddMatrix(a, b),
+                  referenceElementwise(a, [&](int i, int j) {
+                      return (long double)a.matrix[i][j] + b.matrix[i][j];
+                  }),
+                  1, "AddMatrix", seed);
+        checkUlps(Matrix::SubtractMatix(a, b),
+                  referenceElementwise(a, [&](int i, int j) {
+                      return (long double)a.matrix[i][j] - b.matrix[i][j];
+                  }),
+                  1, "SubtractMatix", seed);
+        checkUlps(Matrix::Constmultiplication(a, scalar),
+                  referenceElementwise(a, [&](int i, int j) {
+                      return (long double)a.matrix[i][j] * scalar;
+                  }),
+                  1, "Constmultiplication", seed);
+    }
+}
+
+void test_differential_symmetric(void) {
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(200); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int n = stressDimension(rng);
+        Matrix dense = stressMatrix(n, n, rng);
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                dense.matrix[i][j] = dense.matrix[j][i];
+            }
+        }
+        SymmetricMatrix A = SymmetricMatrix::fromMatrix(dense);
+        Matrix B = stressMatrix(n, stressDimension(rng), rng);
+        checkUlps(SymmetricMatrix::symm(A, B), referenceProduct(dense, B), n, "symm", seed);
+        Matrix x = stressMatrix(n, 1, rng);
+        checkUlps(columnMatrix(SymmetricMatrix::symv(A, x.getCol(0))),
+                  referenceProduct(dense, x), n, "symv", seed);
+    }
+}
+
+void test_differential_banded(void) {
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(200); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int n = stressDimension(rng);
+        int lower = rng() % n;
+        int upper = rng() % n;
+        BandMatrix A = BandMatrix::fromMatrix(stressMatrix(n, n, rng), lower, upper);
+        Matrix x = stressMatrix(n, 1, rng);
+        checkUlps(columnMatrix(BandMatrix::gbmv(A, x.getCol(0))),
+                  referenceProduct(A.toMatrix(), x), n, "gbmv", seed);
+    }
+}
+
+void test_differential_sparse(void) {
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(200); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int m = stressDimension(rng);
+        int n = stressDimension(rng);
+        Matrix dense = stressMatrix(m, n, rng);
+        Matrix x = stressMatrix(n, 1, rng);
+        SparseMatrix A = SparseMatrix::fromMatrix(dense);
+        checkUlps(columnMatrix(A.apply(x.getCol(0))), referenceProduct(dense, x), n,
+                  "SparseMatrix::apply", seed);
+    }
+}
+
+void test_differential_tiled(void) {
+    const char* paths[] = {"morpheus_stress_a.til", "morpheus_stress_b.til",
+                           "morpheus_stress_c.til"};
+    static const int tileSizes[] = {5, 16, 32};
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(30); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int m = stressDimension(rng);
+        int k = stressDimension(rng);
+        int n = stressDimension(rng);
+        int tileSize = tileSizes[rng() % 3];
+        Matrix a = stressMatrix(m, k, rng);
+        Matrix b = stressMatrix(k, n, rng);
+        {
+            TiledMatrix ta = TiledMatrix::fromMatrix(a, paths[0], tileSize);
+            TiledMatrix tb = TiledMatrix::fromMatrix(b, paths[1], tileSize);
+            checkUlps(TiledMatrix::dot(ta, tb, paths[2]).toMatrix(), referenceProduct(a, b), k,
+                      "TiledMatrix::dot", seed);
+        }
+        for (const char* path : paths) {
+            std::remove(path);
+        }
+    }
+}
+
+void test_differential_stream_gram(void) {
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(100); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int m = stressDimension(rng);
+        int n = stressDimension(rng);
+        Matrix x = stressMatrix(m, n, rng);
+        std::vector<double> rows;
+        for (int i = 0; i < m; i++) {
+            rows.insert(rows.end(), x.matrix[i].begin(), x.matrix[i].end());
+        }
+        ViewRowSource source(MatrixView(rows.data(), m, n));
+        checkUlps(streamGram(source, 1 + rng() % m), referenceProduct(Matrix::transpose(x), x),
+                  m, "streamGram", seed);
+    }
+}
+
+// Left-to-right product of factors in long double. The scale is the same
+// product of the factors' absolute values, which bounds the rounding of any
+// parenthesization: each product of the chain adds at most its inner
+// dimension in ulps of it.
+Reference referenceChain(const std::vector<Matrix>& factors) {
+    Reference r;
+    r.rows = factors[0].rowsize;
+    r.cols = factors[0].columnsize;
+    for (int i = 0; i < r.rows; i++) {
+        for (int j = 0; j < r.cols; j++) {
+            r.value.push_back(factors[0].matrix[i][j]);
+            r.scale.push_back(std::fabs((long double)factors[0].matrix[i][j]));
+        }
+    }
+    for (size_t f = 1; f < factors.size(); f++) {
+        const Matrix& b = factors[f];
+        Reference next;
+        next.rows = r.rows;
+        next.cols = b.columnsize;
+        next.value.assign((size_t)next.rows * next.cols, 0.0L);
+        next.scale.assign((size_t)next.rows * next.cols, 0.0L);
+        for (int i = 0; i < r.rows; i++) {
+            for (int k = 0; k < r.cols; k++) {
+                long double v = r.value[(size_t)i * r.cols + k];
+                long double m = r.scale[(size_t)i * r.cols + k];
+                for (int j = 0; j < next.cols; j++) {
+                    next.value[(size_t)i * next.cols + j] += v * b.matrix[k][j];
+                    next.scale[(size_t)i * next.cols + j] += m * std::fabs(b.matrix[k][j]);
+                }
+            }
+        }
+        r = std::move(next);
+    }
+    return r;
+}
+
+void test_differential_multi_dot(void) {
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(200); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int count = 1 + rng() % 5;
+        std::vector<int> dims{stressDimension(rng)};
+        std::vector<Matrix> factors;
+        std::vector<std::reference_wrapper<const Matrix>> refs;
+        double inner = 0;
+        for (int f = 0; f < count; f++) {
+            dims.push_back(stressDimension(rng));
+            factors.push_back(stressMatrix(dims[f], dims[f + 1], rng));
+            inner += f ? dims[f] : 0;
+        }
+        for (const Matrix& m : factors) {
+            refs.push_back(m);
+        }
+        checkUlps(multi_dot(refs), referenceChain(factors), inner, "multi_dot", seed);
+    }
+}
+
+void test_differential_dot_fused(void) {
+    const GemmEpilogue::Activation activations[] = {
+        GemmEpilogue::Activation::None, GemmEpilogue::Activation::ReLU,
+        GemmEpilogue::Activation::Sigmoid, GemmEpilogue::Activation::Tanh,
+        GemmEpilogue::Activation::GELU};
+    uint64_t base = stressSeed();
+    Matrix reused;
+    for (uint64_t c = 0; c < stressCases(400); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int m = stressDimension(rng);
+        int k = stressDimension(rng);
+        int n = stressDimension(rng);
+        Matrix a = stressMatrix(m, k, rng);
+        Matrix b = stressMatrix(k, n, rng);
+        GemmEpilogue epilogue;
+        epilogue.scale = stressMatrix(1, 1, rng).matrix[0][0];
+        if (rng() % 2) {
+            epilogue.rowBias = stressMatrix(1, m, rng).getRow(0);
+        }
+        if (rng() % 2) {
+            epilogue.columnBias = stressMatrix(1, n, rng).getRow(0);
+        }
+        epilogue.activation = activations[rng() % 5];
+
+        // Every activation is at most about 1.13-Lipschitz, so the error of
+        // the biased product carries over; the activation itself adds a few
+        // ulps of its result.
+        Reference ref = referenceProduct(a, b);
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                size_t e = (size_t)i * n + j;
+                long double rowBias = epilogue.rowBias.empty() ? 0 : epilogue.rowBias[i];
+                long double columnBias = epilogue.columnBias.empty() ? 0 : epilogue.columnBias[j];
+                long double v = epilogue.scale * ref.value[e] + rowBias + columnBias;
+                switch (epilogue.activation) {
+                case GemmEpilogue::Activation::None:
+                    break;
+                case GemmEpilogue::Activation::ReLU:
+                    v = v > 0 ? v : 0;
+                    break;
+                case GemmEpilogue::Activation::Sigmoid:
+                    v = 1 / (1 + std::exp(-v));
+                    break;
+                case GemmEpilogue::Activation::Tanh:
+                    v = std::tanh(v);
+                    break;
+                case GemmEpilogue::Activation::GELU:
+                    v = 0.5L * v * (1 + std::tanh(0.7978845608028654L * (v + 0.044715L * v * v * v)));
+                    break;
+                }
+                ref.scale[e] = std::fabs(epilogue.scale) * ref.scale[e] + std::fabs(rowBias) +
+                               std::fabs(columnBias) + std::fabs(v);
+                ref.value[e] = v;
+            }
+        }
+        checkUlps(dotFused(a, b, epilogue), ref, 2 * k + 8, "dotFused", seed);
+        dotFusedInto(a, b, reused, epilogue);
+        checkUlps(reused, ref, 2 * k + 8, "dotFusedInto", seed);
+    }
+}
+
+void test_differential_in_place(void) {
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(4));
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(100); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        std::pair<int, int> shape = rng() % 8 == 0
+                                        ? stressLargeShape(rng)
+                                        : std::make_pair(stressDimension(rng), stressDimension(rng));
+        Matrix a = stressMatrix(shape.first, shape.second, rng);
+        Matrix b = stressMatrix(shape.first, shape.second, rng);
+        double k = stressMatrix(1, 1, rng).matrix[0][0];
+
+        Matrix acc = a;
+        acc += b;
+        checkUlps(acc, referenceElementwise(a, [&](int i, int j) {
+                      return (long double)a.matrix[i][j] + b.matrix[i][j];
+                  }),
+                  1, "operator+=", seed);
+        acc = a;
+        acc -= b;
+        checkUlps(acc, referenceElementwise(a, [&](int i, int j) {
+                      return (long double)a.matrix[i][j] - b.matrix[i][j];
+                  }),
+                  1, "operator-=", seed);
+        acc = a;
+        acc *= k;
+        checkUlps(acc, referenceElementwise(a, [&](int i, int j) {
+                      return (long double)a.matrix[i][j] * k;
+                  }),
+                  1, "operator*=", seed);
+
+        // Two roundings unless the multiply-add is fused
+        acc = a;
+        acc.axpy(k, b);
+        Reference axpy = referenceElementwise(a, [&](int i, int j) {
+            return (long double)a.matrix[i][j] + (long double)k * b.matrix[i][j];
+        });
+        for (int i = 0; i < a.rowsize; i++) {
+            for (int j = 0; j < a.columnsize; j++) {
+                axpy.scale[(size_t)i * a.columnsize + j] =
+                    std::fabs((long double)a.matrix[i][j]) + std::fabs((long double)k * b.matrix[i][j]);
+            }
+        }
+        checkUlps(acc, axpy, 2, "axpy", seed);
+
+        // The operand may be the target itself
+        acc = a;
+        acc += acc;
+        checkUlps(acc, referenceElementwise(a, [&](int i, int j) {
+                      return 2.0L * a.matrix[i][j];
+                  }),
+                  0, "operator+= on itself", seed);
+        acc -= acc;
+        checkUlps(acc, referenceElementwise(a, [](int, int) { return 0.0L; }), 0,
+                  "operator-= on itself", seed);
+    }
+    setExecutor(nullptr);
+}
+
+// Which result each element of a reduction feeds: the only one of a
+// whole-matrix reduction, or its row's or its column's.
+struct ReductionShape {
+    bool whole;
+    Axis axis;
+    const char* name;
+
+    int groups(const Matrix& m) const {
+        return whole ? 1 : axis == Axis::PerRow ? m.rowsize : m.columnsize;
+    }
+    int length(const Matrix& m) const {
+        return whole ? m.rowsize * m.columnsize : axis == Axis::PerRow ? m.columnsize : m.rowsize;
+    }
+    int group(int i, int j) const { return whole ? 0 : axis == Axis::PerRow ? i : j; }
+};
+
+const ReductionShape reductionShapes[] = {
+    {true, Axis::PerRow, "whole"},
+    {false, Axis::PerRow, "per row"},
+    {false, Axis::PerColumn, "per column"},
+};
+
+// term(v) summed over each group of `shape`, as a column of results.
+template <typename Term>
+Reference referenceSum(const Matrix& a, const ReductionShape& shape, Term term) {
+    Reference r;
+    r.rows = shape.groups(a);
+    r.cols = 1;
+    r.value.assign(r.rows, 0.0L);
+    r.scale.assign(r.rows, 0.0L);
+    for (int i = 0; i < a.rowsize; i++) {
+        for (int j = 0; j < a.columnsize; j++) {
+            long double t = term((long double)a.matrix[i][j]);
+            r.value[shape.group(i, j)] += t;
+            r.scale[shape.group(i, j)] += std::fabs(t);
+        }
+    }
+    return r;
+}
+
+// The reduction of `shape` as a column: whole() for the whole matrix,
+// along(axis) otherwise.
+template <typename Whole, typename Along>
+Matrix reduced(const ReductionShape& shape, Whole whole, Along along) {
+    return shape.whole ? columnMatrix(vec{whole()}) : columnMatrix(along(shape.axis));
+}
+
+void test_differential_reductions(void) {
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(4));
+    uint64_t base = stressSeed();
+    for (uint64_t c = 0; c < stressCases(100); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        std::pair<int, int> shape = rng() % 8 == 0
+                                        ? stressLargeShape(rng)
+                                        : std::make_pair(stressDimension(rng), stressDimension(rng));
+        Matrix a = stressMatrix(shape.first, shape.second, rng);
+
+        for (const ReductionShape& s : reductionShapes) {
+            std::string what = std::string(" ") + s.name;
+            double n = s.length(a);
+            checkUlps(reduced(s, [&] { return sum(a); }, [&](Axis axis) { return sum(a, axis); }),
+                      referenceSum(a, s, [](long double v) { return v; }), n,
+                      ("sum" + what).c_str(), seed);
+            checkUlps(reduced(s, [&] { return norm(a, Norm::L1); },
+                              [&](Axis axis) { return norm(a, axis, Norm::L1); }),
+                      referenceSum(a, s, [](long double v) { return std::fabs(v); }), n,
+                      ("L1 norm" + what).c_str(), seed);
+
+            // The square root halves the sum's relative error
+            Reference squares = referenceSum(a, s, [](long double v) { return v * v; });
+            for (size_t g = 0; g < squares.value.size(); g++) {
+                squares.value[g] = std::sqrt(squares.value[g]);
+                squares.scale[g] = squares.value[g];
+            }
+            checkUlps(reduced(s, [&] { return norm(a, Norm::L2); },
+                              [&](Axis axis) { return norm(a, axis, Norm::L2); }),
+                      squares, n, ("L2 norm" + what).c_str(), seed);
+
+            // Extremes are exact, and the arg reductions find their first
+            // occurrence in row-major order
+            int groups = s.groups(a);
+            Reference largest{groups, 1, std::vector<long double>(groups, -INFINITY),
+                              std::vector<long double>(groups, 0)};
+            Reference smallest{groups, 1, std::vector<long double>(groups, INFINITY),
+                               std::vector<long double>(groups, 0)};
+            Reference largestAbs{groups, 1, std::vector<long double>(groups, 0),
+                                 std::vector<long double>(groups, 0)};
+            std::vector<std::pair<int, int>> argLargest(groups), argSmallest(groups);
+            for (int i = 0; i < a.rowsize; i++) {
+                for (int j = 0; j < a.columnsize; j++) {
+                    int g = s.group(i, j);
+                    long double v = a.matrix[i][j];
+                    if (v > largest.value[g]) {
+                        largest.value[g] = v;
+                        argLargest[g] = {i, j};
+                    }
+                    if (v < smallest.value[g]) {
+                        smallest.value[g] = v;
+                        argSmallest[g] = {i, j};
+                    }
+                    largestAbs.value[g] = std::max(largestAbs.value[g], std::fabs(v));
+                }
+            }
+            checkUlps(reduced(s, [&] { return maximum(a); }, [&](Axis axis) { return maximum(a, axis); }),
+                      largest, 0, ("maximum" + what).c_str(), seed);
+            checkUlps(reduced(s, [&] { return minimum(a); }, [&](Axis axis) { return minimum(a, axis); }),
+                      smallest, 0, ("minimum" + what).c_str(), seed);
+            checkUlps(reduced(s, [&] { return norm(a, Norm::Inf); },
+                              [&](Axis axis) { return norm(a, axis, Norm::Inf); }),
+                      largestAbs, 0, ("Inf norm" + what).c_str(), seed);
+
+            bool argsMatch = true;
+            if (s.whole) {
+                argsMatch = argmax(a) == argLargest[0] && argmin(a) == argSmallest[0];
+            } else {
+                std::vector<int> max = argmax(a, s.axis);
+                std::vector<int> min = argmin(a, s.axis);
+                for (int g = 0; g < groups; g++) {
+                    int at = s.axis == Axis::PerRow ? 1 : 0;
+                    argsMatch = argsMatch &&
+                                max[g] == (at ? argLargest[g].second : argLargest[g].first) &&
+                                min[g] == (at ? argSmallest[g].second : argSmallest[g].first);
+                }
+            }
+            TEST_CHECK_(argsMatch, "argmin and argmax%s (seed %llu)", what.c_str(),
+                        (unsigned long long)seed);
+        }
+    }
+    setExecutor(nullptr);
+}
+
+// Sum of products x * y to well beyond double precision whatever the
+// cancellation: each product is split exactly with fma into a double and
+// its error, and the pieces are added with Neumaier's compensation in long
+// double. magnitude is the sum of the products' absolute values.
+struct AccurateSum {
+    long double sum = 0;
+    long double error = 0;
+    long double magnitude = 0;
+
+    void add(long double v) {
+        long double t = sum + v;
+        error += std::fabs(sum) >= std::fabs(v) ? (sum - t) + v : (v - t) + sum;
+        sum = t;
+    }
+    void addProduct(double x, double y) {
+        double p = x * y;
+        add(p);
+        add(std::fma(x, y, -p));
+        magnitude += std::fabs((long double)x * y);
+    }
+    long double value() const { return sum + error; }
+};
+
+// Reference for n-term sums accumulated in `mode`. The plain modes are held
+// to n ulps of the terms' magnitude. Neumaier (which also compensates the
+// products) is held to the compensated dot product's bound,
+// u |sum| + n^2 u^2 magnitude, as 2 ulps of |sum| + n^2 u magnitude.
+Reference summationReference(int rows, int cols, const std::vector<AccurateSum>& sums,
+                             Summation mode, double n) {
+    Reference r;
+    r.rows = rows;
+    r.cols = cols;
+    for (const AccurateSum& s : sums) {
+        long double v = s.value();
+        r.value.push_back(v);
+        r.scale.push_back(mode == Summation::Neumaier
+                              ? std::fabs(v) + n * n * std::ldexp(s.magnitude, -52)
+                              : s.magnitude);
+    }
+    return r;
+}
+
+double summationUlps(Summation mode, double n) { return mode == Summation::Neumaier ? 2 : n; }
+
+void test_differential_summation_modes(void) {
+    const Summation modes[] = {Summation::Naive, Summation::Pairwise, Summation::Neumaier,
+                               Summation::BlockedFma};
+    const char* names[] = {"Naive", "Pairwise", "Neumaier", "BlockedFma"};
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(4));
+    uint64_t base = stressSeed();
+    Matrix reused;
+    for (uint64_t c = 0; c < stressCases(50); c++) {
+        uint64_t seed = base + c;
+        std::mt19937_64 rng(seed);
+        int m = stressDimension(rng);
+        int k = stressDimension(rng);
+        int n = stressDimension(rng);
+        Matrix a = stressMatrix(m, k, rng);
+        Matrix b = stressMatrix(k, n, rng);
+        std::vector<AccurateSum> products((size_t)m * n);
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < n; j++) {
+                for (int p = 0; p < k; p++) {
+                    products[(size_t)i * n + j].addProduct(a.matrix[i][p], b.matrix[p][j]);
+                }
+            }
+        }
+
+        std::pair<int, int> shape = rng() % 8 == 0
+                                        ? stressLargeShape(rng)
+                                        : std::make_pair(stressDimension(rng), stressDimension(rng));
+        Matrix x = stressMatrix(shape.first, shape.second, rng);
+
+        // Exact sums, absolute sums and sums of squares along each shape
+        std::vector<std::vector<AccurateSum>> sums, absSums, squareSums;
+        for (const ReductionShape& s : reductionShapes) {
+            sums.emplace_back(s.groups(x));
+            absSums.emplace_back(s.groups(x));
+            squareSums.emplace_back(s.groups(x));
+            for (int i = 0; i < x.rowsize; i++) {
+                for (int j = 0; j < x.columnsize; j++) {
+                    double v = x.matrix[i][j];
+                    sums.back()[s.group(i, j)].addProduct(v, 1.0);
+                    absSums.back()[s.group(i, j)].addProduct(std::fabs(v), 1.0);
+                    squareSums.back()[s.group(i, j)].addProduct(v, v);
+                }
+            }
+        }
+
+        for (int mode = 0; mode < 4; mode++) {
+            Summation sm = modes[mode];
+            std::string what = std::string(" ") + names[mode];
+            Reference ref = summationReference(m, n, products, sm, k);
+            checkUlps(Matrix::dot(a, b, sm), ref, summationUlps(sm, k), ("dot" + what).c_str(), seed);
+            Matrix::dotInto(a, b, reused, sm);
+            checkUlps(reused, ref, summationUlps(sm, k), ("dotInto" + what).c_str(), seed);
+
+            for (size_t r = 0; r < sums.size(); r++) {
+                const ReductionShape& s = reductionShapes[r];
+                std::string along = what + " " + s.name;
+                double length = s.length(x);
+                checkUlps(reduced(s, [&] { return sum(x, sm); }, [&](Axis axis) { return sum(x, axis, sm); }),
+                          summationReference(s.groups(x), 1, sums[r], sm, length),
+                          summationUlps(sm, length), ("sum" + along).c_str(), seed);
+                checkUlps(reduced(s, [&] { return norm(x, Norm::L1, sm); },
+                                  [&](Axis axis) { return norm(x, axis, Norm::L1, sm); }),
+                          summationReference(s.groups(x), 1, absSums[r], sm, length),
+                          summationUlps(sm, length), ("L1 norm" + along).c_str(), seed);
+
+                // The square root halves the sum's relative error and adds
+                // one rounding
+                Reference l2 = summationReference(s.groups(x), 1, squareSums[r], sm, length);
+                for (size_t g = 0; g < l2.value.size(); g++) {
+                    l2.value[g] = std::sqrt(l2.value[g]);
+                    l2.scale[g] = l2.value[g];
+                }
+                checkUlps(reduced(s, [&] { return norm(x, Norm::L2, sm); },
+                                  [&](Axis axis) { return norm(x, axis, Norm::L2, sm); }),
+                          l2, summationUlps(sm, length), ("L2 norm" + along).c_str(), seed);
+            }
+        }
+    }
+    setExecutor(nullptr);
+}
+
+// ============================================================================
+// Scheduler Tests
+// ============================================================================
+
+void test_work_stealing_deque(void) {
+    std::vector<int> items(20000);
+    for (size_t i = 0; i < items.size(); i++) {
+        items[i] = (int)i;
+    }
+
+    morpheus::WorkStealingDeque<int> deque(4);
+    for (int i = 0; i < 100; i++) {
+        deque.push(&items[i]); // grows past the initial capacity
+    }
+    TEST_CHECK(*deque.pop() == 99);
+    TEST_CHECK(*deque.steal() == 0);
+    while (deque.pop()) {
+    }
+    TEST_CHECK(deque.empty());
+    TEST_CHECK(deque.steal() == nullptr);
+
+    // Every item is taken exactly once by the owner or one of the thieves
+    std::vector<std::atomic<int>> taken(items.size());
+    std::atomic<bool> done{false};
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; t++) {
+        thieves.emplace_back([&] {
+            while (!done.load() || !deque.empty()) {
+                if (int* item = deque.steal()) {
+                    taken[*item]++;
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < items.size(); i++) {
+        deque.push(&items[i]);
+        if (i % 3 == 0) {
+            if (int* item = deque.pop()) {
+                taken[*item]++;
+            }
+        }
+    }
+    while (int* item = deque.pop()) {
+        taken[*item]++;
+    }
+    done = true;
+    for (std::thread& t : thieves) {
+        t.join();
+    }
+    bool once = true;
+    for (std::atomic<int>& count : taken) {
+        once = once && count.load() == 1;
+    }
+    TEST_CHECK(once);
+}
+
+void test_parallel_for_on_work_stealing_pool(void) {
+    auto pool = std::make_shared<morpheus::WorkStealingPool>(4);
+    setExecutor(pool);
+    TEST_CHECK(morpheus::chunkCount(1 << 20, 1) == 16);
+    TEST_CHECK(morpheus::chunkCount(10, 1) == 10);
+
+    // Nested loops cover every cell exactly once
+    const size_t rows = 40;
+    const size_t cols = 50;
+    std::vector<std::atomic<int>> hits(rows * cols);
+    morpheus::parallelFor(rows, 1, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            morpheus::parallelFor(cols, 1, [&](size_t, size_t first, size_t last) {
+                for (size_t j = first; j < last; j++) {
+                    hits[i * cols + j]++;
+                }
+            });
+        }
+    });
+    bool once = true;
+    for (std::atomic<int>& h : hits) {
+        once = once && h.load() == 1;
+    }
+    TEST_CHECK(once);
+
+    // Threads outside the pool can share it
+    SparseMatrix A = poissonMatrix(40);
+    vec x(A.cols(), 1.0);
+    vec expected = A.apply(x);
+    std::vector<std::thread> callers;
+    std::atomic<int> matches{0};
+    for (int t = 0; t < 3; t++) {
+        callers.emplace_back([&] {
+            for (int r = 0; r < 20; r++) {
+                matches += A.apply(x) == expected;
+            }
+        });
+    }
+    for (std::thread& t : callers) {
+        t.join();
+    }
+    TEST_CHECK(matches == 60);
+
+    TEST_EXCEPTION(morpheus::parallelFor(100, 1, [](size_t c, size_t, size_t) {
+                       if (c == 7) {
+                           throw std::runtime_error("chunk failed");
+                       }
+                   }),
+                   std::runtime_error);
+    setExecutor(nullptr);
+}
+
+void test_pool_waiters_skip_posted_tasks(void) {
+    // The pool's only worker is held by a posted task
+    morpheus::WorkStealingPool pool(2);
+    std::atomic<bool> open{false};
+    std::atomic<bool> held{false};
+    pool.post([&] {
+        held = true;
+        while (!open.load()) {
+            std::this_thread::yield();
+        }
+    });
+    while (!held.load()) {
+        std::this_thread::yield();
+    }
+
+    // A loop run meanwhile finishes without running the queued post
+    std::atomic<bool> ran{false};
+    std::thread::id ranOn;
+    pool.post([&] {
+        ranOn = std::this_thread::get_id();
+        ran = true;
+    });
+    std::atomic<int> chunks{0};
+    pool.run(8, [&](size_t) { chunks++; });
+    TEST_CHECK(chunks == 8);
+    TEST_CHECK(!ran.load());
+
+    open = true;
+    while (!ran.load()) {
+        std::this_thread::yield();
+    }
+    TEST_CHECK(ranOn != std::this_thread::get_id());
+}
+
+// Runs every task inline, counting the loops it was given.
+class CountingExecutor : public Executor {
+
+public:
+    size_t concurrency() const override { return 3; }
+
+    void run(size_t count, const std::function<void(size_t)>& task) override {
+        loops++;
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+    }
+
+    int loops = 0;
+};
+
+void test_custom_executor(void) {
+    auto executor = std::make_shared<CountingExecutor>();
+    setExecutor(executor);
+    TEST_CHECK(morpheus::chunkCount(1 << 20, 1) == 12);
+
+    vec x(1 << 18, 0.5);
+    vec y(1 << 18, 4.0);
+    TEST_CHECK(morpheus::dot(x, y) == 2.0 * (1 << 18));
+    TEST_CHECK(executor->loops == 1);
+
+    setExecutor(nullptr);
+    TEST_CHECK(morpheus::dot(x, y) == 2.0 * (1 << 18));
+    TEST_CHECK(executor->loops == 1);
+}
+
+// ============================================================================
+// Async Tests
+// ============================================================================
+
+// Holds the executor's only worker until released, so operations posted
+// after it stay queued.
+struct PoolGate {
+    std::atomic<bool> open{false};
+    AsyncResult<int> task = runAsync([this] {
+        while (!open.load()) {
+            std::this_thread::yield();
+        }
+        return 0;
+    });
+
+    ~PoolGate() {
+        open = true;
+        task.wait();
+    }
+};
+
+void test_async_matches_sync(void) {
+    Matrix a = patternedMatrix(9, 7, 1);
+    Matrix b = patternedMatrix(7, 9, 2);
+    Matrix c = patternedMatrix(9, 9, 3);
+
+    AsyncResult<Matrix> product = dotAsync(a, b);
+    AsyncResult<Matrix> sum = AddMatrixAsync(product, AsyncResult<Matrix>::ready(c));
+    AsyncResult<Matrix> difference = SubtractMatixAsync(sum, product);
+    AsyncResult<double> corner = difference.then([](const Matrix& m) { return m.matrix[8][8]; });
+
+    TEST_CHECK(product.get().matrix == Matrix::dot(a, b).matrix);
+    TEST_CHECK(sum.get().matrix == Matrix::AddMatrix(Matrix::dot(a, b), c).matrix);
+    TEST_CHECK(matricesEqual(difference.get(), c));
+    TEST_CHECK(doubleEquals(corner.get(), c.matrix[8][8]));
+    TEST_CHECK(difference.isReady());
+}
+
+void test_async_errors_propagate(void) {
+    AsyncResult<Matrix> bad = dotAsync(patternedMatrix(2, 3, 1), patternedMatrix(2, 3, 1));
+    AsyncResult<Matrix> dependent = AddMatrixAsync(bad, bad);
+    AsyncResult<int> chained = dependent.then([](const Matrix&) { return 1; });
+    TEST_EXCEPTION(bad.get(), std::invalid_argument);
+    TEST_EXCEPTION(dependent.get(), std::invalid_argument);
+    TEST_EXCEPTION(chained.get(), std::invalid_argument);
+}
+
+void test_async_cancel(void) {
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(1));
+    {
+        PoolGate gate;
+        AsyncResult<Matrix> queued = dotAsync(patternedMatrix(4, 4, 1), patternedMatrix(4, 4, 2));
+        AsyncResult<Matrix> dependent = AddMatrixAsync(queued, queued);
+        TEST_CHECK(!queued.isReady());
+        queued.cancel();
+        TEST_CHECK(queued.isReady());
+        TEST_EXCEPTION(queued.get(), OperationCancelled);
+        TEST_EXCEPTION(dependent.get(), OperationCancelled);
+
+        // Cancelling a dependent leaves its input alone
+        AsyncResult<Matrix> input = dotAsync(patternedMatrix(3, 3, 1), patternedMatrix(3, 3, 1));
+        AsyncResult<int> follower = input.then([](const Matrix&) { return 1; });
+        follower.cancel();
+        gate.open = true;
+        TEST_CHECK(input.get().rowsize == 3);
+        TEST_EXCEPTION(follower.get(), OperationCancelled);
+    }
+
+    // No effect once finished
+    AsyncResult<Matrix> done = AddMatrixAsync(patternedMatrix(2, 2, 1), patternedMatrix(2, 2, 1));
+    done.wait();
+    done.cancel();
+    TEST_CHECK(done.get().rowsize == 2);
+    setExecutor(nullptr);
+}
+
+void test_async_decompositions(void) {
+    int n = 8;
+    BandMatrix a(n, 1, 1);
+    for (int i = 0; i < n; i++) {
+        a.set(i, i, 4.0);
+        if (i + 1 < n) { a.set(i, i + 1, -1.0); a.set(i + 1, i, -1.0); }
+    }
+    vec x(n);
+    for (int i = 0; i < n; i++) {
+        x[i] = i - 3.5;
+    }
+    vec b = BandMatrix::gbmv(a, x);
+
+    vec viaLu = luAsync(a).get().solve(b);
+    vec viaCholesky = choleskyAsync(AsyncResult<BandMatrix>::ready(a)).get().solve(b);
+    for (int i = 0; i < n; i++) {
+        TEST_CHECK(doubleEquals(viaLu[i], x[i]));
+        TEST_CHECK(doubleEquals(viaCholesky[i], x[i]));
+    }
+
+    BandMatrix indefinite(2, 0, 0);
+    indefinite.set(0, 0, -1.0);
+    TEST_EXCEPTION(choleskyAsync(indefinite).get(), std::invalid_argument);
+}
+
+// Stands in for std::coroutine_handle, which needs C++20.
+struct FakeCoroutine {
+    std::atomic<int>* resumed;
+    void resume() { (*resumed)++; }
+};
+
+void test_async_awaitable(void) {
+    setExecutor(std::make_shared<morpheus::WorkStealingPool>(1));
+    std::atomic<int> resumed{0};
+    {
+        PoolGate gate;
+        AsyncResult<Matrix> sum = AddMatrixAsync(patternedMatrix(3, 3, 1), patternedMatrix(3, 3, 2));
+        TEST_CHECK(!sum.await_ready());
+        sum.await_suspend(FakeCoroutine{&resumed});
+        TEST_CHECK(resumed == 0);
+        gate.open = true;
+        while (resumed == 0) {
+            std::this_thread::yield();
+        }
+        TEST_CHECK(sum.await_ready());
+        TEST_CHECK(sum.await_resume().matrix ==
+                   Matrix::AddMatrix(patternedMatrix(3, 3, 1), patternedMatrix(3, 3, 2)).matrix);
+    }
+    TEST_CHECK(resumed == 1);
+    setExecutor(nullptr);
+}
+
+// ============================================================================
+// Lazy Evaluation Tests
+// ============================================================================
+
+void test_lazy_shares_common_products(void) {
+    Matrix A = patternedMatrix(6, 5, 1);
+    Matrix B = patternedMatrix(5, 6, 2);
+    Matrix C = patternedMatrix(6, 6, 3);
+
+    // A·B + A·B·C - 2·A·B, with A·B spelled out three times
+    LazyMatrix e = LazyMatrix::SubtractMatix(
+        LazyMatrix::AddMatrix(LazyMatrix::dot(A, B), LazyMatrix::dot(LazyMatrix::dot(A, B), C)),
+        LazyMatrix::Constmultiplication(LazyMatrix::dot(A, B), 2));
+    morpheus::LazyPlan plan = e.plan();
+    TEST_CHECK(plan.steps() == 2);    // A·B, then (A·B)·C with -A·B as epilogue
+    TEST_CHECK(plan.products() == 2);
+
+    Matrix AB = Matrix::dot(A, B);
+    Matrix expected = Matrix::SubtractMatix(Matrix::AddMatrix(AB, Matrix::dot(AB, C)),
+                                            Matrix::Constmultiplication(AB, 2));
+    TEST_CHECK(!e.evaluated());
+    const Matrix& value = e.eval();
+    TEST_CHECK(e.evaluated());
+    TEST_CHECK(matricesEqual(value, expected));
+    TEST_CHECK(&e.eval() == &value);
+}
+
+void test_lazy_reassociates_chains(void) {
+    Matrix A = patternedMatrix(50, 2, 1);
+    Matrix B = patternedMatrix(2, 50, 2);
+    Matrix C = patternedMatrix(50, 2, 3);
+
+    // Written as (A·B)·C: 10000 multiply-adds; A·(B·C) needs 400
+    LazyMatrix e = LazyMatrix::dot(LazyMatrix::dot(A, B), C);
+    TEST_CHECK(e.plan().multiplyAdds() == 400);
+    TEST_CHECK(matricesEqual(e.eval(), Matrix::dot(Matrix::dot(A, B), C)));
+
+    // A product used twice is computed once and kept whole
+    LazyMatrix AB = LazyMatrix::dot(A, B);
+    LazyMatrix twice = LazyMatrix::AddMatrix(LazyMatrix::dot(AB, A), LazyMatrix::dot(AB, A));
+    TEST_CHECK(twice.plan().products() == 2);
+    TEST_CHECK(matricesEqual(twice.eval(), Matrix::Constmultiplication(
+                                               Matrix::dot(Matrix::dot(A, B), A), 2)));
+}
+
+void test_lazy_reuses_dead_buffers(void) {
+    Matrix m[7];
+    for (int i = 0; i < 7; i++) {
+        m[i] = patternedMatrix(8, 8, i);
+    }
+    // ((A·B + C)·D + E)·F + G: three steps, the last one reusing the first
+    // one's buffer
+    LazyMatrix e = LazyMatrix::AddMatrix(
+        LazyMatrix::dot(LazyMatrix::AddMatrix(
+                            LazyMatrix::dot(LazyMatrix::AddMatrix(LazyMatrix::dot(m[0], m[1]), m[2]),
+                                            m[3]),
+                            m[4]),
+                        m[5]),
+        m[6]);
+    TEST_CHECK(e.plan().steps() == 3);
+    TEST_CHECK(allocationsDuring([&] { e.eval(); }) == 2 * 9);
+
+    Matrix expected = m[0];
+    for (int i = 1; i < 7; i += 2) {
+        expected = Matrix::AddMatrix(Matrix::dot(expected, m[i]), m[i + 1]);
+    }
+    TEST_CHECK(matricesEqual(e.eval(), expected));
+}
+
+void test_lazy_leaves_and_errors(void) {
+    // Temporaries are owned by the expression
+    LazyMatrix sum = LazyMatrix::AddMatrix(patternedMatrix(3, 3, 1), patternedMatrix(3, 3, 2));
+    TEST_CHECK(matricesEqual(sum.eval(),
+                             Matrix::AddMatrix(patternedMatrix(3, 3, 1), patternedMatrix(3, 3, 2))));
+
+    // An evaluated expression is a plain input to later ones
+    LazyMatrix scaled = LazyMatrix::Constmultiplication(sum, 0.5);
+    TEST_CHECK(scaled.plan().steps() == 1);
+    TEST_CHECK(doubleEquals(scaled.eval().matrix[2][1], 0.5 * sum.eval().matrix[2][1]));
+
+    // Terms that cancel leave zeros
+    Matrix A = patternedMatrix(2, 3, 4);
+    TEST_CHECK(matricesEqual(LazyMatrix::SubtractMatix(A, A).eval(), Matrix({}, std::make_tuple(2, 3))));
+
+    TEST_EXCEPTION(LazyMatrix::dot(A, A), std::invalid_argument);
+    TEST_EXCEPTION(LazyMatrix::AddMatrix(A, patternedMatrix(3, 2, 1)), std::invalid_argument);
+}
+
+void test_lazy_keeps_non_finite_values(void) {
+    // Terms of opposite sign are not merged, and zero coefficients still
+    // multiply their term, so infinities become NaN as they do eagerly
+    Matrix A = patternedMatrix(3, 4, 1);
+    Matrix B = patternedMatrix(4, 3, 2);
+    A.matrix[1][2] = std::numeric_limits<double>::infinity();
+    B.matrix[0][1] = std::nan("");
+    Matrix AB = Matrix::dot(A, B);
+    Matrix eager[] = {Matrix::SubtractMatix(AB, AB), Matrix::Constmultiplication(AB, 0),
+                      Matrix::SubtractMatix(Matrix::AddMatrix(AB, AB), AB)};
+    LazyMatrix lazyAB = LazyMatrix::dot(A, B);
+    LazyMatrix lazy[] = {LazyMatrix::SubtractMatix(LazyMatrix::dot(A, B), LazyMatrix::dot(A, B)),
+                         LazyMatrix::Constmultiplication(LazyMatrix::dot(A, B), 0),
+                         LazyMatrix::SubtractMatix(LazyMatrix::AddMatrix(lazyAB, lazyAB), lazyAB)};
+    for (int e = 0; e < 3; e++) {
+        const Matrix& value = lazy[e].eval();
+        bool same = true;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                double x = value.matrix[i][j];
+                double y = eager[e].matrix[i][j];
+                same = same && (std::isnan(x) ? std::isnan(y) : x == y);
+            }
+        }
+        TEST_CHECK(same);
+        TEST_MSG("expression %d", e);
+    }
+}
+
+void test_lazy_plan_outlives_expression(void) {
+    morpheus::LazyPlan plan = [] {
+        LazyMatrix e = LazyMatrix::dot(patternedMatrix(4, 5, 1), patternedMatrix(5, 3, 2));
+        return e.plan();
+    }();
+    TEST_CHECK(matricesEqual(plan.run(),
+                             Matrix::dot(patternedMatrix(4, 5, 1), patternedMatrix(5, 3, 2))));
+}
+
+// ============================================================================
+// Matrix Chain Tests
+// ============================================================================
+
+void test_chain_order(void) {
+    // The textbook six-matrix example
+    morpheus::ChainOrder order({30, 35, 15, 5, 10, 20, 25});
+    TEST_CHECK(order.cost() == 15125);
+    TEST_CHECK(order.split(0, 5) == 2); // (A1 A2 A3)(A4 A5 A6)
+    TEST_CHECK(order.split(0, 2) == 0); // A1 (A2 A3)
+    TEST_CHECK(order.split(3, 5) == 4); // (A4 A5) A6
+    TEST_CHECK(morpheus::ChainOrder({4, 7}).cost() == 0);
+}
+
+void test_multi_dot_matches_nested_dot(void) {
+    Matrix A = patternedMatrix(10, 100, 1);
+    Matrix B = patternedMatrix(100, 5, 2);
+    Matrix C = patternedMatrix(5, 50, 3);
+    Matrix D = patternedMatrix(50, 2, 4);
+
+    // Left to right takes 8500 multiply-adds, the best order 3500
+    TEST_CHECK(morpheus::ChainOrder({10, 100, 5, 50, 2}).cost() == 3500);
+    Matrix nested = Matrix::dot(Matrix::dot(Matrix::dot(A, B), C), D);
+    TEST_CHECK(matricesEqual(multi_dot({A, B, C, D}), nested, 1e-6));
+    TEST_CHECK(multi_dot({A}).matrix == A.matrix);
+}
+
+void test_multi_dot_reuses_buffers(void) {
+    std::vector<Matrix> factors;
+    for (int i = 0; i < 6; i++) {
+        factors.push_back(patternedMatrix(8, 8, i));
+    }
+    std::vector<std::reference_wrapper<const Matrix>> refs(factors.begin(), factors.end());
+
+    // Five 8x8 products cycle through two buffers of 9 allocations each
+    Matrix product;
+    TEST_CHECK(allocationsDuring([&] { product = multi_dot(refs); }) == 2 * 9);
+
+    Matrix expected = factors[0];
+    for (int i = 1; i < 6; i++) {
+        expected = Matrix::dot(expected, factors[i]);
+    }
+    TEST_CHECK(matricesEqual(product, expected));
+}
+
+void test_multi_dot_errors(void) {
+    Matrix A = patternedMatrix(2, 3, 1);
+    TEST_EXCEPTION(multi_dot({}), std::invalid_argument);
+    TEST_EXCEPTION(multi_dot({A, A}), std::invalid_argument);
+}
+
+// ============================================================================
+// Epilogue Tests
+// ============================================================================
+
+// dot followed by the epilogue as separate passes
+Matrix unfusedEpilogue(const Matrix& A, const Matrix& B, const GemmEpilogue& e,
+                       double (*activate)(double)) {
+    Matrix C = Matrix::dot(A, B);
+    for (int i = 0; i < C.rowsize; i++) {
+        for (int j = 0; j < C.columnsize; j++) {
+            double v = e.scale * C.matrix[i][j];
+            v += e.rowBias.empty() ? 0 : e.rowBias[i];
+            v += e.columnBias.empty() ? 0 : e.columnBias[j];
+            C.matrix[i][j] = activate(v);
+        }
+    }
+    return C;
+}
+
+void test_epilogue_matches_unfused(void) {
+    Matrix A = patternedMatrix(7, 5, 1);
+    Matrix B = patternedMatrix(5, 9, 2);
+    vec rowBias(7), columnBias(9);
+    for (int i = 0; i < 7; i++) {
+        rowBias[i] = 0.5 * i - 1.5;
+    }
+    for (int j = 0; j < 9; j++) {
+        columnBias[j] = 1.0 - 0.25 * j;
+    }
+
+    using Act = GemmEpilogue::Activation;
+    struct Case { Act activation; double (*reference)(double); };
+    Case cases[] = {
+        { Act::None, [](double v) { return v; } },
+        { Act::ReLU, [](double v) { return std::max(v, 0.0); } },
+        { Act::Sigmoid, [](double v) { return 1 / (1 + std::exp(-v)); } },
+        { Act::Tanh, [](double v) { return std::tanh(v); } },
+        { Act::GELU, [](double v) {
+              return 0.5 * v * (1 + std::tanh(std::sqrt(2 / std::acos(-1.0)) * (v + 0.044715 * v * v * v)));
+          } },
+    };
+    for (const Case& c : cases) {
+        for (int biases = 0; biases < 4; biases++) {
+            GemmEpilogue e;
+            e.scale = 0.125;
+            e.activation = c.activation;
+            if (biases & 1) e.rowBias = rowBias;
+            if (biases & 2) e.columnBias = columnBias;
+            TEST_CHECK(matricesEqual(dotFused(A, B, e), unfusedEpilogue(A, B, e, c.reference), 1e-12));
+            TEST_MSG("activation %d, biases %d", (int)c.activation, biases);
+        }
+    }
+
+    // The default epilogue is a plain product
+    TEST_CHECK(matricesEqual(dotFused(A, B, GemmEpilogue()), Matrix::dot(A, B), 1e-12));
+}
+
+void test_epilogue_custom_element(void) {
+    Matrix A = patternedMatrix(4, 6, 3);
+    Matrix B = patternedMatrix(6, 5, 4);
+    GemmEpilogue e;
+    e.activation = GemmEpilogue::Activation::ReLU;
+
+    // The callback sees the activated value and its position
+    Matrix C = dotFused(A, B, e, [](double v, int i, int j) { return v + 100 * i + j; });
+    Matrix expected = Matrix::dot(A, B);
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 5; j++) {
+            expected.matrix[i][j] = std::max(expected.matrix[i][j], 0.0) + 100 * i + j;
+        }
+    }
+    TEST_CHECK(matricesEqual(C, expected, 1e-12));
+
+    // Fusing costs no storage beyond the product itself
+    TEST_CHECK(allocationsDuring([&] { dotFused(A, B, e); }) ==
+               allocationsDuring([&] { Matrix::dot(A, B); }));
+    Matrix out = Matrix::dot(A, B);
+    int calls = 0;
+    TEST_CHECK(allocationsDuring([&] {
+        dotFusedInto(A, B, out, e, [&](double v, int, int) { calls++; return v; });
+    }) == 0);
+    TEST_CHECK(calls == 20);
+}
+
+void test_epilogue_errors(void) {
+    Matrix A = patternedMatrix(3, 4, 1);
+    Matrix B = patternedMatrix(4, 2, 2);
+    GemmEpilogue e;
+    e.rowBias = vec(2, 1.0);
+    TEST_EXCEPTION(dotFused(A, B, e), std::invalid_argument);
+    e.rowBias = vec(3, 1.0);
+    e.columnBias = vec(3, 1.0);
+    TEST_EXCEPTION(dotFused(A, B, e), std::invalid_argument);
+    e.columnBias = vec(2, 1.0);
+    TEST_CHECK(dotFused(A, B, e).rowsize == 3);
+    TEST_EXCEPTION(dotFused(B, A, GemmEpilogue()), std::invalid_argument);
+}
+
+// ============================================================================
+// In-place Tests
+// ============================================================================
+
+void test_in_place_matches_allocating(void) {
+    Matrix A = patternedMatrix(5, 7, 1);
+    Matrix B = patternedMatrix(5, 7, 2);
+
+    Matrix acc = A;
+    acc += B;
+    TEST_CHECK(matricesEqual(acc, Matrix::AddMatrix(A, B)));
+    acc -= B;
+    acc -= B;
+    TEST_CHECK(matricesEqual(acc, Matrix::SubtractMatix(A, B)));
+    acc = A;
+    acc *= 3;
+    TEST_CHECK(matricesEqual(acc, Matrix::Constmultiplication(A, 3)));
+    acc *= 0.5;
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 7; j++) {
+            TEST_CHECK(acc.matrix[i][j] == A.matrix[i][j] * 1.5);
+        }
+    }
+
+    acc = A;
+    acc.axpy(-2.5, B);
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 7; j++) {
+            TEST_CHECK(acc.matrix[i][j] == A.matrix[i][j] + -2.5 * B.matrix[i][j]);
+        }
+    }
+
+    // Operands may alias the target
+    acc = A;
+    acc += acc;
+    TEST_CHECK(matricesEqual(acc, Matrix::Constmultiplication(A, 2)));
+    acc -= acc;
+    TEST_CHECK(matricesEqual(acc, Matrix({}, std::make_tuple(5, 7))));
+}
+
+void test_in_place_does_not_allocate(void) {
+    Matrix acc({}, std::make_tuple(16, 16));
+    Matrix x = patternedMatrix(16, 16, 3);
+    TEST_CHECK(allocationsDuring([&] {
+        for (int it = 0; it < 100; it++) {
+            acc += x;
+            acc -= x;
+            acc *= 0.5;
+            acc.axpy(0.25, x);
+        }
+    }) == 0);
+}
+
+void test_in_place_parallel(void) {
+    // Above parallelGrain elements the rows are split over the executor
+    Matrix A = patternedMatrix(520, 256, 4);
+    Matrix B = patternedMatrix(520, 256, 5);
+    Matrix expected = Matrix::AddMatrix(A, Matrix::Constmultiplication(B, 2));
+
+    auto executor = std::make_shared<CountingExecutor>();
+    setExecutor(executor);
+    Matrix acc = A;
+    acc.axpy(2, B);
+    TEST_CHECK(executor->loops == 1);
+    acc += B;
+    acc -= B;
+    TEST_CHECK(executor->loops == 3);
+
+    // Small matrices never reach the executor
+    Matrix small = patternedMatrix(8, 8, 6);
+    small += small;
+    small *= 2;
+    TEST_CHECK(executor->loops == 3);
+    setExecutor(nullptr);
+
+    TEST_CHECK(matricesEqual(acc, expected));
+}
+
+void test_in_place_errors(void) {
+    Matrix A = patternedMatrix(3, 4, 1);
+    Matrix B = patternedMatrix(4, 3, 2);
+    TEST_EXCEPTION(A += B, std::invalid_argument);
+    TEST_EXCEPTION(A -= B, std::invalid_argument);
+    TEST_EXCEPTION(A.axpy(1, B), std::invalid_argument);
+    TEST_CHECK(matricesEqual(A, patternedMatrix(3, 4, 1)));
+}
+
+// ============================================================================
+// Reduction Tests
+// ============================================================================
+
+// The elements of every row (perRow) or every column, in order
+std::vector<std::vector<double>> rowsOrColumns(const Matrix& m, bool perRow) {
+    std::vector<std::vector<double>> out(perRow ? m.rowsize : m.columnsize);
+    for (int i = 0; i < m.rowsize; i++) {
+        for (int j = 0; j < m.columnsize; j++) {
+            out[perRow ? i : j].push_back(m.matrix[i][j]);
+        }
+    }
+    return out;
+}
+
+void test_reductions_match_loops(void) {
+    // 9 columns: a block of four lanes plus a remainder
+    Matrix m = patternedMatrix(13, 9, 2);
+    std::vector<double> all;
+    for (auto& line : rowsOrColumns(m, true)) {
+        all.insert(all.end(), line.begin(), line.end());
+    }
+
+    double total = 0, abs = 0, squares = 0, largestAbs = 0;
+    for (double v : all) {
+        total += v;
+        abs += std::abs(v);
+        squares += v * v;
+        largestAbs = std::max(largestAbs, std::abs(v));
+    }
+    TEST_CHECK(sum(m) == total);
+    TEST_CHECK(doubleEquals(mean(m), total / all.size()));
+    TEST_CHECK(norm(m, Norm::L1) == abs);
+    TEST_CHECK(doubleEquals(norm(m), std::sqrt(squares)));
+    TEST_CHECK(norm(m, Norm::L2) == norm(m, Norm::Frobenius));
+    TEST_CHECK(norm(m, Norm::Inf) == largestAbs);
+    TEST_CHECK(minimum(m) == *std::min_element(all.begin(), all.end()));
+    TEST_CHECK(maximum(m) == *std::max_element(all.begin(), all.end()));
+
+    for (Axis axis : {Axis::PerRow, Axis::PerColumn}) {
+        auto expected = rowsOrColumns(m, axis == Axis::PerRow);
+        vec sums = sum(m, axis), means = mean(m, axis);
+        vec l1 = norm(m, axis, Norm::L1), l2 = norm(m, axis), inf = norm(m, axis, Norm::Inf);
+        vec lows = minimum(m, axis), highs = maximum(m, axis);
+        TEST_CHECK(sums.size() == expected.size());
+        for (size_t k = 0; k < expected.size(); k++) {
+            const std::vector<double>& line = expected[k];
+            double s = 0, a = 0, q = 0, big = 0;
+            for (double v : line) {
+                s += v;
+                a += std::abs(v);
+                q += v * v;
+                big = std::max(big, std::abs(v));
+            }
+            TEST_CHECK(sums[k] == s);
+            TEST_CHECK(doubleEquals(means[k], s / line.size()));
+            TEST_CHECK(l1[k] == a);
+            TEST_CHECK(doubleEquals(l2[k], std::sqrt(q)));
+            TEST_CHECK(inf[k] == big);
+            TEST_CHECK(lows[k] == *std::min_element(line.begin(), line.end()));
+            TEST_CHECK(highs[k] == *std::max_element(line.begin(), line.end()));
+            TEST_MSG("axis %d, line %d", (int)axis, (int)k);
+        }
+    }
+}
+
+void test_reductions_arg(void) {
+    Matrix m({{1, 5, 5}, {-2, 0, 5}, {-2, 7, 1}, {0, 7, -2}}, std::make_tuple(4, 3));
+
+    // Ties go to the first element in row-major order
+    TEST_CHECK(argmax(m) == std::make_pair(2, 1));
+    TEST_CHECK(argmin(m) == std::make_pair(1, 0));
+    TEST_CHECK(argmax(m, Axis::PerRow) == std::vector<int>({1, 2, 1, 1}));
+    TEST_CHECK(argmin(m, Axis::PerRow) == std::vector<int>({0, 0, 0, 2}));
+    TEST_CHECK(argmax(m, Axis::PerColumn) == std::vector<int>({0, 2, 0}));
+    TEST_CHECK(argmin(m, Axis::PerColumn) == std::vector<int>({1, 1, 3}));
+}
+
+void test_reductions_parallel(void) {
+    Matrix m = patternedMatrix(520, 256, 3);
+    m.matrix[400][17] = 100;
+    m.matrix[77][200] = -100;
+    double serialSum = sum(m);
+    vec serialColumns = sum(m, Axis::PerColumn);
+    vec serialRows = norm(m, Axis::PerRow, Norm::L1);
+    std::vector<int> serialArg = argmax(m, Axis::PerColumn);
+
+    // Past parallelGrain elements every reduction runs on the executor.
+    // The patterned values are exact in binary, so the chunked sums agree
+    // exactly with the serial ones.
+    auto executor = std::make_shared<CountingExecutor>();
+    setExecutor(executor);
+    TEST_CHECK(sum(m) == serialSum);
+    TEST_CHECK(sum(m, Axis::PerColumn) == serialColumns);
+    TEST_CHECK(norm(m, Axis::PerRow, Norm::L1) == serialRows);
+    TEST_CHECK(argmax(m, Axis::PerColumn) == serialArg);
+    TEST_CHECK(argmax(m) == std::make_pair(400, 17));
+    TEST_CHECK(argmin(m) == std::make_pair(77, 200));
+    TEST_CHECK(maximum(m) == 100);
+    TEST_CHECK(executor->loops == 7);
+
+    Matrix small = patternedMatrix(8, 8, 1);
+    sum(small, Axis::PerColumn);
+    argmax(small);
+    TEST_CHECK(executor->loops == 7);
+    setExecutor(nullptr);
+}
+
+void test_reductions_nan(void) {
+    // NaN wins wherever it sits: first element, any lane, any chunk
+    auto executor = std::make_shared<CountingExecutor>();
+    setExecutor(executor);
+    const double nan = std::nan("");
+    for (auto [rows, cols] : {std::make_pair(5, 7), std::make_pair(520, 256)}) {
+        for (auto [r, c] : {std::make_pair(0, 0), std::make_pair(3, 6), std::make_pair(4, 3),
+                            std::make_pair(rows - 1, cols - 1)}) {
+            Matrix m = patternedMatrix(rows, cols, 5);
+            m.matrix[r][c] = nan;
+            TEST_CHECK(std::isnan(maximum(m)));
+            TEST_CHECK(std::isnan(minimum(m)));
+            TEST_CHECK(std::isnan(norm(m, Norm::Inf)));
+            TEST_CHECK(argmax(m) == std::make_pair(r, c));
+            TEST_CHECK(argmin(m) == std::make_pair(r, c));
+            TEST_MSG("%dx%d, NaN at (%d, %d)", rows, cols, r, c);
+
+            vec rowMax = maximum(m, Axis::PerRow);
+            vec columnMin = minimum(m, Axis::PerColumn);
+            TEST_CHECK(std::isnan(rowMax[r]) && !std::isnan(rowMax[(r + 1) % rows]));
+            TEST_CHECK(std::isnan(columnMin[c]) && !std::isnan(columnMin[(c + 1) % cols]));
+            TEST_CHECK(argmax(m, Axis::PerRow)[r] == c);
+            TEST_CHECK(argmin(m, Axis::PerColumn)[c] == r);
+
+            // A later NaN does not displace the first
+            m.matrix[rows - 1][cols - 1] = nan;
+            TEST_CHECK(argmax(m) == std::make_pair(r, c));
+        }
+    }
+    TEST_CHECK(executor->loops > 0);
+    setExecutor(nullptr);
+}
+
+void test_reductions_empty(void) {
+    Matrix empty({}, std::make_tuple(0, 0));
+    Matrix noColumns({}, std::make_tuple(3, 0));
+    TEST_CHECK(sum(empty) == 0);
+    TEST_CHECK(norm(empty) == 0);
+    TEST_CHECK(maximum(empty) == -INFINITY);
+    TEST_CHECK(minimum(empty) == INFINITY);
+    TEST_CHECK(sum(noColumns, Axis::PerRow) == vec(3, 0.0));
+    TEST_CHECK(sum(noColumns, Axis::PerColumn).empty());
+    TEST_EXCEPTION(mean(empty), std::invalid_argument);
+    TEST_EXCEPTION(mean(noColumns, Axis::PerRow), std::invalid_argument);
+    TEST_CHECK(mean(noColumns, Axis::PerColumn).empty());
+    TEST_EXCEPTION(argmax(empty), std::invalid_argument);
+    TEST_EXCEPTION(argmin(noColumns, Axis::PerRow), std::invalid_argument);
+    TEST_CHECK(argmax(noColumns, Axis::PerColumn).empty());
+}
+
+// ============================================================================
+// Summation Mode Tests
+// ============================================================================
+
+const Summation allModes[] = {Summation::Naive, Summation::Pairwise, Summation::Neumaier,
+                              Summation::BlockedFma};
+
+// Terms that cancel badly: large values that come back negated later, with
+// small ones in between that carry the whole sum.
+std::vector<double> cancellingTerms(int n, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    std::vector<double> big(n / 4);
+    for (double& b : big) {
+        b = std::ldexp(unit(rng), 30);
+    }
+    std::vector<double> x;
+    for (int i = 0; (int)x.size() < n; i++) {
+        if (i % 4 == 1 && i / 4 < (int)big.size()) {
+            x.push_back(big[i / 4]);
+        } else if (i % 4 == 3 && i / 4 < (int)big.size()) {
+            x.push_back(-big[big.size() - 1 - i / 4]);
+        } else {
+            x.push_back(unit(rng));
+        }
+    }
+    return x;
+}
+
+// Close to the exact sum: compensated summation in long double
+long double referenceSum(const std::vector<double>& x) {
+    long double s = 0, c = 0;
+    for (double v : x) {
+        long double t = s + v;
+        c += std::fabs(s) >= std::fabs((long double)v) ? (s - t) + v : (v - t) + s;
+        s = t;
+    }
+    return s + c;
+}
+
+double sumOfAbs(const std::vector<double>& x) {
+    double s = 0;
+    for (double v : x) {
+        s += std::abs(v);
+    }
+    return s;
+}
+
+// The error bound of each mode for n terms, in units of u * sum|x|, with
+// slack; Neumaier's is relative to |sum| instead.
+bool withinBound(Summation mode, double computed, long double exact, double absSum, int n) {
+    const double u = std::ldexp(1.0, -53);
+    double error = (double)std::fabs(computed - exact);
+    switch (mode) {
+    case Summation::Naive:
+        return error <= 2.0 * n * u * absSum;
+    case Summation::Pairwise:
+        return error <= 2.0 * (std::log2(n) + 128) * u * absSum;
+    case Summation::Neumaier:
+        return error <= 4 * u * std::fabs((double)exact) + 4.0 * n * u * u * absSum;
+    case Summation::BlockedFma:
+        return error <= 2.0 * (64 + n / 64 + 1) * u * absSum;
+    }
+    return false;
+}
+
+void test_summation_modes_sum(void) {
+    const int n = 20000;
+    std::vector<double> x = cancellingTerms(n, 11);
+    long double exact = referenceSum(x);
+    double absSum = sumOfAbs(x);
+
+    // The same terms as one row, as one column and row-major in a block
+    Matrix row({}, std::make_tuple(1, n));
+    Matrix column({}, std::make_tuple(n, 1));
+    Matrix block({}, std::make_tuple(100, n / 100));
+    for (int k = 0; k < n; k++) {
+        row.matrix[0][k] = x[k];
+        column.matrix[k][0] = x[k];
+        block.matrix[k / (n / 100)][k % (n / 100)] = x[k];
+    }
+
+    double naiveError = std::fabs(sum(row) - (double)exact);
+    for (Summation mode : allModes) {
+        double results[] = {sum(row, mode), sum(row, Axis::PerRow, mode)[0],
+                            sum(column, mode), sum(column, Axis::PerColumn, mode)[0],
+                            sum(block, mode)};
+        for (double r : results) {
+            TEST_CHECK(withinBound(mode, r, exact, absSum, n));
+            TEST_MSG("mode %d: %.17g, exact %.17Lg", (int)mode, r, exact);
+        }
+    }
+    // Only compensation recovers what the cancelling terms wipe out
+    TEST_CHECK(std::fabs(sum(row, Summation::Neumaier) - (double)exact) < naiveError / 1000);
+    TEST_CHECK(std::fabs(sum(column, Summation::Neumaier) - (double)exact) < naiveError / 1000);
+
+    // The modes carry over to the other sums
+    Matrix negated = row;
+    negated *= -1;
+    TEST_CHECK(norm(negated, Norm::L1, Summation::Neumaier) == norm(row, Norm::L1, Summation::Neumaier));
+    TEST_CHECK(doubleEquals(mean(column, Summation::Neumaier), (double)(exact / n), 1e-15));
+    TEST_CHECK(doubleEquals(norm(block, Norm::L2, Summation::Pairwise) / norm(block), 1, 1e-12));
+}
+
+void test_summation_modes_dot(void) {
+    // Element [0][0] of A * B is a dot product of inexact products that
+    // cancel: a large a * b comes back later as -fl(a * b) * 1, leaving
+    // only its rounding error, among small terms that carry the sum.
+    const int K = 4096;
+    std::mt19937_64 rng(12);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    Matrix A = patternedMatrix(3, K, 1);
+    Matrix B = patternedMatrix(K, 5, 2);
+    std::vector<double> parts; // exact products, as value and error pairs
+    double absSum = 0;
+    for (int k = 0; k < K; k++) {
+        double a = unit(rng);
+        double b = unit(rng);
+        if (k % 4 == 1) {
+            a = std::ldexp(a, 30);
+        } else if (k % 4 == 3) {
+            a = -(A.matrix[0][k - 2] * B.matrix[k - 2][0]);
+            b = 1;
+        }
+        A.matrix[0][k] = a;
+        B.matrix[k][0] = b;
+        double p = a * b;
+        parts.push_back(p);
+        parts.push_back(std::fma(a, b, -p));
+        absSum += std::fabs(p);
+    }
+    long double exact = referenceSum(parts);
+
+    TEST_CHECK(matricesEqual(Matrix::dot(A, B, Summation::Naive), Matrix::dot(A, B), 1e-300));
+    Matrix plain = Matrix::dot(A, B);
+    for (Summation mode : allModes) {
+        Matrix C = Matrix::dot(A, B, mode);
+        TEST_CHECK(withinBound(mode, C.matrix[0][0], exact, absSum, K));
+        TEST_MSG("mode %d: %.17g, exact %.17Lg", (int)mode, C.matrix[0][0], exact);
+        // Away from row 0 and column 0 the terms are products of exact
+        // binary fractions
+        C.matrix[0] = plain.matrix[0];
+        for (int i = 0; i < 3; i++) {
+            C.matrix[i][0] = plain.matrix[i][0];
+        }
+        TEST_CHECK(matricesEqual(C, plain, 1e-300));
+    }
+    double naiveError = std::fabs(plain.matrix[0][0] - (double)exact);
+    TEST_CHECK(std::fabs(Matrix::dot(A, B, Summation::Neumaier).matrix[0][0] - (double)exact) <
+               naiveError / 1000);
+
+    // Into a sized output only the mode's scratch row(s) are allocated
+    Matrix out = Matrix::dot(A, B);
+    for (Summation mode : allModes) {
+        uint64_t expected = mode == Summation::Naive ? 0 : 1;
+        TEST_CHECK(allocationsDuring([&] { Matrix::dotInto(A, B, out, mode); }) == expected);
+    }
+    TEST_EXCEPTION(Matrix::dot(B, B, Summation::Pairwise), std::invalid_argument);
+}
+
+void test_summation_modes_parallel(void) {
+    // Exact binary fractions: every mode and every chunking gives the exact sum
+    Matrix m = patternedMatrix(520, 256, 3);
+    double exact = sum(m);
+    vec exactColumns = sum(m, Axis::PerColumn);
+
+    auto executor = std::make_shared<CountingExecutor>();
+    setExecutor(executor);
+    for (Summation mode : allModes) {
+        TEST_CHECK(sum(m, mode) == exact);
+        TEST_CHECK(sum(m, Axis::PerColumn, mode) == exactColumns);
+    }
+    TEST_CHECK(executor->loops == 8);
+
+    // Compensation carries across chunks: terms that cancel between
+    // different chunks still give an accurate sum
+    std::vector<double> x = cancellingTerms(520 * 256, 13);
+    for (int k = 0; k < 520 * 256; k++) {
+        m.matrix[k / 256][k % 256] = x[k];
+    }
+    long double whole = referenceSum(x);
+    TEST_CHECK(withinBound(Summation::Neumaier, sum(m, Summation::Neumaier), whole, 0, 0));
+    vec columns = sum(m, Axis::PerColumn, Summation::Neumaier);
+    for (int j = 0; j < 256; j++) {
+        std::vector<double> column;
+        for (int i = 0; i < 520; i++) {
+            column.push_back(m.matrix[i][j]);
+        }
+        TEST_CHECK(withinBound(Summation::Neumaier, columns[j], referenceSum(column), 0, 0));
+    }
+    TEST_CHECK(executor->loops == 10);
+    setExecutor(nullptr);
+}
+
+// ============================================================================
+// Test List
+// ============================================================================
+
+TEST_LIST = {
+    // Constructor tests
+    { "default-constructor", test_default_constructor },
+    { "constructor-with-dimension", test_constructor_with_dimension },
+    { "constructor-with-data", test_constructor_with_data },
+    { "constructor-1x1", test_constructor_1x1 },
+    { "constructor-tall-matrix", test_constructor_tall_matrix },
+    { "constructor-wide-matrix", test_constructor_wide_matrix },
+    { "constructor-with-negative-data", test_constructor_with_negative_data },
+    
+    // getRow and getCol tests
+    { "getRow", test_getRow },
+    { "getCol", test_getCol },
+    { "getRow-single-row-matrix", test_getRow_single_row_matrix },
+    { "getCol-single-column-matrix", test_getCol_single_column_matrix },
+    { "getRow-with-negatives", test_getRow_with_negatives },
+    { "getCol-from-non-square", test_getCol_from_non_square },
+    
+    // Matrix multiplication tests
+    { "dot-basic", test_dot_basic },
+    { "dot-non-square", test_dot_non_square },
+    { "dot-identity", test_dot_identity },
+    { "dot-1x3-times-3x1", test_dot_1x3_times_3x1 },
+    { "dot-3x2-times-2x4", test_dot_3x2_times_2x4 },
+    { "dot-4x1-times-1x4", test_dot_4x1_times_1x4 },
+    { "dot-3x3-times-3x3", test_dot_3x3_times_3x3 },
+    { "dot-with-zeros", test_dot_with_zeros },
+    { "dot-with-negatives", test_dot_with_negatives },
+    { "dot-incompatible-dimensions", test_dot_incompatible_dimensions },
+    
+    // Scalar multiplication tests
+    { "const-multiplication-basic", test_const_multiplication_basic },
+    { "const-multiplication-zero", test_const_multiplication_zero },
+    { "const-multiplication-negative", test_const_multiplication_negative },
+    { "const-multiplication-non-square", test_const_multiplication_non_square },
+    { "const-multiplication-fractional", test_const_multiplication_fractional },
+    { "const-multiplication-large-scalar", test_const_multiplication_large_scalar },
+    { "const-multiplication-one", test_const_multiplication_one },
+    
+    // Matrix addition tests
+    { "add-basic", test_add_basic },
+    { "add-with-negatives", test_add_with_negatives },
+    { "add-non-square", test_add_non_square },
+    { "add-incompatible-dimensions", test_add_incompatible_dimensions },
+    { "add-single-row", test_add_single_row },
+    { "add-single-column", test_add_single_column },
+    { "add-large-matrices", test_add_large_matrices },
+    { "add-zero-matrix", test_add_zero_matrix },
+    
+    // Matrix subtraction tests
+    { "subtract-basic", test_subtract_basic },
+    { "subtract-with-negatives", test_subtract_with_negatives },
+    { "subtract-same-matrix", test_subtract_same_matrix },
+    { "subtract-non-square", test_subtract_non_square },
+    { "subtract-incompatible-dimensions", test_subtract_incompatible_dimensions },
+    { "subtract-single-row", test_subtract_single_row },
+    { "subtract-single-column", test_subtract_single_column },
+    { "subtract-resulting-in-negatives", test_subtract_resulting_in_negatives },
+    { "subtract-zero-matrix", test_subtract_zero_matrix },
+    
+    // Edge case tests
+    { "single-element-matrix", test_single_element_matrix },
+    { "large-matrix-dimensions", test_large_matrix_dimensions },
+    { "floating-point-precision", test_floating_point_precision },
+    { "commutative-addition", test_commutative_addition },
+    { "associative-addition", test_associative_addition },
+    { "distributive-scalar-multiplication", test_distributive_scalar_multiplication },
+    { "dot-associativity", test_dot_associativity },
+    { "very-small-values", test_very_small_values },
+    
+    // SymmetricMatrix tests
+    { "symmetric-round-trip", test_symmetric_round_trip },
+    { "symmetric-rejects-non-symmetric", test_symmetric_rejects_non_symmetric },
+    { "symmetric-symv", test_symmetric_symv },
+    { "symmetric-symm-matches-dot", test_symmetric_symm_matches_dot },
+    { "symmetric-add-and-scale", test_symmetric_add_and_scale },
+    
+    // BandMatrix tests
+    { "band-round-trip-and-gbmv", test_band_round_trip_and_gbmv },
+    { "band-set-outside-band-throws", test_band_set_outside_band_throws },
+    { "band-lu-solve-with-pivoting", test_band_lu_solve_with_pivoting },
+    { "band-cholesky-solve", test_band_cholesky_solve },
+    { "band-cholesky-not-positive-definite", test_band_cholesky_not_positive_definite },
+    { "tridiagonal-thomas", test_tridiagonal_thomas },
+    { "tridiagonal-batched-matches-single", test_tridiagonal_batched_matches_single },
+    
+    // DiagonalMatrix and PermutationMatrix tests
+    { "diagonal-products-match-dot", test_diagonal_products_match_dot },
+    { "diagonal-incompatible-dimensions", test_diagonal_incompatible_dimensions },
+    { "permutation-products-match-dot", test_permutation_products_match_dot },
+    { "permutation-in-place", test_permutation_in_place },
+    { "permutation-from-pivots", test_permutation_from_pivots },
+    { "permutation-rejects-invalid", test_permutation_rejects_invalid },
+    
+    // Sparse matrix and iterative solver tests
+    { "sparse-round-trip-and-spmv", test_sparse_round_trip_and_spmv },
+    { "sparse-triplets-sum-duplicates", test_sparse_triplets_sum_duplicates },
+    { "cg-sparse-with-preconditioners", test_cg_sparse_with_preconditioners },
+    { "cg-dense-operator", test_cg_dense_operator },
+    { "gmres-non-symmetric", test_gmres_non_symmetric },
+    { "gmres-exact-ilu-converges-immediately", test_gmres_exact_ilu_converges_immediately },
+    { "solver-incompatible-dimensions", test_solver_incompatible_dimensions },
+    
+    // Matrix power, exponential and polynomial tests
+    { "dot-into-matches-dot", test_dot_into_matches_dot },
+    { "pow-matches-repeated-dot", test_pow_matches_repeated_dot },
+    { "pow-negative-throws", test_pow_negative_throws },
+    { "polyval-matches-horner", test_polyval_matches_horner },
+    { "expm-diagonal-and-nilpotent", test_expm_diagonal_and_nilpotent },
+    { "expm-rotation-with-scaling", test_expm_rotation_with_scaling },
+    
+    // Binary serialization tests
+    { "binary-round-trip", test_binary_round_trip },
+    { "binary-map-is-zero-copy", test_binary_map_is_zero_copy },
+    { "binary-converted-dtypes", test_binary_converted_dtypes },
+    { "binary-byte-swapped-file", test_binary_byte_swapped_file },
+    { "binary-rejects-bad-files", test_binary_rejects_bad_files },
+    
+    // CSV reader and writer tests
+    { "csv-parse-basic", test_csv_parse_basic },
+    { "csv-parse-tsv-with-header", test_csv_parse_tsv_with_header },
+    { "csv-parse-errors", test_csv_parse_errors },
+    { "csv-count-newlines", test_csv_count_newlines },
+    { "csv-write-round-trip", test_csv_write_round_trip },
+    { "csv-file-round-trip", test_csv_file_round_trip },
+    { "csv-streaming-reader", test_csv_streaming_reader },
+    { "csv-blank-lines-match-reader", test_csv_blank_lines_match_reader },
+    
+    // NumPy .npy / .npz tests
+    { "npy-round-trip-and-map", test_npy_round_trip_and_map },
+    { "npy-fortran-and-dtypes", test_npy_fortran_and_dtypes },
+    { "npy-reads-numpy-layouts", test_npy_reads_numpy_layouts },
+    { "npz-round-trip", test_npz_round_trip },
+    { "npz-zip64-end-record", test_npz_zip64_end_record },
+    { "npz-writes-zip64-for-many-members", test_npz_writes_zip64_for_many_members },
+    { "npz-rejects-compressed", test_npz_rejects_compressed },
+    
+    // Matrix Market tests
+    { "mtx-coordinate-sparse-and-dense", test_mtx_coordinate_sparse_and_dense },
+    { "mtx-symmetric-and-pattern", test_mtx_symmetric_and_pattern },
+    { "mtx-array-format", test_mtx_array_format },
+    { "mtx-write-round-trip", test_mtx_write_round_trip },
+    { "mtx-rejects-bad-files", test_mtx_rejects_bad_files },
+    
+    // Tiled out-of-core matrix tests
+    { "tiled-round-trip-and-reopen", test_tiled_round_trip_and_reopen },
+    { "tiled-lru-cache-bounds-mappings", test_tiled_lru_cache_bounds_mappings },
+    { "tiled-dot-matches-in-memory", test_tiled_dot_matches_in_memory },
+    { "tiled-add-subtract-transpose", test_tiled_add_subtract_transpose },
+    { "tiled-prefetch-uses-current-executor", test_tiled_prefetch_uses_current_executor },
+    
+    // Streaming row chunk tests
+    { "stream-chunks-are-bounded-and-ordered", test_stream_chunks_are_bounded_and_ordered },
+    { "stream-gram-and-column-sums", test_stream_gram_and_column_sums },
+    { "stream-propagates-errors", test_stream_propagates_errors },
+    
+    // Formatting tests
+    { "format-print-matches-stream-output", test_format_print_matches_stream_output },
+    { "format-precision-and-width", test_format_precision_and_width },
+    { "format-head-tail-truncation", test_format_head_tail_truncation },
+    { "format-large-matrix-to-file-descriptor", test_format_large_matrix_to_file_descriptor },
+    
+    // Instrumentation and tracing tests
+    { "perf-scopes-accumulate-per-operation", test_perf_scopes_accumulate_per_operation },
+    
+    { "perf-json-precision-and-worker-counters", test_perf_json_precision_and_worker_counters },
+    { "trace-records-events-per-thread", test_trace_records_events_per_thread },
+    { "trace-keeps-nanosecond-resolution", test_trace_keeps_nanosecond_resolution },
+    { "trace-ring-keeps-latest-events", test_trace_ring_keeps_latest_events },
+    { "trace-concurrent-snapshot-and-clear", test_trace_concurrent_snapshot_and_clear },
+    
+    // Allocation accounting tests
+    { "alloc-operations-do-not-copy-inputs", test_alloc_operations_do_not_copy_inputs },
+    { "alloc-report-per-operation", test_alloc_report_per_operation },
+    { "alloc-report-across-threads", test_alloc_report_across_threads },
+    
+    // Transpose tests
+    { "transpose", test_transpose },
+    
+    // Differential tests
+    { "differential-dot", test_differential_dot },
+    { "differential-transpose", test_differential_transpose },
+    { "differential-elementwise", test_differential_elementwise },
+    { "differential-symmetric", test_differential_symmetric },
+    { "differential-banded", test_differential_banded },
+    { "differential-sparse", test_differential_sparse },
+    { "differential-tiled", test_differential_tiled },
+    { "differential-stream-gram", test_differential_stream_gram },
+    { "differential-multi-dot", test_differential_multi_dot },
+    { "differential-dot-fused", test_differential_dot_fused },
+    { "differential-in-place", test_differential_in_place },
+    { "differential-reductions", test_differential_reductions },
+    { "differential-summation-modes", test_differential_summation_modes },
+    
+    // Scheduler tests
+    { "work-stealing-deque", test_work_stealing_deque },
+    { "parallel-for-on-work-stealing-pool", test_parallel_for_on_work_stealing_pool },
+    { "pool-waiters-skip-posted-tasks", test_pool_waiters_skip_posted_tasks },
+    { "custom-executor", test_custom_executor },
+    
+    // Async tests
+    { "async-matches-sync", test_async_matches_sync },
+    { "async-errors-propagate", test_async_errors_propagate },
+    { "async-cancel", test_async_cancel },
+    { "async-decompositions", test_async_decompositions },
+    { "async-awaitable", test_async_awaitable },
+    
+    // Lazy evaluation tests
+    { "lazy-shares-common-products", test_lazy_shares_common_products },
+    { "lazy-reassociates-chains", test_lazy_reassociates_chains },
+    { "lazy-reuses-dead-buffers", test_lazy_reuses_dead_buffers },
+    { "lazy-leaves-and-errors", test_lazy_leaves_and_errors },
+    { "lazy-keeps-non-finite-values", test_lazy_keeps_non_finite_values },
+    { "lazy-plan-outlives-expression", test_lazy_plan_outlives_expression },
+    
+    // Matrix chain tests
+    { "chain-order", test_chain_order },
+    { "multi-dot-matches-nested-dot", test_multi_dot_matches_nested_dot },
+    { "multi-dot-reuses-buffers", test_multi_dot_reuses_buffers },
+    { "multi-dot-errors", test_multi_dot_errors },
+    
+    // Epilogue tests
+    { "epilogue-matches-unfused", test_epilogue_matches_unfused },
+    { "epilogue-custom-element", test_epilogue_custom_element },
+    { "epilogue-errors", test_epilogue_errors },
+    
+    // In-place tests
+    { "in-place-matches-allocating", test_in_place_matches_allocating },
+    { "in-place-does-not-allocate", test_in_place_does_not_allocate },
+    { "in-place-parallel", test_in_place_parallel },
+    { "in-place-errors", test_in_place_errors },
+    
+    // Reduction tests
+    { "reductions-match-loops", test_reductions_match_loops },
+    { "reductions-arg", test_reductions_arg },
+    { "reductions-parallel", test_reductions_parallel },
+    { "reductions-empty", test_reductions_empty },
+    { "reductions-nan", test_reductions_nan },
+    
+    // Summation mode tests
+    { "summation-modes-sum", test_summation_modes_sum },
+    { "summation-modes-dot", test_summation_modes_dot },
+    { "summation-modes-parallel", test_summation_modes_parallel },
     
     { NULL, NULL }
 };
@@ -0,0 +1,545 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "matrix.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Tiled matrix file, version 1:
+//
+//   offset  size  field
+//        0     8  magic "MORPHTIL"
+//        8     4  byte-order mark 0x01020304
+//       12     2  format version
+//       14     2  reserved, zero
+//       16     8  rows
+//       24     8  columns
+//       32     4  tile size T
+//       36     4  reserved, zero
+//       40     8  offset of the first tile from the start of the file
+//       48    16  reserved, zero
+//
+// The matrix is cut into T x T tiles stored one after another in row-major
+// tile order. Each tile is T * T row-major doubles; tiles on the right and
+// bottom edges are padded with zeros. Files are only read on machines with
+// the writer's byte order, since tiles are used in place.
+struct TiledHeader {
+  char magic[8];
+  uint32_t byteOrder;
+  uint16_t version;
+  uint16_t reserved0;
+  uint64_t rows;
+  uint64_t columns;
+  uint32_t tileSize;
+  uint32_t reserved1;
+  uint64_t dataOffset;
+  unsigned char reserved[16];
+};
+static_assert(sizeof(TiledHeader) == 64, "TiledHeader must be 64 bytes");
+
+// One mapped tile. `owner` keeps the mapping alive after the tile cache has
+// evicted it.
+struct Tile {
+  int rowsize = 0;    // rows inside the matrix
+  int columnsize = 0; // columns inside the matrix
+  int stride = 0;     // the tile size
+  double *data = nullptr;
+  std::shared_ptr<MappedFile> owner;
+
+  double *row(int i) const { return data + (size_t)i * stride; }
+};
+
+namespace morpheus {
+
+const char tiledMagic[8] = {'M', 'O', 'R', 'P', 'H', 'T', 'I', 'L'};
+const uint16_t tiledVersion = 1;
+
+// Least-recently-used set of mapped tiles. Loading happens outside the lock
+// so a prefetch task and the computing thread can map tiles at the same
+// time.
+class TileCache {
+
+public:
+  using Loader = std::function<std::shared_ptr<MappedFile>(size_t)>;
+
+  TileCache(size_t capacity, Loader load)
+      : capacity(capacity == 0 ? 1 : capacity), load(std::move(load)) {}
+
+  std::shared_ptr<MappedFile> get(size_t key) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      auto found = entries.find(key);
+      if (found != entries.end()) {
+        order.splice(order.begin(), order, found->second.second);
+        hits++;
+        return found->second.first;
+      }
+    }
+
+    std::shared_ptr<MappedFile> tile = load(key);
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+      // Another thread loaded it meanwhile.
+      return found->second.first;
+    }
+    misses++;
+    order.push_front(key);
+    entries.emplace(key, std::make_pair(tile, order.begin()));
+    while (entries.size() > capacity) {
+      entries.erase(order.back());
+      order.pop_back();
+    }
+    return tile;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    entries.clear();
+    order.clear();
+  }
+
+  std::atomic<size_t> hits{0};
+  std::atomic<size_t> misses{0};
+
+private:
+  size_t capacity;
+  Loader load;
+  std::mutex lock;
+  std::list<size_t> order; // most recently used first
+  std::unordered_map<size_t, std::pair<std::shared_ptr<MappedFile>,
+                                       std::list<size_t>::iterator>>
+      entries;
+};
+
+// Reads one byte per page so the pages are resident before they are needed.
+inline void touchPages(const unsigned char *p, size_t length) {
+  volatile unsigned char sink = 0;
+  for (size_t i = 0; i < length; i += 4096) {
+    sink = sink + p[i];
+  }
+}
+
+// Background work posted to the current executor. A task that has not
+// started by the time wait() is called is cancelled rather than waited for:
+// it only warms the cache, and the pool may have no idle worker to run it
+// when the caller is itself a pool task.
+class TilePrefetch {
+
+public:
+  TilePrefetch() = default;
+
+  explicit TilePrefetch(std::function<void()> work)
+      : state(std::make_shared<State>()) {
+    currentExecutor()->post([state = state, work = std::move(work)] {
+      if (state->claimed.exchange(true)) {
+        return;
+      }
+      work();
+      std::lock_guard<std::mutex> guard(state->lock);
+      state->done = true;
+      state->finished.notify_all();
+    });
+  }
+
+  TilePrefetch(TilePrefetch &&) = default;
+  TilePrefetch &operator=(TilePrefetch &&other) {
+    wait();
+    state = std::move(other.state);
+    return *this;
+  }
+  ~TilePrefetch() { wait(); }
+
+  // Returns once the task has finished or can no longer start.
+  void wait() {
+    if (!state) {
+      return;
+    }
+    if (state->claimed.exchange(true)) {
+      std::unique_lock<std::mutex> guard(state->lock);
+      state->finished.wait(guard, [&] { return state->done; });
+    }
+    state.reset();
+  }
+
+private:
+  struct State {
+    std::atomic<bool> claimed{false};
+    std::mutex lock;
+    std::condition_variable finished;
+    bool done = false;
+  };
+  std::shared_ptr<State> state;
+};
+
+} // namespace morpheus
+
+// Disk-backed matrix for data that does not fit in memory. Tiles are mapped
+// on demand through an LRU cache holding at most `cacheTiles` mappings, so
+// resident memory is bounded by the cache rather than the matrix size.
+// Results of the out-of-core operations are written to new files.
+class TiledMatrix {
+
+public:
+  int rowsize = 0;
+  int columnsize = 0;
+  int tileSize = 0;
+
+  TiledMatrix(TiledMatrix &&) = default;
+  TiledMatrix &operator=(TiledMatrix &&) = default;
+
+  // Creates a zero-filled tiled file.
+  static TiledMatrix create(const std::string &path, int rows, int cols,
+                            int tileSize = 256, size_t cacheTiles = 64) {
+    if (rows < 0 || cols < 0 || tileSize <= 0) {
+      throw std::invalid_argument("INVALID DIMENSIONS! Tiled matrix needs "
+                                  "non-negative sizes and a positive tile "
+                                  "size");
+    }
+    TiledHeader h{};
+    std::memcpy(h.magic, morpheus::tiledMagic, sizeof(h.magic));
+    h.byteOrder = 0x01020304;
+    h.version = morpheus::tiledVersion;
+    h.rows = rows;
+    h.columns = cols;
+    h.tileSize = tileSize;
+    h.dataOffset = sizeof(TiledHeader);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("CANNOT OPEN FILE! " + path);
+    }
+    out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    size_t tiles = (size_t)tilesAlong(rows, tileSize) *
+                   tilesAlong(cols, tileSize);
+    size_t bytes = tiles * tileSize * tileSize * sizeof(double);
+    if (bytes > 0) {
+      // Leaves a hole on file systems with sparse files.
+      out.seekp(h.dataOffset + bytes - 1);
+      out.put(0);
+    }
+    if (!out) {
+      throw std::runtime_error("CANNOT WRITE FILE! " + path);
+    }
+    out.close();
+    return TiledMatrix(path, h, MapMode::ReadWrite, cacheTiles);
+  }
+
+  static TiledMatrix open(const std::string &path,
+                          MapMode mode = MapMode::ReadOnly,
+                          size_t cacheTiles = 64) {
+    MappedFile file(path);
+    if (file.size() < sizeof(TiledHeader)) {
+      throw std::runtime_error("INVALID FORMAT! " + path +
+                               " is too small for a tiled matrix header");
+    }
+    TiledHeader h;
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (std::memcmp(h.magic, morpheus::tiledMagic, sizeof(h.magic)) != 0) {
+      throw std::runtime_error("INVALID FORMAT! " + path +
+                               " is not a Morpheus tiled matrix file");
+    }
+    if (h.byteOrder != 0x01020304) {
+      throw std::runtime_error("INVALID FORMAT! " + path +
+                               " was written with a different byte order");
+    }
+    if (h.version != morpheus::tiledVersion) {
+      throw std::runtime_error("INVALID FORMAT! " + path + " has version " +
+                               std::to_string(h.version) + ", expected " +
+                               std::to_string(morpheus::tiledVersion));
+    }
+    if (h.rows > INT32_MAX || h.columns > INT32_MAX || h.tileSize == 0 ||
+        h.tileSize > INT32_MAX) {
+      throw std::runtime_error("INVALID FORMAT! " + path +
+                               " has invalid dimensions");
+    }
+    size_t tiles = (size_t)tilesAlong(h.rows, h.tileSize) *
+                   tilesAlong(h.columns, h.tileSize);
+    if (h.dataOffset < sizeof(TiledHeader) ||
+        file.size() < h.dataOffset + tiles * h.tileSize * h.tileSize *
+                                         sizeof(double)) {
+      throw std::runtime_error("INVALID FORMAT! " + path + " is truncated");
+    }
+    return TiledMatrix(path, h, mode, cacheTiles);
+  }
+
+  static TiledMatrix fromMatrix(const Matrix &m, const std::string &path,
+                                int tileSize = 256, size_t cacheTiles = 64) {
+    TiledMatrix Result =
+        create(path, m.rowsize, m.columnsize, tileSize, cacheTiles);
+    for (int ti = 0; ti < Result.tileRows(); ti++) {
+      for (int tj = 0; tj < Result.tileColumns(); tj++) {
+        Tile t = Result.tile(ti, tj);
+        for (int i = 0; i < t.rowsize; i++) {
+          const double *src = m.matrix[ti * tileSize + i].data() + tj * tileSize;
+          std::copy(src, src + t.columnsize, t.row(i));
+        }
+      }
+    }
+    return Result;
+  }
+
+  Matrix toMatrix() const {
+    Matrix Result({}, Dimension());
+    for (int ti = 0; ti < tileRows(); ti++) {
+      for (int tj = 0; tj < tileColumns(); tj++) {
+        Tile t = tile(ti, tj);
+        for (int i = 0; i < t.rowsize; i++) {
+          std::copy(t.row(i), t.row(i) + t.columnsize,
+                    Result.matrix[ti * tileSize + i].begin() + tj * tileSize);
+        }
+      }
+    }
+    return Result;
+  }
+
+  Dim Dimension() const { return std::make_tuple(rowsize, columnsize); }
+  int tileRows() const { return tilesAlong(rowsize, tileSize); }
+  int tileColumns() const { return tilesAlong(columnsize, tileSize); }
+  const std::string &path() const { return file; }
+
+  // Tile (ti, tj). Writing through it is only allowed for ReadWrite files.
+  Tile tile(int ti, int tj) const {
+    Tile t;
+    t.owner = cache->get((size_t)ti * tileColumns() + tj);
+    t.data = reinterpret_cast<double *>(t.owner->writableData());
+    t.stride = tileSize;
+    t.rowsize = std::min(tileSize, rowsize - ti * tileSize);
+    t.columnsize = std::min(tileSize, columnsize - tj * tileSize);
+    return t;
+  }
+
+  // Maps tile (ti, tj) and faults its pages in on the current executor.
+  // Indices outside the tile grid are ignored.
+  morpheus::TilePrefetch prefetch(int ti, int tj) const {
+    if (ti < 0 || ti >= tileRows() || tj < 0 || tj >= tileColumns()) {
+      return morpheus::TilePrefetch();
+    }
+    return morpheus::TilePrefetch([this, ti, tj] {
+      Tile t = tile(ti, tj);
+      morpheus::touchPages(t.owner->data(), t.owner->size());
+    });
+  }
+
+  double get(int i, int j) const {
+    checkIndex(i, j);
+    return tile(i / tileSize, j / tileSize)
+        .row(i % tileSize)[j % tileSize];
+  }
+
+  void set(int i, int j, double value) {
+    checkIndex(i, j);
+    checkWritable();
+    tile(i / tileSize, j / tileSize).row(i % tileSize)[j % tileSize] = value;
+  }
+
+  // Drops every cached mapping; tiles still referenced stay mapped.
+  void flush() { cache->clear(); }
+
+  size_t cacheHits() const { return cache->hits; }
+  size_t cacheMisses() const { return cache->misses; }
+
+  // Tile-by-tile product written to `path`. While one pair of tiles is
+  // multiplied the next pair is prefetched.
+  static TiledMatrix dot(const TiledMatrix &A, const TiledMatrix &B,
+                         const std::string &path, size_t cacheTiles = 64) {
+    MORPHEUS_OP("TiledMatrix::dot", 2.0 * A.rowsize * B.columnsize * A.columnsize,
+                8.0 * ((double)A.rowsize * A.columnsize +
+                       (double)B.rowsize * B.columnsize +
+                       (double)A.rowsize * B.columnsize),
+                A.rowsize, B.columnsize, A.columnsize);
+    if (A.columnsize != B.rowsize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix of columnsize " +
+          std::to_string(A.columnsize) + " and Matrix of rowsize " +
+          std::to_string(B.rowsize));
+    }
+    checkTileSizes(A, B);
+    TiledMatrix C = create(path, A.rowsize, B.columnsize, A.tileSize,
+                           cacheTiles);
+    int inner = A.tileColumns();
+    if (inner == 0) {
+      return C;
+    }
+
+    // Step s multiplies A(ti, k) by B(k, tj) into C(ti, tj).
+    size_t steps = (size_t)C.tileRows() * C.tileColumns() * inner;
+    auto decode = [&](size_t s, int &ti, int &tj, int &k) {
+      k = s % inner;
+      tj = s / inner % C.tileColumns();
+      ti = s / inner / C.tileColumns();
+    };
+    for (size_t s = 0; s < steps; s++) {
+      int ti, tj, k;
+      decode(s, ti, tj, k);
+      morpheus::TilePrefetch nextA, nextB;
+      if (s + 1 < steps) {
+        int ni, nj, nk;
+        decode(s + 1, ni, nj, nk);
+        nextA = A.prefetch(ni, nk);
+        nextB = B.prefetch(nk, nj);
+      }
+
+      Tile a = A.tile(ti, k);
+      Tile b = B.tile(k, tj);
+      Tile c = C.tile(ti, tj);
+      morpheus::parallelFor(
+          a.rowsize, morpheus::rowGrain((size_t)a.columnsize * b.columnsize),
+          [&](size_t, size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+              double *out = c.row(i);
+              const double *left = a.row(i);
+              for (int kk = 0; kk < a.columnsize; kk++) {
+                double aik = left[kk];
+                const double *right = b.row(kk);
+                for (int j = 0; j < b.columnsize; j++) {
+                  out[j] += aik * right[j];
+                }
+              }
+            }
+          });
+
+      nextA.wait();
+      nextB.wait();
+    }
+    return C;
+  }
+
+  static TiledMatrix AddMatrix(const TiledMatrix &A, const TiledMatrix &B,
+                               const std::string &path,
+                               size_t cacheTiles = 64) {
+    MORPHEUS_OP("TiledMatrix::AddMatrix", (double)A.rowsize * A.columnsize,
+                24.0 * A.rowsize * A.columnsize, A.rowsize, A.columnsize);
+    return elementwise(A, B, path, cacheTiles, 1.0);
+  }
+
+  static TiledMatrix SubtractMatix(const TiledMatrix &A, const TiledMatrix &B,
+                                   const std::string &path,
+                                   size_t cacheTiles = 64) {
+    MORPHEUS_OP("TiledMatrix::SubtractMatix", (double)A.rowsize * A.columnsize,
+                24.0 * A.rowsize * A.columnsize, A.rowsize, A.columnsize);
+    return elementwise(A, B, path, cacheTiles, -1.0);
+  }
+
+  static TiledMatrix transpose(const TiledMatrix &A, const std::string &path,
+                               size_t cacheTiles = 64) {
+    MORPHEUS_OP("TiledMatrix::transpose", 0, 16.0 * A.rowsize * A.columnsize,
+                A.rowsize, A.columnsize);
+    TiledMatrix T =
+        create(path, A.columnsize, A.rowsize, A.tileSize, cacheTiles);
+    forEachTile(A, nullptr, [&](int ti, int tj) {
+      Tile in = A.tile(ti, tj);
+      Tile out = T.tile(tj, ti);
+      for (int i = 0; i < in.rowsize; i++) {
+        const double *src = in.row(i);
+        for (int j = 0; j < in.columnsize; j++) {
+          out.row(j)[i] = src[j];
+        }
+      }
+    });
+    return T;
+  }
+
+private:
+  TiledMatrix(const std::string &path, const TiledHeader &h, MapMode mode,
+              size_t cacheTiles)
+      : rowsize(h.rows), columnsize(h.columns), tileSize(h.tileSize),
+        mode(mode), file(path) {
+    size_t tileBytes = (size_t)tileSize * tileSize * sizeof(double);
+    size_t dataOffset = h.dataOffset;
+    cache = std::make_unique<morpheus::TileCache>(
+        cacheTiles, [path, tileBytes, dataOffset, mode](size_t key) {
+          return std::make_shared<MappedFile>(
+              path, dataOffset + key * tileBytes, tileBytes, mode);
+        });
+  }
+
+  static int tilesAlong(uint64_t n, uint64_t tileSize) {
+    return (n + tileSize - 1) / tileSize;
+  }
+
+  void checkIndex(int i, int j) const {
+    if (i < 0 || i >= rowsize || j < 0 || j >= columnsize) {
+      throw std::out_of_range("INVALID INDEX! (" + std::to_string(i) + ", " +
+                              std::to_string(j) + ") is out of range");
+    }
+  }
+
+  void checkWritable() const {
+    if (mode != MapMode::ReadWrite) {
+      throw std::runtime_error("READ-ONLY MATRIX! " + file +
+                               " was opened read-only");
+    }
+  }
+
+  static void checkTileSizes(const TiledMatrix &A, const TiledMatrix &B) {
+    if (A.tileSize != B.tileSize) {
+      throw std::invalid_argument(
+          "INVALID OPERATION! Tiled operands must share a tile size");
+    }
+  }
+
+  // Calls fn(ti, tj) for every tile of A in order, prefetching the next
+  // tile of A (and of B, if given) meanwhile.
+  template <typename F>
+  static void forEachTile(const TiledMatrix &A, const TiledMatrix *B, F fn) {
+    int cols = A.tileColumns();
+    size_t tiles = (size_t)A.tileRows() * cols;
+    for (size_t s = 0; s < tiles; s++) {
+      morpheus::TilePrefetch nextA, nextB;
+      if (s + 1 < tiles) {
+        nextA = A.prefetch((s + 1) / cols, (s + 1) % cols);
+        if (B) {
+          nextB = B->prefetch((s + 1) / cols, (s + 1) % cols);
+        }
+      }
+      fn(s / cols, s % cols);
+      nextA.wait();
+      nextB.wait();
+    }
+  }
+
+  static TiledMatrix elementwise(const TiledMatrix &A, const TiledMatrix &B,
+                                 const std::string &path, size_t cacheTiles,
+                                 double sign) {
+    if (A.Dimension() != B.Dimension()) {
+      throw std::invalid_argument(
+          "INVALID OPERATION UNEQUAL DIMENSIONS! Matrix addition operation "
+          "should have = dimensions");
+    }
+    checkTileSizes(A, B);
+    TiledMatrix C =
+        create(path, A.rowsize, A.columnsize, A.tileSize, cacheTiles);
+    forEachTile(A, &B, [&](int ti, int tj) {
+      Tile a = A.tile(ti, tj);
+      Tile b = B.tile(ti, tj);
+      Tile c = C.tile(ti, tj);
+      for (int i = 0; i < a.rowsize; i++) {
+        const double *x = a.row(i);
+        const double *y = b.row(i);
+        double *out = c.row(i);
+        for (int j = 0; j < a.columnsize; j++) {
+          out[j] = x[j] + sign * y[j];
+        }
+      }
+    });
+    return C;
+  }
+
+  MapMode mode = MapMode::ReadOnly;
+  std::string file;
+  std::unique_ptr<morpheus::TileCache> cache;
+};
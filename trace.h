@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace morpheus {
+
+// Bytes of matrix storage allocated by the calling thread so far. Fed by
+// the storage allocation path; trace events record how much it grew during
+// each operation.
+inline uint64_t &threadAllocatedBytes() {
+  thread_local uint64_t bytes = 0;
+  return bytes;
+}
+
+inline void noteAllocation(uint64_t bytes) { threadAllocatedBytes() += bytes; }
+
+inline uint64_t traceClock() {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+struct TraceEvent {
+  const char *name;
+  uint64_t begin; // ns since the trace epoch
+  uint64_t end;
+  int shape[3]; // -1 where unused
+  double flops;
+  uint64_t allocatedBytes;
+};
+static_assert(std::is_trivially_copyable<TraceEvent>::value,
+              "TraceEvent is copied through raw words");
+
+// Fixed-size ring of the most recent events of one thread. Only the owning
+// thread writes; readers copy slots without locking and use the per-slot
+// sequence number to skip slots that are being overwritten. Events are
+// stored as relaxed atomic words so a torn read is detected rather than
+// being a data race. Clearing never touches the writer's head: it starts a
+// new generation at the current head and readers skip older events.
+class TraceBuffer {
+
+public:
+  static const size_t capacity = 1 << 14;
+
+  explicit TraceBuffer(int thread) : thread(thread), slots(capacity) {}
+
+  void record(const TraceEvent &event) {
+    uint64_t n = head.load(std::memory_order_relaxed);
+    Slot &s = slots[n % capacity];
+    uint64_t words[eventWords] = {};
+    std::memcpy(words, &event, sizeof(TraceEvent));
+    s.sequence.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t w = 0; w < eventWords; w++) {
+      s.words[w].store(words[w], std::memory_order_relaxed);
+    }
+    s.sequence.store(2 * n + 2, std::memory_order_release);
+    head.store(n + 1, std::memory_order_release);
+  }
+
+  // Events still in the ring, oldest first.
+  std::vector<TraceEvent> snapshot() const {
+    uint64_t n = head.load(std::memory_order_acquire);
+    uint64_t first = std::max(n > capacity ? n - capacity : 0,
+                              generation.load(std::memory_order_acquire));
+    if (first >= n) {
+      return {};
+    }
+    std::vector<TraceEvent> events;
+    events.reserve(n - first);
+    for (uint64_t k = first; k < n; k++) {
+      const Slot &s = slots[k % capacity];
+      uint64_t before = s.sequence.load(std::memory_order_acquire);
+      uint64_t words[eventWords];
+      for (size_t w = 0; w < eventWords; w++) {
+        words[w] = s.words[w].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (before == 2 * k + 2 &&
+          s.sequence.load(std::memory_order_relaxed) == before) {
+        TraceEvent copy;
+        std::memcpy(&copy, words, sizeof(TraceEvent));
+        events.push_back(copy);
+      }
+    }
+    return events;
+  }
+
+  // Safe to call from any thread while the owner keeps recording.
+  void clear() {
+    uint64_t n = head.load(std::memory_order_acquire);
+    uint64_t current = generation.load(std::memory_order_relaxed);
+    while (current < n &&
+           !generation.compare_exchange_weak(current, n,
+                                             std::memory_order_release)) {
+    }
+  }
+
+  const int thread;
+
+private:
+  static constexpr size_t eventWords =
+      (sizeof(TraceEvent) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  struct Slot {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> words[eventWords] = {};
+  };
+
+  std::atomic<uint64_t> head{0};
+  // Number of events recorded before the last clear().
+  std::atomic<uint64_t> generation{0};
+  std::vector<Slot> slots;
+};
+
+// Every thread's buffer, kept after the thread exits so its events can
+// still be exported.
+class TraceRegistry {
+
+public:
+  static TraceRegistry &instance() {
+    static TraceRegistry registry;
+    return registry;
+  }
+
+  TraceBuffer &forThisThread() {
+    thread_local std::shared_ptr<TraceBuffer> buffer = add();
+    return *buffer;
+  }
+
+  std::vector<std::shared_ptr<TraceBuffer>> all() {
+    std::lock_guard<std::mutex> guard(lock);
+    return buffers;
+  }
+
+private:
+  std::shared_ptr<TraceBuffer> add() {
+    std::lock_guard<std::mutex> guard(lock);
+    buffers.push_back(std::make_shared<TraceBuffer>((int)buffers.size() + 1));
+    return buffers.back();
+  }
+
+  std::mutex lock;
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+};
+
+// Records one complete event for the enclosing operation when it ends.
+class TraceScope {
+
+public:
+  TraceScope(const char *name, double flops, double, int d0 = -1, int d1 = -1,
+             int d2 = -1)
+      : allocatedAtStart(threadAllocatedBytes()) {
+    event.name = name;
+    event.flops = flops;
+    event.shape[0] = d0;
+    event.shape[1] = d1;
+    event.shape[2] = d2;
+    event.begin = traceClock();
+  }
+
+  ~TraceScope() {
+    event.end = traceClock();
+    event.allocatedBytes = threadAllocatedBytes() - allocatedAtStart;
+    TraceRegistry::instance().forThisThread().record(event);
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  TraceEvent event;
+  uint64_t allocatedAtStart;
+};
+
+// Writes ns as microseconds with a fixed 3-digit fraction, so timestamps
+// keep nanosecond resolution however long the run.
+inline void writeMicroseconds(std::ostream &out, uint64_t ns) {
+  char buffer[32];
+  char *end = std::to_chars(buffer, buffer + sizeof(buffer), ns / 1000).ptr;
+  uint64_t fraction = ns % 1000;
+  *end++ = '.';
+  *end++ = char('0' + fraction / 100);
+  *end++ = char('0' + fraction / 10 % 10);
+  *end++ = char('0' + fraction % 10);
+  out.write(buffer, end - buffer);
+}
+
+// Writes v in the shortest form that reads back exactly.
+inline void writeShortest(std::ostream &out, double v) {
+  char buffer[32];
+  char *end = std::to_chars(buffer, buffer + sizeof(buffer), v).ptr;
+  out.write(buffer, end - buffer);
+}
+
+} // namespace morpheus
+
+// Drops all recorded events.
+inline void traceClear() {
+  for (auto &buffer : morpheus::TraceRegistry::instance().all()) {
+    buffer->clear();
+  }
+}
+
+// Writes the recorded events in the Chrome trace-event format (load it in
+// chrome://tracing or Perfetto). Each operation is a complete ("X") event
+// on its thread's track with its shape, FLOPs and allocated bytes as args.
+inline void writeChromeTrace(std::ostream &out) {
+  out << "{\"traceEvents\": [";
+  bool first = true;
+  for (auto &buffer : morpheus::TraceRegistry::instance().all()) {
+    for (const morpheus::TraceEvent &e : buffer->snapshot()) {
+      out << (first ? "\n" : ",\n") << "  {\"name\": \"" << e.name
+          << "\", \"cat\": \"morpheus\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+          << buffer->thread << ", \"ts\": ";
+      morpheus::writeMicroseconds(out, e.begin);
+      out << ", \"dur\": ";
+      morpheus::writeMicroseconds(out, e.end - e.begin);
+      out << ", \"args\": {\"shape\": [";
+      for (int d = 0; d < 3 && e.shape[d] >= 0; d++) {
+        out << (d ? ", " : "") << e.shape[d];
+      }
+      out << "], \"flops\": ";
+      morpheus::writeShortest(out, e.flops);
+      out << ", \"allocated_bytes\": " << e.allocatedBytes << "}}";
+      first = false;
+    }
+  }
+  out << "\n], \"displayTimeUnit\": \"ns\"}\n";
+}
+
+inline void writeChromeTrace(const std::string &path) {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("CANNOT OPEN FILE! " + path);
+  }
+  writeChromeTrace(out);
+  if (!out) {
+    throw std::runtime_error("CANNOT WRITE FILE! " + path);
+  }
+}